@@ -88,11 +88,18 @@ unsigned int alloc_commit_index(void)
 	return count++;
 }
 
-void *alloc_commit_node(void)
+void init_commit_node(struct commit *c)
 {
-	struct commit *c = alloc_node(&commit_state, sizeof(struct commit));
 	c->object.type = OBJ_COMMIT;
 	c->index = alloc_commit_index();
+	c->graph_pos = COMMIT_NOT_FROM_GRAPH;
+	c->generation = GENERATION_NUMBER_INFINITY;
+}
+
+void *alloc_commit_node(void)
+{
+	struct commit *c = alloc_node(&commit_state, sizeof(struct commit));
+	init_commit_node(c);
 	return c;
 }
 
@@ -142,11 +142,12 @@ struct all_attrs_item {
 /*
  * Reallocate and reinitialize the array of all attributes (which is used in
  * the attribute collection process) in 'check' based on the global dictionary
- * of attributes.
+ * of attributes. Returns non-zero if the array was reallocated, in which
+ * case the 'macro' fields have to be filled in again.
  */
-static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
+static int all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 {
-	int i;
+	int i, resized = 0;
 
 	hashmap_lock(map);
 
@@ -166,6 +167,7 @@ static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 
 		REALLOC_ARRAY(check->all_attrs, map->map.size);
 		check->all_attrs_nr = map->map.size;
+		resized = 1;
 
 		while ((e = hashmap_iter_next(&iter))) {
 			const struct git_attr *a = e->value;
@@ -180,10 +182,9 @@ static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 	 * This re-initialization can live outside of the locked region since
 	 * the attribute dictionary is no longer being accessed.
 	 */
-	for (i = 0; i < check->all_attrs_nr; i++) {
+	for (i = 0; i < check->all_attrs_nr; i++)
 		check->all_attrs[i].value = ATTR__UNKNOWN;
-		check->all_attrs[i].macro = NULL;
-	}
+	return resized;
 }
 
 static int attr_name_valid(const char *name, size_t namelen)
@@ -452,11 +453,36 @@ struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+
+	/*
+	 * The patterns of attrs[] grouped by how a path is matched
+	 * against them, built by index_attr_stack() when the frame is
+	 * first used. Each group lists indices into attrs[] in order.
+	 */
+	int indexed;
+	int icase;	/* ignore_case at the time the frame was indexed */
+	struct hashmap basenames;	/* literal basenames, e.g. "Makefile" */
+	struct hashmap extensions;	/* "*.c", by what follows the last dot */
+	int *others;	/* every other pattern */
+	int others_nr, others_alloc;
+
+	/*
+	 * The others[] that may match a path in the directory
+	 * candidates_dir, so that consecutive paths in the same
+	 * directory do not have to rule out the same patterns again.
+	 */
+	int *candidates;
+	int candidates_nr, candidates_alloc;
+	int candidates_valid;
+	struct strbuf candidates_dir;
 };
 
+static void attr_stack_unindex(struct attr_stack *e);
+
 static void attr_stack_free(struct attr_stack *e)
 {
 	int i;
+	attr_stack_unindex(e);
 	free(e->origin);
 	for (i = 0; i < e->num_matches; i++) {
 		struct match_attr *a = e->attrs[i];
@@ -891,11 +917,16 @@ static void bootstrap_attr_stack(struct attr_stack **stack)
 	push_stack(stack, e, NULL, 0);
 }
 
-static void prepare_attr_stack(const char *path, int dirlen,
-			       struct attr_stack **stack)
+/*
+ * Returns non-zero if frames were pushed to or popped from the stack,
+ * so that what was learned from the previous stack is stale.
+ */
+static int prepare_attr_stack(const char *path, int dirlen,
+			      struct attr_stack **stack)
 {
 	struct attr_stack *info;
 	struct strbuf pathbuf = STRBUF_INIT;
+	int changed = !*stack;
 
 	/*
 	 * At the bottom of the attribute stack is the built-in
@@ -939,6 +970,7 @@ static void prepare_attr_stack(const char *path, int dirlen,
 		debug_pop(elem);
 		*stack = elem->prev;
 		attr_stack_free(elem);
+		changed = 1;
 	}
 
 	/*
@@ -975,6 +1007,7 @@ static void prepare_attr_stack(const char *path, int dirlen,
 
 		origin = xstrdup(pathbuf.buf);
 		push_stack(stack, next, origin, len);
+		changed = 1;
 	}
 
 	/*
@@ -983,6 +1016,204 @@ static void prepare_attr_stack(const char *path, int dirlen,
 	push_stack(stack, info, NULL, 0);
 
 	strbuf_release(&pathbuf);
+	return changed;
+}
+
+struct attr_index_entry {
+	struct hashmap_entry ent;
+	int *pos;	/* indices into attrs[], in increasing order */
+	int nr, alloc;
+	int keylen;
+	char key[FLEX_ARRAY];
+};
+
+static int attr_index_entry_cmp(const struct attr_index_entry *e1,
+				const struct attr_index_entry *e2,
+				const char *key)
+{
+	return e1->keylen != e2->keylen ||
+		fspathncmp(e1->key, key ? key : e2->key, e1->keylen);
+}
+
+static unsigned int attr_index_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static const struct attr_index_entry *attr_index_get(const struct hashmap *map,
+						     const char *key,
+						     int keylen,
+						     unsigned int hash)
+{
+	struct attr_index_entry k;
+
+	hashmap_entry_init(&k, hash);
+	k.keylen = keylen;
+	return hashmap_get(map, &k, key);
+}
+
+static void attr_index_add(struct hashmap *map, const char *key, int keylen,
+			   int pos)
+{
+	unsigned int hash = attr_index_hash(key, keylen);
+	struct attr_index_entry *e;
+
+	e = (struct attr_index_entry *)attr_index_get(map, key, keylen, hash);
+	if (!e) {
+		FLEX_ALLOC_MEM(e, key, key, keylen);
+		hashmap_entry_init(e, hash);
+		e->keylen = keylen;
+		hashmap_add(map, e);
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+}
+
+static void attr_index_free(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct attr_index_entry *e;
+
+	hashmap_iter_init(map, &iter);
+	while ((e = hashmap_iter_next(&iter)))
+		free(e->pos);
+	hashmap_free(map, 1);
+}
+
+static void attr_stack_unindex(struct attr_stack *e)
+{
+	if (!e->indexed)
+		return;
+	attr_index_free(&e->basenames);
+	attr_index_free(&e->extensions);
+	free(e->others);
+	e->others = NULL;
+	e->others_nr = e->others_alloc = 0;
+	free(e->candidates);
+	e->candidates = NULL;
+	e->candidates_nr = e->candidates_alloc = 0;
+	e->candidates_valid = 0;
+	strbuf_release(&e->candidates_dir);
+	e->indexed = 0;
+}
+
+/*
+ * If "pattern" only matches basenames that end with a literal string
+ * containing a dot, like "*.c" or "*.tar.gz", return in "ext" what
+ * follows its last dot; any basename it matches has the same.
+ */
+static int pattern_extension(const struct pattern *pat,
+			     const char **ext, int *extlen)
+{
+	int len = pat->patternlen;
+
+	if (!(pat->flags & EXC_FLAG_NODIR) ||
+	    !(pat->flags & EXC_FLAG_ENDSWITH))
+		return 0;
+	while (--len > 0)
+		if (pat->pattern[len] == '.') {
+			*ext = pat->pattern + len + 1;
+			*extlen = pat->patternlen - len - 1;
+			return 1;
+		}
+	return 0;
+}
+
+static void index_attr_stack(struct attr_stack *e)
+{
+	int i;
+
+	if (e->indexed && e->icase == ignore_case)
+		return;
+	attr_stack_unindex(e);
+
+	hashmap_init(&e->basenames, (hashmap_cmp_fn)attr_index_entry_cmp, 0);
+	hashmap_init(&e->extensions, (hashmap_cmp_fn)attr_index_entry_cmp, 0);
+	strbuf_init(&e->candidates_dir, 0);
+	for (i = 0; i < e->num_matches; i++) {
+		const struct match_attr *a = e->attrs[i];
+		const struct pattern *pat = &a->u.pat;
+		const char *ext;
+		int extlen;
+
+		if (a->is_macro)
+			continue;
+		if ((pat->flags & EXC_FLAG_NODIR) &&
+		    pat->nowildcardlen == pat->patternlen)
+			attr_index_add(&e->basenames, pat->pattern,
+				       pat->patternlen, i);
+		else if (pattern_extension(pat, &ext, &extlen))
+			attr_index_add(&e->extensions, ext, extlen, i);
+		else {
+			ALLOC_GROW(e->others, e->others_nr + 1,
+				   e->others_alloc);
+			e->others[e->others_nr++] = i;
+		}
+	}
+	e->icase = ignore_case;
+	e->indexed = 1;
+}
+
+/*
+ * Can a pattern with a directory in it match a path in "dir" at all?
+ * Only its literal leading part is compared, as match_pathname() does
+ * before it looks at the wildcards.
+ */
+static int pattern_may_match_in_dir(const struct pattern *pat,
+				    const char *base, int baselen,
+				    const char *dir, int dirlen)
+{
+	const char *pattern = pat->pattern;
+	int prefix = pat->nowildcardlen;
+	const char *rel;
+	int rellen;
+
+	if (pat->flags & EXC_FLAG_NODIR)
+		return 1;
+	if (*pattern == '/') {
+		pattern++;
+		prefix--;
+	}
+	if (dirlen < baselen || fspathncmp(dir, base, baselen))
+		return 1; /* not below this frame; let path_matches() decide */
+
+	/* the directory of the path, relative to "base" */
+	rel = dir + baselen;
+	rellen = dirlen - baselen;
+	if (baselen && rellen) {
+		rel++;
+		rellen--;
+	}
+
+	if (fspathncmp(pattern, rel, prefix < rellen ? prefix : rellen))
+		return 0;
+	return prefix <= rellen || !rellen || pattern[rellen] == '/';
+}
+
+static void prepare_attr_candidates(struct attr_stack *e,
+				    const char *dir, int dirlen)
+{
+	const char *base = e->origin ? e->origin : "";
+	int i;
+
+	if (e->candidates_valid && e->candidates_dir.len == dirlen &&
+	    !memcmp(e->candidates_dir.buf, dir, dirlen))
+		return;
+
+	e->candidates_nr = 0;
+	for (i = 0; i < e->others_nr; i++) {
+		const struct match_attr *a = e->attrs[e->others[i]];
+
+		if (!pattern_may_match_in_dir(&a->u.pat, base, e->originlen,
+					      dir, dirlen))
+			continue;
+		ALLOC_GROW(e->candidates, e->candidates_nr + 1,
+			   e->candidates_alloc);
+		e->candidates[e->candidates_nr++] = e->others[i];
+	}
+	strbuf_reset(&e->candidates_dir);
+	strbuf_add(&e->candidates_dir, dir, dirlen);
+	e->candidates_valid = 1;
 }
 
 static int path_matches(const char *pathname, int pathlen,
@@ -1032,19 +1263,85 @@ static int fill_one(const char *what, struct all_attrs_item *all_attrs,
 	return rem;
 }
 
-static int fill(const char *path, int pathlen, int basename_offset,
-		const struct attr_stack *stack,
+/* A path whose attributes are being collected, see collect_some_attrs(). */
+struct attr_path {
+	const char *path;
+	int pathlen;
+	int basename_offset;
+	int dirlen;
+	const char *basename;
+	int basenamelen;	/* without the trailing slash of a directory */
+	unsigned int basename_hash;
+	const char *ext;	/* after the last dot of the basename, or NULL */
+	int extlen;
+	unsigned int ext_hash;
+};
+
+/*
+ * Take the largest index left in the three groups of a frame that a
+ * path may match, or return -1 when they are all used up.
+ */
+static int next_candidate(const int *a, int *a_nr, const int *b, int *b_nr,
+			  const int *c, int *c_nr)
+{
+	int *nr = NULL;
+	int pos = -1;
+
+	if (*a_nr && a[*a_nr - 1] > pos) {
+		pos = a[*a_nr - 1];
+		nr = a_nr;
+	}
+	if (*b_nr && b[*b_nr - 1] > pos) {
+		pos = b[*b_nr - 1];
+		nr = b_nr;
+	}
+	if (*c_nr && c[*c_nr - 1] > pos) {
+		pos = c[*c_nr - 1];
+		nr = c_nr;
+	}
+	if (nr)
+		(*nr)--;
+	return pos;
+}
+
+static int fill(const struct attr_path *p, struct attr_stack *stack,
 		struct all_attrs_item *all_attrs, int rem)
 {
 	for (; rem > 0 && stack; stack = stack->prev) {
-		int i;
 		const char *base = stack->origin ? stack->origin : "";
+		const struct attr_index_entry *e;
+		const int *by_name = NULL, *by_ext = NULL;
+		int name_nr = 0, ext_nr = 0, other_nr;
+		int i;
 
-		for (i = stack->num_matches - 1; 0 < rem && 0 <= i; i--) {
+		if (!stack->num_matches)
+			continue;
+		index_attr_stack(stack);
+		prepare_attr_candidates(stack, p->path, p->dirlen);
+
+		e = attr_index_get(&stack->basenames, p->basename,
+				   p->basenamelen, p->basename_hash);
+		if (e) {
+			by_name = e->pos;
+			name_nr = e->nr;
+		}
+		if (p->ext) {
+			e = attr_index_get(&stack->extensions, p->ext,
+					   p->extlen, p->ext_hash);
+			if (e) {
+				by_ext = e->pos;
+				ext_nr = e->nr;
+			}
+		}
+		other_nr = stack->candidates_nr;
+
+		while (0 < rem &&
+		       0 <= (i = next_candidate(by_name, &name_nr,
+						by_ext, &ext_nr,
+						stack->candidates, &other_nr))) {
 			const struct match_attr *a = stack->attrs[i];
-			if (a->is_macro)
-				continue;
-			if (path_matches(path, pathlen, basename_offset,
+			if (path_matches(p->path, p->pathlen,
+					 p->basename_offset,
 					 &a->u.pat, base, stack->originlen))
 				rem = fill_one("fill", all_attrs, a, rem);
 		}
@@ -1068,9 +1365,13 @@ static int macroexpand_one(struct all_attrs_item *all_attrs, int nr, int rem)
  * This prevents having to search through the attribute stack each time
  * a macro needs to be expanded during the fill stage.
  */
-static void determine_macros(struct all_attrs_item *all_attrs,
+static void determine_macros(struct all_attrs_item *all_attrs, int nr,
 			     const struct attr_stack *stack)
 {
+	int i;
+
+	for (i = 0; i < nr; i++)
+		all_attrs[i].macro = NULL;
 	for (; stack; stack = stack->prev) {
 		int i;
 		for (i = stack->num_matches - 1; i >= 0; i--) {
@@ -1092,26 +1393,44 @@ static void determine_macros(struct all_attrs_item *all_attrs,
  */
 static void collect_some_attrs(const char *path, struct attr_check *check)
 {
-	int i, pathlen, rem, dirlen;
+	int i, rem, stack_changed;
 	const char *cp, *last_slash = NULL;
-	int basename_offset;
+	struct attr_path p;
 
 	for (cp = path; *cp; cp++) {
 		if (*cp == '/' && cp[1])
 			last_slash = cp;
 	}
-	pathlen = cp - path;
+	p.path = path;
+	p.pathlen = cp - path;
 	if (last_slash) {
-		basename_offset = last_slash + 1 - path;
-		dirlen = last_slash - path;
+		p.basename_offset = last_slash + 1 - path;
+		p.dirlen = last_slash - path;
 	} else {
-		basename_offset = 0;
-		dirlen = 0;
+		p.basename_offset = 0;
+		p.dirlen = 0;
 	}
+	p.basename = path + p.basename_offset;
+	p.basenamelen = p.pathlen - p.basename_offset;
+	if (p.basenamelen && p.basename[p.basenamelen - 1] == '/')
+		p.basenamelen--;
+	p.basename_hash = attr_index_hash(p.basename, p.basenamelen);
+	p.ext = NULL;
+	p.extlen = 0;
+	p.ext_hash = 0;
+	for (i = p.basenamelen - 1; i >= 0; i--)
+		if (p.basename[i] == '.') {
+			p.ext = p.basename + i + 1;
+			p.extlen = p.basenamelen - i - 1;
+			p.ext_hash = attr_index_hash(p.ext, p.extlen);
+			break;
+		}
 
-	prepare_attr_stack(path, dirlen, &check->stack);
-	all_attrs_init(&g_attr_hashmap, check);
-	determine_macros(check->all_attrs, check->stack);
+	stack_changed = prepare_attr_stack(path, p.dirlen, &check->stack);
+	/* the macros only depend on the stack, unless new attrs appeared */
+	if (all_attrs_init(&g_attr_hashmap, check) || stack_changed)
+		determine_macros(check->all_attrs, check->all_attrs_nr,
+				 check->stack);
 
 	if (check->nr) {
 		rem = 0;
@@ -1128,7 +1447,7 @@ static void collect_some_attrs(const char *path, struct attr_check *check)
 	}
 
 	rem = check->all_attrs_nr;
-	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
+	fill(&p, check->stack, check->all_attrs, rem);
 }
 
 int git_check_attr(const char *path, struct attr_check *check)
@@ -6,6 +6,7 @@
 #include "diffcore.h"
 #include "tag.h"
 #include "blame.h"
+#include "bloom.h"
 
 void blame_origin_decref(struct blame_origin *o)
 {
@@ -154,7 +155,7 @@ static struct commit *fake_working_tree_commit(struct diff_options *opt,
 	struct strbuf buf = STRBUF_INIT;
 	const char *ident;
 	time_t now;
-	int size, len;
+	int len;
 	struct cache_entry *ce;
 	unsigned mode;
 	struct strbuf msg = STRBUF_INIT;
@@ -252,8 +253,7 @@ static struct commit *fake_working_tree_commit(struct diff_options *opt,
 			/* Let's not bother reading from HEAD tree */
 			mode = S_IFREG | 0644;
 	}
-	size = cache_entry_size(len);
-	ce = xcalloc(1, size);
+	ce = make_empty_cache_entry(&the_index, len);
 	oidcpy(&ce->oid, &origin->blob_oid);
 	memcpy(ce->name, path, len);
 	ce->ce_flags = create_ce_flags(0);
@@ -537,6 +537,20 @@ static struct blame_origin *find_origin(struct commit *parent,
 			return blame_origin_incref (porigin);
 		}
 
+	/*
+	 * The changed-path Bloom filter may tell us without a diff that
+	 * the path is the same in the first parent.
+	 */
+	if (!is_null_oid(&origin->commit->object.oid) &&
+	    origin->commit->parents &&
+	    origin->commit->parents->item == parent &&
+	    !bloom_filter_maybe_changed(origin->commit, origin->path)) {
+		porigin = get_origin(parent, origin->path);
+		oidcpy(&porigin->blob_oid, &origin->blob_oid);
+		porigin->mode = origin->mode;
+		return porigin;
+	}
+
 	/* See if the origin->path is different between parent
 	 * and origin first.  Most of the time they are the
 	 * same and diff-tree is fairly efficient about this.
@@ -0,0 +1,217 @@
+#include "cache.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "string-list.h"
+#include "commit.h"
+#include "commit-graph.h"
+#include "bloom.h"
+
+static uint32_t rotate_left(uint32_t value, int count)
+{
+	return (value << count) | (value >> (32 - count));
+}
+
+/*
+ * 32-bit version of MurmurHash3, as described at
+ * https://en.wikipedia.org/wiki/MurmurHash.  The blocks are read as
+ * little-endian words so that filters are portable.
+ */
+uint32_t murmur3_seeded(uint32_t seed, const char *data, size_t len)
+{
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	const uint32_t r1 = 15;
+	const uint32_t r2 = 13;
+	const uint32_t m = 5;
+	const uint32_t n = 0xe6546b64;
+	const unsigned char *bytes = (const unsigned char *)data;
+	size_t nblocks = len / 4;
+	uint32_t seed_hash = seed;
+	uint32_t k;
+	size_t i;
+
+	for (i = 0; i < nblocks; i++) {
+		k = (uint32_t)bytes[4 * i] |
+		    ((uint32_t)bytes[4 * i + 1] << 8) |
+		    ((uint32_t)bytes[4 * i + 2] << 16) |
+		    ((uint32_t)bytes[4 * i + 3] << 24);
+		k *= c1;
+		k = rotate_left(k, r1);
+		k *= c2;
+
+		seed_hash ^= k;
+		seed_hash = rotate_left(seed_hash, r2) * m + n;
+	}
+
+	k = 0;
+	bytes += 4 * nblocks;
+	switch (len & 3) {
+	case 3:
+		k ^= (uint32_t)bytes[2] << 16;
+		/* fallthrough */
+	case 2:
+		k ^= (uint32_t)bytes[1] << 8;
+		/* fallthrough */
+	case 1:
+		k ^= (uint32_t)bytes[0];
+		k *= c1;
+		k = rotate_left(k, r1);
+		k *= c2;
+		seed_hash ^= k;
+	}
+
+	seed_hash ^= (uint32_t)len;
+	seed_hash ^= (seed_hash >> 16);
+	seed_hash *= 0x85ebca6b;
+	seed_hash ^= (seed_hash >> 13);
+	seed_hash *= 0xc2b2ae35;
+	seed_hash ^= (seed_hash >> 16);
+
+	return seed_hash;
+}
+
+/*
+ * Derive all the hashes of a key from two seeded murmur3 hashes
+ * ("double hashing"), as in Kirsch and Mitzenmacher, "Less Hashing,
+ * Same Performance".
+ */
+void fill_bloom_key(const char *data, size_t len, struct bloom_key *key,
+		    const struct bloom_filter_settings *settings)
+{
+	const uint32_t seed0 = 0x293ae76f;
+	const uint32_t seed1 = 0x7e646e2c;
+	const uint32_t hash0 = murmur3_seeded(seed0, data, len);
+	const uint32_t hash1 = murmur3_seeded(seed1, data, len);
+	uint32_t i;
+
+	ALLOC_ARRAY(key->hashes, settings->num_hashes);
+	for (i = 0; i < settings->num_hashes; i++)
+		key->hashes[i] = hash0 + i * hash1;
+}
+
+void clear_bloom_key(struct bloom_key *key)
+{
+	free(key->hashes);
+	key->hashes = NULL;
+}
+
+void add_key_to_filter(const struct bloom_key *key,
+		       struct bloom_filter *filter,
+		       const struct bloom_filter_settings *settings)
+{
+	uint64_t nbits = (uint64_t)filter->len * BITS_PER_WORD;
+	uint32_t i;
+
+	for (i = 0; i < settings->num_hashes; i++) {
+		uint64_t bit = key->hashes[i] % nbits;
+		filter->data[bit / BITS_PER_WORD] |= 1 << (bit % BITS_PER_WORD);
+	}
+}
+
+int bloom_filter_contains(const struct bloom_filter *filter,
+			  const struct bloom_key *key,
+			  const struct bloom_filter_settings *settings)
+{
+	uint64_t nbits = (uint64_t)filter->len * BITS_PER_WORD;
+	uint32_t i;
+
+	if (!nbits)
+		return -1;
+
+	for (i = 0; i < settings->num_hashes; i++) {
+		uint64_t bit = key->hashes[i] % nbits;
+		if (!(filter->data[bit / BITS_PER_WORD] & (1 << (bit % BITS_PER_WORD))))
+			return 0;
+	}
+	return 1;
+}
+
+static void add_path_and_leading_dirs(struct string_list *paths,
+				      const char *path)
+{
+	const char *p;
+
+	string_list_append(paths, path);
+	for (p = path; *p; p++)
+		if (*p == '/')
+			string_list_append_nodup(paths, xmemdupz(path, p - path));
+}
+
+void compute_bloom_filter(struct commit *c, struct bloom_filter *filter,
+			  const struct bloom_filter_settings *settings)
+{
+	struct diff_options diffopt;
+	struct string_list paths = STRING_LIST_INIT_DUP;
+	int i;
+
+	if (parse_commit(c))
+		die(_("unable to parse commit %s"), oid_to_hex(&c->object.oid));
+
+	diff_setup(&diffopt);
+	DIFF_OPT_SET(&diffopt, RECURSIVE);
+	diffopt.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&diffopt);
+
+	if (c->parents) {
+		parse_commit_or_die(c->parents->item);
+		diff_tree_oid(&c->parents->item->tree->object.oid,
+			      &c->tree->object.oid, "", &diffopt);
+	} else
+		diff_tree_oid(NULL, &c->tree->object.oid, "", &diffopt);
+
+	if (diff_queued_diff.nr > BLOOM_FILTER_MAX_CHANGED_PATHS) {
+		/* a filter that matches every path */
+		filter->len = 1;
+		filter->data = xmalloc(1);
+		filter->data[0] = 0xff;
+	} else {
+		for (i = 0; i < diff_queued_diff.nr; i++) {
+			struct diff_filepair *p = diff_queued_diff.queue[i];
+			add_path_and_leading_dirs(&paths, p->two->path);
+		}
+		string_list_sort(&paths);
+		string_list_remove_duplicates(&paths, 0);
+
+		/* an empty diff still gets a (zero) byte, so that it says "no" */
+		filter->len = (paths.nr * settings->bits_per_entry +
+			       BITS_PER_WORD - 1) / BITS_PER_WORD;
+		if (!filter->len)
+			filter->len = 1;
+		filter->data = xcalloc(filter->len, 1);
+
+		for (i = 0; i < paths.nr; i++) {
+			struct bloom_key key;
+			const char *path = paths.items[i].string;
+
+			fill_bloom_key(path, strlen(path), &key, settings);
+			add_key_to_filter(&key, filter, settings);
+			clear_bloom_key(&key);
+		}
+	}
+
+	diff_flush(&diffopt);
+	string_list_clear(&paths, 0);
+}
+
+int bloom_filter_maybe_changed(struct commit *c, const char *path)
+{
+	const struct bloom_filter_settings *settings;
+	struct bloom_filter filter;
+	struct bloom_key key;
+	size_t len = strlen(path);
+	int ret;
+
+	settings = commit_graph_bloom_settings();
+	if (!settings || !load_bloom_filter_from_graph(c, &filter))
+		return 1;
+
+	while (len && path[len - 1] == '/')
+		len--;
+	if (!len)
+		return 1;
+
+	fill_bloom_key(path, len, &key, settings);
+	ret = bloom_filter_contains(&filter, &key, settings);
+	clear_bloom_key(&key);
+	return ret != 0;
+}
@@ -0,0 +1,78 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+struct commit;
+
+/*
+ * Changed-path Bloom filters.
+ *
+ * For each commit in the commit-graph we may store a Bloom filter over
+ * the paths that differ between the commit and its first parent (or
+ * the empty tree, for a root commit), together with all the leading
+ * directories of those paths.  A history walk limited to a path can
+ * then skip the tree diff for commits whose filter says the path
+ * definitely did not change.
+ */
+
+struct bloom_filter_settings {
+	uint32_t hash_version;
+	uint32_t num_hashes;
+	uint32_t bits_per_entry;
+};
+
+#define DEFAULT_BLOOM_FILTER_SETTINGS { 1, 7, 10 }
+#define BITS_PER_WORD 8
+
+/*
+ * Commits changing more paths than this get a filter that matches
+ * every path, as a diff that large is cheap compared to its size.
+ */
+#define BLOOM_FILTER_MAX_CHANGED_PATHS 512
+
+struct bloom_filter {
+	unsigned char *data;
+	size_t len;
+};
+
+/*
+ * The hash values of one path, computed once per settings and reused
+ * for every filter it is checked against.
+ */
+struct bloom_key {
+	uint32_t *hashes;
+};
+
+extern uint32_t murmur3_seeded(uint32_t seed, const char *data, size_t len);
+
+extern void fill_bloom_key(const char *data, size_t len,
+			   struct bloom_key *key,
+			   const struct bloom_filter_settings *settings);
+extern void clear_bloom_key(struct bloom_key *key);
+
+extern void add_key_to_filter(const struct bloom_key *key,
+			      struct bloom_filter *filter,
+			      const struct bloom_filter_settings *settings);
+
+/*
+ * Return 0 if "key" is definitely not in "filter", 1 if it may be, and
+ * -1 if the filter is empty and so says nothing.
+ */
+extern int bloom_filter_contains(const struct bloom_filter *filter,
+				 const struct bloom_key *key,
+				 const struct bloom_filter_settings *settings);
+
+/*
+ * Compute the changed-path filter of "c" against its first parent.
+ * The caller owns filter->data.
+ */
+extern void compute_bloom_filter(struct commit *c,
+				 struct bloom_filter *filter,
+				 const struct bloom_filter_settings *settings);
+
+/*
+ * Return 0 if the commit-graph says that "path" is the same in "c" and
+ * its first parent, and 1 if it may differ or there is no filter for "c".
+ */
+extern int bloom_filter_maybe_changed(struct commit *c, const char *path);
+
+#endif /* BLOOM_H */
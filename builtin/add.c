@@ -18,6 +18,8 @@
 #include "bulk-checkin.h"
 #include "argv-array.h"
 #include "submodule.h"
+#include "sparse-index.h"
+#include "parallel-hash.h"
 
 static const char * const builtin_add_usage[] = {
 	N_("git add [<options>] [--] <pathspec>..."),
@@ -73,6 +75,17 @@ static void update_callback(struct diff_queue_struct *q,
 	int i;
 	struct update_callback_data *data = cbdata;
 
+	if (!(data->flags & ADD_CACHE_INTENT)) {
+		for (i = 0; i < q->nr; i++) {
+			struct diff_filepair *p = q->queue[i];
+			int status = fix_unmerged_status(p, data);
+			if (status == DIFF_STATUS_MODIFIED ||
+			    status == DIFF_STATUS_TYPE_CHANGED)
+				enqueue_hash(p->one->path, p->one->path);
+		}
+		run_parallel_hash(&the_index, HASH_WRITE_OBJECT);
+	}
+
 	for (i = 0; i < q->nr; i++) {
 		struct diff_filepair *p = q->queue[i];
 		const char *path = p->one->path;
@@ -97,6 +110,7 @@ static void update_callback(struct diff_queue_struct *q,
 			break;
 		}
 	}
+	clear_parallel_hash();
 }
 
 int add_files_to_cache(const char *prefix,
@@ -307,12 +321,20 @@ static int add_files(struct dir_struct *dir, int flags)
 		exit_status = 1;
 	}
 
+	if (!(flags & ADD_CACHE_INTENT)) {
+		for (i = 0; i < dir->nr; i++)
+			enqueue_hash(dir->entries[i]->name,
+				     dir->entries[i]->name);
+		run_parallel_hash(&the_index, HASH_WRITE_OBJECT);
+	}
+
 	for (i = 0; i < dir->nr; i++)
 		if (add_file_to_index(&the_index, dir->entries[i]->name, flags)) {
 			if (!ignore_add_errors)
 				die(_("adding files failed"));
 			exit_status = 1;
 		}
+	clear_parallel_hash();
 	return exit_status;
 }
 
@@ -326,6 +348,7 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	int require_pathspec;
 	char *seen = NULL;
 
+	command_requires_full_index = 0;
 	git_config(add_config, NULL);
 
 	argc = parse_options(argc, argv, prefix, builtin_add_options,
@@ -410,6 +433,7 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	}
 
 	if (refresh_only) {
+		ensure_full_index(&the_index);
 		refresh(verbose, &pathspec);
 		goto finish;
 	}
@@ -417,8 +441,14 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	if (pathspec.nr) {
 		int i;
 
-		if (!seen)
+		if (!seen) {
 			seen = find_pathspecs_matching_against_index(&pathspec, &the_index);
+			if (pathspec_needs_full_index(&the_index, &pathspec, seen)) {
+				free(seen);
+				ensure_full_index(&the_index);
+				seen = find_pathspecs_matching_against_index(&pathspec, &the_index);
+			}
+		}
 
 		/*
 		 * file_exists() assumes exact match
@@ -458,8 +488,11 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	if (add_new_files)
 		exit_status |= add_files(&dir, flags);
 
-	if (chmod_arg && pathspec.nr)
+	if (chmod_arg && pathspec.nr) {
+		if (pathspec_needs_full_index(&the_index, &pathspec, NULL))
+			ensure_full_index(&the_index);
 		chmod_pathspec(&pathspec, chmod_arg[0]);
+	}
 	unplug_bulk_checkin();
 
 finish:
@@ -0,0 +1,77 @@
+#include "builtin.h"
+#include "cache.h"
+#include "parallel-checkout.h"
+#include "parse-options.h"
+#include "pkt-line.h"
+
+static const char * const checkout_worker_usage[] = {
+	N_("git checkout--worker"),
+	NULL
+};
+
+static void packet_to_pc_item(const char *buffer, int len,
+			      struct parallel_checkout_item *pc_item)
+{
+	struct pc_item_fixed_portion fixed;
+
+	if (len < sizeof(fixed))
+		die("checkout--worker: item too short (%d bytes)", len);
+	memcpy(&fixed, buffer, sizeof(fixed));
+	if (fixed.path_len != len - sizeof(fixed))
+		die("checkout--worker: item has a bad path length");
+
+	memset(pc_item, 0, sizeof(*pc_item));
+	pc_item->id = fixed.id;
+	oidcpy(&pc_item->oid, &fixed.oid);
+	pc_item->mode = fixed.mode;
+	pc_item->ca.drv = NULL;
+	pc_item->ca.attr_action = fixed.attr_action;
+	pc_item->ca.crlf_action = fixed.crlf_action;
+	pc_item->ca.ident = fixed.ident;
+	pc_item->path = xmemdupz(buffer + sizeof(fixed), fixed.path_len);
+}
+
+static void send_result(const struct parallel_checkout_item *pc_item)
+{
+	struct pc_item_result res;
+
+	memset(&res, 0, sizeof(res));
+	res.id = pc_item->id;
+	res.status = pc_item->status;
+	if (pc_item->status == PC_ITEM_WRITTEN)
+		res.st = pc_item->st;
+	packet_write(1, (const char *)&res, sizeof(res));
+}
+
+int cmd_checkout__worker(int argc, const char **argv, const char *prefix)
+{
+	struct parallel_checkout_item *items = NULL;
+	size_t i, nr = 0, alloc = 0;
+	int len;
+	struct option options[] = {
+		OPT_END()
+	};
+
+	if (argc == 2 && !strcmp(argv[1], "-h"))
+		usage_with_options(checkout_worker_usage, options);
+
+	git_config(git_default_config, NULL);
+	argc = parse_options(argc, argv, prefix, options, checkout_worker_usage, 0);
+	if (argc > 0)
+		usage_with_options(checkout_worker_usage, options);
+
+	/* read everything before answering, see start_workers() */
+	while ((len = packet_read(0, NULL, NULL, packet_buffer,
+				  sizeof(packet_buffer), 0)) > 0) {
+		ALLOC_GROW(items, nr + 1, alloc);
+		packet_to_pc_item(packet_buffer, len, &items[nr++]);
+	}
+
+	for (i = 0; i < nr; i++) {
+		write_pc_item(&items[i]);
+		send_result(&items[i]);
+		free(items[i].path);
+	}
+	free(items);
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include "builtin.h"
+#include "cache.h"
+#include "parse-options.h"
+#include "sha1-array.h"
+#include "commit-graph.h"
+
+static char const * const builtin_commit_graph_usage[] = {
+	N_("git commit-graph [--object-dir=<dir>] write [--reachable | --stdin-commits] [--append] [--changed-paths]"),
+	NULL
+};
+
+int cmd_commit_graph(int argc, const char **argv, const char *prefix)
+{
+	const char *object_dir = NULL;
+	int reachable = 0, stdin_commits = 0, append = 0, changed_paths = 0;
+	int flags = 0;
+	struct oid_array commits = OID_ARRAY_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	int ret;
+	struct option opts[] = {
+		OPT_FILENAME(0, "object-dir", &object_dir,
+			     N_("the object directory to store the graph")),
+		OPT_BOOL(0, "reachable", &reachable,
+			 N_("start the walk at all refs")),
+		OPT_BOOL(0, "stdin-commits", &stdin_commits,
+			 N_("start the walk at commits listed by stdin")),
+		OPT_BOOL(0, "append", &append,
+			 N_("include all commits already in the commit-graph file")),
+		OPT_BOOL(0, "changed-paths", &changed_paths,
+			 N_("store Bloom filters of the paths changed by each commit")),
+		OPT_END(),
+	};
+
+	git_config(git_default_config, NULL);
+
+	argc = parse_options(argc, argv, prefix, opts,
+			     builtin_commit_graph_usage, 0);
+
+	if (argc != 1 || strcmp(argv[0], "write"))
+		usage_with_options(builtin_commit_graph_usage, opts);
+	if (reachable && stdin_commits)
+		die(_("use at most one of --reachable and --stdin-commits"));
+
+	if (!object_dir)
+		object_dir = get_object_directory();
+	if (append)
+		flags |= COMMIT_GRAPH_APPEND;
+	if (changed_paths)
+		flags |= COMMIT_GRAPH_CHANGED_PATHS;
+
+	if (!stdin_commits)
+		return write_commit_graph_reachable(object_dir, flags);
+
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		struct object_id oid;
+		if (get_oid_hex(buf.buf, &oid))
+			die(_("invalid commit id '%s'"), buf.buf);
+		oid_array_append(&commits, &oid);
+	}
+	ret = write_commit_graph(object_dir, &commits, flags);
+	oid_array_clear(&commits);
+	strbuf_release(&buf);
+	return ret;
+}
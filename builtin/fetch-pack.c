@@ -188,7 +188,7 @@ int cmd_fetch_pack(int argc, const char **argv, const char *prefix)
 		int flags = args.verbose ? CONNECT_VERBOSE : 0;
 		if (args.diag_url)
 			flags |= CONNECT_DIAG_URL;
-		conn = git_connect(fd, dest, args.uploadpack,
+		conn = git_connect(fd, dest, args.uploadpack, NULL,
 				   flags);
 		if (!conn)
 			return args.diag_url ? 0 : 1;
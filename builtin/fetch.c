@@ -16,6 +16,7 @@
 #include "connected.h"
 #include "argv-array.h"
 #include "utf8.h"
+#include "commit-graph.h"
 
 static const char * const builtin_fetch_usage[] = {
 	N_("git fetch [<options>] [<repository> [<refspec>...]]"),
@@ -32,6 +33,9 @@ enum {
 };
 
 static int fetch_prune_config = -1; /* unspecified */
+static int fetch_write_commit_graph;
+static int fetch_batch_ref_updates;
+static int fetch_ref_prefixes = 1;
 static int prune = -1; /* unspecified */
 #define PRUNE_BY_DEFAULT 0 /* do we prune by default? */
 
@@ -52,6 +56,7 @@ static const char *recurse_submodules_default;
 static int shown_url = 0;
 static int refmap_alloc, refmap_nr;
 static const char **refmap_array;
+static struct argv_array ref_prefixes = ARGV_ARRAY_INIT;
 
 static int option_parse_recurse_submodules(const struct option *opt,
 				   const char *arg, int unset)
@@ -74,6 +79,21 @@ static int git_fetch_config(const char *k, const char *v, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(k, "fetch.writecommitgraph")) {
+		fetch_write_commit_graph = git_config_bool(k, v);
+		return 0;
+	}
+
+	if (!strcmp(k, "fetch.batchrefupdates")) {
+		fetch_batch_ref_updates = git_config_bool(k, v);
+		return 0;
+	}
+
+	if (!strcmp(k, "fetch.refprefixes")) {
+		fetch_ref_prefixes = git_config_bool(k, v);
+		return 0;
+	}
+
 	if (!strcmp(k, "submodule.recurse")) {
 		int r = git_config_bool(k, v) ?
 			RECURSE_SUBMODULES_ON : RECURSE_SUBMODULES_OFF;
@@ -424,6 +444,22 @@ static struct ref *get_ref_map(struct transport *transport,
 #define STORE_REF_ERROR_OTHER 1
 #define STORE_REF_ERROR_DF_CONFLICT 2
 
+/*
+ * With fetch.batchRefUpdates, store_updated_refs() queues the ref
+ * updates in this transaction and commits them all at once. The lines
+ * describing each ref are collected in batch_notes until then; the
+ * util field of a line points to the batched_update it describes.
+ */
+static struct ref_transaction *batch;
+static struct string_list batch_notes = STRING_LIST_INIT_DUP;
+
+struct batched_update {
+	struct ref *ref;
+	const char *action;
+	int check_old;
+	struct strbuf failure_note;
+};
+
 static int s_update_ref(const char *action,
 			struct ref *ref,
 			int check_old)
@@ -440,7 +476,7 @@ static int s_update_ref(const char *action,
 		rla = default_rla.buf;
 	msg = xstrfmt("%s: %s", rla, action);
 
-	transaction = ref_transaction_begin(&err);
+	transaction = batch ? batch : ref_transaction_begin(&err);
 	if (!transaction ||
 	    ref_transaction_update(transaction, ref->name,
 				   ref->new_oid.hash,
@@ -448,6 +484,12 @@ static int s_update_ref(const char *action,
 				   0, msg, &err))
 		goto fail;
 
+	if (transaction == batch) {
+		strbuf_release(&err);
+		free(msg);
+		return 0;
+	}
+
 	ret = ref_transaction_commit(transaction, &err);
 	if (ret) {
 		df_conflict = (ret == TRANSACTION_NAME_CONFLICT);
@@ -459,7 +501,8 @@ static int s_update_ref(const char *action,
 	free(msg);
 	return 0;
 fail:
-	ref_transaction_free(transaction);
+	if (transaction != batch)
+		ref_transaction_free(transaction);
 	error("%s", err.buf);
 	strbuf_release(&err);
 	free(msg);
@@ -597,6 +640,46 @@ static void format_display(struct strbuf *display, char code,
 		strbuf_addf(display, "  (%s)", error);
 }
 
+/*
+ * Update the local ref and describe the outcome in display: on success
+ * with the given code, summary and note, otherwise as a failure. When
+ * the update is only queued in the batch, the description is moved to
+ * batch_notes, together with the description to use should the batch
+ * fail to update the ref after all.
+ */
+static int update_ref_and_display(const char *action, struct ref *ref,
+				  int check_old, struct strbuf *display,
+				  char code, const char *summary,
+				  const char *note, const char *remote,
+				  const char *local, int summary_width)
+{
+	struct batched_update *update;
+	int r = s_update_ref(action, ref, check_old);
+
+	if (r) {
+		format_display(display, '!', summary,
+			       _("unable to update local ref"),
+			       remote, local, summary_width);
+		return r;
+	}
+	format_display(display, code, summary, note,
+		       remote, local, summary_width);
+	if (!batch)
+		return 0;
+
+	update = xcalloc(1, sizeof(*update));
+	update->ref = copy_ref(ref);
+	update->action = action;
+	update->check_old = check_old;
+	strbuf_init(&update->failure_note, 0);
+	format_display(&update->failure_note, '!', summary,
+		       _("unable to update local ref"),
+		       remote, local, summary_width);
+	string_list_append(&batch_notes, display->buf)->util = update;
+	strbuf_reset(display);
+	return 0;
+}
+
 static int update_local_ref(struct ref *ref,
 			    const char *remote,
 			    const struct ref *remote_ref,
@@ -635,12 +718,9 @@ static int update_local_ref(struct ref *ref,
 
 	if (!is_null_oid(&ref->old_oid) &&
 	    starts_with(ref->name, "refs/tags/")) {
-		int r;
-		r = s_update_ref("updating tag", ref, 0);
-		format_display(display, r ? '!' : 't', _("[tag update]"),
-			       r ? _("unable to update local ref") : NULL,
-			       remote, pretty_ref, summary_width);
-		return r;
+		return update_ref_and_display("updating tag", ref, 0, display,
+					      't', _("[tag update]"), NULL,
+					      remote, pretty_ref, summary_width);
 	}
 
 	current = lookup_commit_reference_gently(&ref->old_oid, 1);
@@ -648,7 +728,6 @@ static int update_local_ref(struct ref *ref,
 	if (!current || !updated) {
 		const char *msg;
 		const char *what;
-		int r;
 		/*
 		 * Nicely describe the new ref we're fetching.
 		 * Base this on the remote's ref name, as it's
@@ -669,11 +748,9 @@ static int update_local_ref(struct ref *ref,
 		if ((recurse_submodules != RECURSE_SUBMODULES_OFF) &&
 		    (recurse_submodules != RECURSE_SUBMODULES_ON))
 			check_for_new_submodule_commits(&ref->new_oid);
-		r = s_update_ref(msg, ref, 0);
-		format_display(display, r ? '!' : '*', what,
-			       r ? _("unable to update local ref") : NULL,
-			       remote, pretty_ref, summary_width);
-		return r;
+		return update_ref_and_display(msg, ref, 0, display, '*', what,
+					      NULL, remote, pretty_ref,
+					      summary_width);
 	}
 
 	if (in_merge_bases(current, updated)) {
@@ -685,10 +762,9 @@ static int update_local_ref(struct ref *ref,
 		if ((recurse_submodules != RECURSE_SUBMODULES_OFF) &&
 		    (recurse_submodules != RECURSE_SUBMODULES_ON))
 			check_for_new_submodule_commits(&ref->new_oid);
-		r = s_update_ref("fast-forward", ref, 1);
-		format_display(display, r ? '!' : ' ', quickref.buf,
-			       r ? _("unable to update local ref") : NULL,
-			       remote, pretty_ref, summary_width);
+		r = update_ref_and_display("fast-forward", ref, 1, display,
+					   ' ', quickref.buf, NULL,
+					   remote, pretty_ref, summary_width);
 		strbuf_release(&quickref);
 		return r;
 	} else if (force || ref->force) {
@@ -700,10 +776,9 @@ static int update_local_ref(struct ref *ref,
 		if ((recurse_submodules != RECURSE_SUBMODULES_OFF) &&
 		    (recurse_submodules != RECURSE_SUBMODULES_ON))
 			check_for_new_submodule_commits(&ref->new_oid);
-		r = s_update_ref("forced-update", ref, 1);
-		format_display(display, r ? '!' : '+', quickref.buf,
-			       r ? _("unable to update local ref") : _("forced update"),
-			       remote, pretty_ref, summary_width);
+		r = update_ref_and_display("forced-update", ref, 1, display,
+					   '+', quickref.buf, _("forced update"),
+					   remote, pretty_ref, summary_width);
 		strbuf_release(&quickref);
 		return r;
 	} else {
@@ -727,6 +802,56 @@ static int iterate_ref_map(void *cb_data, unsigned char sha1[20])
 	return 0;
 }
 
+static void show_note(const char *url, int url_len, const char *note)
+{
+	if (verbosity < 0)
+		return;
+	if (!shown_url) {
+		fprintf(stderr, _("From %.*s\n"), url_len, url);
+		shown_url = 1;
+	}
+	fprintf(stderr, " %s\n", note);
+}
+
+/*
+ * Commit the updates queued in the batch. If the transaction fails as
+ * a whole, retry the updates one by one, so that every ref that can be
+ * updated is, and each failure is reported for its own ref.
+ */
+static int commit_batched_updates(void)
+{
+	struct strbuf err = STRBUF_INIT;
+	struct string_list_item *item;
+	int failed, rc = 0;
+
+	failed = ref_transaction_commit(batch, &err);
+	ref_transaction_free(batch);
+	batch = NULL;
+	strbuf_release(&err);
+
+	for_each_string_list_item(item, &batch_notes) {
+		struct batched_update *update = item->util;
+
+		if (!update)
+			continue;
+		if (failed) {
+			int r = s_update_ref(update->action, update->ref,
+					     update->check_old);
+			if (r) {
+				free(item->string);
+				item->string = strbuf_detach(&update->failure_note,
+							     NULL);
+				rc |= r;
+			}
+		}
+		strbuf_release(&update->failure_note);
+		free(update->ref);
+		free(update);
+		item->util = NULL;
+	}
+	return rc;
+}
+
 static int store_updated_refs(const char *raw_url, const char *remote_name,
 		struct ref *ref_map)
 {
@@ -758,6 +883,22 @@ static int store_updated_refs(const char *raw_url, const char *remote_name,
 
 	prepare_format_display(ref_map);
 
+	url_len = strlen(url);
+	for (i = url_len - 1; url[i] == '/' && 0 <= i; i--)
+		;
+	url_len = i + 1;
+	if (4 < i && !strncmp(".git", url + i - 3, 4))
+		url_len = i - 3;
+
+	if (fetch_batch_ref_updates && !dry_run) {
+		struct strbuf err = STRBUF_INIT;
+
+		batch = ref_transaction_begin(&err);
+		if (!batch)
+			warning("%s", err.buf);
+		strbuf_release(&err);
+	}
+
 	/*
 	 * We do a pass for each fetch_head_status type in their enum order, so
 	 * merged entries are written before not-for-merge. That lets readers
@@ -814,13 +955,6 @@ static int store_updated_refs(const char *raw_url, const char *remote_name,
 				what = rm->name;
 			}
 
-			url_len = strlen(url);
-			for (i = url_len - 1; url[i] == '/' && 0 <= i; i--)
-				;
-			url_len = i + 1;
-			if (4 < i && !strncmp(".git", url + i - 3, 4))
-				url_len = i - 3;
-
 			strbuf_reset(&note);
 			if (*what) {
 				if (*kind)
@@ -859,17 +993,23 @@ static int store_updated_refs(const char *raw_url, const char *remote_name,
 					       *what ? what : "HEAD",
 					       "FETCH_HEAD", summary_width);
 			if (note.len) {
-				if (verbosity >= 0 && !shown_url) {
-					fprintf(stderr, _("From %.*s\n"),
-							url_len, url);
-					shown_url = 1;
-				}
-				if (verbosity >= 0)
-					fprintf(stderr, " %s\n", note.buf);
+				if (batch)
+					string_list_append(&batch_notes, note.buf);
+				else
+					show_note(url, url_len, note.buf);
 			}
 		}
 	}
 
+	if (batch) {
+		struct string_list_item *item;
+
+		rc |= commit_batched_updates();
+		for_each_string_list_item(item, &batch_notes)
+			show_note(url, url_len, item->string);
+		string_list_clear(&batch_notes, 0);
+	}
+
 	if (rc & STORE_REF_ERROR_DF_CONFLICT)
 		error(_("some local refs could not be updated; try running\n"
 		      " 'git remote prune %s' to remove any old, conflicting "
@@ -1013,6 +1153,8 @@ static struct transport *prepare_transport(struct remote *remote, int deepen)
 {
 	struct transport *transport;
 	transport = transport_get(remote, NULL);
+	if (ref_prefixes.argc)
+		transport->ref_prefixes = &ref_prefixes;
 	transport_set_verbosity(transport, verbosity, progress);
 	transport->family = family;
 	if (upload_pack)
@@ -1073,13 +1215,6 @@ static int do_fetch(struct transport *transport,
 
 	for_each_ref(add_existing, &existing_refs);
 
-	if (tags == TAGS_DEFAULT) {
-		if (transport->remote->fetch_tags == 2)
-			tags = TAGS_SET;
-		if (transport->remote->fetch_tags == -1)
-			tags = TAGS_UNSET;
-	}
-
 	if (!transport->get_refs_list || !transport->fetch)
 		die(_("Don't know how to fetch from %s"), transport->url);
 
@@ -1253,6 +1388,51 @@ static int fetch_multiple(struct string_list *list)
 	return result;
 }
 
+/*
+ * Collect the prefixes of the remote refs that get_ref_map() and the
+ * tag following can use, so that the server can leave the other refs
+ * out of its advertisement.
+ */
+static void get_ref_prefixes(struct remote *remote,
+			     struct refspec *refs, int ref_count,
+			     struct argv_array *prefixes)
+{
+	int autotags = (remote->fetch_tags == 1);
+	int i;
+
+	/* Any ref may point at an object that is asked for by name */
+	for (i = 0; i < ref_count; i++)
+		if (refs[i].exact_sha1)
+			return;
+
+	if (ref_count) {
+		refspec_ref_prefixes(refs, ref_count, prefixes);
+		for (i = 0; i < ref_count; i++)
+			if (refs[i].dst && refs[i].dst[0])
+				autotags = 1;
+	} else {
+		struct branch *branch = branch_get(NULL);
+		int has_merge = branch_has_merge_config(branch) &&
+			!strcmp(branch->remote_name, remote->name);
+
+		if (remote->fetch_refspec_nr || has_merge) {
+			refspec_ref_prefixes(remote->fetch,
+					     remote->fetch_refspec_nr, prefixes);
+			for (i = 0; i < remote->fetch_refspec_nr; i++)
+				if (remote->fetch[i].dst &&
+				    remote->fetch[i].dst[0])
+					autotags = 1;
+			for (i = 0; has_merge && i < branch->merge_nr; i++)
+				expand_ref_prefix(prefixes, branch->merge[i]->src);
+		} else {
+			argv_array_push(prefixes, "HEAD");
+		}
+	}
+
+	if (tags == TAGS_SET || (tags == TAGS_DEFAULT && autotags))
+		argv_array_push(prefixes, "refs/tags/");
+}
+
 static int fetch_one(struct remote *remote, int argc, const char **argv)
 {
 	static const char **refs = NULL;
@@ -1264,18 +1444,6 @@ static int fetch_one(struct remote *remote, int argc, const char **argv)
 		die(_("No remote repository specified.  Please, specify either a URL or a\n"
 		    "remote name from which new revisions should be fetched."));
 
-	gtransport = prepare_transport(remote, 1);
-
-	if (prune < 0) {
-		/* no command line request */
-		if (0 <= gtransport->remote->prune)
-			prune = gtransport->remote->prune;
-		else if (0 <= fetch_prune_config)
-			prune = fetch_prune_config;
-		else
-			prune = PRUNE_BY_DEFAULT;
-	}
-
 	if (argc > 0) {
 		int j = 0;
 		int i;
@@ -1293,14 +1461,36 @@ static int fetch_one(struct remote *remote, int argc, const char **argv)
 		refs[j] = NULL;
 		ref_nr = j;
 	}
+	refspec = parse_fetch_refspec(ref_nr, refs);
+
+	if (tags == TAGS_DEFAULT) {
+		if (remote->fetch_tags == 2)
+			tags = TAGS_SET;
+		if (remote->fetch_tags == -1)
+			tags = TAGS_UNSET;
+	}
+	if (fetch_ref_prefixes)
+		get_ref_prefixes(remote, refspec, ref_nr, &ref_prefixes);
+
+	gtransport = prepare_transport(remote, 1);
+
+	if (prune < 0) {
+		/* no command line request */
+		if (0 <= gtransport->remote->prune)
+			prune = gtransport->remote->prune;
+		else if (0 <= fetch_prune_config)
+			prune = fetch_prune_config;
+		else
+			prune = PRUNE_BY_DEFAULT;
+	}
 
 	sigchain_push_common(unlock_pack_on_signal);
 	atexit(unlock_pack);
-	refspec = parse_fetch_refspec(ref_nr, refs);
 	exit_code = do_fetch(gtransport, refspec, ref_nr);
 	free_refspec(ref_nr, refspec);
 	transport_disconnect(gtransport);
 	gtransport = NULL;
+	argv_array_clear(&ref_prefixes);
 	return exit_code;
 }
 
@@ -1401,6 +1591,10 @@ int cmd_fetch(int argc, const char **argv, const char *prefix)
 
 	string_list_clear(&list, 0);
 
+	if (!result && fetch_write_commit_graph)
+		write_commit_graph_reachable(get_object_directory(),
+					     COMMIT_GRAPH_APPEND);
+
 	close_all_packs();
 
 	argv_array_pushl(&argv_gc_auto, "gc", "--auto", NULL);
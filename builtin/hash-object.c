@@ -9,6 +9,7 @@
 #include "quote.h"
 #include "parse-options.h"
 #include "exec_cmd.h"
+#include "parallel-hash.h"
 
 /*
  * This is to create corrupt objects for debugging and as such it
@@ -49,6 +50,13 @@ static void hash_object(const char *path, const char *type, const char *vpath,
 			unsigned flags, int literally)
 {
 	int fd;
+	unsigned char sha1[20];
+
+	if (!literally && parallel_hash_result(path, vpath, NULL, flags, sha1)) {
+		printf("%s\n", sha1_to_hex(sha1));
+		maybe_flush_or_die(stdout, "hash to stdout");
+		return;
+	}
 	fd = open(path, O_RDONLY);
 	if (fd < 0)
 		die_errno("Cannot open '%s'", path);
@@ -60,16 +68,40 @@ static void hash_stdin_paths(const char *type, int no_filters, unsigned flags,
 {
 	struct strbuf buf = STRBUF_INIT;
 	struct strbuf unquoted = STRBUF_INIT;
-
-	while (strbuf_getline(&buf, stdin) != EOF) {
-		if (buf.buf[0] == '"') {
-			strbuf_reset(&unquoted);
-			if (unquote_c_style(&unquoted, buf.buf, NULL))
-				die("line is badly quoted");
-			strbuf_swap(&buf, &unquoted);
+	struct string_list lines = STRING_LIST_INIT_DUP;
+	struct string_list_item *item;
+	int parallel = !literally && !strcmp(type, blob_type);
+
+	/*
+	 * Answer the paths in batches of what is available, so that the
+	 * files of a batch can be hashed in parallel.
+	 */
+	while (read_available_lines(0, &buf, '\n', &lines)) {
+		for_each_string_list_item(item, &lines) {
+			char *path = item->string;
+			size_t len = strlen(path);
+
+			if (len && path[len - 1] == '\r')
+				path[len - 1] = '\0';
+			if (path[0] == '"') {
+				strbuf_reset(&unquoted);
+				if (unquote_c_style(&unquoted, path, NULL))
+					die("line is badly quoted");
+				item->string = strbuf_detach(&unquoted, NULL);
+				free(path);
+			}
+			if (parallel)
+				enqueue_hash(item->string,
+					     no_filters ? NULL : item->string);
 		}
-		hash_object(buf.buf, type, no_filters ? NULL : buf.buf, flags,
-			    literally);
+		if (parallel)
+			run_parallel_hash(NULL, flags);
+		for_each_string_list_item(item, &lines)
+			hash_object(item->string, type,
+				    no_filters ? NULL : item->string, flags,
+				    literally);
+		clear_parallel_hash();
+		string_list_clear(&lines, 0);
 	}
 	strbuf_release(&buf);
 	strbuf_release(&unquoted);
@@ -140,16 +172,24 @@ int cmd_hash_object(int argc, const char **argv, const char *prefix)
 	if (hashstdin)
 		hash_fd(0, type, vpath, flags, literally);
 
+	for (i = 0 ; i < argc; i++)
+		if (prefix)
+			argv[i] = prefix_filename(prefix, argv[i]);
+
+	if (!literally && !strcmp(type, blob_type)) {
+		for (i = 0; i < argc; i++)
+			enqueue_hash(argv[i],
+				     no_filters ? NULL : vpath ? vpath : argv[i]);
+		run_parallel_hash(NULL, flags);
+	}
+
 	for (i = 0 ; i < argc; i++) {
 		const char *arg = argv[i];
-		char *to_free = NULL;
 
-		if (prefix)
-			arg = to_free = prefix_filename(prefix, arg);
 		hash_object(arg, type, no_filters ? NULL : vpath ? vpath : arg,
 			    flags, literally);
-		free(to_free);
 	}
+	clear_parallel_hash();
 
 	if (stdin_paths)
 		hash_stdin_paths(type, no_filters, flags, literally);
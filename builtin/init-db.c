@@ -22,6 +22,7 @@
 static int init_is_bare_repository = 0;
 static int init_shared_repository = -1;
 static const char *init_db_template_dir;
+static const char *init_ref_format;
 
 static void copy_templates_1(struct strbuf *path, struct strbuf *template,
 			     DIR *dir)
@@ -170,6 +171,36 @@ static int needs_work_tree_config(const char *git_dir, const char *work_tree)
 	return 1;
 }
 
+/*
+ * Decide which reference backend the repository uses: the one it
+ * already has when reinitializing, otherwise the one asked for with
+ * --ref-format or $GIT_DEFAULT_REF_FORMAT, defaulting to "files".
+ */
+static const char *ref_storage_format(int reinit)
+{
+	const char *format = init_ref_format;
+
+	if (reinit) {
+		struct repository_format repo_fmt;
+		const char *existing = "files";
+
+		read_repository_format(&repo_fmt, git_path("config"));
+		if (repo_fmt.version >= 1 && repo_fmt.ref_storage)
+			existing = repo_fmt.ref_storage;
+		if (format && strcmp(format, existing))
+			die(_("attempt to reinitialize repository with different ref format"));
+		return existing;
+	}
+
+	if (!format)
+		format = getenv(GIT_DEFAULT_REF_FORMAT_ENVIRONMENT);
+	if (!format)
+		format = "files";
+	if (!ref_storage_backend_exists(format))
+		die(_("unknown ref storage format '%s'"), format);
+	return format;
+}
+
 static int create_default_files(const char *template_path,
 				const char *original_git_dir)
 {
@@ -180,6 +211,7 @@ static int create_default_files(const char *template_path,
 	char junk[2];
 	int reinit;
 	int filemode;
+	const char *ref_format;
 	struct strbuf err = STRBUF_INIT;
 
 	/* Just look for `init.templatedir` */
@@ -215,6 +247,20 @@ static int create_default_files(const char *template_path,
 		adjust_shared_perm(get_git_dir());
 	}
 
+	path = git_path_buf(&buf, "HEAD");
+	reinit = (!access(path, R_OK)
+		  || readlink(path, junk, sizeof(junk)-1) != -1);
+
+	/*
+	 * The ref store of the repository is set up according to its
+	 * config, so record a non-default format before touching refs.
+	 */
+	ref_format = ref_storage_format(reinit);
+	if (!reinit && strcmp(ref_format, "files")) {
+		git_config_set("core.repositoryformatversion", "1");
+		git_config_set("extensions.refstorage", ref_format);
+	}
+
 	/*
 	 * We need to create a "refs" dir in any case so that older
 	 * versions of git can tell that this is a repository.
@@ -229,9 +275,6 @@ static int create_default_files(const char *template_path,
 	 * Create the default symlink from ".git/HEAD" to the "master"
 	 * branch, if it does not exist yet.
 	 */
-	path = git_path_buf(&buf, "HEAD");
-	reinit = (!access(path, R_OK)
-		  || readlink(path, junk, sizeof(junk)-1) != -1);
 	if (!reinit) {
 		if (create_symref("HEAD", "refs/heads/master", NULL) < 0)
 			exit(1);
@@ -239,7 +282,7 @@ static int create_default_files(const char *template_path,
 
 	/* This forces creation of new config file */
 	xsnprintf(repo_version_string, sizeof(repo_version_string),
-		  "%d", GIT_REPO_VERSION);
+		  "%d", strcmp(ref_format, "files") ? 1 : GIT_REPO_VERSION);
 	git_config_set("core.repositoryformatversion", repo_version_string);
 
 	/* Check filemode trustability */
@@ -454,7 +497,7 @@ static int shared_callback(const struct option *opt, const char *arg, int unset)
 }
 
 static const char *const init_db_usage[] = {
-	N_("git init [-q | --quiet] [--bare] [--template=<template-directory>] [--shared[=<permissions>]] [<directory>]"),
+	N_("git init [-q | --quiet] [--bare] [--template=<template-directory>] [--shared[=<permissions>]] [--ref-format=<format>] [<directory>]"),
 	NULL
 };
 
@@ -483,6 +526,8 @@ int cmd_init_db(int argc, const char **argv, const char *prefix)
 		OPT_BIT('q', "quiet", &flags, N_("be quiet"), INIT_DB_QUIET),
 		OPT_STRING(0, "separate-git-dir", &real_git_dir, N_("gitdir"),
 			   N_("separate git dir from working tree")),
+		OPT_STRING(0, "ref-format", &init_ref_format, N_("format"),
+			   N_("specify the reference storage format to use")),
 		OPT_END()
 	};
 
@@ -6,9 +6,11 @@
 #include "csum-file.h"
 #include "pack.h"
 #include "strbuf.h"
+#include "oidset.h"
 
 static struct bulk_checkin_state {
 	unsigned plugged:1;
+	unsigned batch:1;
 
 	char *pack_tmp_name;
 	struct sha1file *f;
@@ -18,6 +20,7 @@ static struct bulk_checkin_state {
 	struct pack_idx_entry **written;
 	uint32_t alloc_written;
 	uint32_t nr_written;
+	struct oidset written_set;
 } state;
 
 static void finish_bulk_checkin(struct bulk_checkin_state *state)
@@ -52,7 +55,13 @@ static void finish_bulk_checkin(struct bulk_checkin_state *state)
 
 clear_exit:
 	free(state->written);
-	memset(state, 0, sizeof(*state));
+	state->written = NULL;
+	state->alloc_written = state->nr_written = 0;
+	oidset_clear(&state->written_set);
+	free(state->pack_tmp_name);
+	state->pack_tmp_name = NULL;
+	state->f = NULL;
+	state->offset = 0;
 
 	strbuf_release(&packname);
 	/* Make objects we just wrote available to ourselves */
@@ -61,19 +70,24 @@ static void finish_bulk_checkin(struct bulk_checkin_state *state)
 
 static int already_written(struct bulk_checkin_state *state, unsigned char sha1[])
 {
-	int i;
+	struct object_id oid;
 
 	/* The object may already exist in the repository */
 	if (has_sha1_file(sha1))
 		return 1;
 
-	/* Might want to keep the list sorted */
-	for (i = 0; i < state->nr_written; i++)
-		if (!hashcmp(state->written[i]->oid.hash, sha1))
-			return 1;
+	hashcpy(oid.hash, sha1);
+	return oidset_contains(&state->written_set, &oid);
+}
 
-	/* This is a new object we need to keep */
-	return 0;
+static void add_written(struct bulk_checkin_state *state,
+			struct pack_idx_entry *idx)
+{
+	ALLOC_GROW(state->written,
+		   state->nr_written + 1,
+		   state->alloc_written);
+	state->written[state->nr_written++] = idx;
+	oidset_insert(&state->written_set, &idx->oid);
 }
 
 /*
@@ -174,6 +188,8 @@ static void prepare_to_stream(struct bulk_checkin_state *state,
 
 	state->f = create_tmp_packfile(&state->pack_tmp_name);
 	reset_pack_idx_option(&state->pack_idx_opts);
+	if (git_config_get_write_rev_index())
+		state->pack_idx_opts.flags |= WRITE_REV;
 
 	/* Pretend we are going to write only one object */
 	state->offset = write_pack_header(state->f, 1);
@@ -243,10 +259,7 @@ static int deflate_to_pack(struct bulk_checkin_state *state,
 		free(idx);
 	} else {
 		hashcpy(idx->oid.hash, result_sha1);
-		ALLOC_GROW(state->written,
-			   state->nr_written + 1,
-			   state->alloc_written);
-		state->written[state->nr_written++] = idx;
+		add_written(state, idx);
 	}
 	return 0;
 }
@@ -262,9 +275,88 @@ int index_bulk_checkin(unsigned char *sha1,
 	return status;
 }
 
+int bulk_checkin_batches_objects(void)
+{
+	return state.plugged && state.batch;
+}
+
+void deflate_pack_entry(struct strbuf *out, enum object_type type,
+			const void *buf, size_t size)
+{
+	git_zstream s;
+	unsigned char hdr[16];
+	int hdrlen, status;
+
+	hdrlen = encode_in_pack_object_header(hdr, sizeof(hdr), type, size);
+	strbuf_add(out, hdr, hdrlen);
+
+	git_deflate_init(&s, pack_compression_level);
+	strbuf_grow(out, git_deflate_bound(&s, size));
+	s.next_in = (void *)buf;
+	s.avail_in = size;
+	do {
+		strbuf_grow(out, 1024);
+		s.next_out = (unsigned char *)out->buf + out->len;
+		s.avail_out = strbuf_avail(out);
+		status = git_deflate(&s, Z_FINISH);
+		strbuf_setlen(out, (char *)s.next_out - out->buf);
+	} while (status == Z_OK || status == Z_BUF_ERROR);
+	if (status != Z_STREAM_END)
+		die("unexpected deflate failure: %d", status);
+	git_deflate_end(&s);
+}
+
+int write_pack_entry_bulk_checkin(const unsigned char *sha1,
+				  const struct strbuf *entry)
+{
+	struct pack_idx_entry *idx;
+	struct object_id oid;
+
+	hashcpy(oid.hash, sha1);
+	if (oidset_contains(&state.written_set, &oid) || freshen_object(sha1))
+		return 0;
+
+	prepare_to_stream(&state, HASH_WRITE_OBJECT);
+	if (state.nr_written && pack_size_limit_cfg &&
+	    pack_size_limit_cfg < state.offset + entry->len) {
+		finish_bulk_checkin(&state);
+		prepare_to_stream(&state, HASH_WRITE_OBJECT);
+	}
+
+	idx = xcalloc(1, sizeof(*idx));
+	idx->offset = state.offset;
+	crc32_begin(state.f);
+	sha1write(state.f, entry->buf, entry->len);
+	state.offset += entry->len;
+	idx->crc32 = crc32_end(state.f);
+	oidcpy(&idx->oid, &oid);
+	add_written(&state, idx);
+	return 0;
+}
+
+int write_sha1_file_bulk_checkin(const void *buf, size_t size,
+				 enum object_type type, unsigned char *sha1)
+{
+	struct strbuf entry = STRBUF_INIT;
+	int ret;
+
+	if (!bulk_checkin_batches_objects())
+		return write_sha1_file(buf, size, typename(type), sha1);
+	hash_sha1_file(buf, size, typename(type), sha1);
+	deflate_pack_entry(&entry, type, buf, size);
+	ret = write_pack_entry_bulk_checkin(sha1, &entry);
+	strbuf_release(&entry);
+	return ret;
+}
+
 void plug_bulk_checkin(void)
 {
+	int batch;
+
 	state.plugged = 1;
+	if (git_config_get_bool("core.bulkcheckin", &batch))
+		batch = 0;
+	state.batch = batch;
 }
 
 void unplug_bulk_checkin(void)
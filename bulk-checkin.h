@@ -8,7 +8,38 @@ extern int index_bulk_checkin(unsigned char sha1[],
 			      int fd, size_t size, enum object_type type,
 			      const char *path, unsigned flags);
 
+/*
+ * Between plug_bulk_checkin() and unplug_bulk_checkin(), the objects
+ * written by index_bulk_checkin() go to the same new packfile. With
+ * core.bulkCheckin, so do the smaller objects that index_path() and
+ * index_fd() write, instead of becoming loose objects each of their
+ * own; the packfile is synced and made available once, when the
+ * checkin is unplugged.
+ */
 extern void plug_bulk_checkin(void);
 extern void unplug_bulk_checkin(void);
 
+/* Do objects written now go to the bulk checkin packfile? */
+extern int bulk_checkin_batches_objects(void);
+
+/*
+ * Write an object like write_sha1_file() does, to the packfile of the
+ * bulk checkin if bulk_checkin_batches_objects().
+ */
+extern int write_sha1_file_bulk_checkin(const void *buf, size_t size,
+					enum object_type type,
+					unsigned char *sha1);
+
+/*
+ * The same in two steps, so that the object can be deflated by
+ * another thread: deflate_pack_entry() appends to "out" the object
+ * as a pack entry, and can be called from several threads at once.
+ * write_pack_entry_bulk_checkin() adds such an entry for the object
+ * "sha1" to the packfile, unless the object exists already.
+ */
+extern void deflate_pack_entry(struct strbuf *out, enum object_type type,
+			       const void *buf, size_t size);
+extern int write_pack_entry_bulk_checkin(const unsigned char *sha1,
+					 const struct strbuf *entry);
+
 #endif
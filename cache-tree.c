@@ -32,6 +32,17 @@ void cache_tree_free(struct cache_tree **it_p)
 	*it_p = NULL;
 }
 
+void cache_tree_free_subtrees(struct cache_tree *it)
+{
+	int i;
+
+	for (i = 0; i < it->subtree_nr; i++) {
+		cache_tree_free(&it->down[i]->cache_tree);
+		free(it->down[i]);
+	}
+	it->subtree_nr = 0;
+}
+
 static int subtree_name_cmp(const char *one, int onelen,
 			    const char *two, int twolen)
 {
@@ -42,7 +53,7 @@ static int subtree_name_cmp(const char *one, int onelen,
 	return memcmp(one, two, onelen);
 }
 
-static int subtree_pos(struct cache_tree *it, const char *path, int pathlen)
+int cache_tree_subtree_pos(struct cache_tree *it, const char *path, int pathlen)
 {
 	struct cache_tree_sub **down = it->down;
 	int lo, hi;
@@ -69,7 +80,7 @@ static struct cache_tree_sub *find_subtree(struct cache_tree *it,
 					   int create)
 {
 	struct cache_tree_sub *down;
-	int pos = subtree_pos(it, path, pathlen);
+	int pos = cache_tree_subtree_pos(it, path, pathlen);
 	if (0 <= pos)
 		return it->down[pos];
 	if (!create)
@@ -121,7 +132,7 @@ static int do_invalidate_path(struct cache_tree *it, const char *path)
 	it->entry_count = -1;
 	if (!*slash) {
 		int pos;
-		pos = subtree_pos(it, path, namelen);
+		pos = cache_tree_subtree_pos(it, path, namelen);
 		if (0 <= pos) {
 			cache_tree_free(&it->down[pos]->cache_tree);
 			free(it->down[pos]);
@@ -293,6 +304,16 @@ static int update_one(struct cache_tree *it,
 		sub = find_subtree(it, path + baselen, sublen, 1);
 		if (!sub->cache_tree)
 			sub->cache_tree = cache_tree();
+		if (S_ISSPARSEDIR(ce->ce_mode) && slash == path + pathlen - 1) {
+			/* a sparse directory entry already names its tree */
+			cache_tree_free_subtrees(sub->cache_tree);
+			oidcpy(&sub->cache_tree->oid, &ce->oid);
+			sub->cache_tree->entry_count = 1;
+			i++;
+			sub->count = 1;
+			sub->used = 1;
+			continue;
+		}
 		subcnt = update_one(sub->cache_tree,
 				    cache + i, entries - i,
 				    path,
@@ -425,6 +446,26 @@ static int update_one(struct cache_tree *it,
 	return i;
 }
 
+void cache_tree_expand_sparse_dir(struct cache_tree *it, const char *path,
+				  int nr)
+{
+	const char *slash;
+
+	while (it && (slash = strchr(path, '/'))) {
+		struct cache_tree_sub *sub;
+
+		if (0 <= it->entry_count)
+			it->entry_count += nr - 1;
+		sub = find_subtree(it, path, slash - path, 0);
+		if (!sub)
+			return;
+		it = sub->cache_tree;
+		path = slash + 1;
+	}
+	if (it && 0 <= it->entry_count)
+		it->entry_count += nr - 1;
+}
+
 int cache_tree_update(struct index_state *istate, int flags)
 {
 	struct cache_tree *it = istate->cache_tree;
@@ -24,15 +24,26 @@ struct cache_tree {
 
 struct cache_tree *cache_tree(void);
 void cache_tree_free(struct cache_tree **);
+void cache_tree_free_subtrees(struct cache_tree *);
 void cache_tree_invalidate_path(struct index_state *, const char *);
 struct cache_tree_sub *cache_tree_sub(struct cache_tree *, const char *);
 
+/* Position of the subtree "path" in it->down, or -1-(insertion point) */
+int cache_tree_subtree_pos(struct cache_tree *, const char *path, int pathlen);
+
 void cache_tree_write(struct strbuf *, struct cache_tree *root);
 struct cache_tree *cache_tree_read(const char *buffer, unsigned long size);
 
 int cache_tree_fully_valid(struct cache_tree *);
 int cache_tree_update(struct index_state *, int);
 
+/*
+ * The sparse directory entry "path" (with its trailing slash) has been
+ * replaced by "nr" entries; adjust the entry counts of the trees that
+ * contain them.
+ */
+void cache_tree_expand_sparse_dir(struct cache_tree *, const char *path, int nr);
+
 int update_main_cache_tree(int);
 
 /* bitmasks to write_cache_as_tree flags */
@@ -100,6 +100,14 @@ struct object_id {
 #define S_IFGITLINK	0160000
 #define S_ISGITLINK(m)	(((m) & S_IFMT) == S_IFGITLINK)
 
+/*
+ * A sparse index stores a directory that is entirely outside of the
+ * sparse checkout as a single entry with the mode of a tree, the name
+ * of the directory with a trailing slash, and the object name of the
+ * tree; see sparse-index.h.
+ */
+#define S_ISSPARSEDIR(m) ((m) == S_IFDIR)
+
 /*
  * Some mode bits are also used internally for computations.
  *
@@ -177,6 +185,7 @@ struct cache_entry {
 	unsigned int ce_flags;
 	unsigned int ce_namelen;
 	unsigned int index;	/* for link extension */
+	unsigned int mem_pool_allocated;
 	struct object_id oid;
 	char name[FLEX_ARRAY]; /* more */
 };
@@ -201,6 +210,7 @@ struct cache_entry {
 #define CE_ADDED             (1 << 19)
 
 #define CE_HASHED            (1 << 20)
+#define CE_FSMONITOR_VALID   (1 << 21)
 #define CE_WT_REMOVE         (1 << 22) /* remove in work directory */
 #define CE_CONFLICTED        (1 << 23)
 
@@ -245,6 +255,7 @@ static inline void copy_cache_entry(struct cache_entry *dst,
 				    const struct cache_entry *src)
 {
 	unsigned int state = dst->ce_flags & CE_HASHED;
+	int mem_pool_allocated = dst->mem_pool_allocated;
 
 	/* Don't copy hash chain and name */
 	memcpy(&dst->ce_stat_data, &src->ce_stat_data,
@@ -253,6 +264,9 @@ static inline void copy_cache_entry(struct cache_entry *dst,
 
 	/* Restore the hash state */
 	dst->ce_flags = (dst->ce_flags & ~CE_HASHED) | state;
+
+	/* Restore the mem_pool_allocated flag */
+	dst->mem_pool_allocated = mem_pool_allocated;
 }
 
 static inline unsigned create_ce_flags(unsigned stage)
@@ -324,9 +338,13 @@ static inline unsigned int canon_mode(unsigned int mode)
 #define CACHE_TREE_CHANGED	(1 << 5)
 #define SPLIT_INDEX_ORDERED	(1 << 6)
 #define UNTRACKED_CHANGED	(1 << 7)
+#define FSMONITOR_CHANGED	(1 << 8)
 
 struct split_index;
 struct untracked_cache;
+struct ewah_bitmap;
+
+struct mem_pool;
 
 struct index_state {
 	struct cache_entry **cache;
@@ -337,16 +355,26 @@ struct index_state {
 	struct split_index *split_index;
 	struct cache_time timestamp;
 	unsigned name_hash_initialized : 1,
-		 initialized : 1;
+		 initialized : 1,
+		 fsmonitor_has_run_once : 1,
+		 sparse_index : 1;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	unsigned char sha1[20];
 	struct untracked_cache *untracked;
+	uint64_t fsmonitor_last_update;
+	struct ewah_bitmap *fsmonitor_dirty;
+	struct mem_pool *ce_mem_pool;
 };
 
 extern struct index_state the_index;
 
 /* Name hashing */
+/*
+ * Build the name hash now rather than on the first lookup, so that
+ * threads can then look names up concurrently.
+ */
+extern void lazy_init_name_hash(struct index_state *istate);
 extern int test_lazy_init_name_hash(struct index_state *istate, int try_threaded);
 extern void add_name_hash(struct index_state *istate, struct cache_entry *ce);
 extern void remove_name_hash(struct index_state *istate, struct cache_entry *ce);
@@ -441,6 +469,8 @@ static inline enum object_type object_type(unsigned int mode)
 #define GIT_NOGLOB_PATHSPECS_ENVIRONMENT "GIT_NOGLOB_PATHSPECS"
 #define GIT_ICASE_PATHSPECS_ENVIRONMENT "GIT_ICASE_PATHSPECS"
 #define GIT_QUARANTINE_ENVIRONMENT "GIT_QUARANTINE_PATH"
+#define GIT_DEFAULT_REF_FORMAT_ENVIRONMENT "GIT_DEFAULT_REF_FORMAT"
+#define GIT_PROTOCOL_ENVIRONMENT "GIT_PROTOCOL"
 
 /*
  * This environment variable is expected to contain a boolean indicating
@@ -621,8 +651,17 @@ extern struct cache_entry *index_file_exists(struct index_state *istate, const c
  * index_name_pos(&index, "e", 1) -> -3
  * index_name_pos(&index, "f", 1) -> -3
  * index_name_pos(&index, "g", 1) -> -5
+ *
+ * If the index is sparse and the name is inside one of its sparse
+ * directories, the index is expanded to a full one first.
+ */
+extern int index_name_pos(struct index_state *, const char *name, int namelen);
+
+/*
+ * Like index_name_pos(), but never expands a sparse index: a name
+ * inside a sparse directory is simply not found.
  */
-extern int index_name_pos(const struct index_state *, const char *name, int namelen);
+extern int index_name_pos_sparse(const struct index_state *, const char *name, int namelen);
 
 #define ADD_CACHE_OK_TO_ADD 1		/* Ok to add */
 #define ADD_CACHE_OK_TO_REPLACE 2	/* Ok to replace file/directory */
@@ -655,7 +694,27 @@ extern int remove_file_from_index(struct index_state *, const char *path);
 extern int add_to_index(struct index_state *, const char *path, struct stat *, int flags);
 extern int add_file_to_index(struct index_state *, const char *path, int flags);
 
-extern struct cache_entry *make_cache_entry(unsigned int mode, const unsigned char *sha1, const char *path, int stage, unsigned int refresh_options);
+/*
+ * Cache entries that are added to an index are allocated from the
+ * memory pool of that index, and go away with it in discard_index().
+ * Entries that are only used on their own (e.g. to check out a single
+ * file) are "transient" and allocated individually. Either kind is
+ * released with discard_cache_entry(), which only frees the latter.
+ */
+extern struct cache_entry *make_empty_cache_entry(struct index_state *istate, size_t name_len);
+extern struct cache_entry *make_empty_transient_cache_entry(size_t name_len);
+extern struct cache_entry *make_cache_entry(struct index_state *istate, unsigned int mode, const unsigned char *sha1, const char *path, int stage, unsigned int refresh_options);
+extern struct cache_entry *make_transient_cache_entry(unsigned int mode, const unsigned char *sha1, const char *path, int stage);
+extern struct cache_entry *dup_cache_entry(const struct cache_entry *ce, struct index_state *istate);
+extern void discard_cache_entry(struct cache_entry *ce);
+
+/*
+ * With GIT_TEST_VALIDATE_INDEX_CACHE_ENTRIES set, discard_index()
+ * checks that all the entries of the index come from its memory pool,
+ * and overwrites the pool before freeing it, so that an entry that
+ * outlives its index is more likely to be noticed.
+ */
+extern int should_validate_cache_entries(void);
 extern int chmod_index_entry(struct index_state *, struct cache_entry *ce, char flip);
 extern int ce_same_name(const struct cache_entry *a, const struct cache_entry *b);
 extern void set_object_name_for_intent_to_add_entry(struct cache_entry *ce);
@@ -705,7 +764,7 @@ extern void fill_stat_cache_info(struct cache_entry *ce, struct stat *st);
 #define REFRESH_IGNORE_SUBMODULES	0x0010	/* ignore submodules */
 #define REFRESH_IN_PORCELAIN	0x0020	/* user friendly output, not "needs update" */
 extern int refresh_index(struct index_state *, unsigned int flags, const struct pathspec *pathspec, char *seen, const char *header_msg);
-extern struct cache_entry *refresh_cache_entry(struct cache_entry *, unsigned int);
+extern struct cache_entry *refresh_cache_entry(struct index_state *, struct cache_entry *, unsigned int);
 
 extern void update_index_if_able(struct index_state *, struct lock_file *);
 
@@ -762,7 +821,15 @@ extern char *git_replace_ref_base;
 
 extern int fsync_object_files;
 extern int core_preload_index;
+extern const char *core_fsmonitor;
 extern int core_apply_sparse_checkout;
+
+/*
+ * Commands that can work with the directory entries of a sparse index
+ * clear this before reading the index; for all others, a sparse index
+ * is expanded to a full one as it is read.
+ */
+extern int command_requires_full_index;
 extern int precomposed_unicode;
 extern int protect_hfs;
 extern int protect_ntfs;
@@ -851,6 +918,7 @@ extern int repository_format_precious_objects;
 struct repository_format {
 	int version;
 	int precious_objects;
+	char *ref_storage;
 	int is_bare;
 	char *work_tree;
 	struct string_list unknown_extensions;
@@ -1227,6 +1295,12 @@ static inline void *read_sha1_file(const unsigned char *sha1, enum object_type *
  */
 extern const unsigned char *do_lookup_replace_object(const unsigned char *sha1);
 
+/*
+ * Return true if replace references are in effect for this run and at
+ * least one object is replaced.
+ */
+extern int replace_objects_present(void);
+
 /*
  * If object sha1 should be replaced, return the replacement object's
  * name (replaced recursively, if necessary).  The return value is
@@ -1252,6 +1326,17 @@ extern int sha1_object_info(const unsigned char *, unsigned long *);
 extern int hash_sha1_file(const void *buf, unsigned long len, const char *type, unsigned char *sha1);
 extern int write_sha1_file(const void *buf, unsigned long len, const char *type, unsigned char *return_sha1);
 extern int hash_sha1_file_literally(const void *buf, unsigned long len, const char *type, unsigned char *sha1, unsigned flags);
+
+/*
+ * freshen_object() tells whether the object database already has the
+ * object, updating its mtime so that it is not pruned, as
+ * write_sha1_file() does before writing one. write_loose_sha1_file()
+ * writes an object whose name the caller already computed as a loose
+ * object, and unlike the rest of this API can be called from several
+ * threads at once.
+ */
+extern int freshen_object(const unsigned char *sha1);
+extern int write_loose_sha1_file(const unsigned char *sha1, const char *type, const void *buf, unsigned long len);
 extern int pretend_sha1_file(void *, unsigned long, enum object_type, unsigned char *);
 extern int force_object_loose(const unsigned char *sha1, time_t mtime);
 extern int git_open_cloexec(const char *name, int flags);
@@ -1652,9 +1737,13 @@ extern struct packed_git {
 	unsigned pack_local:1,
 		 pack_keep:1,
 		 freshened:1,
-		 do_not_close:1;
+		 do_not_close:1,
+		 multi_pack_index:1;
 	unsigned char sha1[20];
 	struct revindex_entry *revindex;
+	const uint32_t *revindex_data;
+	const void *revindex_map;
+	size_t revindex_size;
 	/* something like ".git/objects/pack/xxxxx.pack" */
 	char pack_name[FLEX_ARRAY]; /* more */
 } *packed_git;
@@ -2056,6 +2145,12 @@ extern int git_config_get_maybe_bool(const char *key, int *dest);
 extern int git_config_get_pathname(const char *key, const char **dest);
 extern int git_config_get_untracked_cache(void);
 extern int git_config_get_split_index(void);
+extern int git_config_get_fsmonitor(void);
+extern int git_config_get_sparse_index(void);
+extern int git_config_get_index_threads(void);
+extern int git_config_get_untracked_threads(void);
+extern int git_config_get_hash_threads(void);
+extern int git_config_get_write_rev_index(void);
 extern int git_config_get_max_percent_split_change(void);
 
 /* This dies if the configured or default date is in the future */
@@ -2150,6 +2245,8 @@ extern void *alloc_tag_node(void);
 extern void *alloc_object_node(void);
 extern void alloc_report(void);
 extern unsigned int alloc_commit_index(void);
+struct commit;
+extern void init_commit_node(struct commit *c);
 
 /* pkt-line.c */
 void packet_trace_identity(const char *prog);
@@ -0,0 +1,827 @@
+#include "cache.h"
+#include "lockfile.h"
+#include "csum-file.h"
+#include "refs.h"
+#include "tag.h"
+#include "sha1-array.h"
+#include "bloom.h"
+#include "commit-graph.h"
+
+#define GRAPH_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
+#define GRAPH_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
+#define GRAPH_CHUNKID_DATA 0x43444154 /* "CDAT" */
+#define GRAPH_CHUNKID_EXTRAEDGES 0x45444745 /* "EDGE" */
+#define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
+#define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
+#define GRAPH_MAX_CHUNKS 6
+
+#define GRAPH_HEADER_SIZE 8
+#define GRAPH_CHUNKLOOKUP_WIDTH 12
+#define GRAPH_FANOUT_SIZE (4 * 256)
+#define GRAPH_DATA_WIDTH (GIT_SHA1_RAWSZ + 16)
+#define GRAPH_BLOOM_DATA_HEADER_SIZE 12
+
+#define GRAPH_PARENT_NONE 0x70000000
+#define GRAPH_OCTOPUS_EDGES_NEEDED 0x80000000
+#define GRAPH_EDGE_LAST_MASK 0x7fffffff
+#define GRAPH_LAST_EDGE 0x80000000
+
+/* Marks commits already queued while writing a commit-graph. */
+#define GRAPH_SEEN (1u<<15)
+
+static struct commit_graph *commit_graph;
+
+char *get_commit_graph_filename(const char *obj_dir)
+{
+	return xstrfmt("%s/info/commit-graph", obj_dir);
+}
+
+struct commit_graph *load_commit_graph_one(const char *graph_file)
+{
+	struct commit_graph *g;
+	size_t chunk_size[GRAPH_MAX_CHUNKS + 1] = { 0 };
+	const unsigned char *data;
+	size_t graph_size;
+	void *graph_map;
+	struct stat st;
+	uint32_t i, nr_chunks;
+	int fd;
+
+	fd = git_open(graph_file);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			error_errno(_("unable to open %s"), graph_file);
+		return NULL;
+	}
+	if (fstat(fd, &st)) {
+		error_errno(_("unable to stat %s"), graph_file);
+		close(fd);
+		return NULL;
+	}
+	graph_size = xsize_t(st.st_size);
+	if (graph_size < GRAPH_HEADER_SIZE + GIT_SHA1_RAWSZ) {
+		error(_("commit-graph file %s is too small"), graph_file);
+		close(fd);
+		return NULL;
+	}
+	graph_map = xmmap(NULL, graph_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	g = xcalloc(1, sizeof(*g));
+	g->data = data = graph_map;
+	g->data_len = graph_size;
+
+	if (get_be32(data) != GRAPH_SIGNATURE) {
+		error(_("commit-graph signature 0x%08x does not match signature 0x%08x"),
+		      get_be32(data), GRAPH_SIGNATURE);
+		goto cleanup_fail;
+	}
+	if (data[4] != GRAPH_VERSION) {
+		error(_("commit-graph version %d not recognized"), data[4]);
+		goto cleanup_fail;
+	}
+	if (data[5] != GRAPH_OID_VERSION) {
+		error(_("commit-graph hash version %d not recognized"), data[5]);
+		goto cleanup_fail;
+	}
+	nr_chunks = data[6];
+
+	if (GRAPH_HEADER_SIZE + (nr_chunks + 1) * GRAPH_CHUNKLOOKUP_WIDTH +
+	    GIT_SHA1_RAWSZ > graph_size) {
+		error(_("commit-graph file %s is too small"), graph_file);
+		goto cleanup_fail;
+	}
+
+	for (i = 0; i < nr_chunks; i++) {
+		const unsigned char *row = data + GRAPH_HEADER_SIZE +
+					   i * GRAPH_CHUNKLOOKUP_WIDTH;
+		uint32_t chunk_id = get_be32(row);
+		uint64_t chunk_offset = get_be64(row + 4);
+		uint64_t next_offset = get_be64(row + GRAPH_CHUNKLOOKUP_WIDTH + 4);
+		const unsigned char *chunk = data + chunk_offset;
+		int slot;
+
+		if (chunk_offset > next_offset ||
+		    next_offset > graph_size - GIT_SHA1_RAWSZ) {
+			error(_("commit-graph %s has improper chunk offset"),
+			      graph_file);
+			goto cleanup_fail;
+		}
+
+		switch (chunk_id) {
+		case GRAPH_CHUNKID_OIDFANOUT:
+			g->chunk_oid_fanout = (const uint32_t *)chunk;
+			slot = 0;
+			break;
+		case GRAPH_CHUNKID_OIDLOOKUP:
+			g->chunk_oid_lookup = chunk;
+			slot = 1;
+			break;
+		case GRAPH_CHUNKID_DATA:
+			g->chunk_commit_data = chunk;
+			slot = 2;
+			break;
+		case GRAPH_CHUNKID_EXTRAEDGES:
+			g->chunk_extra_edges = chunk;
+			g->chunk_extra_edges_len = next_offset - chunk_offset;
+			slot = 3;
+			break;
+		case GRAPH_CHUNKID_BLOOMINDEXES:
+			g->chunk_bloom_indexes = chunk;
+			slot = 4;
+			break;
+		case GRAPH_CHUNKID_BLOOMDATA:
+			g->chunk_bloom_data = chunk;
+			g->chunk_bloom_data_len = next_offset - chunk_offset;
+			slot = 5;
+			break;
+		case 0:
+			error(_("commit-graph %s has terminating chunk id too early"),
+			      graph_file);
+			goto cleanup_fail;
+		default:
+			/* Unknown chunks are ignored for forward compatibility. */
+			slot = GRAPH_MAX_CHUNKS;
+			break;
+		}
+		chunk_size[slot] = next_offset - chunk_offset;
+	}
+
+	if (!g->chunk_oid_fanout || !g->chunk_oid_lookup ||
+	    !g->chunk_commit_data) {
+		error(_("commit-graph %s is missing a required chunk"),
+		      graph_file);
+		goto cleanup_fail;
+	}
+	if (chunk_size[0] != GRAPH_FANOUT_SIZE) {
+		error(_("commit-graph %s has a bad OID fanout"), graph_file);
+		goto cleanup_fail;
+	}
+	for (i = 0; i < 256; i++) {
+		uint32_t n = ntohl(g->chunk_oid_fanout[i]);
+		if (n < g->num_commits) {
+			error(_("commit-graph %s has non-monotonic fanout"),
+			      graph_file);
+			goto cleanup_fail;
+		}
+		g->num_commits = n;
+	}
+	if (chunk_size[1] != st_mult(g->num_commits, GIT_SHA1_RAWSZ) ||
+	    chunk_size[2] != st_mult(g->num_commits, GRAPH_DATA_WIDTH)) {
+		error(_("commit-graph %s has wrong commit table sizes"),
+		      graph_file);
+		goto cleanup_fail;
+	}
+
+	/*
+	 * Bloom filters are only an optimization: ignore them, rather
+	 * than the whole file, if they cannot be used.
+	 */
+	if (g->chunk_bloom_indexes && g->chunk_bloom_data &&
+	    chunk_size[4] == st_mult(g->num_commits, 4) &&
+	    chunk_size[5] >= GRAPH_BLOOM_DATA_HEADER_SIZE &&
+	    get_be32(g->chunk_bloom_data) == 1) {
+		g->bloom_filter_settings = xmalloc(sizeof(*g->bloom_filter_settings));
+		g->bloom_filter_settings->hash_version = get_be32(g->chunk_bloom_data);
+		g->bloom_filter_settings->num_hashes = get_be32(g->chunk_bloom_data + 4);
+		g->bloom_filter_settings->bits_per_entry = get_be32(g->chunk_bloom_data + 8);
+	} else {
+		g->chunk_bloom_indexes = NULL;
+		g->chunk_bloom_data = NULL;
+		g->chunk_bloom_data_len = 0;
+	}
+
+	return g;
+
+cleanup_fail:
+	close_commit_graph(g);
+	return NULL;
+}
+
+void close_commit_graph(struct commit_graph *g)
+{
+	if (!g)
+		return;
+	munmap((void *)g->data, g->data_len);
+	free(g->bloom_filter_settings);
+	free(g);
+}
+
+static int commit_graph_compatible(void)
+{
+	return !commit_grafts_present() && !replace_objects_present();
+}
+
+static int prepare_alt_commit_graph(struct alternate_object_database *alt,
+				    void *data)
+{
+	char *graph_name;
+
+	if (commit_graph)
+		return 1;
+	graph_name = get_commit_graph_filename(alt->path);
+	commit_graph = load_commit_graph_one(graph_name);
+	free(graph_name);
+	return !!commit_graph;
+}
+
+/*
+ * Load the commit-graph of the repository, or failing that the first
+ * one found among the alternates.  Returns the graph, or NULL if
+ * there is none or it must not be used.
+ */
+static struct commit_graph *prepare_commit_graph(void)
+{
+	static int prepared, enabled;
+	char *graph_name;
+
+	if (!prepared) {
+		prepared = 1;
+		if (git_config_get_bool("core.commitgraph", &enabled) ||
+		    !enabled || !commit_graph_compatible()) {
+			enabled = 0;
+			return NULL;
+		}
+
+		graph_name = get_commit_graph_filename(get_object_directory());
+		commit_graph = load_commit_graph_one(graph_name);
+		free(graph_name);
+		if (!commit_graph)
+			foreach_alt_odb(prepare_alt_commit_graph, NULL);
+	}
+
+	/* A shallow fetch may register new grafts at any time. */
+	if (!enabled || commit_grafts_present())
+		return NULL;
+	return commit_graph;
+}
+
+static int bsearch_graph(struct commit_graph *g, const struct object_id *oid,
+			 uint32_t *pos)
+{
+	uint32_t lo, hi;
+
+	hi = ntohl(g->chunk_oid_fanout[oid->hash[0]]);
+	lo = oid->hash[0] ? ntohl(g->chunk_oid_fanout[oid->hash[0] - 1]) : 0;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(g->chunk_oid_lookup + mi * GIT_SHA1_RAWSZ,
+				  oid->hash);
+
+		if (!cmp) {
+			*pos = mi;
+			return 1;
+		}
+		if (cmp > 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+static struct commit_list **insert_parent_or_die(struct commit_graph *g,
+						 uint32_t pos,
+						 struct commit_list **pptr)
+{
+	struct commit *c;
+	struct object_id oid;
+
+	if (pos >= g->num_commits)
+		die(_("invalid parent position %"PRIu32" in commit-graph"), pos);
+
+	hashcpy(oid.hash, g->chunk_oid_lookup + GIT_SHA1_RAWSZ * pos);
+	c = lookup_commit(&oid);
+	if (!c)
+		die(_("could not find commit %s"), oid_to_hex(&oid));
+	c->graph_pos = pos;
+	return &commit_list_insert(c, pptr)->next;
+}
+
+static int fill_commit_in_graph(struct commit *item, struct commit_graph *g,
+				uint32_t pos)
+{
+	const unsigned char *commit_data = g->chunk_commit_data +
+					   GRAPH_DATA_WIDTH * pos;
+	struct commit_list **pptr;
+	struct object_id tree_oid;
+	uint32_t edge_value;
+	uint64_t date_high, date_low;
+
+	item->object.parsed = 1;
+	item->graph_pos = pos;
+
+	hashcpy(tree_oid.hash, commit_data);
+	item->tree = lookup_tree(&tree_oid);
+
+	pptr = &item->parents;
+
+	edge_value = get_be32(commit_data + GIT_SHA1_RAWSZ);
+	if (edge_value == GRAPH_PARENT_NONE)
+		goto done;
+	pptr = insert_parent_or_die(g, edge_value, pptr);
+
+	edge_value = get_be32(commit_data + GIT_SHA1_RAWSZ + 4);
+	if (edge_value == GRAPH_PARENT_NONE)
+		goto done;
+	if (!(edge_value & GRAPH_OCTOPUS_EDGES_NEEDED)) {
+		pptr = insert_parent_or_die(g, edge_value, pptr);
+		goto done;
+	}
+
+	edge_value &= GRAPH_EDGE_LAST_MASK;
+	do {
+		const unsigned char *edge;
+
+		if (st_mult(edge_value + 1, 4) > g->chunk_extra_edges_len)
+			die(_("commit-graph extra edge out of bounds for %s"),
+			    oid_to_hex(&item->object.oid));
+		edge = g->chunk_extra_edges + 4 * edge_value;
+		pptr = insert_parent_or_die(g, get_be32(edge) & GRAPH_EDGE_LAST_MASK,
+					    pptr);
+		edge_value++;
+		if (get_be32(edge) & GRAPH_LAST_EDGE)
+			break;
+	} while (1);
+
+done:
+	date_high = get_be32(commit_data + GIT_SHA1_RAWSZ + 8) & 0x3;
+	date_low = get_be32(commit_data + GIT_SHA1_RAWSZ + 12);
+	item->date = (timestamp_t)((date_high << 32) | date_low);
+	item->generation = get_be32(commit_data + GIT_SHA1_RAWSZ + 8) >> 2;
+	return 1;
+}
+
+int parse_commit_in_graph(struct commit *item)
+{
+	struct commit_graph *g;
+	uint32_t pos;
+
+	if (item->object.parsed)
+		return 1;
+
+	g = prepare_commit_graph();
+	if (!g)
+		return 0;
+
+	if (item->graph_pos != COMMIT_NOT_FROM_GRAPH)
+		pos = item->graph_pos;
+	else if (!bsearch_graph(g, &item->object.oid, &pos))
+		return 0;
+	return fill_commit_in_graph(item, g, pos);
+}
+
+void load_commit_graph_info(struct commit *item)
+{
+	struct commit_graph *g;
+	const unsigned char *commit_data;
+	uint32_t pos;
+
+	g = prepare_commit_graph();
+	if (!g)
+		return;
+	if (item->graph_pos != COMMIT_NOT_FROM_GRAPH)
+		pos = item->graph_pos;
+	else if (!bsearch_graph(g, &item->object.oid, &pos))
+		return;
+
+	commit_data = g->chunk_commit_data + GRAPH_DATA_WIDTH * pos;
+	item->graph_pos = pos;
+	item->generation = get_be32(commit_data + GIT_SHA1_RAWSZ + 8) >> 2;
+}
+
+int generation_numbers_enabled(void)
+{
+	return !!prepare_commit_graph();
+}
+
+const struct bloom_filter_settings *commit_graph_bloom_settings(void)
+{
+	struct commit_graph *g = prepare_commit_graph();
+
+	return g ? g->bloom_filter_settings : NULL;
+}
+
+int load_bloom_filter_from_graph(struct commit *c, struct bloom_filter *filter)
+{
+	struct commit_graph *g = prepare_commit_graph();
+	uint32_t start = 0, end;
+
+	if (!g || !g->bloom_filter_settings)
+		return 0;
+	load_commit_graph_info(c);
+	if (c->graph_pos == COMMIT_NOT_FROM_GRAPH)
+		return 0;
+
+	end = get_be32(g->chunk_bloom_indexes + 4 * c->graph_pos);
+	if (c->graph_pos)
+		start = get_be32(g->chunk_bloom_indexes + 4 * (c->graph_pos - 1));
+	if (start > end ||
+	    end > g->chunk_bloom_data_len - GRAPH_BLOOM_DATA_HEADER_SIZE)
+		return 0;
+
+	filter->data = (unsigned char *)g->chunk_bloom_data +
+		       GRAPH_BLOOM_DATA_HEADER_SIZE + start;
+	filter->len = end - start;
+	return 1;
+}
+
+struct packed_commit_list {
+	struct commit **list;
+	int nr;
+	int alloc;
+};
+
+static void add_commit_to_list(struct packed_commit_list *commits,
+			       struct commit *c)
+{
+	if (c->object.flags & GRAPH_SEEN)
+		return;
+	c->object.flags |= GRAPH_SEEN;
+	ALLOC_GROW(commits->list, commits->nr + 1, commits->alloc);
+	commits->list[commits->nr++] = c;
+}
+
+static int commit_compare(const void *a_, const void *b_)
+{
+	const struct commit *a = *(const struct commit **)a_;
+	const struct commit *b = *(const struct commit **)b_;
+	return oidcmp(&a->object.oid, &b->object.oid);
+}
+
+static uint32_t commit_pos(struct commit **commits, int nr,
+			   const struct object_id *oid)
+{
+	int lo = 0, hi = nr;
+
+	while (lo < hi) {
+		int mi = lo + (hi - lo) / 2;
+		int cmp = oidcmp(&commits[mi]->object.oid, oid);
+
+		if (!cmp)
+			return mi;
+		if (cmp > 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	die("BUG: commit %s missing from commit-graph closure",
+	    oid_to_hex(oid));
+}
+
+/*
+ * Compute generation numbers without recursion: a commit is finished
+ * once all of its parents are, so keep a stack of commits waiting on
+ * unfinished parents.
+ */
+static void compute_generation_numbers(struct commit **commits, int nr,
+				       uint32_t *generation)
+{
+	int *stack = NULL;
+	int stack_nr = 0, stack_alloc = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (generation[i])
+			continue;
+
+		ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+		stack[stack_nr++] = i;
+
+		while (stack_nr) {
+			int cur = stack[stack_nr - 1];
+			struct commit_list *parent;
+			uint32_t max_generation = 0;
+			int all_parents_done = 1;
+
+			for (parent = commits[cur]->parents; parent; parent = parent->next) {
+				int pos = commit_pos(commits, nr,
+						     &parent->item->object.oid);
+
+				if (!generation[pos]) {
+					all_parents_done = 0;
+					ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+					stack[stack_nr++] = pos;
+				} else if (generation[pos] > max_generation)
+					max_generation = generation[pos];
+			}
+
+			if (all_parents_done) {
+				stack_nr--;
+				if (max_generation >= GENERATION_NUMBER_MAX)
+					max_generation = GENERATION_NUMBER_MAX - 1;
+				generation[cur] = max_generation + 1;
+			}
+		}
+	}
+	free(stack);
+}
+
+static void write_graph_chunk_fanout(struct sha1file *f,
+				     struct commit **commits, int nr)
+{
+	int i, count = 0;
+
+	for (i = 0; i < 256; i++) {
+		while (count < nr && commits[count]->object.oid.hash[0] == i)
+			count++;
+		sha1write_be32(f, count);
+	}
+}
+
+static void write_graph_chunk_data(struct sha1file *f,
+				   struct commit **commits, int nr,
+				   const uint32_t *generation)
+{
+	uint32_t num_extra_edges = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct commit *c = commits[i];
+		struct commit_list *parent = c->parents;
+		uint64_t date = c->date;
+
+		if (!c->tree)
+			die(_("unable to get tree for %s"),
+			    oid_to_hex(&c->object.oid));
+		sha1write(f, c->tree->object.oid.hash, GIT_SHA1_RAWSZ);
+
+		if (!parent)
+			sha1write_be32(f, GRAPH_PARENT_NONE);
+		else {
+			sha1write_be32(f, commit_pos(commits, nr,
+						     &parent->item->object.oid));
+			parent = parent->next;
+		}
+
+		if (!parent)
+			sha1write_be32(f, GRAPH_PARENT_NONE);
+		else if (!parent->next)
+			sha1write_be32(f, commit_pos(commits, nr,
+						     &parent->item->object.oid));
+		else {
+			sha1write_be32(f, GRAPH_OCTOPUS_EDGES_NEEDED | num_extra_edges);
+			for (; parent; parent = parent->next)
+				num_extra_edges++;
+		}
+
+		sha1write_be32(f, generation[i] << 2 | (uint32_t)((date >> 32) & 0x3));
+		sha1write_be32(f, (uint32_t)date);
+	}
+}
+
+static void write_graph_chunk_extra_edges(struct sha1file *f,
+					  struct commit **commits, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct commit_list *parent = commits[i]->parents;
+
+		/* only octopus merges need extra edges */
+		if (!parent || !parent->next || !parent->next->next)
+			continue;
+
+		for (parent = parent->next; parent; parent = parent->next) {
+			uint32_t pos = commit_pos(commits, nr,
+						  &parent->item->object.oid);
+			if (!parent->next)
+				pos |= GRAPH_LAST_EDGE;
+			sha1write_be32(f, pos);
+		}
+	}
+}
+
+static void write_graph_chunk_bloom_indexes(struct sha1file *f,
+					    struct bloom_filter *filters, int nr)
+{
+	uint32_t offset = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		offset += filters[i].len;
+		sha1write_be32(f, offset);
+	}
+}
+
+static void write_graph_chunk_bloom_data(struct sha1file *f,
+					 struct bloom_filter *filters, int nr,
+					 const struct bloom_filter_settings *settings)
+{
+	int i;
+
+	sha1write_be32(f, settings->hash_version);
+	sha1write_be32(f, settings->num_hashes);
+	sha1write_be32(f, settings->bits_per_entry);
+	for (i = 0; i < nr; i++)
+		sha1write(f, filters[i].data, filters[i].len);
+}
+
+/*
+ * Compute the changed-path Bloom filters of all commits.  Returns the
+ * total size of the filters, or 0 (and no filters) if they would not
+ * fit the 32-bit offsets of the file format.
+ */
+static uint64_t compute_bloom_filters(struct commit **commits, int nr,
+				      const struct bloom_filter_settings *settings,
+				      struct bloom_filter **filters_p)
+{
+	struct bloom_filter *filters;
+	uint64_t total = 0;
+	int i;
+
+	filters = xcalloc(nr, sizeof(*filters));
+	for (i = 0; i < nr; i++) {
+		compute_bloom_filter(commits[i], &filters[i], settings);
+		total += filters[i].len;
+	}
+
+	if (total > 0xffffffff) {
+		warning(_("changed-path Bloom filters too large; not writing them"));
+		for (i = 0; i < nr; i++)
+			free(filters[i].data);
+		free(filters);
+		return 0;
+	}
+	*filters_p = filters;
+	return total;
+}
+
+static uint32_t count_extra_edges(struct commit **commits, int nr)
+{
+	uint32_t count = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct commit_list *parent = commits[i]->parents;
+
+		if (!parent || !parent->next || !parent->next->next)
+			continue;
+		for (parent = parent->next; parent; parent = parent->next)
+			count++;
+	}
+	return count;
+}
+
+int write_commit_graph(const char *obj_dir, struct oid_array *commits_in,
+		       int flags)
+{
+	static struct lock_file lk;
+	struct packed_commit_list commits = { NULL, 0, 0 };
+	struct bloom_filter_settings bloom_settings = DEFAULT_BLOOM_FILTER_SETTINGS;
+	struct bloom_filter *bloom_filters = NULL;
+	uint64_t bloom_data_len = 0;
+	uint32_t chunk_ids[GRAPH_MAX_CHUNKS + 1];
+	uint64_t chunk_sizes[GRAPH_MAX_CHUNKS];
+	uint64_t chunk_offsets[GRAPH_MAX_CHUNKS + 1];
+	uint32_t *generation;
+	uint32_t num_extra_edges, num_chunks;
+	struct commit_graph *old;
+	struct sha1file *f;
+	char *graph_name;
+	int i, j;
+
+	if (!commit_graph_compatible())
+		return 0;
+
+	graph_name = get_commit_graph_filename(obj_dir);
+	old = load_commit_graph_one(graph_name);
+	free(graph_name);
+	if (old) {
+		if (old->bloom_filter_settings)
+			flags |= COMMIT_GRAPH_CHANGED_PATHS;
+		for (i = 0; (flags & COMMIT_GRAPH_APPEND) && i < old->num_commits; i++) {
+			struct object_id oid;
+			hashcpy(oid.hash, old->chunk_oid_lookup +
+				i * GIT_SHA1_RAWSZ);
+			oid_array_append(commits_in, &oid);
+		}
+		close_commit_graph(old);
+	}
+
+	for (i = 0; i < commits_in->nr; i++) {
+		struct commit *c;
+
+		c = lookup_commit_reference_gently(&commits_in->oid[i], 1);
+		if (!c || parse_commit(c))
+			continue;
+		add_commit_to_list(&commits, c);
+	}
+
+	/* Close the list under taking parents. */
+	for (i = 0; i < commits.nr; i++) {
+		struct commit_list *parent;
+
+		for (parent = commits.list[i]->parents; parent; parent = parent->next) {
+			if (parse_commit(parent->item))
+				die(_("unable to parse commit %s"),
+				    oid_to_hex(&parent->item->object.oid));
+			add_commit_to_list(&commits, parent->item);
+		}
+	}
+	for (i = 0; i < commits.nr; i++)
+		commits.list[i]->object.flags &= ~GRAPH_SEEN;
+
+	QSORT(commits.list, commits.nr, commit_compare);
+
+	generation = xcalloc(commits.nr, sizeof(*generation));
+	compute_generation_numbers(commits.list, commits.nr, generation);
+	num_extra_edges = count_extra_edges(commits.list, commits.nr);
+
+	if (flags & COMMIT_GRAPH_CHANGED_PATHS)
+		bloom_data_len = compute_bloom_filters(commits.list, commits.nr,
+						       &bloom_settings,
+						       &bloom_filters);
+
+	num_chunks = 0;
+	chunk_ids[num_chunks] = GRAPH_CHUNKID_OIDFANOUT;
+	chunk_sizes[num_chunks++] = GRAPH_FANOUT_SIZE;
+	chunk_ids[num_chunks] = GRAPH_CHUNKID_OIDLOOKUP;
+	chunk_sizes[num_chunks++] = (uint64_t)commits.nr * GIT_SHA1_RAWSZ;
+	chunk_ids[num_chunks] = GRAPH_CHUNKID_DATA;
+	chunk_sizes[num_chunks++] = (uint64_t)commits.nr * GRAPH_DATA_WIDTH;
+	if (num_extra_edges) {
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_EXTRAEDGES;
+		chunk_sizes[num_chunks++] = 4 * (uint64_t)num_extra_edges;
+	}
+	if (bloom_filters) {
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_BLOOMINDEXES;
+		chunk_sizes[num_chunks++] = 4 * (uint64_t)commits.nr;
+		chunk_ids[num_chunks] = GRAPH_CHUNKID_BLOOMDATA;
+		chunk_sizes[num_chunks++] = GRAPH_BLOOM_DATA_HEADER_SIZE +
+					    bloom_data_len;
+	}
+	chunk_ids[num_chunks] = 0;
+
+	chunk_offsets[0] = GRAPH_HEADER_SIZE +
+			   (num_chunks + 1) * GRAPH_CHUNKLOOKUP_WIDTH;
+	for (i = 0; i < num_chunks; i++)
+		chunk_offsets[i + 1] = chunk_offsets[i] + chunk_sizes[i];
+
+	graph_name = get_commit_graph_filename(obj_dir);
+	if (safe_create_leading_directories(graph_name))
+		die_errno(_("unable to create leading directories of %s"),
+			  graph_name);
+	hold_lock_file_for_update(&lk, graph_name, LOCK_DIE_ON_ERROR);
+	f = sha1fd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	sha1write_be32(f, GRAPH_SIGNATURE);
+	sha1write_u8(f, GRAPH_VERSION);
+	sha1write_u8(f, GRAPH_OID_VERSION);
+	sha1write_u8(f, num_chunks);
+	sha1write_u8(f, 0); /* unused padding byte */
+
+	for (i = 0; i <= num_chunks; i++) {
+		sha1write_be32(f, chunk_ids[i]);
+		sha1write_be32(f, chunk_offsets[i] >> 32);
+		sha1write_be32(f, chunk_offsets[i] & 0xffffffff);
+	}
+
+	write_graph_chunk_fanout(f, commits.list, commits.nr);
+	for (j = 0; j < commits.nr; j++)
+		sha1write(f, commits.list[j]->object.oid.hash, GIT_SHA1_RAWSZ);
+	write_graph_chunk_data(f, commits.list, commits.nr, generation);
+	if (num_extra_edges)
+		write_graph_chunk_extra_edges(f, commits.list, commits.nr);
+	if (bloom_filters) {
+		write_graph_chunk_bloom_indexes(f, bloom_filters, commits.nr);
+		write_graph_chunk_bloom_data(f, bloom_filters, commits.nr,
+					     &bloom_settings);
+	}
+
+	sha1close(f, NULL, CSUM_HASH_IN_STREAM);
+	if (commit_lock_file(&lk) < 0)
+		die_errno(_("unable to write '%s'"), graph_name);
+
+	free(graph_name);
+	free(generation);
+	if (bloom_filters) {
+		for (i = 0; i < commits.nr; i++)
+			free(bloom_filters[i].data);
+		free(bloom_filters);
+	}
+	free(commits.list);
+	return 0;
+}
+
+static int add_ref_to_list(const char *refname,
+			   const struct object_id *oid,
+			   int flags, void *cb_data)
+{
+	struct oid_array *list = cb_data;
+
+	oid_array_append(list, oid);
+	return 0;
+}
+
+int write_commit_graph_reachable(const char *obj_dir, int flags)
+{
+	struct oid_array list = OID_ARRAY_INIT;
+	int ret;
+
+	for_each_ref(add_ref_to_list, &list);
+	ret = write_commit_graph(obj_dir, &list, flags);
+	oid_array_clear(&list);
+	return ret;
+}
@@ -0,0 +1,111 @@
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include "commit.h"
+
+struct oid_array;
+struct bloom_filter;
+struct bloom_filter_settings;
+
+/*
+ * A commit-graph file records, for a set of commits closed under
+ * taking parents, the root tree, the parents (as positions within the
+ * file), the commit date and the generation number of each commit, so
+ * that parse_commit() can fill a commit without inflating and parsing
+ * the object.  See Documentation/technical/commit-graph-format.txt.
+ */
+
+#define GRAPH_SIGNATURE 0x43475048 /* "CGPH" */
+#define GRAPH_VERSION 1
+#define GRAPH_OID_VERSION 1 /* SHA-1 */
+
+struct commit_graph {
+	const unsigned char *data;
+	size_t data_len;
+
+	uint32_t num_commits;
+
+	const uint32_t *chunk_oid_fanout;
+	const unsigned char *chunk_oid_lookup;
+	const unsigned char *chunk_commit_data;
+	const unsigned char *chunk_extra_edges;
+	size_t chunk_extra_edges_len;
+
+	/* optional changed-path Bloom filters, see bloom.h */
+	const unsigned char *chunk_bloom_indexes;
+	const unsigned char *chunk_bloom_data;
+	size_t chunk_bloom_data_len;
+	struct bloom_filter_settings *bloom_filter_settings;
+};
+
+extern char *get_commit_graph_filename(const char *obj_dir);
+
+/*
+ * Map and check the commit-graph file at "graph_file".  Returns NULL
+ * if there is none or it cannot be used.
+ */
+extern struct commit_graph *load_commit_graph_one(const char *graph_file);
+extern void close_commit_graph(struct commit_graph *g);
+
+/*
+ * If core.commitGraph is enabled and "item" is in the commit-graph of
+ * the repository (or of one of its alternates), fill in its tree,
+ * parents, date and generation from there, mark it parsed and return 1.
+ * Otherwise return 0 and leave "item" for parse_commit_buffer().
+ *
+ * The commit-graph is not used at all while grafts, a shallow file or
+ * replace refs alter the history.
+ */
+extern int parse_commit_in_graph(struct commit *item);
+
+/*
+ * If "item" is in the commit-graph, record its position and generation
+ * number there.  Used for commits that are parsed from their object,
+ * so that reachability queries can still prune by generation number.
+ */
+extern void load_commit_graph_info(struct commit *item);
+
+/*
+ * Return 1 if a commit-graph is in use.  Commits in it have finite
+ * generation numbers and, as the graph is closed under taking parents,
+ * never have an ancestor outside of it, so generation numbers can be
+ * used to order a walk.
+ */
+extern int generation_numbers_enabled(void);
+
+/*
+ * The settings of the changed-path Bloom filters in the commit-graph in
+ * use, or NULL if there are no filters.
+ */
+extern const struct bloom_filter_settings *commit_graph_bloom_settings(void);
+
+/*
+ * Point "filter" at the changed-path Bloom filter of "c" in the
+ * commit-graph.  Returns 1 on success and 0 if there is no filter for
+ * "c".
+ */
+extern int load_bloom_filter_from_graph(struct commit *c,
+					struct bloom_filter *filter);
+
+#define COMMIT_GRAPH_APPEND        (1 << 0)
+#define COMMIT_GRAPH_CHANGED_PATHS (1 << 1)
+
+/*
+ * Write a commit-graph into "obj_dir" covering the commits named by
+ * "commits" (tags are peeled) and everything reachable from them.
+ *
+ * With COMMIT_GRAPH_APPEND in "flags", the commits of the existing
+ * commit-graph are kept.  With COMMIT_GRAPH_CHANGED_PATHS, or when the
+ * existing commit-graph has them, changed-path Bloom filters are
+ * computed and stored too.
+ *
+ * Returns 0 on success; nothing is written if grafts, a shallow file or
+ * replace refs alter the history.
+ */
+extern int write_commit_graph(const char *obj_dir, struct oid_array *commits,
+			      int flags);
+
+/* Like write_commit_graph(), starting from all refs. */
+extern int write_commit_graph_reachable(const char *obj_dir, int flags);
+
+#endif /* COMMIT_GRAPH_H */
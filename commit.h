@@ -13,6 +13,10 @@ struct commit_list {
 	struct commit_list *next;
 };
 
+#define COMMIT_NOT_FROM_GRAPH 0xFFFFFFFF
+#define GENERATION_NUMBER_INFINITY 0xFFFFFFFF
+#define GENERATION_NUMBER_MAX 0x3FFFFFFF
+
 struct commit {
 	struct object object;
 	void *util;
@@ -20,6 +24,16 @@ struct commit {
 	timestamp_t date;
 	struct commit_list *parents;
 	struct tree *tree;
+	/* position in the commit-graph, or COMMIT_NOT_FROM_GRAPH */
+	uint32_t graph_pos;
+	/*
+	 * 1 for root commits, otherwise one more than the largest
+	 * generation of the parents; GENERATION_NUMBER_INFINITY when
+	 * unknown because the commit is not in the commit-graph.  A commit
+	 * can only reach commits of strictly lower generation, except that
+	 * generations are capped at GENERATION_NUMBER_MAX.
+	 */
+	uint32_t generation;
 };
 
 extern int save_commit_buffer;
@@ -240,6 +254,17 @@ enum rev_sort_order {
  */
 void sort_in_topological_order(struct commit_list **, enum rev_sort_order);
 
+/*
+ * The author dates used by REV_SORT_BY_AUTHOR_DATE.  A user defines
+ * the slab with define_commit_slab(author_date_slab, timestamp_t),
+ * fills it with record_author_date() and passes it as the cb_data of
+ * compare_commits_by_author_date().
+ */
+struct author_date_slab;
+void record_author_date(struct author_date_slab *author_date,
+			struct commit *commit);
+int compare_commits_by_author_date(const void *a_, const void *b_, void *author_date);
+
 struct commit_graft {
 	struct object_id oid;
 	int nr_parent; /* < 0 if shallow commit */
@@ -250,6 +275,8 @@ typedef int (*each_commit_graft_fn)(const struct commit_graft *, void *);
 struct commit_graft *read_graft_line(char *buf, int len);
 int register_commit_graft(struct commit_graft *, int);
 struct commit_graft *lookup_commit_graft(const unsigned char *sha1);
+/* Do grafts or a shallow file alter the parents of some commits? */
+int commit_grafts_present(void);
 
 extern struct commit_list *get_merge_bases(struct commit *rev1, struct commit *rev2);
 extern struct commit_list *get_merge_bases_many(struct commit *one, int n, struct commit **twos);
@@ -393,6 +420,7 @@ extern int remove_signature(struct strbuf *buf);
 extern int check_commit_signature(const struct commit *commit, struct signature_check *sigc);
 
 int compare_commits_by_commit_date(const void *a_, const void *b_, void *unused);
+int compare_commits_by_gen_then_commit_date(const void *a_, const void *b_, void *unused);
 
 LAST_ARG_MUST_BE_NULL
 extern int run_commit_hook(int editor_is_used, const char *index_file, const char *name, ...);
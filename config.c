@@ -2022,6 +2022,97 @@ int git_config_get_split_index(void)
 	return -1; /* default value */
 }
 
+int git_config_get_sparse_index(void)
+{
+	int val;
+
+	if (!git_config_get_bool("index.sparse", &val))
+		return val;
+
+	return 0; /* default value */
+}
+
+int git_config_get_fsmonitor(void)
+{
+	if (git_config_get_pathname("core.fsmonitor", &core_fsmonitor))
+		core_fsmonitor = NULL;
+	if (core_fsmonitor && !*core_fsmonitor)
+		core_fsmonitor = NULL;
+
+	return !!core_fsmonitor;
+}
+
+int git_config_get_index_threads(void)
+{
+	int is_bool, val;
+
+	val = git_env_ulong("GIT_TEST_INDEX_THREADS", 0);
+	if (val)
+		return val;
+
+	if (!git_config_get_bool_or_int("index.threads", &is_bool, &val)) {
+		if (is_bool)
+			return val ? 0 : 1;
+		if (val < 0)
+			return 0;
+		return val;
+	}
+
+	return 0; /* default value: as many as the index is worth */
+}
+
+int git_config_get_untracked_threads(void)
+{
+	int is_bool, val;
+
+	val = git_env_ulong("GIT_TEST_UNTRACKED_THREADS", 0);
+	if (val)
+		return val;
+
+	if (!git_config_get_bool_or_int("core.untrackedthreads", &is_bool, &val)) {
+		if (is_bool)
+			return val ? 0 : 1;
+		if (val < 0)
+			return 0;
+		return val;
+	}
+
+	return 0; /* default value: one per CPU */
+}
+
+int git_config_get_hash_threads(void)
+{
+	int is_bool, val;
+
+	val = git_env_ulong("GIT_TEST_HASH_THREADS", 0);
+	if (val)
+		return val;
+
+	if (!git_config_get_bool_or_int("core.hashthreads", &is_bool, &val)) {
+		if (is_bool)
+			return val ? 0 : 1;
+		if (val < 0)
+			return 0;
+		return val;
+	}
+
+	return 0; /* default value: as many as the files are worth */
+}
+
+int git_config_get_write_rev_index(void)
+{
+	int val;
+
+	val = git_env_bool("GIT_TEST_WRITE_REV_INDEX", -1);
+	if (val >= 0)
+		return val;
+
+	if (!git_config_get_bool("pack.writereverseindex", &val))
+		return val;
+
+	return 0; /* default value */
+}
+
 int git_config_get_max_percent_split_change(void)
 {
 	int val = -1;
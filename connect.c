@@ -755,6 +755,36 @@ static void handle_ssh_variant(const char *ssh_command, int is_cmdline,
 	free(p);
 }
 
+/*
+ * The extra parameters of a request must fit into the pkt-line that
+ * git:// sends it in, and into an environment variable otherwise.
+ */
+#define MAX_REF_PREFIX_PARAMS 8192
+
+/*
+ * Append to buf a "ref-prefix=<prefix>" parameter for each of
+ * ref_prefixes, separated by sep. Nothing is appended if they would
+ * take too much space; the server then advertises all refs.
+ */
+void append_ref_prefix_params(struct strbuf *buf, char sep,
+			      const struct argv_array *ref_prefixes)
+{
+	size_t orig_len = buf->len;
+	int i;
+
+	if (!ref_prefixes)
+		return;
+	for (i = 0; i < ref_prefixes->argc; i++) {
+		if (i)
+			strbuf_addch(buf, sep);
+		strbuf_addf(buf, "ref-prefix=%s", ref_prefixes->argv[i]);
+		if (buf->len - orig_len > MAX_REF_PREFIX_PARAMS) {
+			strbuf_setlen(buf, orig_len);
+			return;
+		}
+	}
+}
+
 /*
  * This returns a dummy child_process if the transport protocol does not
  * need fork(2), or a struct child_process object if it does.  Once done,
@@ -767,12 +797,15 @@ static void handle_ssh_variant(const char *ssh_command, int is_cmdline,
  * the connection failed).
  */
 struct child_process *git_connect(int fd[2], const char *url,
-				  const char *prog, int flags)
+				  const char *prog,
+				  const struct argv_array *ref_prefixes,
+				  int flags)
 {
 	char *hostandport, *path;
 	struct child_process *conn = &no_fork;
 	enum protocol protocol;
 	struct strbuf cmd = STRBUF_INIT;
+	struct strbuf params = STRBUF_INIT;
 
 	/* Without this we cannot rely on waitpid() to tell
 	 * what happened to our children.
@@ -811,15 +844,25 @@ struct child_process *git_connect(int fd[2], const char *url,
 		 * Separate original protocol components prog and path
 		 * from extended host header with a NUL byte.
 		 *
-		 * Note: Do not add any other headers here!  Doing so
-		 * will cause older git-daemon servers to crash.
+		 * Note: Do not add any other headers right after the
+		 * host header!  Doing so will cause older git-daemon
+		 * servers to crash. Extra parameters go after a second
+		 * NUL byte, where older servers ignore them.
 		 */
-		packet_write_fmt(fd[1],
-			     "%s %s%chost=%s%c",
-			     prog, path, 0,
-			     target_host, 0);
+		strbuf_addf(&cmd, "%s %s%chost=%s%c",
+			    prog, path, 0, target_host, 0);
+		append_ref_prefix_params(&params, '\0', ref_prefixes);
+		if (params.len) {
+			strbuf_addch(&cmd, '\0');
+			strbuf_addbuf(&cmd, &params);
+			strbuf_addch(&cmd, '\0');
+		}
+		packet_write(fd[1], cmd.buf, cmd.len);
+		strbuf_release(&cmd);
 		free(target_host);
 	} else {
+		const char * const *var;
+
 		conn = xmalloc(sizeof(*conn));
 		child_process_init(conn);
 
@@ -828,7 +871,13 @@ struct child_process *git_connect(int fd[2], const char *url,
 		sq_quote_buf(&cmd, path);
 
 		/* remove repo-local variables from the environment */
-		conn->env = local_repo_env;
+		for (var = local_repo_env; *var; var++)
+			argv_array_push(&conn->env_array, *var);
+		/* and pass the extra parameters to the server side */
+		append_ref_prefix_params(&params, ':', ref_prefixes);
+		if (params.len)
+			argv_array_pushf(&conn->env_array, "%s=%s",
+					 GIT_PROTOCOL_ENVIRONMENT, params.buf);
 		conn->use_shell = 1;
 		conn->in = conn->out = -1;
 		if (protocol == PROTO_SSH) {
@@ -852,6 +901,8 @@ struct child_process *git_connect(int fd[2], const char *url,
 
 				free(hostandport);
 				free(path);
+				strbuf_release(&params);
+				child_process_clear(conn);
 				free(conn);
 				return NULL;
 			}
@@ -878,6 +929,15 @@ struct child_process *git_connect(int fd[2], const char *url,
 			}
 
 			argv_array_push(&conn->args, ssh);
+			/*
+			 * Only OpenSSH is known to understand SendEnv,
+			 * so do not pass it to a custom ssh command.
+			 */
+			if (params.len && !conn->use_shell &&
+			    !getenv("GIT_SSH"))
+				argv_array_pushl(&conn->args, "-o",
+						 "SendEnv=" GIT_PROTOCOL_ENVIRONMENT,
+						 NULL);
 			if (flags & CONNECT_IPV4)
 				argv_array_push(&conn->args, "-4");
 			else if (flags & CONNECT_IPV6)
@@ -904,6 +964,7 @@ struct child_process *git_connect(int fd[2], const char *url,
 	}
 	free(hostandport);
 	free(path);
+	strbuf_release(&params);
 	return conn;
 }
 
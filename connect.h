@@ -5,7 +5,12 @@
 #define CONNECT_DIAG_URL      (1u << 1)
 #define CONNECT_IPV4          (1u << 2)
 #define CONNECT_IPV6          (1u << 3)
-extern struct child_process *git_connect(int fd[2], const char *url, const char *prog, int flags);
+struct argv_array;
+struct strbuf;
+extern struct child_process *git_connect(int fd[2], const char *url, const char *prog,
+					 const struct argv_array *ref_prefixes, int flags);
+extern void append_ref_prefix_params(struct strbuf *buf, char sep,
+				     const struct argv_array *ref_prefixes);
 extern int finish_connect(struct child_process *conn);
 extern int git_connection_is_socket(struct child_process *conn);
 extern int server_supports(const char *feature);
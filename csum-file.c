@@ -61,9 +61,10 @@ int sha1close(struct sha1file *f, unsigned char *result, unsigned int flags)
 	git_SHA1_Final(f->buffer, &f->ctx);
 	if (result)
 		hashcpy(result, f->buffer);
-	if (flags & (CSUM_CLOSE | CSUM_FSYNC)) {
-		/* write checksum and close fd */
+	if (flags & (CSUM_CLOSE | CSUM_FSYNC | CSUM_HASH_IN_STREAM))
 		flush(f, f->buffer, 20);
+	if (flags & (CSUM_CLOSE | CSUM_FSYNC)) {
+		/* checksum is written; close fd */
 		if (flags & CSUM_FSYNC)
 			fsync_or_die(f->fd, f->name);
 		if (close(f->fd))
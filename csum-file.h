@@ -29,6 +29,8 @@ extern int sha1file_truncate(struct sha1file *, struct sha1file_checkpoint *);
 /* sha1close flags */
 #define CSUM_CLOSE	1
 #define CSUM_FSYNC	2
+/* write the checksum to the file even if the fd is kept open */
+#define CSUM_HASH_IN_STREAM	4
 
 extern struct sha1file *sha1fd(int fd, const char *name);
 extern struct sha1file *sha1fd_check(const char *name);
@@ -39,6 +41,12 @@ extern void sha1flush(struct sha1file *f);
 extern void crc32_begin(struct sha1file *);
 extern uint32_t crc32_end(struct sha1file *);
 
+/* The number of bytes written so far, including the buffered ones */
+static inline off_t sha1file_total(struct sha1file *f)
+{
+	return f->total + f->offset;
+}
+
 static inline void sha1write_u8(struct sha1file *f, uint8_t data)
 {
 	sha1write(f, &data, sizeof(data));
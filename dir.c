@@ -17,6 +17,8 @@
 #include "utf8.h"
 #include "varint.h"
 #include "ewah/ewok.h"
+#include "fsmonitor.h"
+#include "thread-utils.h"
 
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
@@ -45,13 +47,40 @@ struct cached_dir {
 	struct untracked_cache_dir *ucd;
 };
 
+struct walk_tasks;
+
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	struct index_state *istate, const char *path, int len,
 	struct untracked_cache_dir *untracked,
-	int check_only, const struct pathspec *pathspec);
+	int check_only, const struct pathspec *pathspec,
+	struct walk_tasks *tasks);
 static int get_dtype(struct dirent *de, struct index_state *istate,
 		     const char *path, int len);
 
+#ifndef NO_PTHREADS
+/*
+ * Taken by the threads of read_directory_parallel() around the few
+ * things that they cannot do concurrently, like reading objects.
+ */
+static int walk_use_locks;
+static pthread_mutex_t walk_mutex;
+
+static void walk_lock(void)
+{
+	if (walk_use_locks)
+		pthread_mutex_lock(&walk_mutex);
+}
+
+static void walk_unlock(void)
+{
+	if (walk_use_locks)
+		pthread_mutex_unlock(&walk_mutex);
+}
+#else
+#define walk_lock()
+#define walk_unlock()
+#endif
+
 int fspathcmp(const char *a, const char *b)
 {
 	return ignore_case ? strcasecmp(a, b) : strcmp(a, b);
@@ -602,12 +631,14 @@ static void *read_skip_worktree_file_from_index(const struct index_state *istate
 	void *data;
 
 	len = strlen(path);
-	pos = index_name_pos(istate, path, len);
+	pos = index_name_pos_sparse(istate, path, len);
 	if (pos < 0)
 		return NULL;
 	if (!ce_skip_worktree(istate->cache[pos]))
 		return NULL;
+	walk_lock();
 	data = read_sha1_file(istate->cache[pos]->oid.hash, &type, &sz);
+	walk_unlock();
 	if (!data || type != OBJ_BLOB) {
 		free(data);
 		return NULL;
@@ -620,6 +651,8 @@ static void *read_skip_worktree_file_from_index(const struct index_state *istate
 	return data;
 }
 
+static void free_exclude_index(struct exclude_list *el);
+
 /*
  * Frees memory within el which was allocated for exclude patterns and
  * the file buffer.  Does not free el itself.
@@ -632,6 +665,7 @@ void clear_exclude_list(struct exclude_list *el)
 		free(el->excludes[i]);
 	free(el->excludes);
 	free(el->filebuf);
+	free_exclude_index(el);
 
 	memset(el, 0, sizeof(*el));
 }
@@ -955,6 +989,257 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+static int exclude_matches(struct exclude *x,
+			   const char *pathname, int pathlen,
+			   const char *basename, int *dtype,
+			   struct index_state *istate)
+{
+	if (x->flags & EXC_FLAG_MUSTBEDIR) {
+		if (*dtype == DT_UNKNOWN)
+			*dtype = get_dtype(NULL, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (x->flags & EXC_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      x->pattern, x->nowildcardlen,
+				      x->patternlen, x->flags);
+
+	assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      x->base, x->baselen ? x->baselen - 1 : 0,
+			      x->pattern, x->nowildcardlen, x->patternlen,
+			      x->flags);
+}
+
+/*
+ * Lists with fewer patterns than this are scanned without building an
+ * exclude_index first.
+ */
+#define EXCLUDE_INDEX_MIN_PATTERNS 16
+
+/*
+ * The patterns of an exclude list that may match a path, grouped by
+ * what they are looked up with. Each group is in the order of the
+ * list, so the last pattern in the list that matches still wins.
+ */
+struct exclude_index_entry {
+	struct hashmap_entry ent;
+	int *pos;	/* indices into el->excludes, in increasing order */
+	int nr, alloc;
+	int keylen;
+	char key[FLEX_ARRAY];
+};
+
+struct exclude_index {
+	int nr;		/* how many patterns of the list are indexed */
+	int icase;	/* ignore_case at the time the index was built */
+
+	/* literal basename patterns, e.g. "Makefile" */
+	struct hashmap basenames;
+	/* literal pathname patterns, e.g. "/doc/build", by the full path */
+	struct hashmap paths;
+	/*
+	 * other pathname patterns, e.g. "doc/api-*.html", by the leading
+	 * directories of their literal part, e.g. "doc/"
+	 */
+	struct hashmap dirs;
+	/* the basename patterns with wildcards, e.g. "*.o" */
+	int *globs;
+	int globs_nr, globs_alloc;
+};
+
+static int exclude_index_entry_cmp(const struct exclude_index_entry *e1,
+				   const struct exclude_index_entry *e2,
+				   const char *key)
+{
+	return e1->keylen != e2->keylen ||
+		fspathncmp(e1->key, key ? key : e2->key, e1->keylen);
+}
+
+static unsigned int exclude_index_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static const struct exclude_index_entry *exclude_index_get(
+		const struct hashmap *map, const char *key, int keylen)
+{
+	struct exclude_index_entry k;
+
+	hashmap_entry_init(&k, exclude_index_hash(key, keylen));
+	k.keylen = keylen;
+	return hashmap_get(map, &k, key);
+}
+
+static void exclude_index_add(struct hashmap *map, const char *key,
+			      int keylen, int pos)
+{
+	struct exclude_index_entry *e;
+
+	e = (struct exclude_index_entry *)exclude_index_get(map, key, keylen);
+	if (!e) {
+		FLEX_ALLOC_MEM(e, key, key, keylen);
+		hashmap_entry_init(e, exclude_index_hash(key, keylen));
+		e->keylen = keylen;
+		hashmap_add(map, e);
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+}
+
+static void free_exclude_index_map(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct exclude_index_entry *e;
+
+	hashmap_iter_init(map, &iter);
+	while ((e = hashmap_iter_next(&iter)))
+		free(e->pos);
+	hashmap_free(map, 1);
+}
+
+static void free_exclude_index(struct exclude_list *el)
+{
+	struct exclude_index *idx = el->index;
+
+	if (!idx)
+		return;
+	free_exclude_index_map(&idx->basenames);
+	free_exclude_index_map(&idx->paths);
+	free_exclude_index_map(&idx->dirs);
+	free(idx->globs);
+	free(idx);
+	el->index = NULL;
+}
+
+/*
+ * Build the index of a long exclude list, or bring it up to date if
+ * patterns were added since. Lists that are shared between threads
+ * must be prepared before the threads start.
+ */
+static void prepare_exclude_index(struct exclude_list *el)
+{
+	struct exclude_index *idx = el->index;
+	struct strbuf key = STRBUF_INIT;
+	int i;
+
+	if (el->nr < EXCLUDE_INDEX_MIN_PATTERNS)
+		return;
+	if (idx && idx->nr == el->nr && idx->icase == ignore_case)
+		return;
+
+	free_exclude_index(el);
+	idx = xcalloc(1, sizeof(*idx));
+	hashmap_init(&idx->basenames,
+		     (hashmap_cmp_fn)exclude_index_entry_cmp, 0);
+	hashmap_init(&idx->paths, (hashmap_cmp_fn)exclude_index_entry_cmp, 0);
+	hashmap_init(&idx->dirs, (hashmap_cmp_fn)exclude_index_entry_cmp, 0);
+	idx->icase = ignore_case;
+
+	for (i = 0; i < el->nr; i++) {
+		const struct exclude *x = el->excludes[i];
+		const char *pattern = x->pattern;
+		int prefix = x->nowildcardlen;
+		int patternlen = x->patternlen;
+
+		if (x->flags & EXC_FLAG_NODIR) {
+			if (prefix == patternlen)
+				exclude_index_add(&idx->basenames, pattern,
+						  patternlen, i);
+			else {
+				ALLOC_GROW(idx->globs, idx->globs_nr + 1,
+					   idx->globs_alloc);
+				idx->globs[idx->globs_nr++] = i;
+			}
+			continue;
+		}
+
+		/* the same key as the path that match_pathname() checks */
+		if (*pattern == '/') {
+			pattern++;
+			patternlen--;
+			prefix--;
+		}
+		strbuf_reset(&key);
+		strbuf_add(&key, x->base, x->baselen);
+		if (prefix == patternlen) {
+			strbuf_add(&key, pattern, patternlen);
+			exclude_index_add(&idx->paths, key.buf, key.len, i);
+		} else {
+			while (prefix && pattern[prefix - 1] != '/')
+				prefix--;
+			strbuf_add(&key, pattern, prefix);
+			exclude_index_add(&idx->dirs, key.buf, key.len, i);
+		}
+	}
+	strbuf_release(&key);
+	idx->nr = el->nr;
+	el->index = idx;
+}
+
+/*
+ * Return the largest of "best" and the positions in "pos" whose
+ * pattern matches, trying the positions above "best" from the end.
+ */
+static int last_matching_position(const int *pos, int nr, int best,
+				  const char *pathname, int pathlen,
+				  const char *basename, int *dtype,
+				  struct exclude_list *el,
+				  struct index_state *istate)
+{
+	while (nr-- && pos[nr] > best)
+		if (exclude_matches(el->excludes[pos[nr]], pathname, pathlen,
+				    basename, dtype, istate))
+			return pos[nr];
+	return best;
+}
+
+static struct exclude *last_exclude_matching_from_index(const char *pathname,
+							int pathlen,
+							const char *basename,
+							int *dtype,
+							struct exclude_list *el,
+							struct index_state *istate)
+{
+	struct exclude_index *idx = el->index;
+	const struct exclude_index_entry *e;
+	int best = -1;
+	int i;
+
+	e = exclude_index_get(&idx->basenames, basename,
+			      pathlen - (basename - pathname));
+	if (e)
+		best = last_matching_position(e->pos, e->nr, best,
+					      pathname, pathlen, basename,
+					      dtype, el, istate);
+
+	e = exclude_index_get(&idx->paths, pathname, pathlen);
+	if (e)
+		best = last_matching_position(e->pos, e->nr, best,
+					      pathname, pathlen, basename,
+					      dtype, el, istate);
+
+	for (i = 0; i <= pathlen; i++) {
+		if (i && pathname[i - 1] != '/')
+			continue;
+		e = exclude_index_get(&idx->dirs, pathname, i);
+		if (e)
+			best = last_matching_position(e->pos, e->nr, best,
+						      pathname, pathlen,
+						      basename, dtype, el,
+						      istate);
+	}
+
+	best = last_matching_position(idx->globs, idx->globs_nr, best,
+				      pathname, pathlen, basename,
+				      dtype, el, istate);
+
+	return best < 0 ? NULL : el->excludes[best];
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -968,44 +1253,25 @@ static struct exclude *last_exclude_matching_from_list(const char *pathname,
 						       struct exclude_list *el,
 						       struct index_state *istate)
 {
-	struct exclude *exc = NULL; /* undecided */
 	int i;
 
 	if (!el->nr)
 		return NULL;	/* undefined */
 
+	prepare_exclude_index(el);
+	if (el->index)
+		return last_exclude_matching_from_index(pathname, pathlen,
+							basename, dtype, el,
+							istate);
+
 	for (i = el->nr - 1; 0 <= i; i--) {
 		struct exclude *x = el->excludes[i];
-		const char *exclude = x->pattern;
-		int prefix = x->nowildcardlen;
-
-		if (x->flags & EXC_FLAG_MUSTBEDIR) {
-			if (*dtype == DT_UNKNOWN)
-				*dtype = get_dtype(NULL, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (x->flags & EXC_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, x->patternlen,
-					   x->flags)) {
-				exc = x;
-				break;
-			}
-			continue;
-		}
 
-		assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   x->base, x->baselen ? x->baselen - 1 : 0,
-				   exclude, prefix, x->patternlen, x->flags)) {
-			exc = x;
-			break;
-		}
+		if (exclude_matches(x, pathname, pathlen, basename, dtype,
+				    istate))
+			return x;
 	}
-	return exc;
+	return NULL;
 }
 
 /*
@@ -1383,7 +1649,13 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 			break;
 		if (!(dir->flags & DIR_NO_GITLINKS)) {
 			unsigned char sha1[20];
-			if (resolve_gitlink_ref(dirname, "HEAD", sha1) == 0)
+			int is_gitlink;
+
+			/* the submodule ref stores are shared */
+			walk_lock();
+			is_gitlink = !resolve_gitlink_ref(dirname, "HEAD", sha1);
+			walk_unlock();
+			if (is_gitlink)
 				return path_untracked;
 		}
 		return path_recurse;
@@ -1397,7 +1669,7 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 	untracked = lookup_untracked(dir->untracked, untracked,
 				     dirname + baselen, len - baselen);
 	return read_directory_recursive(dir, istate, dirname, len,
-					untracked, 1, pathspec);
+					untracked, 1, pathspec, NULL);
 }
 
 /*
@@ -1625,7 +1897,7 @@ static enum path_treatment treat_path_fast(struct dir_struct *dir,
 		 * with check_only set.
 		 */
 		return read_directory_recursive(dir, istate, path->buf, path->len,
-						cdir->ucd, 1, pathspec);
+						cdir->ucd, 1, pathspec, NULL);
 	/*
 	 * We get path_recurse in the first run when
 	 * directory_exists_in_index() returns index_nonexistent. We
@@ -1680,17 +1952,25 @@ static int valid_cached_dir(struct dir_struct *dir,
 	if (!untracked)
 		return 0;
 
-	if (stat(path->len ? path->buf : ".", &st)) {
-		invalidate_directory(dir->untracked, untracked);
-		memset(&untracked->stat_data, 0, sizeof(untracked->stat_data));
-		return 0;
-	}
-	if (!untracked->valid ||
-	    match_stat_data_racy(istate, &untracked->stat_data, &st)) {
-		if (untracked->valid)
+	/*
+	 * With fsmonitor, a directory is still valid unless the hook
+	 * reported a path in it, so there is no need to stat() it.
+	 */
+	refresh_fsmonitor(istate);
+	if (!(dir->untracked->use_fsmonitor && untracked->valid)) {
+		if (stat(path->len ? path->buf : ".", &st)) {
 			invalidate_directory(dir->untracked, untracked);
-		fill_stat_data(&untracked->stat_data, &st);
-		return 0;
+			memset(&untracked->stat_data, 0,
+			       sizeof(untracked->stat_data));
+			return 0;
+		}
+		if (!untracked->valid ||
+		    match_stat_data_racy(istate, &untracked->stat_data, &st)) {
+			if (untracked->valid)
+				invalidate_directory(dir->untracked, untracked);
+			fill_stat_data(&untracked->stat_data, &st);
+			return 0;
+		}
 	}
 
 	if (untracked->check_only != !!check_only) {
@@ -1776,6 +2056,34 @@ static void close_cached_dir(struct cached_dir *cdir)
 	}
 }
 
+/*
+ * The subdirectories left by the top of a parallel walk for the
+ * threads to read, see read_directory_parallel().
+ */
+struct walk_task {
+	char *path;
+	int len;
+	struct untracked_cache_dir *untracked;
+};
+
+struct walk_tasks {
+	struct walk_task *task;
+	int nr, alloc;
+	int next; /* the first task no thread has taken yet */
+};
+
+static void add_walk_task(struct walk_tasks *tasks, const char *path, int len,
+			  struct untracked_cache_dir *untracked)
+{
+	struct walk_task *task;
+
+	ALLOC_GROW(tasks->task, tasks->nr + 1, tasks->alloc);
+	task = &tasks->task[tasks->nr++];
+	task->path = xmemdupz(path, len);
+	task->len = len;
+	task->untracked = untracked;
+}
+
 /*
  * Read a directory tree. We currently ignore anything but
  * directories, regular files and symlinks. That's because git
@@ -1786,11 +2094,14 @@ static void close_cached_dir(struct cached_dir *cdir)
  * That likely will not change.
  *
  * Returns the most significant path_treatment value encountered in the scan.
+ *
+ * If "tasks" is given, the subdirectories to recurse into are added to
+ * it instead, and the returned value does not account for them.
  */
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	struct index_state *istate, const char *base, int baselen,
 	struct untracked_cache_dir *untracked, int check_only,
-	const struct pathspec *pathspec)
+	const struct pathspec *pathspec, struct walk_tasks *tasks)
 {
 	struct cached_dir cdir;
 	enum path_treatment state, subdir_state, dir_state = path_none;
@@ -1821,12 +2132,18 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 			ud = lookup_untracked(dir->untracked, untracked,
 					      path.buf + baselen,
 					      path.len - baselen);
-			subdir_state =
-				read_directory_recursive(dir, istate, path.buf,
-							 path.len, ud,
-							 check_only, pathspec);
-			if (subdir_state > dir_state)
-				dir_state = subdir_state;
+			if (tasks) {
+				add_walk_task(tasks, path.buf, path.len, ud);
+			} else {
+				subdir_state =
+					read_directory_recursive(dir, istate,
+								 path.buf,
+								 path.len, ud,
+								 check_only,
+								 pathspec, NULL);
+				if (subdir_state > dir_state)
+					dir_state = subdir_state;
+			}
 		}
 
 		if (check_only) {
@@ -2084,6 +2401,237 @@ static struct untracked_cache_dir *validate_untracked_cache(struct dir_struct *d
 	return root;
 }
 
+#ifndef NO_PTHREADS
+struct walk_thread {
+	pthread_t pthread;
+	struct dir_struct dir;
+	struct untracked_cache untracked;
+	struct index_state *istate;
+	const struct pathspec *pathspec;
+	struct walk_tasks *tasks;
+};
+
+/*
+ * Give the thread a dir_struct of its own, with the same settings and
+ * exclude lists as "src". The per-directory exclude lists of the
+ * leading directories are shared: every task is below them, so
+ * prep_exclude() never pops them.
+ */
+static void setup_walk_thread_dir(struct walk_thread *t, struct dir_struct *src)
+{
+	struct dir_struct *dir = &t->dir;
+	const struct exclude_list_group *src_group =
+		&src->exclude_list_group[EXC_DIRS];
+	struct exclude_list_group *group = &dir->exclude_list_group[EXC_DIRS];
+	struct exclude_stack *stk, **tail;
+
+	memset(dir, 0, sizeof(*dir));
+	dir->flags = src->flags;
+	dir->exclude_per_dir = src->exclude_per_dir;
+	dir->exclude_list_group[EXC_CMDL] = src->exclude_list_group[EXC_CMDL];
+	dir->exclude_list_group[EXC_FILE] = src->exclude_list_group[EXC_FILE];
+
+	ALLOC_ARRAY(group->el, src_group->nr);
+	COPY_ARRAY(group->el, src_group->el, src_group->nr);
+	group->nr = group->alloc = src_group->nr;
+	tail = &dir->exclude_stack;
+	for (stk = src->exclude_stack; stk; stk = stk->prev) {
+		*tail = xmalloc(sizeof(**tail));
+		**tail = *stk;
+		tail = &(*tail)->prev;
+	}
+	dir->exclude = src->exclude;
+	strbuf_init(&dir->basebuf, PATH_MAX);
+	strbuf_addbuf(&dir->basebuf, &src->basebuf);
+
+	/* the statistics are counted per thread and summed up at the end */
+	if (src->untracked) {
+		t->untracked = *src->untracked;
+		t->untracked.dir_created = 0;
+		t->untracked.gitignore_invalidated = 0;
+		t->untracked.dir_invalidated = 0;
+		t->untracked.dir_opened = 0;
+		dir->untracked = &t->untracked;
+	}
+}
+
+/*
+ * Move what the thread found to "dst", and free what the thread has
+ * not shared with it.
+ */
+static void finish_walk_thread_dir(struct walk_thread *t, struct dir_struct *dst)
+{
+	struct dir_struct *dir = &t->dir;
+	struct exclude_list_group *group = &dir->exclude_list_group[EXC_DIRS];
+	int shared_nr = dst->exclude_list_group[EXC_DIRS].nr;
+
+	while (dir->exclude_stack) {
+		struct exclude_stack *stk = dir->exclude_stack;
+
+		if (stk->exclude_ix >= shared_nr) {
+			struct exclude_list *el = &group->el[stk->exclude_ix];
+
+			free((char *)el->src); /* see prep_exclude() */
+			clear_exclude_list(el);
+		}
+		dir->exclude_stack = stk->prev;
+		free(stk);
+	}
+	free(group->el);
+	strbuf_release(&dir->basebuf);
+
+	ALLOC_GROW(dst->entries, dst->nr + dir->nr, dst->alloc);
+	COPY_ARRAY(dst->entries + dst->nr, dir->entries, dir->nr);
+	dst->nr += dir->nr;
+	free(dir->entries);
+	ALLOC_GROW(dst->ignored, dst->ignored_nr + dir->ignored_nr,
+		   dst->ignored_alloc);
+	COPY_ARRAY(dst->ignored + dst->ignored_nr, dir->ignored,
+		   dir->ignored_nr);
+	dst->ignored_nr += dir->ignored_nr;
+	free(dir->ignored);
+
+	if (dst->untracked) {
+		dst->untracked->dir_created += t->untracked.dir_created;
+		dst->untracked->gitignore_invalidated +=
+			t->untracked.gitignore_invalidated;
+		dst->untracked->dir_invalidated += t->untracked.dir_invalidated;
+		dst->untracked->dir_opened += t->untracked.dir_opened;
+	}
+}
+
+/* Index the exclude lists that the threads are going to share. */
+static void prepare_exclude_indexes(struct dir_struct *dir)
+{
+	int i, j;
+
+	for (i = EXC_CMDL; i <= EXC_FILE; i++) {
+		struct exclude_list_group *group = &dir->exclude_list_group[i];
+
+		for (j = 0; j < group->nr; j++)
+			prepare_exclude_index(&group->el[j]);
+	}
+}
+
+static void *walk_thread_proc(void *data)
+{
+	struct walk_thread *t = data;
+
+	for (;;) {
+		struct walk_task *task = NULL;
+
+		walk_lock();
+		if (t->tasks->next < t->tasks->nr)
+			task = &t->tasks->task[t->tasks->next++];
+		walk_unlock();
+		if (!task)
+			break;
+		read_directory_recursive(&t->dir, t->istate, task->path,
+					 task->len, task->untracked, 0,
+					 t->pathspec, NULL);
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * How many threads to read the subdirectories of the top of the walk
+ * with; 1 means that the walk is done serially.
+ */
+static int walk_threads(struct index_state *istate, int nr_tasks)
+{
+#ifdef NO_PTHREADS
+	return 1;
+#else
+	int nr_threads;
+
+	/* a lookup in a sparse index may have to expand it */
+	if (istate->sparse_index)
+		return 1;
+
+	nr_threads = git_config_get_untracked_threads();
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (nr_threads > nr_tasks)
+		nr_threads = nr_tasks;
+	return nr_threads > 1 ? nr_threads : 1;
+#endif
+}
+
+/*
+ * Like read_directory_recursive(), but let threads read the
+ * subdirectories of "base". Each thread takes whole subdirectories
+ * from the list, so that the untracked cache nodes and the exclude
+ * lists it looks at below "base" are its own. The results are merged
+ * in read_directory(), which sorts them anyway.
+ */
+static void read_directory_parallel(struct dir_struct *dir,
+				    struct index_state *istate,
+				    const char *base, int baselen,
+				    struct untracked_cache_dir *untracked,
+				    const struct pathspec *pathspec)
+{
+	struct walk_tasks tasks = { NULL };
+	int i, nr_threads;
+
+	if (walk_threads(istate, INT_MAX) <= 1) {
+		read_directory_recursive(dir, istate, base, baselen, untracked,
+					 0, pathspec, NULL);
+		return;
+	}
+
+	read_directory_recursive(dir, istate, base, baselen, untracked, 0,
+				 pathspec, &tasks);
+
+	nr_threads = walk_threads(istate, tasks.nr);
+#ifndef NO_PTHREADS
+	if (nr_threads > 1) {
+		struct walk_thread *threads;
+		uint64_t start = getnanotime();
+
+		/* the threads start from the exclude lists of "base" */
+		prep_exclude(dir, istate, base, baselen);
+		prepare_exclude_indexes(dir);
+		lazy_init_name_hash(istate);
+
+		pthread_mutex_init(&walk_mutex, NULL);
+		walk_use_locks = 1;
+		threads = xcalloc(nr_threads, sizeof(*threads));
+		for (i = 0; i < nr_threads; i++) {
+			struct walk_thread *t = &threads[i];
+
+			setup_walk_thread_dir(t, dir);
+			t->istate = istate;
+			t->pathspec = pathspec;
+			t->tasks = &tasks;
+			if (pthread_create(&t->pthread, NULL,
+					   walk_thread_proc, t))
+				die("unable to create threaded directory walk");
+		}
+		for (i = 0; i < nr_threads; i++) {
+			if (pthread_join(threads[i].pthread, NULL))
+				die("unable to join threaded directory walk");
+			finish_walk_thread_dir(&threads[i], dir);
+		}
+		free(threads);
+		walk_use_locks = 0;
+		pthread_mutex_destroy(&walk_mutex);
+		trace_performance_since(start, "read %d directories with %d threads",
+					tasks.nr, nr_threads);
+	}
+#endif
+	if (nr_threads <= 1)
+		for (i = 0; i < tasks.nr; i++)
+			read_directory_recursive(dir, istate, tasks.task[i].path,
+						 tasks.task[i].len,
+						 tasks.task[i].untracked, 0,
+						 pathspec, NULL);
+
+	for (i = 0; i < tasks.nr; i++)
+		free(tasks.task[i].path);
+	free(tasks.task);
+}
+
 int read_directory(struct dir_struct *dir, struct index_state *istate,
 		   const char *path, int len, const struct pathspec *pathspec)
 {
@@ -2100,7 +2648,7 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 */
 		dir->untracked = NULL;
 	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
-		read_directory_recursive(dir, istate, path, len, untracked, 0, pathspec);
+		read_directory_parallel(dir, istate, path, len, untracked, pathspec);
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
@@ -54,6 +54,9 @@ struct exclude_list {
 	const char *src;
 
 	struct exclude **excludes;
+
+	/* lookup tables for long lists, built when first matched against */
+	struct exclude_index *index;
 };
 
 /*
@@ -134,6 +137,11 @@ struct untracked_cache {
 	 */
 	unsigned dir_flags;
 	struct untracked_cache_dir *root;
+	/*
+	 * The fsmonitor hook reports all changes to the work tree, so
+	 * valid directories need not be checked with stat().
+	 */
+	int use_fsmonitor;
 	/* Statistics */
 	int dir_created;
 	int gitignore_invalidated;
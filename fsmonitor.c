@@ -0,0 +1,228 @@
+#include "cache.h"
+#include "dir.h"
+#include "ewah/ewok.h"
+#include "fsmonitor.h"
+#include "run-command.h"
+
+#define INDEX_EXTENSION_VERSION	1
+#define HOOK_INTERFACE_VERSION	1
+
+int read_fsmonitor_extension(struct index_state *istate, const void *data_,
+			     unsigned long sz)
+{
+	const unsigned char *data = data_;
+	uint32_t version, ewah_size;
+	int ret;
+
+	if (sz < 16)
+		return error("corrupt fsmonitor extension (too short)");
+	version = get_be32(data);
+	if (version != INDEX_EXTENSION_VERSION)
+		return error("bad fsmonitor extension version %"PRIu32, version);
+	istate->fsmonitor_last_update = get_be64(data + 4);
+	ewah_size = get_be32(data + 12);
+	data += 16;
+	sz -= 16;
+	if (ewah_size != sz)
+		return error("corrupt fsmonitor extension (bad bitmap size)");
+
+	istate->fsmonitor_dirty = ewah_new();
+	ret = ewah_read_mmap(istate->fsmonitor_dirty, data, sz);
+	if (ret != sz) {
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = NULL;
+		return error("corrupt dirty bitmap in fsmonitor extension");
+	}
+	return 0;
+}
+
+void fill_fsmonitor_bitmap(struct index_state *istate)
+{
+	int i, skipped = 0;
+
+	if (istate->fsmonitor_dirty)
+		ewah_free(istate->fsmonitor_dirty);
+	istate->fsmonitor_dirty = ewah_new();
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE)
+			skipped++;
+		else if (!(ce->ce_flags & CE_FSMONITOR_VALID))
+			ewah_set(istate->fsmonitor_dirty, i - skipped);
+	}
+}
+
+void write_fsmonitor_extension(struct strbuf *sb, struct index_state *istate)
+{
+	unsigned char hdr[16];
+	size_t ewah_start;
+
+	put_be32(hdr, INDEX_EXTENSION_VERSION);
+	put_be32(hdr + 4, istate->fsmonitor_last_update >> 32);
+	put_be32(hdr + 8, istate->fsmonitor_last_update & 0xffffffff);
+	put_be32(hdr + 12, 0); /* size of the bitmap, fixed up below */
+	strbuf_add(sb, hdr, sizeof(hdr));
+
+	ewah_start = sb->len;
+	ewah_serialize_strbuf(istate->fsmonitor_dirty, sb);
+	put_be32(sb->buf + ewah_start - 4, sb->len - ewah_start);
+}
+
+static void mark_entry_dirty(size_t pos, void *data)
+{
+	struct index_state *istate = data;
+
+	istate->cache[pos]->ce_flags &= ~CE_FSMONITOR_VALID;
+}
+
+static void invalidate_all(struct index_state *istate)
+{
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++)
+		istate->cache[i]->ce_flags &= ~CE_FSMONITOR_VALID;
+	if (istate->untracked)
+		istate->untracked->use_fsmonitor = 0;
+}
+
+static void add_fsmonitor(struct index_state *istate)
+{
+	if (istate->fsmonitor_last_update)
+		return;
+
+	istate->cache_changed |= FSMONITOR_CHANGED;
+	istate->fsmonitor_last_update = getnanotime();
+	invalidate_all(istate);
+
+	/*
+	 * The untracked cache may only skip the directories that the
+	 * hook does not report once we know that the hook has seen all
+	 * changes to them; start over with an empty one.
+	 */
+	if (istate->untracked) {
+		remove_untracked_cache(istate);
+		add_untracked_cache(istate);
+		istate->untracked->use_fsmonitor = 1;
+	}
+}
+
+static void remove_fsmonitor(struct index_state *istate)
+{
+	if (!istate->fsmonitor_last_update)
+		return;
+
+	istate->cache_changed |= FSMONITOR_CHANGED;
+	istate->fsmonitor_last_update = 0;
+	invalidate_all(istate);
+}
+
+void tweak_fsmonitor(struct index_state *istate)
+{
+	struct ewah_bitmap *dirty = istate->fsmonitor_dirty;
+	int i;
+
+	istate->fsmonitor_dirty = NULL;
+	if (!git_config_get_fsmonitor()) {
+		remove_fsmonitor(istate);
+		goto out;
+	}
+	if (!istate->fsmonitor_last_update || !dirty) {
+		add_fsmonitor(istate);
+		goto out;
+	}
+
+	if (dirty->bit_size > istate->cache_nr) {
+		warning("fsmonitor extension does not match the index; ignoring it");
+		invalidate_all(istate);
+		goto out;
+	}
+	for (i = 0; i < istate->cache_nr; i++)
+		istate->cache[i]->ce_flags |= CE_FSMONITOR_VALID;
+	ewah_each_bit(dirty, mark_entry_dirty, istate);
+	if (istate->untracked)
+		istate->untracked->use_fsmonitor = 1;
+
+out:
+	if (dirty)
+		ewah_free(dirty);
+}
+
+/*
+ * Run the hook to learn which paths have changed since last_update,
+ * as a list of NUL-terminated paths relative to the work tree.
+ */
+static int query_fsmonitor(uint64_t last_update, struct strbuf *result)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+
+	argv_array_push(&cp.args, core_fsmonitor);
+	argv_array_pushf(&cp.args, "%d", HOOK_INTERFACE_VERSION);
+	argv_array_pushf(&cp.args, "%"PRIuMAX, (uintmax_t)last_update);
+	cp.use_shell = 1;
+	cp.dir = get_git_work_tree();
+
+	return capture_command(&cp, result, 1024);
+}
+
+static void mark_path_dirty(struct index_state *istate, const char *name)
+{
+	int pos = index_name_pos(istate, name, strlen(name));
+
+	if (pos >= 0)
+		istate->cache[pos]->ce_flags &= ~CE_FSMONITOR_VALID;
+
+	/* even if it is not tracked, it may be a new untracked file */
+	untracked_cache_invalidate_path(istate, name);
+}
+
+void refresh_fsmonitor(struct index_state *istate)
+{
+	struct strbuf result = STRBUF_INIT;
+	uint64_t now;
+	int ok;
+
+	if (!core_fsmonitor || !istate->fsmonitor_last_update ||
+	    istate->fsmonitor_has_run_once)
+		return;
+	istate->fsmonitor_has_run_once = 1;
+
+	/*
+	 * Take the time before asking, so that changes made while the
+	 * hook runs are reported again next time.
+	 */
+	now = getnanotime();
+	ok = !query_fsmonitor(istate->fsmonitor_last_update, &result);
+	trace_performance_since(now, "fsmonitor process '%s'", core_fsmonitor);
+
+	/* a hook may answer "/" when it cannot tell what has changed */
+	if (ok && result.buf[0] != '/') {
+		const char *p = result.buf, *end = result.buf + result.len;
+
+		while (p < end) {
+			const char *eol = memchr(p, '\0', end - p);
+
+			if (!eol)
+				eol = end;
+			if (eol > p)
+				mark_path_dirty(istate, p);
+			p = eol + 1;
+		}
+		if (result.len)
+			istate->cache_changed |= FSMONITOR_CHANGED;
+	} else {
+		invalidate_all(istate);
+		istate->cache_changed |= FSMONITOR_CHANGED;
+	}
+	strbuf_release(&result);
+
+	istate->fsmonitor_last_update = now;
+}
+
+void mark_fsmonitor_valid(struct index_state *istate, struct cache_entry *ce)
+{
+	if (!istate->fsmonitor_last_update || (ce->ce_flags & CE_FSMONITOR_VALID))
+		return;
+	ce->ce_flags |= CE_FSMONITOR_VALID;
+	istate->cache_changed |= FSMONITOR_CHANGED;
+}
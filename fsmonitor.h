@@ -0,0 +1,44 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+struct cache_entry;
+struct index_state;
+struct strbuf;
+
+/*
+ * Read the fsmonitor index extension. The dirty bitmap is applied to
+ * the cache entries by tweak_fsmonitor(), once the whole index has
+ * been read.
+ */
+int read_fsmonitor_extension(struct index_state *istate, const void *data,
+			     unsigned long sz);
+
+/*
+ * Record which entries are not known to be clean in
+ * istate->fsmonitor_dirty, numbering them as they will be written,
+ * before write_fsmonitor_extension() writes it out.
+ */
+void fill_fsmonitor_bitmap(struct index_state *istate);
+void write_fsmonitor_extension(struct strbuf *sb, struct index_state *istate);
+
+/*
+ * Add or remove the fsmonitor extension according to core.fsmonitor,
+ * and mark the entries that were clean when the index was written
+ * with CE_FSMONITOR_VALID.
+ */
+void tweak_fsmonitor(struct index_state *istate);
+
+/*
+ * Ask the fsmonitor hook which paths have changed since the index was
+ * written, and clear CE_FSMONITOR_VALID on their entries. Only runs
+ * the hook once per process.
+ */
+void refresh_fsmonitor(struct index_state *istate);
+
+/*
+ * Mark an entry that has just been found to match the work tree, so
+ * that it need not be checked again until the hook reports it.
+ */
+void mark_fsmonitor_valid(struct index_state *istate, struct cache_entry *ce);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+/*
+ * A memory pool hands out small allocations carved from large blocks,
+ * and frees them all at once when the pool is discarded. Allocations
+ * cannot be freed individually.
+ */
+
+struct mp_block {
+	struct mp_block *next_block;
+	char *next_free;
+	char *end;
+	uintmax_t space[FLEX_ARRAY]; /* more */
+};
+
+struct mem_pool {
+	struct mp_block *mp_block;
+
+	/*
+	 * The amount of memory to grow the pool by, not counting the
+	 * overhead of a block.
+	 */
+	size_t block_alloc;
+
+	/* The total amount of memory allocated by the pool. */
+	size_t pool_alloc;
+};
+
+/*
+ * Initialize *mem_pool with a first block of initial_size bytes; with
+ * an initial_size of 0 the first block is allocated when needed.
+ */
+void mem_pool_init(struct mem_pool **mem_pool, size_t initial_size);
+
+/*
+ * Free the blocks of the pool and the pool itself. If invalidate_memory
+ * is set, the memory is overwritten first, so that users of memory that
+ * should not have outlived the pool are more likely to notice.
+ */
+void mem_pool_discard(struct mem_pool *mem_pool, int invalidate_memory);
+
+/*
+ * Allocate len bytes from the pool, aligned to uintmax_t.
+ */
+void *mem_pool_alloc(struct mem_pool *pool, size_t len);
+
+/*
+ * Allocate count * size zeroed bytes from the pool.
+ */
+void *mem_pool_calloc(struct mem_pool *pool, size_t count, size_t size);
+
+/*
+ * Move the blocks of src to dst, so that the memory allocated from src
+ * lives as long as dst. src is left empty.
+ */
+void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src);
+
+/*
+ * Check whether mem was allocated from the pool.
+ */
+int mem_pool_contains(struct mem_pool *mem_pool, void *mem);
+
+#endif
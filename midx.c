@@ -0,0 +1,600 @@
+#include "cache.h"
+#include "csum-file.h"
+#include "lockfile.h"
+#include "dir.h"
+#include "midx.h"
+
+#define MIDX_HEADER_SIZE 12
+#define MIDX_CHUNK_LOOKUP_WIDTH (sizeof(uint32_t) + sizeof(uint64_t))
+
+#define MIDX_CHUNKID_PACKNAMES 0x504e414d /* "PNAM" */
+#define MIDX_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
+#define MIDX_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
+#define MIDX_CHUNKID_OBJECTOFFSETS 0x4f4f4646 /* "OOFF" */
+#define MIDX_CHUNKID_LARGEOFFSETS 0x4c4f4646 /* "LOFF" */
+#define MIDX_MAX_CHUNKS 5
+
+#define MIDX_CHUNK_FANOUT_SIZE (sizeof(uint32_t) * 256)
+#define MIDX_CHUNK_OFFSET_WIDTH (2 * sizeof(uint32_t))
+#define MIDX_CHUNK_LARGE_OFFSET_WIDTH (sizeof(uint64_t))
+#define MIDX_LARGE_OFFSET_NEEDED 0x80000000
+
+struct multi_pack_index *multi_pack_index;
+
+char *get_midx_filename(const char *object_dir)
+{
+	return xstrfmt("%s/pack/multi-pack-index", object_dir);
+}
+
+static int parse_midx_pack_names(struct multi_pack_index *m,
+				 const char *midx_name, size_t len)
+{
+	const char *cur = (const char *)m->chunk_pack_names;
+	const char *end = cur + len;
+	uint32_t i;
+
+	ALLOC_ARRAY(m->pack_names, m->num_packs);
+	m->packs = xcalloc(m->num_packs, sizeof(*m->packs));
+
+	for (i = 0; i < m->num_packs; i++) {
+		const char *nul = memchr(cur, '\0', end - cur);
+
+		if (!nul)
+			return error(_("multi-pack-index %s has truncated pack names"),
+				     midx_name);
+		if (i && strcmp(m->pack_names[i - 1], cur) >= 0)
+			return error(_("multi-pack-index %s pack names out of order: '%s' before '%s'"),
+				     midx_name, m->pack_names[i - 1], cur);
+		m->pack_names[i] = cur;
+		cur = nul + 1;
+	}
+	return 0;
+}
+
+struct multi_pack_index *load_multi_pack_index(const char *object_dir)
+{
+	struct multi_pack_index *m = NULL;
+	char *midx_name = get_midx_filename(object_dir);
+	size_t chunk_size[MIDX_MAX_CHUNKS + 1] = { 0 };
+	const unsigned char *data;
+	size_t midx_size;
+	void *midx_map;
+	struct stat st;
+	uint32_t i, nr_chunks;
+	int fd;
+
+	fd = git_open(midx_name);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			error_errno(_("unable to open %s"), midx_name);
+		free(midx_name);
+		return NULL;
+	}
+	if (fstat(fd, &st)) {
+		error_errno(_("unable to stat %s"), midx_name);
+		close(fd);
+		free(midx_name);
+		return NULL;
+	}
+	midx_size = xsize_t(st.st_size);
+	if (midx_size < MIDX_HEADER_SIZE + GIT_SHA1_RAWSZ) {
+		error(_("multi-pack-index file %s is too small"), midx_name);
+		close(fd);
+		free(midx_name);
+		return NULL;
+	}
+	midx_map = xmmap(NULL, midx_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	FLEX_ALLOC_STR(m, object_dir, object_dir);
+	m->data = data = midx_map;
+	m->data_len = midx_size;
+
+	if (get_be32(data) != MIDX_SIGNATURE) {
+		error(_("multi-pack-index signature 0x%08x does not match signature 0x%08x"),
+		      get_be32(data), MIDX_SIGNATURE);
+		goto cleanup_fail;
+	}
+	if (data[4] != MIDX_VERSION) {
+		error(_("multi-pack-index version %d not recognized"), data[4]);
+		goto cleanup_fail;
+	}
+	if (data[5] != MIDX_HASH_VERSION) {
+		error(_("multi-pack-index hash version %d not recognized"), data[5]);
+		goto cleanup_fail;
+	}
+	nr_chunks = data[6];
+	if (data[7]) {
+		error(_("multi-pack-index %s has unsupported base files"), midx_name);
+		goto cleanup_fail;
+	}
+	m->num_packs = get_be32(data + 8);
+
+	if (MIDX_HEADER_SIZE + (nr_chunks + 1) * MIDX_CHUNK_LOOKUP_WIDTH +
+	    GIT_SHA1_RAWSZ > midx_size) {
+		error(_("multi-pack-index file %s is too small"), midx_name);
+		goto cleanup_fail;
+	}
+
+	for (i = 0; i < nr_chunks; i++) {
+		const unsigned char *row = data + MIDX_HEADER_SIZE +
+					   i * MIDX_CHUNK_LOOKUP_WIDTH;
+		uint32_t chunk_id = get_be32(row);
+		uint64_t chunk_offset = get_be64(row + 4);
+		uint64_t next_offset = get_be64(row + MIDX_CHUNK_LOOKUP_WIDTH + 4);
+		const unsigned char *chunk = data + chunk_offset;
+		size_t size;
+		int slot;
+
+		if (chunk_offset > next_offset ||
+		    next_offset > midx_size - GIT_SHA1_RAWSZ) {
+			error(_("multi-pack-index %s has improper chunk offset"),
+			      midx_name);
+			goto cleanup_fail;
+		}
+		size = next_offset - chunk_offset;
+
+		switch (chunk_id) {
+		case MIDX_CHUNKID_PACKNAMES:
+			m->chunk_pack_names = chunk;
+			slot = 0;
+			break;
+		case MIDX_CHUNKID_OIDFANOUT:
+			m->chunk_oid_fanout = (const uint32_t *)chunk;
+			slot = 1;
+			break;
+		case MIDX_CHUNKID_OIDLOOKUP:
+			m->chunk_oid_lookup = chunk;
+			slot = 2;
+			break;
+		case MIDX_CHUNKID_OBJECTOFFSETS:
+			m->chunk_object_offsets = chunk;
+			slot = 3;
+			break;
+		case MIDX_CHUNKID_LARGEOFFSETS:
+			m->chunk_large_offsets = chunk;
+			m->chunk_large_offsets_len = size;
+			slot = 4;
+			break;
+		case 0:
+			error(_("multi-pack-index %s has terminating chunk id too early"),
+			      midx_name);
+			goto cleanup_fail;
+		default:
+			/* Unknown chunks are ignored for forward compatibility. */
+			slot = MIDX_MAX_CHUNKS;
+			break;
+		}
+		chunk_size[slot] = size;
+	}
+
+	if (!m->chunk_pack_names || !m->chunk_oid_fanout ||
+	    !m->chunk_oid_lookup || !m->chunk_object_offsets) {
+		error(_("multi-pack-index %s is missing a required chunk"),
+		      midx_name);
+		goto cleanup_fail;
+	}
+	if (chunk_size[1] != MIDX_CHUNK_FANOUT_SIZE) {
+		error(_("multi-pack-index %s has a bad OID fanout"), midx_name);
+		goto cleanup_fail;
+	}
+
+	for (i = 0; i < 256; i++) {
+		uint32_t n = ntohl(m->chunk_oid_fanout[i]);
+		if (n < m->num_objects) {
+			error(_("multi-pack-index %s has non-monotonic fanout"),
+			      midx_name);
+			goto cleanup_fail;
+		}
+		m->num_objects = n;
+	}
+	if (chunk_size[2] != st_mult(m->num_objects, GIT_SHA1_RAWSZ) ||
+	    chunk_size[3] != st_mult(m->num_objects, MIDX_CHUNK_OFFSET_WIDTH)) {
+		error(_("multi-pack-index %s has wrong object table sizes"),
+		      midx_name);
+		goto cleanup_fail;
+	}
+
+	if (parse_midx_pack_names(m, midx_name, chunk_size[0]))
+		goto cleanup_fail;
+
+	free(midx_name);
+	return m;
+
+cleanup_fail:
+	close_multi_pack_index(m);
+	free(midx_name);
+	return NULL;
+}
+
+void close_multi_pack_index(struct multi_pack_index *m)
+{
+	if (!m)
+		return;
+	munmap((void *)m->data, m->data_len);
+	free(m->pack_names);
+	free(m->packs);
+	free(m);
+}
+
+void prepare_multi_pack_index_one(const char *object_dir)
+{
+	struct multi_pack_index *m;
+	struct strbuf pack_name = STRBUF_INIT;
+	size_t dirlen;
+	uint32_t i;
+	int enabled;
+
+	if (git_config_get_bool("core.multipackindex", &enabled) || !enabled)
+		return;
+
+	for (m = multi_pack_index; m; m = m->next)
+		if (!strcmp(m->object_dir, object_dir))
+			return;
+
+	m = load_multi_pack_index(object_dir);
+	if (!m)
+		return;
+
+	strbuf_addf(&pack_name, "%s/pack/", object_dir);
+	dirlen = pack_name.len;
+	for (i = 0; i < m->num_packs; i++) {
+		struct packed_git *p;
+
+		strbuf_setlen(&pack_name, dirlen);
+		strbuf_addstr(&pack_name, m->pack_names[i]);
+		strbuf_strip_suffix(&pack_name, ".idx");
+		strbuf_addstr(&pack_name, ".pack");
+
+		for (p = packed_git; p; p = p->next)
+			if (!strcmp(p->pack_name, pack_name.buf))
+				break;
+		if (!p) {
+			/*
+			 * The pack went away (e.g. repack removed it without
+			 * rewriting the midx); the index is stale.
+			 */
+			strbuf_release(&pack_name);
+			close_multi_pack_index(m);
+			return;
+		}
+		m->packs[i] = p;
+	}
+	strbuf_release(&pack_name);
+
+	for (i = 0; i < m->num_packs; i++)
+		m->packs[i]->multi_pack_index = 1;
+	m->next = multi_pack_index;
+	multi_pack_index = m;
+}
+
+int find_midx_entry(struct multi_pack_index *m,
+		    const unsigned char *sha1,
+		    struct packed_git **pack, off_t *offset)
+{
+	const unsigned char *offset_data;
+	uint32_t lo, hi, pack_int_id, off32;
+
+	hi = ntohl(m->chunk_oid_fanout[*sha1]);
+	lo = *sha1 ? ntohl(m->chunk_oid_fanout[*sha1 - 1]) : 0;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(m->chunk_oid_lookup + mi * GIT_SHA1_RAWSZ, sha1);
+
+		if (!cmp) {
+			lo = mi;
+			goto found;
+		}
+		if (cmp > 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+
+found:
+	offset_data = m->chunk_object_offsets + lo * MIDX_CHUNK_OFFSET_WIDTH;
+	pack_int_id = get_be32(offset_data);
+	off32 = get_be32(offset_data + sizeof(uint32_t));
+
+	if (pack_int_id >= m->num_packs)
+		return error(_("multi-pack-index has bad pack-int-id %"PRIu32" for %s"),
+			     pack_int_id, sha1_to_hex(sha1));
+
+	if (off32 & MIDX_LARGE_OFFSET_NEEDED) {
+		size_t pos = off32 & ~MIDX_LARGE_OFFSET_NEEDED;
+
+		if (st_mult(pos + 1, MIDX_CHUNK_LARGE_OFFSET_WIDTH) >
+		    m->chunk_large_offsets_len)
+			return error(_("multi-pack-index large offset out of bounds for %s"),
+				     sha1_to_hex(sha1));
+		*offset = get_be64(m->chunk_large_offsets +
+				   pos * MIDX_CHUNK_LARGE_OFFSET_WIDTH);
+	} else
+		*offset = off32;
+
+	*pack = m->packs[pack_int_id];
+	return 1;
+}
+
+struct midx_pack {
+	char *idx_name;
+	struct packed_git *p;
+};
+
+struct pack_midx_entry {
+	struct object_id oid;
+	uint32_t pack_int_id;
+	time_t pack_mtime;
+	off_t offset;
+};
+
+static int midx_pack_name_compare(const void *a_, const void *b_)
+{
+	const struct midx_pack *a = a_, *b = b_;
+	return strcmp(a->idx_name, b->idx_name);
+}
+
+static int midx_oid_compare(const void *a_, const void *b_)
+{
+	const struct pack_midx_entry *a = a_, *b = b_;
+	int cmp = oidcmp(&a->oid, &b->oid);
+
+	if (cmp)
+		return cmp;
+
+	/*
+	 * Of several copies of an object, prefer the one in the youngest
+	 * pack, as sort_pack() would have found that one first.
+	 */
+	if (a->pack_mtime > b->pack_mtime)
+		return -1;
+	if (a->pack_mtime < b->pack_mtime)
+		return 1;
+	if (a->pack_int_id < b->pack_int_id)
+		return -1;
+	return a->pack_int_id > b->pack_int_id;
+}
+
+static void collect_midx_packs(const char *object_dir,
+			       struct midx_pack **packs_p,
+			       uint32_t *nr_p)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct midx_pack *packs = NULL;
+	uint32_t nr = 0, alloc = 0;
+	size_t dirlen;
+	struct dirent *de;
+	DIR *dir;
+
+	strbuf_addf(&path, "%s/pack", object_dir);
+	dir = opendir(path.buf);
+	if (!dir) {
+		if (errno != ENOENT)
+			error_errno(_("unable to open object pack directory: %s"),
+				    path.buf);
+		strbuf_release(&path);
+		*packs_p = NULL;
+		*nr_p = 0;
+		return;
+	}
+	strbuf_addch(&path, '/');
+	dirlen = path.len;
+
+	while ((de = readdir(dir)) != NULL) {
+		struct packed_git *p;
+
+		if (!ends_with(de->d_name, ".idx"))
+			continue;
+
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+
+		p = add_packed_git(path.buf, path.len, 0);
+		if (!p)
+			continue;
+		if (open_pack_index(p)) {
+			free(p);
+			continue;
+		}
+
+		ALLOC_GROW(packs, nr + 1, alloc);
+		packs[nr].idx_name = xstrdup(de->d_name);
+		packs[nr].p = p;
+		nr++;
+	}
+	closedir(dir);
+	strbuf_release(&path);
+
+	QSORT(packs, nr, midx_pack_name_compare);
+	*packs_p = packs;
+	*nr_p = nr;
+}
+
+static struct pack_midx_entry *get_sorted_entries(struct midx_pack *packs,
+						  uint32_t nr_packs,
+						  uint32_t *nr_objects)
+{
+	struct pack_midx_entry *entries;
+	size_t total = 0;
+	uint32_t i, j, nr = 0;
+
+	for (i = 0; i < nr_packs; i++)
+		total = st_add(total, packs[i].p->num_objects);
+	if (total > UINT32_MAX)
+		die(_("too many objects for a multi-pack-index"));
+
+	ALLOC_ARRAY(entries, total);
+	for (i = 0; i < nr_packs; i++) {
+		struct packed_git *p = packs[i].p;
+
+		for (j = 0; j < p->num_objects; j++) {
+			struct pack_midx_entry *e = &entries[nr++];
+
+			nth_packed_object_oid(&e->oid, p, j);
+			e->pack_int_id = i;
+			e->pack_mtime = p->mtime;
+			e->offset = nth_packed_object_offset(p, j);
+		}
+	}
+
+	QSORT(entries, nr, midx_oid_compare);
+
+	/* Keep only the preferred copy of each object. */
+	for (i = j = 0; i < nr; i++) {
+		if (j && !oidcmp(&entries[j - 1].oid, &entries[i].oid))
+			continue;
+		entries[j++] = entries[i];
+	}
+
+	*nr_objects = j;
+	return entries;
+}
+
+static void write_midx_pack_names(struct sha1file *f,
+				  struct midx_pack *packs, uint32_t nr)
+{
+	static const unsigned char padding[4];
+	size_t written = 0;
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		size_t len = strlen(packs[i].idx_name) + 1;
+		sha1write(f, packs[i].idx_name, len);
+		written += len;
+	}
+	if (written % 4)
+		sha1write(f, padding, 4 - written % 4);
+}
+
+static void write_midx_oid_fanout(struct sha1file *f,
+				  struct pack_midx_entry *entries,
+				  uint32_t nr)
+{
+	uint32_t i, pos = 0;
+
+	/*
+	 * Write the first-level table (the list is sorted,
+	 * but we use a 256-entry lookup to be able to avoid
+	 * having to do eight extra binary search iterations).
+	 */
+	for (i = 0; i < 256; i++) {
+		while (pos < nr && entries[pos].oid.hash[0] == i)
+			pos++;
+		sha1write_be32(f, pos);
+	}
+}
+
+static void write_midx_object_offsets(struct sha1file *f,
+				      struct pack_midx_entry *entries,
+				      uint32_t nr)
+{
+	uint32_t i, nr_large = 0;
+
+	for (i = 0; i < nr; i++) {
+		sha1write_be32(f, entries[i].pack_int_id);
+		if (entries[i].offset >> 31)
+			sha1write_be32(f, MIDX_LARGE_OFFSET_NEEDED | nr_large++);
+		else
+			sha1write_be32(f, (uint32_t)entries[i].offset);
+	}
+}
+
+static void write_midx_large_offsets(struct sha1file *f,
+				     struct pack_midx_entry *entries,
+				     uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		uint64_t offset = entries[i].offset;
+
+		if (!(offset >> 31))
+			continue;
+		sha1write_be32(f, offset >> 32);
+		sha1write_be32(f, offset & 0xffffffff);
+	}
+}
+
+int write_midx_file(const char *object_dir)
+{
+	static struct lock_file lk;
+	struct sha1file *f;
+	struct midx_pack *packs;
+	struct pack_midx_entry *entries;
+	uint32_t chunk_ids[MIDX_MAX_CHUNKS + 1];
+	uint64_t chunk_offsets[MIDX_MAX_CHUNKS + 1];
+	uint32_t nr_packs, nr_objects, nr_large = 0, nr_chunks, i;
+	size_t pack_names_len = 0;
+	char *midx_name;
+
+	collect_midx_packs(object_dir, &packs, &nr_packs);
+	entries = get_sorted_entries(packs, nr_packs, &nr_objects);
+
+	for (i = 0; i < nr_packs; i++)
+		pack_names_len += strlen(packs[i].idx_name) + 1;
+	if (pack_names_len % 4)
+		pack_names_len += 4 - pack_names_len % 4;
+	for (i = 0; i < nr_objects; i++)
+		if (entries[i].offset >> 31)
+			nr_large++;
+
+	nr_chunks = nr_large ? 5 : 4;
+	chunk_ids[0] = MIDX_CHUNKID_PACKNAMES;
+	chunk_ids[1] = MIDX_CHUNKID_OIDFANOUT;
+	chunk_ids[2] = MIDX_CHUNKID_OIDLOOKUP;
+	chunk_ids[3] = MIDX_CHUNKID_OBJECTOFFSETS;
+	chunk_ids[4] = MIDX_CHUNKID_LARGEOFFSETS;
+	chunk_ids[nr_chunks] = 0;
+
+	chunk_offsets[0] = MIDX_HEADER_SIZE +
+			   (nr_chunks + 1) * MIDX_CHUNK_LOOKUP_WIDTH;
+	chunk_offsets[1] = chunk_offsets[0] + pack_names_len;
+	chunk_offsets[2] = chunk_offsets[1] + MIDX_CHUNK_FANOUT_SIZE;
+	chunk_offsets[3] = chunk_offsets[2] +
+			   (uint64_t)nr_objects * GIT_SHA1_RAWSZ;
+	chunk_offsets[4] = chunk_offsets[3] +
+			   (uint64_t)nr_objects * MIDX_CHUNK_OFFSET_WIDTH;
+	chunk_offsets[5] = chunk_offsets[4] +
+			   (uint64_t)nr_large * MIDX_CHUNK_LARGE_OFFSET_WIDTH;
+
+	midx_name = get_midx_filename(object_dir);
+	hold_lock_file_for_update(&lk, midx_name, LOCK_DIE_ON_ERROR);
+	f = sha1fd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	sha1write_be32(f, MIDX_SIGNATURE);
+	sha1write_u8(f, MIDX_VERSION);
+	sha1write_u8(f, MIDX_HASH_VERSION);
+	sha1write_u8(f, nr_chunks);
+	sha1write_u8(f, 0); /* number of base multi-pack-index files */
+	sha1write_be32(f, nr_packs);
+
+	for (i = 0; i <= nr_chunks; i++) {
+		sha1write_be32(f, chunk_ids[i]);
+		sha1write_be32(f, chunk_offsets[i] >> 32);
+		sha1write_be32(f, chunk_offsets[i] & 0xffffffff);
+	}
+
+	write_midx_pack_names(f, packs, nr_packs);
+	write_midx_oid_fanout(f, entries, nr_objects);
+	for (i = 0; i < nr_objects; i++)
+		sha1write(f, entries[i].oid.hash, GIT_SHA1_RAWSZ);
+	write_midx_object_offsets(f, entries, nr_objects);
+	if (nr_large)
+		write_midx_large_offsets(f, entries, nr_objects);
+
+	sha1close(f, NULL, CSUM_HASH_IN_STREAM);
+	if (commit_lock_file(&lk) < 0)
+		die_errno(_("unable to write '%s'"), midx_name);
+
+	for (i = 0; i < nr_packs; i++) {
+		close_pack_index(packs[i].p);
+		free(packs[i].p);
+		free(packs[i].idx_name);
+	}
+	free(packs);
+	free(entries);
+	free(midx_name);
+	return 0;
+}
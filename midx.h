@@ -0,0 +1,77 @@
+#ifndef MIDX_H
+#define MIDX_H
+
+/*
+ * A multi-pack-index ("midx") maps every object in a set of packfiles
+ * in an object directory to the pack that holds it and the offset
+ * within that pack, so that object lookups can do a single binary
+ * search instead of one per pack.  See the "multi-pack-index" section
+ * of Documentation/technical/pack-format.txt for the on-disk format.
+ */
+
+#define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
+#define MIDX_VERSION 1
+#define MIDX_HASH_VERSION 1 /* SHA-1 */
+
+struct multi_pack_index {
+	struct multi_pack_index *next;
+
+	const unsigned char *data;
+	size_t data_len;
+
+	uint32_t num_packs;
+	uint32_t num_objects;
+
+	const unsigned char *chunk_pack_names;
+	const uint32_t *chunk_oid_fanout;
+	const unsigned char *chunk_oid_lookup;
+	const unsigned char *chunk_object_offsets;
+	const unsigned char *chunk_large_offsets;
+	size_t chunk_large_offsets_len;
+
+	/* pack index names ("pack-<sha1>.idx"), sorted */
+	const char **pack_names;
+	/* the packed_git for each entry of pack_names, once resolved */
+	struct packed_git **packs;
+
+	char object_dir[FLEX_ARRAY];
+};
+
+/*
+ * The multi-pack-indexes of the local object directory and of any
+ * alternates, as loaded by prepare_packed_git().
+ */
+extern struct multi_pack_index *multi_pack_index;
+
+extern char *get_midx_filename(const char *object_dir);
+
+/*
+ * Map and check the multi-pack-index of "object_dir". Returns NULL if
+ * there is none or it cannot be used.
+ */
+extern struct multi_pack_index *load_multi_pack_index(const char *object_dir);
+extern void close_multi_pack_index(struct multi_pack_index *m);
+
+/*
+ * Load the multi-pack-index of "object_dir" (if core.multiPackIndex is
+ * enabled) and connect it to the packs already in the packed_git list,
+ * marking those packs as covered.  A midx naming a pack that is not
+ * present is ignored.  Called by prepare_packed_git().
+ */
+extern void prepare_multi_pack_index_one(const char *object_dir);
+
+/*
+ * Look up "sha1" in "m". On success, return 1 and fill in the pack and
+ * the offset of the object within it.
+ */
+extern int find_midx_entry(struct multi_pack_index *m,
+			   const unsigned char *sha1,
+			   struct packed_git **pack, off_t *offset);
+
+/*
+ * Write a multi-pack-index covering every pack in "object_dir".
+ * Returns 0 on success.
+ */
+extern int write_midx_file(const char *object_dir);
+
+#endif /* MIDX_H */
@@ -159,8 +159,9 @@ void *object_as_type(struct object *obj, enum object_type type, int quiet)
 		return obj;
 	else if (obj->type == OBJ_NONE) {
 		if (type == OBJ_COMMIT)
-			((struct commit *)obj)->index = alloc_commit_index();
-		obj->type = type;
+			init_commit_node((struct commit *)obj);
+		else
+			obj->type = type;
 		return obj;
 	}
 	else {
@@ -466,7 +466,8 @@ static const unsigned char *sha1_access(size_t pos, void *table)
 
 static void write_selected_commits_v1(struct sha1file *f,
 				      struct pack_idx_entry **index,
-				      uint32_t index_nr)
+				      uint32_t index_nr,
+				      off_t *offsets)
 {
 	int i;
 
@@ -479,6 +480,9 @@ static void write_selected_commits_v1(struct sha1file *f,
 		if (commit_pos < 0)
 			die("BUG: trying to write commit not in index");
 
+		stored->commit_pos = commit_pos;
+		offsets[i] = sha1file_total(f);
+
 		sha1write_be32(f, commit_pos);
 		sha1write_u8(f, stored->xor_offset);
 		sha1write_u8(f, stored->flags);
@@ -487,6 +491,50 @@ static void write_selected_commits_v1(struct sha1file *f,
 	}
 }
 
+static int table_cmp(const void *va, const void *vb, void *data)
+{
+	struct bitmapped_commit *selected = data;
+	uint32_t a = selected[*(const uint32_t *)va].commit_pos;
+	uint32_t b = selected[*(const uint32_t *)vb].commit_pos;
+
+	return (a < b) ? -1 : (a != b);
+}
+
+/*
+ * Write one row per bitmapped commit, sorted by its position in the
+ * index, so that a reader can find the entry of a commit by bisecting
+ * the table and load only the bitmaps it needs.
+ */
+static void write_lookup_table(struct sha1file *f, off_t *offsets)
+{
+	uint32_t *table, *table_inv, i;
+
+	ALLOC_ARRAY(table, writer.selected_nr);
+	ALLOC_ARRAY(table_inv, writer.selected_nr);
+
+	for (i = 0; i < writer.selected_nr; i++)
+		table[i] = i;
+	QSORT_S(table, writer.selected_nr, table_cmp, writer.selected);
+	for (i = 0; i < writer.selected_nr; i++)
+		table_inv[table[i]] = i;
+
+	for (i = 0; i < writer.selected_nr; i++) {
+		struct bitmapped_commit *stored = &writer.selected[table[i]];
+		uint32_t xor_row = BITMAP_LOOKUP_NO_XOR;
+
+		if (stored->xor_offset)
+			xor_row = table_inv[table[i] - stored->xor_offset];
+
+		sha1write_be32(f, stored->commit_pos);
+		sha1write_be32(f, (uint64_t)offsets[table[i]] >> 32);
+		sha1write_be32(f, offsets[table[i]] & 0xffffffff);
+		sha1write_be32(f, xor_row);
+	}
+
+	free(table);
+	free(table_inv);
+}
+
 static void write_hash_cache(struct sha1file *f,
 			     struct pack_idx_entry **index,
 			     uint32_t index_nr)
@@ -514,6 +562,7 @@ void bitmap_writer_finish(struct pack_idx_entry **index,
 	static uint16_t flags = BITMAP_OPT_FULL_DAG;
 	struct strbuf tmp_file = STRBUF_INIT;
 	struct sha1file *f;
+	off_t *offsets;
 
 	struct bitmap_disk_header header;
 
@@ -532,7 +581,12 @@ void bitmap_writer_finish(struct pack_idx_entry **index,
 	dump_bitmap(f, writer.trees);
 	dump_bitmap(f, writer.blobs);
 	dump_bitmap(f, writer.tags);
-	write_selected_commits_v1(f, index, index_nr);
+	ALLOC_ARRAY(offsets, writer.selected_nr);
+	write_selected_commits_v1(f, index, index_nr, offsets);
+
+	if (options & BITMAP_OPT_LOOKUP_TABLE)
+		write_lookup_table(f, offsets);
+	free(offsets);
 
 	if (options & BITMAP_OPT_HASH_CACHE)
 		write_hash_cache(f, index, index_nr);
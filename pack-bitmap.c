@@ -66,6 +66,12 @@ static struct bitmap_index {
 	/* Name-hash cache (or NULL if not present). */
 	uint32_t *hashes;
 
+	/*
+	 * Lookup table of the bitmapped commits (or NULL if not present).
+	 * With it, the bitmaps are only read when a walk needs them.
+	 */
+	const unsigned char *table_lookup;
+
 	/*
 	 * Extended index.
 	 *
@@ -148,14 +154,26 @@ static int load_bitmap_header(struct bitmap_index *index)
 	/* Parse known bitmap format options */
 	{
 		uint32_t flags = ntohs(header->options);
+		unsigned char *end = index->map + index->map_size - 20;
 
 		if ((flags & BITMAP_OPT_FULL_DAG) == 0)
 			return error("Unsupported options for bitmap index file "
 				"(Git requires BITMAP_OPT_FULL_DAG)");
 
 		if (flags & BITMAP_OPT_HASH_CACHE) {
-			unsigned char *end = index->map + index->map_size - 20;
 			index->hashes = ((uint32_t *)end) - index->pack->num_objects;
+			end = (unsigned char *)index->hashes;
+		}
+
+		if (flags & BITMAP_OPT_LOOKUP_TABLE) {
+			size_t table_size = st_mult(ntohl(header->entry_count),
+						    BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+
+			if (end < index->map + sizeof(*header) ||
+			    table_size > end - index->map - sizeof(*header))
+				return error("Corrupted bitmap index file (too short to fit lookup table)");
+			if (git_env_bool("GIT_TEST_READ_BITMAP_LOOKUP_TABLE", 1))
+				index->table_lookup = end - table_size;
 		}
 	}
 
@@ -247,6 +265,153 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 	return 0;
 }
 
+static const unsigned char *bitmap_table_row(struct bitmap_index *index,
+					     uint32_t row)
+{
+	return index->table_lookup + st_mult(row, BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+}
+
+static const unsigned char *bitmap_table_sha1(struct bitmap_index *index,
+					      uint32_t row)
+{
+	uint32_t commit_pos = get_be32(bitmap_table_row(index, row));
+
+	if (commit_pos >= index->pack->num_objects) {
+		error("Corrupted bitmap lookup table (bad commit position)");
+		return NULL;
+	}
+	return nth_packed_object_sha1(index->pack, commit_pos);
+}
+
+/* Find the row of "sha1" in the lookup table, or return -1 */
+static int bitmap_table_find(struct bitmap_index *index,
+			     const unsigned char *sha1)
+{
+	uint32_t lo = 0, hi = index->entry_count;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const unsigned char *mi_sha1 = bitmap_table_sha1(index, mi);
+		int cmp;
+
+		if (!mi_sha1)
+			return -1;
+		cmp = hashcmp(sha1, mi_sha1);
+		if (!cmp)
+			return mi;
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return -1;
+}
+
+/*
+ * Read the entry that the given row of the lookup table points to,
+ * whose bitmap is XORed against "xor_with" if that is not NULL.
+ */
+static struct stored_bitmap *load_bitmap_row_1(struct bitmap_index *index,
+					       uint32_t row,
+					       struct stored_bitmap *xor_with)
+{
+	const unsigned char *triplet = bitmap_table_row(index, row);
+	const unsigned char *sha1 = bitmap_table_sha1(index, row);
+	uint64_t offset = get_be64(triplet + 4);
+	struct ewah_bitmap *bitmap;
+	int flags;
+
+	if (!sha1)
+		return NULL;
+	if (offset < sizeof(struct bitmap_disk_header) ||
+	    offset + 6 > index->map_size - 20) {
+		error("Corrupted bitmap lookup table (bad offset)");
+		return NULL;
+	}
+
+	index->map_pos = offset;
+	if (read_be32(index->map, &index->map_pos) != get_be32(triplet)) {
+		error("Corrupted bitmap lookup table (entry mismatch)");
+		return NULL;
+	}
+	read_u8(index->map, &index->map_pos); /* XOR offset, see the table */
+	flags = read_u8(index->map, &index->map_pos);
+
+	bitmap = read_bitmap_1(index);
+	if (!bitmap)
+		return NULL;
+
+	return store_bitmap(index, bitmap, sha1, xor_with, flags);
+}
+
+/*
+ * Load the bitmap of the given row of the lookup table, after the ones
+ * it is XORed against, unless they have been loaded already.
+ */
+static struct stored_bitmap *load_bitmap_row(struct bitmap_index *index,
+					     uint32_t row)
+{
+	struct stored_bitmap *xor_with = NULL;
+	uint32_t *chain = NULL;
+	size_t nr = 0, alloc = 0;
+
+	for (;;) {
+		const unsigned char *sha1 = bitmap_table_sha1(index, row);
+		khiter_t pos;
+		uint32_t xor_row;
+
+		if (!sha1)
+			goto out;
+		pos = kh_get_sha1(index->bitmaps, sha1);
+		if (pos < kh_end(index->bitmaps)) {
+			xor_with = kh_value(index->bitmaps, pos);
+			break;
+		}
+
+		ALLOC_GROW(chain, nr + 1, alloc);
+		chain[nr++] = row;
+
+		xor_row = get_be32(bitmap_table_row(index, row) + 12);
+		if (xor_row == BITMAP_LOOKUP_NO_XOR)
+			break;
+		if (xor_row >= index->entry_count || nr > index->entry_count) {
+			error("Corrupted bitmap lookup table (bad XOR row)");
+			goto out;
+		}
+		row = xor_row;
+	}
+
+	while (nr) {
+		xor_with = load_bitmap_row_1(index, chain[--nr], xor_with);
+		if (!xor_with)
+			break;
+	}
+
+out:
+	free(chain);
+	return xor_with;
+}
+
+/*
+ * Return the stored bitmap of a commit, reading it first if the index
+ * has a lookup table, or NULL if the commit has none.
+ */
+static struct stored_bitmap *find_stored_bitmap(const unsigned char *sha1)
+{
+	khiter_t pos = kh_get_sha1(bitmap_git.bitmaps, sha1);
+	int row;
+
+	if (pos < kh_end(bitmap_git.bitmaps))
+		return kh_value(bitmap_git.bitmaps, pos);
+	if (!bitmap_git.table_lookup)
+		return NULL;
+
+	row = bitmap_table_find(&bitmap_git, sha1);
+	if (row < 0)
+		return NULL;
+	return load_bitmap_row(&bitmap_git, row);
+}
+
 static char *pack_bitmap_filename(struct packed_git *p)
 {
 	size_t len;
@@ -305,7 +470,8 @@ static int load_pack_bitmap(void)
 
 	bitmap_git.bitmaps = kh_init_sha1();
 	bitmap_git.ext_index.positions = kh_init_sha1_pos();
-	load_pack_revindex(bitmap_git.pack);
+	if (load_pack_revindex(bitmap_git.pack))
+		goto failed;
 
 	if (!(bitmap_git.commits = read_bitmap_1(&bitmap_git)) ||
 		!(bitmap_git.trees = read_bitmap_1(&bitmap_git)) ||
@@ -313,7 +479,8 @@ static int load_pack_bitmap(void)
 		!(bitmap_git.tags = read_bitmap_1(&bitmap_git)))
 		goto failed;
 
-	if (load_bitmap_entries_v1(&bitmap_git) < 0)
+	if (!bitmap_git.table_lookup &&
+	    load_bitmap_entries_v1(&bitmap_git) < 0)
 		goto failed;
 
 	bitmap_git.loaded = 1;
@@ -435,7 +602,7 @@ static int add_to_include_set(struct include_data *data,
 			      const unsigned char *sha1,
 			      int bitmap_pos)
 {
-	khiter_t hash_pos;
+	struct stored_bitmap *st;
 
 	if (data->seen && bitmap_get(data->seen, bitmap_pos))
 		return 0;
@@ -443,9 +610,8 @@ static int add_to_include_set(struct include_data *data,
 	if (bitmap_get(data->base, bitmap_pos))
 		return 0;
 
-	hash_pos = kh_get_sha1(bitmap_git.bitmaps, sha1);
-	if (hash_pos < kh_end(bitmap_git.bitmaps)) {
-		struct stored_bitmap *st = kh_value(bitmap_git.bitmaps, hash_pos);
+	st = find_stored_bitmap(sha1);
+	if (st) {
 		bitmap_or_ewah(data->base, lookup_stored_bitmap(st));
 		return 0;
 	}
@@ -499,10 +665,9 @@ static struct bitmap *find_objects(struct rev_info *revs,
 		roots = roots->next;
 
 		if (object->type == OBJ_COMMIT) {
-			khiter_t pos = kh_get_sha1(bitmap_git.bitmaps, object->oid.hash);
+			struct stored_bitmap *st = find_stored_bitmap(object->oid.hash);
 
-			if (pos < kh_end(bitmap_git.bitmaps)) {
-				struct stored_bitmap *st = kh_value(bitmap_git.bitmaps, pos);
+			if (st) {
 				struct ewah_bitmap *or_with = lookup_stored_bitmap(st);
 
 				if (base == NULL)
@@ -612,7 +777,7 @@ static void show_objects_for_type(
 
 		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
 			const unsigned char *sha1;
-			struct revindex_entry *entry;
+			uint32_t nr;
 			uint32_t hash = 0;
 
 			if ((word >> offset) == 0)
@@ -623,13 +788,14 @@ static void show_objects_for_type(
 			if (pos + offset < bitmap_git.reuse_objects)
 				continue;
 
-			entry = &bitmap_git.pack->revindex[pos + offset];
-			sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
+			nr = pack_pos_to_index(bitmap_git.pack, pos + offset);
+			sha1 = nth_packed_object_sha1(bitmap_git.pack, nr);
 
 			if (bitmap_git.hashes)
-				hash = ntohl(bitmap_git.hashes[entry->nr]);
+				hash = ntohl(bitmap_git.hashes[nr]);
 
-			show_reach(sha1, object_type, 0, hash, bitmap_git.pack, entry->offset);
+			show_reach(sha1, object_type, 0, hash, bitmap_git.pack,
+				   nth_packed_object_offset(bitmap_git.pack, nr));
 		}
 
 		pos += BITS_IN_EWORD;
@@ -770,10 +936,9 @@ int reuse_partial_packfile_from_bitmap(struct packed_git **packfile,
 #ifdef GIT_BITMAP_DEBUG
 	{
 		const unsigned char *sha1;
-		struct revindex_entry *entry;
 
-		entry = &bitmap_git.reverse_index->revindex[reuse_objects];
-		sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
+		sha1 = nth_packed_object_sha1(bitmap_git.pack,
+				pack_pos_to_index(bitmap_git.pack, reuse_objects));
 
 		fprintf(stderr, "Failed to reuse at %d (%016llx)\n",
 			reuse_objects, result->words[i]);
@@ -797,7 +962,7 @@ int reuse_partial_packfile_from_bitmap(struct packed_git **packfile,
 		return -1;
 
 	bitmap_git.reuse_objects = *entries = reuse_objects;
-	*up_to = bitmap_git.pack->revindex[reuse_objects].offset;
+	*up_to = pack_pos_to_offset(bitmap_git.pack, reuse_objects);
 	*packfile = bitmap_git.pack;
 
 	return 0;
@@ -921,7 +1086,7 @@ void test_bitmap_walk(struct rev_info *revs)
 {
 	struct object *root;
 	struct bitmap *result = NULL;
-	khiter_t pos;
+	struct stored_bitmap *st;
 	size_t result_popcnt;
 	struct bitmap_test_data tdata;
 
@@ -935,10 +1100,9 @@ void test_bitmap_walk(struct rev_info *revs)
 		bitmap_git.version, bitmap_git.entry_count);
 
 	root = revs->pending.objects[0].item;
-	pos = kh_get_sha1(bitmap_git.bitmaps, root->oid.hash);
+	st = find_stored_bitmap(root->oid.hash);
 
-	if (pos < kh_end(bitmap_git.bitmaps)) {
-		struct stored_bitmap *st = kh_value(bitmap_git.bitmaps, pos);
+	if (st) {
 		struct ewah_bitmap *bm = lookup_stored_bitmap(st);
 
 		fprintf(stderr, "Found bitmap for %s. %d bits / %08x checksum\n",
@@ -1022,16 +1186,22 @@ int rebuild_existing_bitmaps(struct packing_data *mapping,
 	if (prepare_bitmap_git() < 0)
 		return -1;
 
+	/* all of the bitmaps are rebuilt, so read the ones not read yet */
+	if (bitmap_git.table_lookup) {
+		for (i = 0; i < bitmap_git.entry_count; i++)
+			if (!load_bitmap_row(&bitmap_git, i))
+				return -1;
+	}
+
 	num_objects = bitmap_git.pack->num_objects;
 	reposition = xcalloc(num_objects, sizeof(uint32_t));
 
 	for (i = 0; i < num_objects; ++i) {
 		const unsigned char *sha1;
-		struct revindex_entry *entry;
 		struct object_entry *oe;
 
-		entry = &bitmap_git.pack->revindex[i];
-		sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
+		sha1 = nth_packed_object_sha1(bitmap_git.pack,
+				pack_pos_to_index(bitmap_git.pack, i));
 		oe = packlist_find(mapping, sha1, NULL);
 
 		if (oe)
@@ -20,8 +20,17 @@ static const char BITMAP_IDX_SIGNATURE[] = {'B', 'I', 'T', 'M'};
 enum pack_bitmap_opts {
 	BITMAP_OPT_FULL_DAG = 1,
 	BITMAP_OPT_HASH_CACHE = 4,
+	BITMAP_OPT_LOOKUP_TABLE = 16,
 };
 
+/*
+ * Each row of the lookup table: the index position of a bitmapped commit,
+ * the offset of its entry in the file and the row of the commit whose
+ * bitmap it is XORed against, or BITMAP_LOOKUP_NO_XOR.
+ */
+#define BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH (4 + 8 + 4)
+#define BITMAP_LOOKUP_NO_XOR 0xffffffff
+
 enum pack_bitmap_flags {
 	BITMAP_FLAG_REUSE = 0x1
 };
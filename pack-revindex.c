@@ -1,4 +1,5 @@
 #include "cache.h"
+#include "pack.h"
 #include "pack-revindex.h"
 
 /*
@@ -13,6 +14,12 @@
  * ordered by offset, so if you know the offset of an object, next offset
  * is where its packed representation ends and the index_nr can be used to
  * get the object sha1 from the main index.
+ *
+ * The same list can be written next to the index as a ".rev" file,
+ * which only holds the index_nr of each object, in pack order; the
+ * offsets are then read from the main index. Mapping that file saves
+ * reading and sorting all the offsets of a large pack in every process
+ * that needs one of them.
  */
 
 /*
@@ -122,6 +129,9 @@ static void create_pack_revindex(struct packed_git *p)
 	unsigned i;
 	const char *index = p->index_data;
 
+	if (git_env_bool("GIT_TEST_REV_INDEX_DIE_IN_MEMORY", 0))
+		die("dying as requested by GIT_TEST_REV_INDEX_DIE_IN_MEMORY");
+
 	ALLOC_ARRAY(p->revindex, num_ent + 1);
 	index += 4 * 256;
 
@@ -157,23 +167,128 @@ static void create_pack_revindex(struct packed_git *p)
 	sort_revindex(p->revindex, num_ent, p->pack_size);
 }
 
-void load_pack_revindex(struct packed_git *p)
+/*
+ * Map the ".rev" file of the pack, if it has one that goes with its
+ * index. Returns -1 if there is none, or if it cannot be used.
+ */
+static int load_pack_revindex_from_disk(struct packed_git *p)
+{
+	struct strbuf rev_name = STRBUF_INIT;
+	const unsigned char *data;
+	size_t rev_size;
+	struct stat st;
+	int fd, ret = -1;
+
+	strbuf_addstr(&rev_name, p->pack_name);
+	if (!strbuf_strip_suffix(&rev_name, ".pack"))
+		goto out;
+	strbuf_addstr(&rev_name, ".rev");
+
+	fd = git_open(rev_name.buf);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			error_errno("unable to open %s", rev_name.buf);
+		goto out;
+	}
+	if (fstat(fd, &st)) {
+		error_errno("unable to stat %s", rev_name.buf);
+		close(fd);
+		goto out;
+	}
+	rev_size = xsize_t(st.st_size);
+	if (rev_size != st_add(PACK_REV_HEADER_SIZE + 2 * 20,
+			       st_mult(4, p->num_objects))) {
+		error("reverse index %s has the wrong size", rev_name.buf);
+		close(fd);
+		goto out;
+	}
+	data = xmmap(NULL, rev_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(data) != PACK_REV_SIGNATURE) {
+		error("reverse index signature mismatch in %s", rev_name.buf);
+		goto unmap;
+	}
+	if (get_be32(data + 4) != PACK_REV_VERSION) {
+		error("reverse index %s has unsupported version %"PRIu32,
+		      rev_name.buf, get_be32(data + 4));
+		goto unmap;
+	}
+	if (get_be32(data + 8) != 1) {
+		error("reverse index %s has unsupported hash id %"PRIu32,
+		      rev_name.buf, get_be32(data + 8));
+		goto unmap;
+	}
+	/* both end with the checksum of the pack they describe */
+	if (hashcmp(data + rev_size - 40,
+		    (const unsigned char *)p->index_data + p->index_size - 40)) {
+		error("reverse index %s does not match its pack", rev_name.buf);
+		goto unmap;
+	}
+
+	p->revindex_map = data;
+	p->revindex_size = rev_size;
+	p->revindex_data = (const uint32_t *)(data + PACK_REV_HEADER_SIZE);
+	ret = 0;
+	goto out;
+
+unmap:
+	munmap((void *)data, rev_size);
+out:
+	strbuf_release(&rev_name);
+	return ret;
+}
+
+int load_pack_revindex(struct packed_git *p)
 {
-	if (!p->revindex)
+	if (p->revindex || p->revindex_data)
+		return 0;
+	if (open_pack_index(p))
+		return -1;
+	if (load_pack_revindex_from_disk(p))
 		create_pack_revindex(p);
+	return 0;
+}
+
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos)
+{
+	uint32_t nr;
+
+	if (p->revindex)
+		return p->revindex[pos].nr;
+
+	nr = get_be32(p->revindex_data + pos);
+	if (nr >= p->num_objects)
+		die("reverse index for %s is corrupt", p->pack_name);
+	return nr;
+}
+
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos)
+{
+	if (p->revindex)
+		return p->revindex[pos].offset;
+
+	/* This knows the pack format, as create_pack_revindex() does */
+	if (pos == p->num_objects)
+		return p->pack_size - 20;
+	return nth_packed_object_offset(p, pack_pos_to_index(p, pos));
 }
 
 int find_revindex_position(struct packed_git *p, off_t ofs)
 {
 	int lo = 0;
 	int hi = p->num_objects + 1;
-	struct revindex_entry *revindex = p->revindex;
+
+	if (load_pack_revindex(p))
+		return -1;
 
 	do {
 		unsigned mi = lo + (hi - lo) / 2;
-		if (revindex[mi].offset == ofs) {
+		off_t mi_ofs = pack_pos_to_offset(p, mi);
+
+		if (mi_ofs == ofs) {
 			return mi;
-		} else if (ofs < revindex[mi].offset)
+		} else if (ofs < mi_ofs)
 			hi = mi;
 		else
 			lo = mi + 1;
@@ -182,16 +297,3 @@ int find_revindex_position(struct packed_git *p, off_t ofs)
 	error("bad offset for revindex");
 	return -1;
 }
-
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs)
-{
-	int pos;
-
-	load_pack_revindex(p);
-	pos = find_revindex_position(p, ofs);
-
-	if (pos < 0)
-		return NULL;
-
-	return p->revindex + pos;
-}
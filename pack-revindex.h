@@ -8,9 +8,29 @@ struct revindex_entry {
 	unsigned int nr;
 };
 
-void load_pack_revindex(struct packed_git *p);
+/*
+ * Make the objects of a pack available in the order they appear in it,
+ * by mapping its ".rev" file if it has a usable one, and otherwise by
+ * sorting the offsets in its index. Returns 0 on success, -1 if the
+ * index cannot be opened.
+ */
+int load_pack_revindex(struct packed_git *p);
+
+/*
+ * Return the position in pack order of the object that starts at
+ * "ofs", loading the revindex if needed, or -1 with an error if no
+ * object starts there.
+ */
 int find_revindex_position(struct packed_git *p, off_t ofs);
 
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs);
+/* Return the position in the index of the "pos"-th object of the pack. */
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos);
+
+/*
+ * Return the offset of the "pos"-th object of the pack. With "pos" equal
+ * to the number of objects, this is the offset of the trailer, where the
+ * data of the last object ends.
+ */
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos);
 
 #endif
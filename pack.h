@@ -35,11 +35,21 @@ struct pack_header {
  */
 #define PACK_IDX_SIGNATURE 0xff744f63	/* "\377tOc" */
 
+/*
+ * The reverse index of a pack, kept next to its index as "pack-*.rev",
+ * starts with this signature, a version and a hash function id, each
+ * 4 bytes in network order (see Documentation/technical/pack-format.txt).
+ */
+#define PACK_REV_SIGNATURE 0x52494458	/* "RIDX" */
+#define PACK_REV_VERSION 1
+#define PACK_REV_HEADER_SIZE 12
+
 struct pack_idx_option {
 	unsigned flags;
 	/* flag bits */
 #define WRITE_IDX_VERIFY 01 /* verify only, do not write the idx file */
 #define WRITE_IDX_STRICT 02
+#define WRITE_REV 04 /* also write (or verify) the reverse index */
 
 	uint32_t version;
 	uint32_t off32_limit;
@@ -78,6 +88,13 @@ struct progress;
 typedef int (*verify_fn)(const struct object_id *, enum object_type, unsigned long, void*, int*);
 
 extern const char *write_idx_file(const char *index_name, struct pack_idx_entry **objects, int nr_objects, const struct pack_idx_option *, const unsigned char *sha1);
+/*
+ * Write the reverse index of a pack, given its objects sorted by name
+ * as write_idx_file() leaves them. Like write_idx_file(), it writes to
+ * a temporary file whose name is returned if "rev_name" is NULL, and
+ * only verifies an existing file with WRITE_IDX_VERIFY.
+ */
+extern const char *write_rev_file(const char *rev_name, struct pack_idx_entry **objects, uint32_t nr_objects, const unsigned char *pack_sha1, unsigned flags);
 extern int check_pack_crc(struct packed_git *p, struct pack_window **w_curs, off_t offset, off_t len, unsigned int nr);
 extern int verify_pack_index(struct packed_git *);
 extern int verify_pack(struct packed_git *, verify_fn fn, struct progress *, uint32_t);
@@ -0,0 +1,418 @@
+#include "cache.h"
+#include "parallel-checkout.h"
+#include "pkt-line.h"
+#include "run-command.h"
+#include "sigchain.h"
+#include "streaming.h"
+#include "thread-utils.h"
+
+struct parallel_checkout {
+	enum pc_status status;
+	struct parallel_checkout_item *items;
+	size_t nr, alloc;
+};
+
+static struct parallel_checkout parallel_checkout;
+
+enum pc_status parallel_checkout_status(void)
+{
+	return parallel_checkout.status;
+}
+
+#define DEFAULT_THRESHOLD_FOR_PARALLELISM 100
+
+void get_parallel_checkout_configs(int *num_workers, int *threshold)
+{
+	if (git_config_get_int("checkout.workers", num_workers))
+		*num_workers = 1;
+	else if (*num_workers < 1)
+		*num_workers = online_cpus();
+
+	if (git_config_get_int("checkout.thresholdForParallelism", threshold))
+		*threshold = DEFAULT_THRESHOLD_FOR_PARALLELISM;
+}
+
+void init_parallel_checkout(void)
+{
+	if (parallel_checkout.status != PC_UNINITIALIZED)
+		die("BUG: parallel checkout already initialized");
+
+	parallel_checkout.status = PC_ACCEPTING_ENTRIES;
+}
+
+static void finish_parallel_checkout(void)
+{
+	size_t i;
+
+	if (parallel_checkout.status == PC_UNINITIALIZED)
+		die("BUG: cannot finish parallel checkout: not initialized yet");
+
+	for (i = 0; i < parallel_checkout.nr; i++)
+		free(parallel_checkout.items[i].path);
+	free(parallel_checkout.items);
+	memset(&parallel_checkout, 0, sizeof(parallel_checkout));
+}
+
+int enqueue_checkout(struct cache_entry *ce, const struct checkout *state)
+{
+	struct parallel_checkout_item *pc_item;
+	struct conv_attrs ca;
+
+	if (parallel_checkout.status != PC_ACCEPTING_ENTRIES ||
+	    !S_ISREG(ce->ce_mode))
+		return -1;
+
+	/*
+	 * The workers cannot run filter drivers: a smudge or process
+	 * filter has to see the files in order, from a single process.
+	 */
+	convert_attrs(&ca, ce->name);
+	if (ca.drv)
+		return -1;
+
+	ALLOC_GROW(parallel_checkout.items, parallel_checkout.nr + 1,
+		   parallel_checkout.alloc);
+	pc_item = &parallel_checkout.items[parallel_checkout.nr];
+	memset(pc_item, 0, sizeof(*pc_item));
+	pc_item->id = parallel_checkout.nr++;
+	pc_item->ce = ce;
+	oidcpy(&pc_item->oid, &ce->oid);
+	pc_item->mode = ce->ce_mode;
+	pc_item->ca = ca;
+	pc_item->path = xstrfmt("%.*s%s", state->base_dir_len,
+				state->base_dir ? state->base_dir : "",
+				ce->name);
+	return 0;
+}
+
+static int create_pc_item_file(const struct parallel_checkout_item *pc_item)
+{
+	int mode = (pc_item->mode & 0100) ? 0777 : 0666;
+
+	return open(pc_item->path, O_WRONLY | O_CREAT | O_EXCL, mode);
+}
+
+static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd)
+{
+	struct stream_filter *filter;
+	struct strbuf buf = STRBUF_INIT;
+	enum object_type type;
+	unsigned long size;
+	size_t newsize;
+	void *new;
+	int ret;
+
+	filter = get_stream_filter_ca(&pc_item->ca, pc_item->oid.hash);
+	if (filter) {
+		if (!stream_blob_to_fd(fd, &pc_item->oid, filter, 1))
+			return 0;
+		/* start over with the blob in-core, as write_entry() does */
+		if (lseek(fd, 0, SEEK_SET) || ftruncate(fd, 0))
+			return error_errno("unable to rewind %s", pc_item->path);
+	}
+
+	new = read_sha1_file(pc_item->oid.hash, &type, &size);
+	if (!new || type != OBJ_BLOB) {
+		free(new);
+		return error("unable to read sha1 file of %s (%s)",
+			     pc_item->path, oid_to_hex(&pc_item->oid));
+	}
+
+	if (convert_to_working_tree_ca(&pc_item->ca, pc_item->path,
+				       new, size, &buf)) {
+		free(new);
+		new = strbuf_detach(&buf, &newsize);
+		size = newsize;
+	}
+
+	ret = write_in_full(fd, new, size) != size;
+	free(new);
+	if (ret)
+		return error("unable to write file %s", pc_item->path);
+	return 0;
+}
+
+void write_pc_item(struct parallel_checkout_item *pc_item)
+{
+	int fd, fstat_done = 0;
+
+	fd = create_pc_item_file(pc_item);
+	if (fd < 0) {
+		if (errno == EEXIST) {
+			pc_item->status = PC_ITEM_COLLIDED;
+			return;
+		}
+		error_errno("unable to create file %s", pc_item->path);
+		pc_item->status = PC_ITEM_FAILED;
+		return;
+	}
+
+	if (write_pc_item_to_fd(pc_item, fd)) {
+		close(fd);
+		unlink(pc_item->path);
+		pc_item->status = PC_ITEM_FAILED;
+		return;
+	}
+
+	if (fstat_is_reliable())
+		fstat_done = !fstat(fd, &pc_item->st);
+	if (close(fd)) {
+		error_errno("unable to write file %s", pc_item->path);
+		pc_item->status = PC_ITEM_FAILED;
+		return;
+	}
+	if (!fstat_done && lstat(pc_item->path, &pc_item->st)) {
+		error_errno("unable to stat just-written file %s",
+			    pc_item->path);
+		pc_item->status = PC_ITEM_FAILED;
+		return;
+	}
+	pc_item->status = PC_ITEM_WRITTEN;
+}
+
+static void write_items_sequentially(void)
+{
+	size_t i;
+
+	for (i = 0; i < parallel_checkout.nr; i++)
+		write_pc_item(&parallel_checkout.items[i]);
+}
+
+struct pc_worker {
+	struct child_process cp;
+	size_t first, nr; /* the range of items it was given */
+};
+
+static void send_items_to_worker(struct pc_worker *worker)
+{
+	struct strbuf buf = STRBUF_INIT;
+	size_t i;
+
+	for (i = worker->first; i < worker->first + worker->nr; i++) {
+		const struct parallel_checkout_item *pc_item =
+			&parallel_checkout.items[i];
+		struct pc_item_fixed_portion fixed;
+		size_t path_len = strlen(pc_item->path);
+
+		memset(&fixed, 0, sizeof(fixed));
+		fixed.id = pc_item->id;
+		oidcpy(&fixed.oid, &pc_item->oid);
+		fixed.mode = pc_item->mode;
+		fixed.attr_action = pc_item->ca.attr_action;
+		fixed.crlf_action = pc_item->ca.crlf_action;
+		fixed.ident = pc_item->ca.ident;
+		fixed.path_len = path_len;
+
+		strbuf_reset(&buf);
+		strbuf_add(&buf, &fixed, sizeof(fixed));
+		strbuf_add(&buf, pc_item->path, path_len);
+		packet_write(worker->cp.in, buf.buf, buf.len);
+	}
+	packet_flush(worker->cp.in);
+	strbuf_release(&buf);
+
+	close(worker->cp.in);
+	worker->cp.in = -1;
+}
+
+static void start_workers(struct pc_worker *workers, int num_workers)
+{
+	size_t first = 0;
+	int i;
+
+	/*
+	 * Give each worker a contiguous range of items, so that the
+	 * files of a directory are mostly created by the same process.
+	 */
+	for (i = 0; i < num_workers; i++) {
+		struct pc_worker *worker = &workers[i];
+		struct child_process *cp = &worker->cp;
+
+		child_process_init(cp);
+		argv_array_push(&cp->args, "checkout--worker");
+		cp->git_cmd = 1;
+		cp->in = -1;
+		cp->out = -1;
+		cp->clean_on_exit = 1;
+		if (start_command(cp))
+			die("failed to spawn checkout worker");
+
+		worker->first = first;
+		worker->nr = (parallel_checkout.nr - first) / (num_workers - i);
+		first += worker->nr;
+	}
+
+	/*
+	 * The workers read all of their items before writing anything
+	 * back, so we can send everything before we start listening.
+	 */
+	sigchain_push(SIGPIPE, SIG_IGN);
+	for (i = 0; i < num_workers; i++)
+		send_items_to_worker(&workers[i]);
+	sigchain_pop(SIGPIPE);
+}
+
+static void parse_and_save_result(const char *buffer, int len,
+				  struct pc_worker *worker)
+{
+	struct pc_item_result res;
+	struct parallel_checkout_item *pc_item;
+
+	if (len != sizeof(res))
+		die("BUG: checkout worker sent a result of %d bytes", len);
+	memcpy(&res, buffer, sizeof(res));
+
+	if (res.id < worker->first || res.id >= worker->first + worker->nr)
+		die("BUG: checkout worker sent a result for an unknown item");
+
+	pc_item = &parallel_checkout.items[res.id];
+	pc_item->status = res.status;
+	pc_item->st = res.st;
+}
+
+static void gather_results_from_workers(struct pc_worker *workers,
+					int num_workers)
+{
+	int i, active_workers = num_workers;
+	struct pollfd *pfds;
+
+	ALLOC_ARRAY(pfds, num_workers);
+	for (i = 0; i < num_workers; i++) {
+		pfds[i].fd = workers[i].cp.out;
+		pfds[i].events = POLLIN;
+	}
+
+	while (active_workers) {
+		int nr = poll(pfds, num_workers, -1);
+
+		if (nr < 0) {
+			if (errno == EINTR)
+				continue;
+			die_errno("failed to poll checkout workers");
+		}
+
+		for (i = 0; i < num_workers && nr > 0; i++) {
+			struct pollfd *pfd = &pfds[i];
+
+			if (!pfd->revents)
+				continue;
+			nr--;
+
+			if (pfd->revents & POLLIN) {
+				int len = packet_read(pfd->fd, NULL, NULL,
+						      packet_buffer,
+						      sizeof(packet_buffer),
+						      PACKET_READ_GENTLE_ON_EOF);
+				if (len > 0) {
+					parse_and_save_result(packet_buffer,
+							      len, &workers[i]);
+					continue;
+				}
+			}
+
+			/* the worker is done, or it died */
+			close(pfd->fd);
+			workers[i].cp.out = -1;
+			pfd->fd = -1;
+			active_workers--;
+		}
+	}
+	free(pfds);
+}
+
+static void write_items_in_parallel(int num_workers)
+{
+	struct pc_worker *workers;
+	int i;
+
+	workers = xcalloc(num_workers, sizeof(*workers));
+	start_workers(workers, num_workers);
+	gather_results_from_workers(workers, num_workers);
+
+	/* items that are still pending are reported by handle_results() */
+	for (i = 0; i < num_workers; i++)
+		if (finish_command(&workers[i].cp))
+			error("checkout worker %d finished with error", i);
+	free(workers);
+}
+
+static int handle_results(struct checkout *state)
+{
+	int ret = 0;
+	size_t i;
+	int have_collisions = 0;
+
+	for (i = 0; i < parallel_checkout.nr; i++) {
+		struct parallel_checkout_item *pc_item =
+			&parallel_checkout.items[i];
+		struct cache_entry *ce = pc_item->ce;
+
+		switch (pc_item->status) {
+		case PC_ITEM_WRITTEN:
+			if (state->refresh_cache) {
+				assert(state->istate);
+				fill_stat_cache_info(ce, &pc_item->st);
+				ce->ce_flags |= CE_UPDATE_IN_BASE;
+				state->istate->cache_changed |= CE_ENTRY_CHANGED;
+			}
+			break;
+		case PC_ITEM_COLLIDED:
+			have_collisions = 1;
+			break;
+		case PC_ITEM_PENDING:
+			ret |= error("parallel checkout did not write %s",
+				     pc_item->path);
+			break;
+		case PC_ITEM_FAILED:
+			/* the error has already been reported */
+			ret = -1;
+			break;
+		}
+	}
+
+	/*
+	 * Write the colliding items again, now that the queue is closed,
+	 * so that they get the same treatment as with a sequential
+	 * checkout (which would remove what is in the way when forced).
+	 */
+	if (have_collisions)
+		for (i = 0; i < parallel_checkout.nr; i++) {
+			struct parallel_checkout_item *pc_item =
+				&parallel_checkout.items[i];
+
+			if (pc_item->status == PC_ITEM_COLLIDED)
+				ret |= checkout_entry(pc_item->ce, state, NULL);
+		}
+
+	return !!ret;
+}
+
+int run_parallel_checkout(struct checkout *state, int num_workers,
+			  int threshold)
+{
+	uint64_t start = getnanotime();
+	int ret;
+
+	if (parallel_checkout.status != PC_ACCEPTING_ENTRIES)
+		die("BUG: cannot run parallel checkout: not accepting entries");
+
+	parallel_checkout.status = PC_RUNNING;
+
+	if (parallel_checkout.nr < num_workers)
+		num_workers = parallel_checkout.nr;
+	if (parallel_checkout.nr < threshold)
+		num_workers = 1;
+
+	if (num_workers <= 1)
+		write_items_sequentially();
+	else
+		write_items_in_parallel(num_workers);
+
+	ret = handle_results(state);
+	trace_performance_since(start, "parallel checkout of %"PRIuMAX
+				" files with %d workers",
+				(uintmax_t)parallel_checkout.nr, num_workers);
+
+	finish_parallel_checkout();
+	return ret;
+}
@@ -0,0 +1,107 @@
+#ifndef PARALLEL_CHECKOUT_H
+#define PARALLEL_CHECKOUT_H
+
+struct cache_entry;
+struct checkout;
+
+/*
+ * Parallel checkout
+ *
+ * Checking out many files is bound by inflating the blobs and by the
+ * latency of the filesystem. While parallel checkout is accepting
+ * entries, checkout_entry() makes room for each regular file that needs
+ * no external filter driver and queues it instead of writing it out;
+ * run_parallel_checkout() then hands the queued files to
+ * "git checkout--worker" processes and updates the index entries with
+ * what they report back.
+ */
+
+enum pc_status {
+	PC_UNINITIALIZED = 0,
+	PC_ACCEPTING_ENTRIES,
+	PC_RUNNING
+};
+
+enum pc_status parallel_checkout_status(void);
+
+/*
+ * Read checkout.workers and checkout.thresholdForParallelism. Parallel
+ * checkout is only worth starting when *num_workers is more than 1.
+ */
+void get_parallel_checkout_configs(int *num_workers, int *threshold);
+
+/* Start accepting entries. */
+void init_parallel_checkout(void);
+
+/*
+ * Queue "ce" to be written by run_parallel_checkout(), if it can be.
+ * Returns 0 if it was queued, and -1 if the caller must write it out
+ * itself.
+ */
+int enqueue_checkout(struct cache_entry *ce, const struct checkout *state);
+
+/*
+ * Write out the queued entries, with up to "num_workers" workers if
+ * there are at least "threshold" of them and in this process
+ * otherwise, and stop accepting entries. Returns 0 on success, and
+ * non-zero if some entry could not be written.
+ */
+int run_parallel_checkout(struct checkout *state, int num_workers,
+			  int threshold);
+
+/*
+ * The rest is shared with builtin/checkout--worker.c.
+ */
+
+enum pc_item_status {
+	PC_ITEM_PENDING = 0,
+	PC_ITEM_WRITTEN,
+	/*
+	 * The path already existed when the item was written, e.g.
+	 * because another entry has the same name on a case-insensitive
+	 * filesystem. It is checked out again sequentially.
+	 */
+	PC_ITEM_COLLIDED,
+	PC_ITEM_FAILED
+};
+
+struct parallel_checkout_item {
+	size_t id; /* position in the queue */
+	struct cache_entry *ce; /* NULL in the workers */
+	struct object_id oid;
+	unsigned int mode;
+	struct conv_attrs ca; /* with a NULL filter driver */
+	char *path; /* with the base directory of the checkout */
+
+	enum pc_item_status status;
+	struct stat st;
+};
+
+/*
+ * An item as sent to the workers in a single packet: this header,
+ * immediately followed by the path_len bytes of the path.
+ */
+struct pc_item_fixed_portion {
+	size_t id;
+	struct object_id oid;
+	unsigned int mode;
+	enum crlf_action attr_action;
+	enum crlf_action crlf_action;
+	int ident;
+	size_t path_len;
+};
+
+/* What a worker sends back, in a single packet, for each item. */
+struct pc_item_result {
+	size_t id;
+	enum pc_item_status status;
+	struct stat st;
+};
+
+/*
+ * Write the item out, creating a new file at its path, and record the
+ * outcome in its status and st fields.
+ */
+void write_pc_item(struct parallel_checkout_item *pc_item);
+
+#endif /* PARALLEL_CHECKOUT_H */
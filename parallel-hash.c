@@ -0,0 +1,341 @@
+#include "cache.h"
+#include "parallel-hash.h"
+#include "blob.h"
+#include "bulk-checkin.h"
+#include "string-list.h"
+#include "thread-utils.h"
+
+/* Below this many files per thread, starting the threads is not worth it. */
+#define THREAD_COST (20)
+
+struct hash_item {
+	struct hashmap_entry ent;
+	char *attr_path;
+	struct conv_attrs ca;
+	unsigned hashed:1, converted:1;
+	struct stat_data sd;
+	unsigned char sha1[20];
+	char path[FLEX_ARRAY];
+};
+
+struct parallel_hash {
+	struct hash_item **items;
+	int nr, alloc;
+	struct hashmap map;
+	unsigned flags;
+	int bulk_checkin;
+};
+
+static struct parallel_hash parallel_hash;
+
+static int hash_item_cmp(const struct hash_item *a,
+			 const struct hash_item *b,
+			 const char *path)
+{
+	return strcmp(a->path, path ? path : b->path);
+}
+
+static struct hash_item *find_hash_item(const char *path)
+{
+	struct hash_item key;
+
+	if (!parallel_hash.nr)
+		return NULL;
+	hashmap_entry_init(&key, strhash(path));
+	return hashmap_get(&parallel_hash.map, &key, path);
+}
+
+void enqueue_hash(const char *path, const char *attr_path)
+{
+	struct hash_item *item;
+
+	if (!parallel_hash.nr)
+		hashmap_init(&parallel_hash.map,
+			     (hashmap_cmp_fn)hash_item_cmp, 0);
+	else if (find_hash_item(path))
+		return;
+
+	FLEX_ALLOC_STR(item, path, path);
+	hashmap_entry_init(item, strhash(path));
+	if (attr_path) {
+		item->attr_path = xstrdup(attr_path);
+		item->converted = 1;
+	}
+	hashmap_add(&parallel_hash.map, item);
+	ALLOC_GROW(parallel_hash.items, parallel_hash.nr + 1,
+		   parallel_hash.alloc);
+	parallel_hash.items[parallel_hash.nr++] = item;
+}
+
+void clear_parallel_hash(void)
+{
+	int i;
+
+	if (!parallel_hash.nr)
+		return;
+	for (i = 0; i < parallel_hash.nr; i++)
+		free(parallel_hash.items[i]->attr_path);
+	hashmap_free(&parallel_hash.map, 1);
+	free(parallel_hash.items);
+	memset(&parallel_hash, 0, sizeof(parallel_hash));
+}
+
+int parallel_hash_result(const char *path, const char *attr_path,
+			 struct stat *st, unsigned flags,
+			 unsigned char *sha1)
+{
+	struct hash_item *item = find_hash_item(path);
+
+	if (!item || !item->hashed)
+		return 0;
+	if ((flags & HASH_WRITE_OBJECT) &&
+	    !(parallel_hash.flags & HASH_WRITE_OBJECT))
+		return 0;
+	if (attr_path ? !item->attr_path || strcmp(attr_path, item->attr_path)
+		      : !!item->attr_path)
+		return 0;
+	if (st && (!S_ISREG(st->st_mode) || match_stat_data(&item->sd, st)))
+		return 0;
+	hashcpy(sha1, item->sha1);
+	return 1;
+}
+
+#ifndef NO_PTHREADS
+
+struct hash_thread {
+	pthread_t pthread;
+	struct index_state *istate;
+	struct cache_def cache;
+};
+
+static pthread_mutex_t hash_mutex;
+static int next_item;
+
+static struct hash_item *next_hash_item(void)
+{
+	struct hash_item *item = NULL;
+
+	pthread_mutex_lock(&hash_mutex);
+	while (next_item < parallel_hash.nr && !item) {
+		item = parallel_hash.items[next_item++];
+		if (item->converted && item->ca.drv)
+			item = NULL;
+	}
+	pthread_mutex_unlock(&hash_mutex);
+	return item;
+}
+
+/*
+ * Is "path" going to be left alone by the caller, because its entry in
+ * the index says that it has not changed?
+ */
+static int hash_item_uptodate(struct index_state *istate, const char *path,
+			      struct stat *st)
+{
+	const struct cache_entry *ce;
+	int pos;
+
+	if (!istate)
+		return 0;
+	pos = index_name_pos_sparse(istate, path, strlen(path));
+	if (pos < 0)
+		return 0;
+	ce = istate->cache[pos];
+	if (S_ISGITLINK(ce->ce_mode))
+		return 0;
+	return !ie_match_stat(istate, ce, st,
+			      CE_MATCH_IGNORE_VALID |
+			      CE_MATCH_IGNORE_SKIP_WORKTREE |
+			      CE_MATCH_RACY_IS_DIRTY);
+}
+
+/*
+ * Do what index_path() does to a regular file, as far as it can be done
+ * without a filter driver and concurrently with other threads. Any
+ * failure leaves the item for index_path(), which reports it.
+ */
+static void hash_one_item(struct hash_thread *t, struct hash_item *item)
+{
+	int write_object = parallel_hash.flags & HASH_WRITE_OBJECT;
+	struct strbuf nbuf = STRBUF_INIT;
+	struct stat st;
+	void *buf = NULL, *map = NULL;
+	size_t size;
+	int fd, have, ret;
+
+	if (threaded_has_symlink_leading_path(&t->cache, item->path,
+					      strlen(item->path)) ||
+	    lstat(item->path, &st) || !S_ISREG(st.st_mode) ||
+	    st.st_size > big_file_threshold ||
+	    hash_item_uptodate(t->istate, item->path, &st))
+		return;
+
+	fd = open(item->path, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    st.st_size > big_file_threshold)
+		goto out;
+	size = xsize_t(st.st_size);
+	if (size <= 32 * 1024) {
+		buf = xmallocz(size);
+		if (read_in_full(fd, buf, size) != size)
+			goto out;
+	} else {
+		map = xmmap_gently(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			map = NULL;
+			goto out;
+		}
+	}
+
+	if (item->converted) {
+		ret = convert_to_git_ca(&item->ca, item->attr_path,
+					buf ? buf : map, size, &nbuf,
+					write_object ? safe_crlf : SAFE_CRLF_FALSE);
+		if (ret < 0)
+			goto out;
+		if (ret) {
+			free(buf);
+			buf = strbuf_detach(&nbuf, &size);
+		}
+	}
+
+	hash_sha1_file(buf ? buf : map, size, blob_type, item->sha1);
+	if (write_object && parallel_hash.bulk_checkin) {
+		struct strbuf entry = STRBUF_INIT;
+
+		deflate_pack_entry(&entry, OBJ_BLOB, buf ? buf : map, size);
+		pthread_mutex_lock(&hash_mutex);
+		ret = write_pack_entry_bulk_checkin(item->sha1, &entry);
+		pthread_mutex_unlock(&hash_mutex);
+		strbuf_release(&entry);
+		if (ret)
+			goto out;
+	} else if (write_object) {
+		pthread_mutex_lock(&hash_mutex);
+		have = freshen_object(item->sha1);
+		pthread_mutex_unlock(&hash_mutex);
+		if (!have && write_loose_sha1_file(item->sha1, blob_type,
+						   buf ? buf : map, size))
+			goto out;
+	}
+	fill_stat_data(&item->sd, &st);
+	item->hashed = 1;
+
+out:
+	strbuf_release(&nbuf);
+	free(buf);
+	if (map)
+		munmap(map, xsize_t(st.st_size));
+	close(fd);
+}
+
+static void *hash_thread_proc(void *data)
+{
+	struct hash_thread *t = data;
+	struct hash_item *item;
+
+	while ((item = next_hash_item()))
+		hash_one_item(t, item);
+	cache_def_clear(&t->cache);
+	return NULL;
+}
+
+static int hash_threads(int nr)
+{
+	int nr_threads = git_config_get_hash_threads();
+
+	if (!nr_threads) {
+		nr_threads = online_cpus();
+		if (nr_threads > nr / THREAD_COST)
+			nr_threads = nr / THREAD_COST;
+	}
+	if (nr_threads > nr)
+		nr_threads = nr;
+	return nr_threads;
+}
+
+void run_parallel_hash(struct index_state *istate, unsigned flags)
+{
+	struct hash_thread *threads;
+	int i, nr_threads = hash_threads(parallel_hash.nr);
+	uint64_t start;
+
+	if (nr_threads <= 1)
+		return;
+
+	start = getnanotime();
+	for (i = 0; i < parallel_hash.nr; i++) {
+		struct hash_item *item = parallel_hash.items[i];
+		if (item->converted)
+			convert_attrs(&item->ca, item->attr_path);
+	}
+	/* initialize what the threads would otherwise race to */
+	if (flags & HASH_WRITE_OBJECT)
+		get_shared_repository();
+
+	parallel_hash.flags = flags;
+	parallel_hash.bulk_checkin = bulk_checkin_batches_objects();
+	next_item = 0;
+	pthread_mutex_init(&hash_mutex, NULL);
+	threads = xcalloc(nr_threads, sizeof(*threads));
+	for (i = 0; i < nr_threads; i++) {
+		struct hash_thread *t = &threads[i];
+
+		t->istate = istate;
+		strbuf_init(&t->cache.path, 0);
+		if (pthread_create(&t->pthread, NULL, hash_thread_proc, t))
+			die("unable to create threaded hashing");
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i].pthread, NULL))
+			die("unable to join threaded hashing");
+	free(threads);
+	pthread_mutex_destroy(&hash_mutex);
+	trace_performance_since(start, "hashed %d files with %d threads",
+				parallel_hash.nr, nr_threads);
+}
+
+#else
+
+void run_parallel_hash(struct index_state *istate, unsigned flags)
+{
+	; /* nothing */
+}
+
+#endif
+
+int read_available_lines(int fd, struct strbuf *buf, int term,
+			 struct string_list *lines)
+{
+	for (;;) {
+		char *eol = memchr(buf->buf, term, buf->len);
+		ssize_t got;
+
+		if (eol) {
+			size_t used = 0;
+
+			do {
+				string_list_append_nodup(lines,
+					xmemdupz(buf->buf + used,
+						 eol - buf->buf - used));
+				used = eol - buf->buf + 1;
+				eol = memchr(buf->buf + used, term,
+					     buf->len - used);
+			} while (eol);
+			strbuf_remove(buf, 0, used);
+			return 1;
+		}
+
+		got = strbuf_read_once(buf, fd, 0);
+		if (got < 0)
+			die_errno("could not read from stdin");
+		if (!got) {
+			if (!buf->len)
+				return 0;
+			string_list_append_nodup(lines, strbuf_detach(buf, NULL));
+			return 1;
+		}
+	}
+}
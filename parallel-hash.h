@@ -0,0 +1,63 @@
+#ifndef PARALLEL_HASH_H
+#define PARALLEL_HASH_H
+
+struct index_state;
+struct string_list;
+
+/*
+ * Parallel hashing
+ *
+ * Adding many files to the object database is bound by reading them,
+ * hashing them and deflating them. Callers that know which files they
+ * are about to add queue them with enqueue_hash(), and
+ * run_parallel_hash() then reads, converts, hashes and writes the
+ * queued files with several threads. The callers add the files one by
+ * one as before, in the same order: index_path() takes the object name
+ * of a queued file from what the threads found, as long as the file has
+ * not changed since.
+ *
+ * Files that need a filter driver, that are larger than
+ * core.bigFileThreshold, or whose end-of-line conversion needs to look
+ * at the index or may warn about the line endings are left for
+ * index_path() to hash as before.
+ */
+
+/*
+ * Queue the file at "path", to be converted to git as if it was at
+ * "attr_path", or as is if "attr_path" is NULL.
+ */
+void enqueue_hash(const char *path, const char *attr_path);
+
+/*
+ * Hash the queued files with the HASH_* "flags", with as many threads
+ * as core.hashThreads says and as the number of files is worth. Files
+ * with an up-to-date stage #0 entry in "istate", if not NULL, are left
+ * alone, since their callers are not going to hash them.
+ */
+void run_parallel_hash(struct index_state *istate, unsigned flags);
+
+/*
+ * If run_parallel_hash() hashed "path" as if it was at "attr_path" with
+ * the "flags" the caller needs and, unless "st" is NULL, the file still
+ * matches "st", store its object name in "sha1" and return 1. Return 0
+ * if the caller has to hash the file itself.
+ */
+int parallel_hash_result(const char *path, const char *attr_path,
+			 struct stat *st, unsigned flags,
+			 unsigned char *sha1);
+
+/* Forget about the queued files. */
+void clear_parallel_hash(void);
+
+/*
+ * Read the lines that are available from "fd" into "lines", without
+ * their "term" terminators, so that a caller that reads paths from a
+ * pipe can queue them all at once. It waits only until there is at
+ * least one line, so that a command that answers every line does not
+ * stall a writer waiting for the answers. "buf" keeps an incomplete
+ * last line for the next call. Returns 0 at the end of the input.
+ */
+int read_available_lines(int fd, struct strbuf *buf, int term,
+			 struct string_list *lines);
+
+#endif /* PARALLEL_HASH_H */
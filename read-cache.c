@@ -17,7 +17,12 @@
 #include "strbuf.h"
 #include "varint.h"
 #include "split-index.h"
+#include "fsmonitor.h"
+#include "ewah/ewok.h"
 #include "utf8.h"
+#include "thread-utils.h"
+#include "mem-pool.h"
+#include "sparse-index.h"
 
 /* Mask for the name length in ce_flags in the on-disk index */
 
@@ -37,13 +42,99 @@
 #define CACHE_EXT_RESOLVE_UNDO 0x52455543 /* "REUC" */
 #define CACHE_EXT_LINK 0x6c696e6b	  /* "link" */
 #define CACHE_EXT_UNTRACKED 0x554E5452	  /* "UNTR" */
+#define CACHE_EXT_FSMONITOR 0x46534D4E	  /* "FSMN" */
+#define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
+#define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
+#define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972	  /* "sdir" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
 		 CE_ENTRY_ADDED | CE_ENTRY_REMOVED | CE_ENTRY_CHANGED | \
-		 SPLIT_INDEX_ORDERED | UNTRACKED_CHANGED)
+		 SPLIT_INDEX_ORDERED | UNTRACKED_CHANGED | \
+		 FSMONITOR_CHANGED)
 
 struct index_state the_index;
+
+/*
+ * The pool that the entries of istate are allocated from. While an
+ * index is split, its entries come from the pool of the shared base
+ * index, as they may end up in the base index when it is rewritten.
+ */
+static struct mem_pool *find_mem_pool(struct index_state *istate)
+{
+	struct mem_pool **pool_ptr;
+
+	if (istate->split_index && istate->split_index->base)
+		pool_ptr = &istate->split_index->base->ce_mem_pool;
+	else
+		pool_ptr = &istate->ce_mem_pool;
+
+	if (!*pool_ptr)
+		mem_pool_init(pool_ptr, 0);
+
+	return *pool_ptr;
+}
+
+static struct cache_entry *mem_pool__ce_alloc(struct mem_pool *mem_pool, size_t len)
+{
+	struct cache_entry *ce;
+	ce = mem_pool_alloc(mem_pool, cache_entry_size(len));
+	ce->mem_pool_allocated = 1;
+	return ce;
+}
+
+static struct cache_entry *mem_pool__ce_calloc(struct mem_pool *mem_pool, size_t len)
+{
+	struct cache_entry *ce;
+	ce = mem_pool_calloc(mem_pool, 1, cache_entry_size(len));
+	ce->mem_pool_allocated = 1;
+	return ce;
+}
+
+struct cache_entry *make_empty_cache_entry(struct index_state *istate, size_t len)
+{
+	return mem_pool__ce_calloc(find_mem_pool(istate), len);
+}
+
+struct cache_entry *make_empty_transient_cache_entry(size_t len)
+{
+	return xcalloc(1, cache_entry_size(len));
+}
+
+struct cache_entry *dup_cache_entry(const struct cache_entry *ce,
+				    struct index_state *istate)
+{
+	unsigned int size = ce_size(ce);
+	int mem_pool_allocated;
+	struct cache_entry *new = make_empty_cache_entry(istate, ce_namelen(ce));
+
+	mem_pool_allocated = new->mem_pool_allocated;
+	memcpy(new, ce, size);
+	new->mem_pool_allocated = mem_pool_allocated;
+	return new;
+}
+
+void discard_cache_entry(struct cache_entry *ce)
+{
+	if (ce && should_validate_cache_entries())
+		memset(ce, 0xCD, cache_entry_size(ce->ce_namelen));
+
+	if (ce && ce->mem_pool_allocated)
+		return;
+
+	free(ce);
+}
+
+int should_validate_cache_entries(void)
+{
+	static int validate_index_cache_entries = -1;
+
+	if (validate_index_cache_entries < 0)
+		validate_index_cache_entries =
+			git_env_bool("GIT_TEST_VALIDATE_INDEX_CACHE_ENTRIES", 0);
+
+	return validate_index_cache_entries;
+}
 static const char *alternate_index_output;
 
 static void set_index_entry(struct index_state *istate, int nr, struct cache_entry *ce)
@@ -58,7 +149,7 @@ static void replace_index_entry(struct index_state *istate, int nr, struct cache
 
 	replace_index_entry_in_base(istate, old, ce);
 	remove_name_hash(istate, old);
-	free(old);
+	discard_cache_entry(old);
 	set_index_entry(istate, nr, ce);
 	ce->ce_flags |= CE_UPDATE_IN_BASE;
 	istate->cache_changed |= CE_ENTRY_CHANGED;
@@ -69,7 +160,7 @@ void rename_index_entry_at(struct index_state *istate, int nr, const char *new_n
 	struct cache_entry *old = istate->cache[nr], *new;
 	int namelen = strlen(new_name);
 
-	new = xmalloc(cache_entry_size(namelen));
+	new = make_empty_cache_entry(istate, namelen);
 	copy_cache_entry(new, old);
 	new->ce_flags &= ~CE_HASHED;
 	new->ce_namelen = namelen;
@@ -477,7 +568,7 @@ int cache_name_stage_compare(const char *name1, int len1, int stage1, const char
 	return 0;
 }
 
-static int index_name_stage_pos(const struct index_state *istate, const char *name, int namelen, int stage)
+static int index_name_stage_pos_sparse(const struct index_state *istate, const char *name, int namelen, int stage)
 {
 	int first, last;
 
@@ -498,11 +589,33 @@ static int index_name_stage_pos(const struct index_state *istate, const char *na
 	return -first-1;
 }
 
-int index_name_pos(const struct index_state *istate, const char *name, int namelen)
+static int index_name_stage_pos(struct index_state *istate, const char *name, int namelen, int stage)
+{
+	int pos = index_name_stage_pos_sparse(istate, name, namelen, stage);
+
+	if (pos < 0 && istate->sparse_index && -pos-1 > 0) {
+		const struct cache_entry *ce = istate->cache[-pos-2];
+
+		/* is the name hidden in the sparse directory just before it? */
+		if (S_ISSPARSEDIR(ce->ce_mode) && ce_namelen(ce) < namelen &&
+		    !memcmp(ce->name, name, ce_namelen(ce))) {
+			ensure_full_index(istate);
+			pos = index_name_stage_pos_sparse(istate, name, namelen, stage);
+		}
+	}
+	return pos;
+}
+
+int index_name_pos(struct index_state *istate, const char *name, int namelen)
 {
 	return index_name_stage_pos(istate, name, namelen, 0);
 }
 
+int index_name_pos_sparse(const struct index_state *istate, const char *name, int namelen)
+{
+	return index_name_stage_pos_sparse(istate, name, namelen, 0);
+}
+
 int remove_index_entry_at(struct index_state *istate, int pos)
 {
 	struct cache_entry *ce = istate->cache[pos];
@@ -611,7 +724,7 @@ static struct cache_entry *create_alias_ce(struct index_state *istate,
 
 	/* Ok, create the new entry using the name of the existing alias */
 	len = ce_namelen(alias);
-	new = xcalloc(1, cache_entry_size(len));
+	new = make_empty_cache_entry(istate, len);
 	memcpy(new->name, alias->name, len);
 	copy_cache_entry(new, ce);
 	save_or_free_index_entry(istate, ce);
@@ -628,7 +741,7 @@ void set_object_name_for_intent_to_add_entry(struct cache_entry *ce)
 
 int add_to_index(struct index_state *istate, const char *path, struct stat *st, int flags)
 {
-	int size, namelen, was_same;
+	int namelen, was_same;
 	mode_t st_mode = st->st_mode;
 	struct cache_entry *ce, *alias;
 	unsigned ce_option = CE_MATCH_IGNORE_VALID|CE_MATCH_IGNORE_SKIP_WORKTREE|CE_MATCH_RACY_IS_DIRTY;
@@ -646,8 +759,7 @@ int add_to_index(struct index_state *istate, const char *path, struct stat *st,
 		while (namelen && path[namelen-1] == '/')
 			namelen--;
 	}
-	size = cache_entry_size(namelen);
-	ce = xcalloc(1, size);
+	ce = make_empty_cache_entry(istate, namelen);
 	memcpy(ce->name, path, namelen);
 	ce->ce_namelen = namelen;
 	if (!intent_only)
@@ -685,12 +797,12 @@ int add_to_index(struct index_state *istate, const char *path, struct stat *st,
 			ce_mark_uptodate(alias);
 		alias->ce_flags |= CE_ADDED;
 
-		free(ce);
+		discard_cache_entry(ce);
 		return 0;
 	}
 	if (!intent_only) {
 		if (index_path(ce->oid.hash, path, st, HASH_WRITE_OBJECT)) {
-			free(ce);
+			discard_cache_entry(ce);
 			return error("unable to index file %s", path);
 		}
 	} else
@@ -707,9 +819,9 @@ int add_to_index(struct index_state *istate, const char *path, struct stat *st,
 		    ce->ce_mode == alias->ce_mode);
 
 	if (pretend)
-		free(ce);
+		discard_cache_entry(ce);
 	else if (add_index_entry(istate, ce, add_option)) {
-		free(ce);
+		discard_cache_entry(ce);
 		return error("unable to add %s to index", path);
 	}
 	if (verbose && !was_same)
@@ -725,11 +837,11 @@ int add_file_to_index(struct index_state *istate, const char *path, int flags)
 	return add_to_index(istate, path, &st, flags);
 }
 
-struct cache_entry *make_cache_entry(unsigned int mode,
-		const unsigned char *sha1, const char *path, int stage,
-		unsigned int refresh_options)
+struct cache_entry *make_cache_entry(struct index_state *istate,
+		unsigned int mode, const unsigned char *sha1, const char *path,
+		int stage, unsigned int refresh_options)
 {
-	int size, len;
+	int len;
 	struct cache_entry *ce, *ret;
 
 	if (!verify_path(path)) {
@@ -738,8 +850,7 @@ struct cache_entry *make_cache_entry(unsigned int mode,
 	}
 
 	len = strlen(path);
-	size = cache_entry_size(len);
-	ce = xcalloc(1, size);
+	ce = make_empty_cache_entry(istate, len);
 
 	hashcpy(ce->oid.hash, sha1);
 	memcpy(ce->name, path, len);
@@ -747,12 +858,35 @@ struct cache_entry *make_cache_entry(unsigned int mode,
 	ce->ce_namelen = len;
 	ce->ce_mode = create_ce_mode(mode);
 
-	ret = refresh_cache_entry(ce, refresh_options);
+	ret = refresh_cache_entry(istate, ce, refresh_options);
 	if (ret != ce)
-		free(ce);
+		discard_cache_entry(ce);
 	return ret;
 }
 
+struct cache_entry *make_transient_cache_entry(unsigned int mode,
+		const unsigned char *sha1, const char *path, int stage)
+{
+	int len;
+	struct cache_entry *ce;
+
+	if (!verify_path(path)) {
+		error("Invalid path '%s'", path);
+		return NULL;
+	}
+
+	len = strlen(path);
+	ce = make_empty_transient_cache_entry(len);
+
+	hashcpy(ce->oid.hash, sha1);
+	memcpy(ce->name, path, len);
+	ce->ce_flags = create_ce_flags(stage);
+	ce->ce_namelen = len;
+	ce->ce_mode = create_ce_mode(mode);
+
+	return ce;
+}
+
 /*
  * Chmod an index entry with either +x or -x.
  *
@@ -854,6 +988,20 @@ int verify_path(const char *path)
 	}
 }
 
+/* The name of a sparse directory entry has a trailing slash */
+static int verify_ce_path(const struct cache_entry *ce)
+{
+	char *dir;
+	int ret;
+
+	if (!S_ISSPARSEDIR(ce->ce_mode))
+		return verify_path(ce->name);
+	dir = xmemdupz(ce->name, ce_namelen(ce) - 1);
+	ret = verify_path(dir);
+	free(dir);
+	return ret;
+}
+
 /*
  * Do we have another file that has the beginning components being a
  * proper superset of the name we're trying to add?
@@ -1163,7 +1311,7 @@ static int add_index_entry_with_check(struct index_state *istate, struct cache_e
 
 	if (!ok_to_add)
 		return -1;
-	if (!verify_path(ce->name))
+	if (!verify_ce_path(ce))
 		return error("Invalid path '%s'", ce->name);
 
 	if (!skip_df_check &&
@@ -1223,7 +1371,7 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 {
 	struct stat st;
 	struct cache_entry *updated;
-	int changed, size;
+	int changed;
 	int refresh = options & CE_MATCH_REFRESH;
 	int ignore_valid = options & CE_MATCH_IGNORE_VALID;
 	int ignore_skip_worktree = options & CE_MATCH_IGNORE_SKIP_WORKTREE;
@@ -1246,6 +1394,19 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 		return ce;
 	}
 
+	/*
+	 * The fsmonitor hook has not reported the path as changed
+	 * since it was last found to be clean.
+	 */
+	if (!ignore_valid && (ce->ce_flags & CE_FSMONITOR_VALID) &&
+	    !S_ISGITLINK(ce->ce_mode)) {
+		refresh_fsmonitor(istate);
+		if (ce->ce_flags & CE_FSMONITOR_VALID) {
+			ce_mark_uptodate(ce);
+			return ce;
+		}
+	}
+
 	if (has_symlink_leading_path(ce->name, ce_namelen(ce))) {
 		if (ignore_missing)
 			return ce;
@@ -1282,8 +1443,10 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 			 * because CE_UPTODATE flag is in-core only;
 			 * we are not going to write this change out.
 			 */
-			if (!S_ISGITLINK(ce->ce_mode))
+			if (!S_ISGITLINK(ce->ce_mode)) {
 				ce_mark_uptodate(ce);
+				mark_fsmonitor_valid(istate, ce);
+			}
 			return ce;
 		}
 	}
@@ -1294,9 +1457,7 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 		return NULL;
 	}
 
-	size = ce_size(ce);
-	updated = xmalloc(size);
-	memcpy(updated, ce, size);
+	updated = dup_cache_entry(ce, istate);
 	fill_stat_cache_info(updated, &st);
 	/*
 	 * If ignore_valid is not set, we should leave CE_VALID bit
@@ -1307,6 +1468,8 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 	if (!ignore_valid && assume_unchanged &&
 	    !(ce->ce_flags & CE_VALID))
 		updated->ce_flags &= ~CE_VALID;
+	if (!S_ISGITLINK(updated->ce_mode))
+		mark_fsmonitor_valid(istate, updated);
 
 	/* istate->cache_changed is updated in the caller */
 	return updated;
@@ -1349,6 +1512,7 @@ int refresh_index(struct index_state *istate, unsigned int flags,
 	typechange_fmt = (in_porcelain ? "T\t%s\n" : "%s needs update\n");
 	added_fmt = (in_porcelain ? "A\t%s\n" : "%s needs update\n");
 	unmerged_fmt = (in_porcelain ? "U\t%s\n" : "%s: needs merge\n");
+	refresh_fsmonitor(istate);
 	for (i = 0; i < istate->cache_nr; i++) {
 		struct cache_entry *ce, *new;
 		int cache_errno = 0;
@@ -1415,10 +1579,11 @@ int refresh_index(struct index_state *istate, unsigned int flags,
 	return has_errors;
 }
 
-struct cache_entry *refresh_cache_entry(struct cache_entry *ce,
-					       unsigned int options)
+struct cache_entry *refresh_cache_entry(struct index_state *istate,
+					struct cache_entry *ce,
+					unsigned int options)
 {
-	return refresh_cache_ent(&the_index, ce, options, NULL, NULL);
+	return refresh_cache_ent(istate, ce, options, NULL, NULL);
 }
 
 
@@ -1549,6 +1714,18 @@ static int read_index_extension(struct index_state *istate,
 	case CACHE_EXT_UNTRACKED:
 		istate->untracked = read_untracked_extension(data, sz);
 		break;
+	case CACHE_EXT_FSMONITOR:
+		if (read_fsmonitor_extension(istate, data, sz))
+			return -1;
+		break;
+	case CACHE_EXT_ENDOFINDEXENTRIES:
+	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
+		/* already handled in do_read_index() */
+		break;
+	case CACHE_EXT_SPARSE_DIRECTORIES:
+		/* no content, only an indication that the index is sparse */
+		istate->sparse_index = 1;
+		break;
 	default:
 		if (*ext < 'A' || 'Z' < *ext)
 			return error("index uses %.4s extension, which we do not understand",
@@ -1569,12 +1746,35 @@ int read_index(struct index_state *istate)
 	return read_index_from(istate, get_index_file());
 }
 
-static struct cache_entry *cache_entry_from_ondisk(struct ondisk_cache_entry *ondisk,
+/*
+ * Without reading the names of the entries, guess how much memory the
+ * in-core entries of an index will take: a little more than the
+ * on-disk entries for index versions 2 and 3, where the name is
+ * stored in full, and a typical path length per entry for version 4.
+ */
+#define CACHE_ENTRY_PATH_LENGTH 80
+
+static size_t estimate_cache_size(size_t ondisk_size, unsigned int entries)
+{
+	long per_entry = sizeof(struct cache_entry) -
+			 sizeof(struct ondisk_cache_entry) +
+			 sizeof(uintmax_t); /* alignment */
+
+	return ondisk_size + entries * per_entry;
+}
+
+static size_t estimate_cache_size_from_compressed(unsigned int entries)
+{
+	return entries * (sizeof(struct cache_entry) + CACHE_ENTRY_PATH_LENGTH);
+}
+
+static struct cache_entry *cache_entry_from_ondisk(struct mem_pool *mem_pool,
+						   struct ondisk_cache_entry *ondisk,
 						   unsigned int flags,
 						   const char *name,
 						   size_t len)
 {
-	struct cache_entry *ce = xmalloc(cache_entry_size(len));
+	struct cache_entry *ce = mem_pool__ce_alloc(mem_pool, len);
 
 	ce->ce_stat_data.sd_ctime.sec = get_be32(&ondisk->ctime.sec);
 	ce->ce_stat_data.sd_mtime.sec = get_be32(&ondisk->mtime.sec);
@@ -1607,7 +1807,14 @@ static unsigned long expand_name_field(struct strbuf *name, const char *cp_)
 	const unsigned char *ep, *cp = (const unsigned char *)cp_;
 	size_t len = decode_varint(&cp);
 
-	if (name->len < len)
+	/*
+	 * The first entry of a block recorded in the IEOT extension
+	 * strips the whole name of the entry before it, which a reader
+	 * starting at that block has not seen.
+	 */
+	if (!name->len)
+		len = 0;
+	else if (name->len < len)
 		die("malformed name field in the index");
 	strbuf_remove(name, name->len - len, len);
 	for (ep = cp; *ep; ep++)
@@ -1616,7 +1823,8 @@ static unsigned long expand_name_field(struct strbuf *name, const char *cp_)
 	return (const char *)ep + 1 - cp_;
 }
 
-static struct cache_entry *create_from_disk(struct ondisk_cache_entry *ondisk,
+static struct cache_entry *create_from_disk(struct mem_pool *mem_pool,
+					    struct ondisk_cache_entry *ondisk,
 					    unsigned long *ent_size,
 					    struct strbuf *previous_name)
 {
@@ -1647,13 +1855,13 @@ static struct cache_entry *create_from_disk(struct ondisk_cache_entry *ondisk,
 		/* v3 and earlier */
 		if (len == CE_NAMEMASK)
 			len = strlen(name);
-		ce = cache_entry_from_ondisk(ondisk, flags, name, len);
+		ce = cache_entry_from_ondisk(mem_pool, ondisk, flags, name, len);
 
 		*ent_size = ondisk_ce_size(ce);
 	} else {
 		unsigned long consumed;
 		consumed = expand_name_field(previous_name, name);
-		ce = cache_entry_from_ondisk(ondisk, flags,
+		ce = cache_entry_from_ondisk(mem_pool, ondisk, flags,
 					     previous_name->buf,
 					     previous_name->len);
 
@@ -1721,18 +1929,401 @@ static void post_read_index_from(struct index_state *istate)
 	check_ce_order(istate);
 	tweak_untracked_cache(istate);
 	tweak_split_index(istate);
+	tweak_fsmonitor(istate);
+}
+
+/*
+ * Parsing an entry costs little enough that a thread is not worth
+ * starting for fewer than this many of them.
+ */
+#define THREAD_COST (10000)
+
+/*
+ * How many threads to use for reading or writing an index with
+ * nr_entries entries, according to index.threads; 1 means that the
+ * index is handled serially.
+ */
+static int index_threads(int nr_entries)
+{
+#ifdef NO_PTHREADS
+	return 1;
+#else
+	int nr_threads = git_config_get_index_threads();
+
+	if (!nr_threads) {
+		nr_threads = nr_entries / THREAD_COST;
+		if (nr_threads > online_cpus())
+			nr_threads = online_cpus();
+	}
+	return nr_threads > 1 ? nr_threads : 1;
+#endif
+}
+
+/*
+ * The "EOIE" extension is always written last. It records where the
+ * extensions start, so that they can be parsed without going through
+ * the entries first, and a hash of the signatures and sizes of the
+ * extensions, to tell whether the offset can be trusted.
+ */
+#define EOIE_SIZE (4 + 20)
+#define EOIE_SIZE_WITH_HEADER (4 + 4 + EOIE_SIZE)
+
+static unsigned long read_eoie_extension(const char *mmap, size_t mmap_size)
+{
+	const char *eoie, *p;
+	unsigned long offset, src_offset, end;
+	unsigned char hash[20];
+	git_SHA_CTX c;
+
+	if (mmap_size < sizeof(struct cache_header) + EOIE_SIZE_WITH_HEADER + 20)
+		return 0;
+
+	end = mmap_size - 20 - EOIE_SIZE_WITH_HEADER;
+	p = eoie = mmap + end;
+	if (CACHE_EXT(p) != CACHE_EXT_ENDOFINDEXENTRIES ||
+	    get_be32(p + 4) != EOIE_SIZE)
+		return 0;
+	p += 8;
+
+	offset = get_be32(p);
+	if (offset < sizeof(struct cache_header) || offset > end)
+		return 0;
+	p += 4;
+
+	git_SHA1_Init(&c);
+	for (src_offset = offset; src_offset < end; ) {
+		uint32_t extsize;
+
+		if (end - src_offset < 8)
+			return 0;
+		extsize = get_be32(mmap + src_offset + 4);
+		git_SHA1_Update(&c, mmap + src_offset, 8);
+		src_offset += 8;
+		if (end - src_offset < extsize)
+			return 0;
+		src_offset += extsize;
+	}
+	git_SHA1_Final(hash, &c);
+	if (hashcmp(hash, (const unsigned char *)p))
+		return 0;
+
+	return offset;
 }
 
+static void write_eoie_extension(struct strbuf *sb, git_SHA_CTX *eoie_context,
+				 unsigned long offset)
+{
+	uint32_t buffer;
+	unsigned char hash[20];
+
+	buffer = htonl(offset);
+	strbuf_add(sb, &buffer, sizeof(buffer));
+
+	git_SHA1_Final(hash, eoie_context);
+	strbuf_add(sb, hash, sizeof(hash));
+}
+
+/*
+ * The "IEOT" extension cuts the entries into blocks that can be parsed
+ * independently of each other: it records the offset of the first
+ * entry of each block and the number of entries in it. With index
+ * format version 4, the first entry of a block does not share a prefix
+ * with the entry before it.
+ */
+#define IEOT_VERSION (1)
+
+struct index_entry_offset {
+	uint32_t offset;
+	uint32_t nr;
+};
+
+struct index_entry_offset_table {
+	int nr;
+	struct index_entry_offset entries[FLEX_ARRAY];
+};
+
+static struct index_entry_offset_table *alloc_ieot(int nr)
+{
+	return xcalloc(1, st_add(sizeof(struct index_entry_offset_table),
+				 st_mult(nr, sizeof(struct index_entry_offset))));
+}
+
+static struct index_entry_offset_table *read_ieot_extension(
+		const char *mmap, size_t mmap_size,
+		unsigned long ext_offset, unsigned int cache_nr)
+{
+	struct index_entry_offset_table *ieot;
+	unsigned long src_offset = ext_offset;
+	const char *p = NULL;
+	uint32_t extsize = 0, prev = 0, total = 0;
+	int i, nr;
+
+	while (src_offset <= mmap_size - 20 - 8) {
+		extsize = get_be32(mmap + src_offset + 4);
+		if (CACHE_EXT((mmap + src_offset)) == CACHE_EXT_INDEXENTRYOFFSETTABLE) {
+			p = mmap + src_offset + 8;
+			break;
+		}
+		src_offset += 8;
+		src_offset += extsize;
+	}
+	if (!p || extsize < 4 || (extsize - 4) % 8)
+		return NULL;
+	if (get_be32(p) != IEOT_VERSION)
+		return NULL;
+	p += 4;
+
+	nr = (extsize - 4) / 8;
+	if (!nr)
+		return NULL;
+	ieot = alloc_ieot(nr);
+	ieot->nr = nr;
+	for (i = 0; i < nr; i++) {
+		ieot->entries[i].offset = get_be32(p);
+		ieot->entries[i].nr = get_be32(p + 4);
+		p += 8;
+
+		if (ieot->entries[i].offset <= prev ||
+		    ieot->entries[i].offset >= ext_offset ||
+		    cache_nr - total < ieot->entries[i].nr)
+			break;
+		prev = ieot->entries[i].offset;
+		total += ieot->entries[i].nr;
+	}
+	if (i < nr || total != cache_nr) {
+		warning("ignoring corrupt IEOT extension");
+		free(ieot);
+		return NULL;
+	}
+	return ieot;
+}
+
+static void write_ieot_extension(struct strbuf *sb,
+				 struct index_entry_offset_table *ieot)
+{
+	uint32_t buffer;
+	int i;
+
+	buffer = htonl(IEOT_VERSION);
+	strbuf_add(sb, &buffer, sizeof(buffer));
+
+	for (i = 0; i < ieot->nr; i++) {
+		buffer = htonl(ieot->entries[i].offset);
+		strbuf_add(sb, &buffer, sizeof(buffer));
+		buffer = htonl(ieot->entries[i].nr);
+		strbuf_add(sb, &buffer, sizeof(buffer));
+	}
+}
+
+static void load_index_extensions(struct index_state *istate,
+				  const char *mmap, size_t mmap_size,
+				  unsigned long src_offset)
+{
+	while (src_offset <= mmap_size - 20 - 8) {
+		/* After an array of active_nr index entries,
+		 * there can be arbitrary number of extended
+		 * sections, each of which is prefixed with
+		 * extension name (4-byte) and section length
+		 * in 4-byte network byte order.
+		 */
+		uint32_t extsize;
+		memcpy(&extsize, mmap + src_offset + 4, 4);
+		extsize = ntohl(extsize);
+		if (read_index_extension(istate,
+					 mmap + src_offset,
+					 (char *)mmap + src_offset + 8,
+					 extsize) < 0)
+			die("index file corrupt");
+		src_offset += 8;
+		src_offset += extsize;
+	}
+}
+
+/*
+ * Create the entries first..first+nr-1 of the index from the on-disk
+ * entries starting at start_offset, and return the number of bytes
+ * consumed.
+ */
+static unsigned long load_cache_entry_block(struct index_state *istate,
+					    struct mem_pool *ce_mem_pool,
+					    const char *mmap,
+					    unsigned long start_offset,
+					    int first, int nr,
+					    struct strbuf *previous_name)
+{
+	unsigned long src_offset = start_offset;
+	int i;
+
+	for (i = first; i < first + nr; i++) {
+		struct ondisk_cache_entry *disk_ce;
+		struct cache_entry *ce;
+		unsigned long consumed;
+
+		disk_ce = (struct ondisk_cache_entry *)(mmap + src_offset);
+		ce = create_from_disk(ce_mem_pool, disk_ce, &consumed,
+				      previous_name);
+		set_index_entry(istate, i, ce);
+
+		src_offset += consumed;
+	}
+	return src_offset - start_offset;
+}
+
+static unsigned long load_all_cache_entries(struct index_state *istate,
+					    const char *mmap, size_t mmap_size,
+					    unsigned long src_offset)
+{
+	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
+	unsigned long consumed;
+
+	if (istate->version == 4) {
+		previous_name = &previous_name_buf;
+		mem_pool_init(&istate->ce_mem_pool,
+			      estimate_cache_size_from_compressed(istate->cache_nr));
+	} else {
+		previous_name = NULL;
+		mem_pool_init(&istate->ce_mem_pool,
+			      estimate_cache_size(mmap_size, istate->cache_nr));
+	}
+
+	consumed = load_cache_entry_block(istate, istate->ce_mem_pool,
+					  mmap, src_offset,
+					  0, istate->cache_nr, previous_name);
+	strbuf_release(&previous_name_buf);
+	return consumed;
+}
+
+#ifndef NO_PTHREADS
+struct load_index_extensions_data {
+	pthread_t pthread;
+	struct index_state *istate;
+	const char *mmap;
+	size_t mmap_size;
+	unsigned long src_offset;
+};
+
+static void *load_index_extensions_thread(void *data_)
+{
+	struct load_index_extensions_data *p = data_;
+
+	load_index_extensions(p->istate, p->mmap, p->mmap_size, p->src_offset);
+	return NULL;
+}
+
+struct load_cache_entries_data {
+	pthread_t pthread;
+	struct index_state *istate;
+	struct mem_pool *ce_mem_pool;
+	const char *mmap;
+	struct index_entry_offset_table *ieot;
+	int ieot_start;		/* first block to load */
+	int ieot_blocks;	/* number of blocks to load */
+	int ce_start;		/* index of the first entry of the first block */
+	unsigned long consumed;	/* bytes consumed by the blocks */
+};
+
+static void *load_cache_entries_thread(void *data_)
+{
+	struct load_cache_entries_data *p = data_;
+	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
+	int i, ce_start = p->ce_start;
+
+	previous_name = (p->istate->version == 4) ? &previous_name_buf : NULL;
+	for (i = p->ieot_start; i < p->ieot_start + p->ieot_blocks; i++) {
+		struct index_entry_offset *block = &p->ieot->entries[i];
+
+		if (previous_name)
+			strbuf_reset(previous_name);
+		p->consumed += load_cache_entry_block(p->istate, p->ce_mem_pool,
+						      p->mmap,
+						      block->offset, ce_start,
+						      block->nr, previous_name);
+		ce_start += block->nr;
+	}
+	strbuf_release(&previous_name_buf);
+	return NULL;
+}
+
+static unsigned long load_cache_entries_threaded(struct index_state *istate,
+						 const char *mmap,
+						 size_t mmap_size,
+						 int nr_threads,
+						 struct index_entry_offset_table *ieot)
+{
+	struct load_cache_entries_data *data;
+	unsigned long consumed = 0;
+	int i, ieot_start = 0, ce_start = 0, ieot_blocks;
+
+	if (nr_threads > ieot->nr)
+		nr_threads = ieot->nr;
+	ieot_blocks = DIV_ROUND_UP(ieot->nr, nr_threads);
+	data = xcalloc(nr_threads, sizeof(*data));
+
+	/*
+	 * Each thread allocates the entries it creates from a pool of
+	 * its own; the pools are handed over to the index once all
+	 * threads are done.
+	 */
+	mem_pool_init(&istate->ce_mem_pool, 0);
+
+	for (i = 0; i < nr_threads && ieot_start < ieot->nr; i++) {
+		struct load_cache_entries_data *p = &data[i];
+		int j;
+
+		if (ieot_start + ieot_blocks > ieot->nr)
+			ieot_blocks = ieot->nr - ieot_start;
+
+		p->istate = istate;
+		p->mmap = mmap;
+		p->ieot = ieot;
+		p->ieot_start = ieot_start;
+		p->ieot_blocks = ieot_blocks;
+		p->ce_start = ce_start;
+
+		for (j = ieot_start; j < ieot_start + ieot_blocks; j++)
+			ce_start += ieot->entries[j].nr;
+		ieot_start += ieot_blocks;
+
+		if (istate->version == 4)
+			mem_pool_init(&p->ce_mem_pool,
+				estimate_cache_size_from_compressed(ce_start - p->ce_start));
+		else
+			mem_pool_init(&p->ce_mem_pool,
+				estimate_cache_size(mmap_size, ce_start - p->ce_start));
+
+		if (pthread_create(&p->pthread, NULL, load_cache_entries_thread, p))
+			die("unable to create load_cache_entries thread");
+	}
+	nr_threads = i;
+
+	for (i = 0; i < nr_threads; i++) {
+		struct load_cache_entries_data *p = &data[i];
+
+		if (pthread_join(p->pthread, NULL))
+			die("unable to join load_cache_entries thread");
+		mem_pool_combine(istate->ce_mem_pool, p->ce_mem_pool);
+		mem_pool_discard(p->ce_mem_pool, 0);
+		consumed += p->consumed;
+	}
+	free(data);
+	return consumed;
+}
+#endif
+
 /* remember to discard_cache() before reading a different cache! */
 int do_read_index(struct index_state *istate, const char *path, int must_exist)
 {
-	int fd, i;
+	int fd, nr_threads;
 	struct stat st;
 	unsigned long src_offset;
 	struct cache_header *hdr;
 	void *mmap;
 	size_t mmap_size;
-	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
+	unsigned long extension_offset = 0;
+#ifndef NO_PTHREADS
+	struct load_index_extensions_data ext_data;
+	struct index_entry_offset_table *ieot = NULL;
+#endif
 
 	if (istate->initialized)
 		return istate->cache_nr;
@@ -1769,45 +2360,54 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	istate->cache = xcalloc(istate->cache_alloc, sizeof(*istate->cache));
 	istate->initialized = 1;
 
-	if (istate->version == 4)
-		previous_name = &previous_name_buf;
-	else
-		previous_name = NULL;
-
 	src_offset = sizeof(*hdr);
-	for (i = 0; i < istate->cache_nr; i++) {
-		struct ondisk_cache_entry *disk_ce;
-		struct cache_entry *ce;
-		unsigned long consumed;
 
-		disk_ce = (struct ondisk_cache_entry *)((char *)mmap + src_offset);
-		ce = create_from_disk(disk_ce, &consumed, previous_name);
-		set_index_entry(istate, i, ce);
+	/*
+	 * If the index says where its extensions start, parse them in
+	 * a thread of their own while the entries are being parsed, and
+	 * spread the blocks of entries recorded by the IEOT extension
+	 * over the remaining threads.
+	 */
+	nr_threads = index_threads(istate->cache_nr);
+	if (nr_threads > 1)
+		extension_offset = read_eoie_extension(mmap, mmap_size);
+#ifndef NO_PTHREADS
+	if (extension_offset) {
+		ext_data.istate = istate;
+		ext_data.mmap = mmap;
+		ext_data.mmap_size = mmap_size;
+		ext_data.src_offset = extension_offset;
+		if (pthread_create(&ext_data.pthread, NULL,
+				   load_index_extensions_thread, &ext_data))
+			die(_("unable to create load_index_extensions thread"));
+		nr_threads--;
+		if (nr_threads > 1)
+			ieot = read_ieot_extension(mmap, mmap_size,
+						   extension_offset,
+						   istate->cache_nr);
+	}
+
+	if (ieot) {
+		src_offset += load_cache_entries_threaded(istate, mmap,
+							  mmap_size,
+							  nr_threads, ieot);
+		free(ieot);
+	} else
+#endif
+		src_offset += load_all_cache_entries(istate, mmap, mmap_size,
+						     src_offset);
 
-		src_offset += consumed;
-	}
-	strbuf_release(&previous_name_buf);
 	istate->timestamp.sec = st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
 
-	while (src_offset <= mmap_size - 20 - 8) {
-		/* After an array of active_nr index entries,
-		 * there can be arbitrary number of extended
-		 * sections, each of which is prefixed with
-		 * extension name (4-byte) and section length
-		 * in 4-byte network byte order.
-		 */
-		uint32_t extsize;
-		memcpy(&extsize, (char *)mmap + src_offset + 4, 4);
-		extsize = ntohl(extsize);
-		if (read_index_extension(istate,
-					 (const char *) mmap + src_offset,
-					 (char *) mmap + src_offset + 8,
-					 extsize) < 0)
-			goto unmap;
-		src_offset += 8;
-		src_offset += extsize;
-	}
+#ifndef NO_PTHREADS
+	if (extension_offset) {
+		if (pthread_join(ext_data.pthread, NULL))
+			die(_("unable to join load_index_extensions thread"));
+	} else
+#endif
+		load_index_extensions(istate, mmap, mmap_size, src_offset);
+
 	munmap(mmap, mmap_size);
 	return istate->cache_nr;
 
@@ -1846,6 +2446,8 @@ int read_index_from(struct index_state *istate, const char *path)
 	split_index = istate->split_index;
 	if (!split_index || is_null_sha1(split_index->base_sha1)) {
 		post_read_index_from(istate);
+		if (command_requires_full_index || istate->split_index)
+			ensure_full_index(istate);
 		return ret;
 	}
 
@@ -1865,6 +2467,7 @@ int read_index_from(struct index_state *istate, const char *path)
 	freshen_shared_index(base_sha1_hex, 0);
 	merge_base_index(istate);
 	post_read_index_from(istate);
+	ensure_full_index(istate);
 	return ret;
 }
 
@@ -1873,13 +2476,69 @@ int is_index_unborn(struct index_state *istate)
 	return (!istate->cache_nr && !istate->timestamp.sec);
 }
 
-int discard_index(struct index_state *istate)
+static void validate_entries_in_pools(const struct index_state *entries,
+				      const struct index_state *istate,
+				      const struct index_state *base)
 {
 	int i;
 
+	for (i = 0; i < entries->cache_nr; i++) {
+		struct cache_entry *ce = entries->cache[i];
+
+		if (!ce)
+			continue;
+		if (istate->ce_mem_pool &&
+		    mem_pool_contains(istate->ce_mem_pool, ce))
+			continue;
+		if (base && base->ce_mem_pool &&
+		    mem_pool_contains(base->ce_mem_pool, ce))
+			continue;
+		die("BUG: cache entry '%s' is not allocated from the pool of the index",
+		    ce->name);
+	}
+}
+
+/*
+ * Check that the entries of the index, and those of its split base
+ * index, come from the pool of either, and die if not.
+ */
+static void validate_cache_entries(const struct index_state *istate)
+{
+	struct index_state *base = NULL;
+
+	if (!should_validate_cache_entries() || !istate->initialized)
+		return;
+
+	if (istate->split_index)
+		base = istate->split_index->base;
+
+	validate_entries_in_pools(istate, istate, base);
+	if (base)
+		validate_entries_in_pools(base, istate, base);
+}
+
+int discard_index(struct index_state *istate)
+{
+	struct split_index *si = istate->split_index;
+
 	unshare_split_index(istate, 1);
-	for (i = 0; i < istate->cache_nr; i++)
-		free(istate->cache[i]);
+
+	/*
+	 * The entries are freed with the pool they were allocated from,
+	 * so there is no need to free them one by one.
+	 */
+	validate_cache_entries(istate);
+
+	/*
+	 * If the split index is shared with another index_state, its
+	 * base may refer to entries of this index; they have to live
+	 * as long as the base.
+	 */
+	if (si && si->refcount > 1 && si->base && istate->ce_mem_pool) {
+		mem_pool_init(&si->base->ce_mem_pool, 0);
+		mem_pool_combine(si->base->ce_mem_pool, istate->ce_mem_pool);
+	}
+
 	resolve_undo_clear_index(istate);
 	istate->cache_nr = 0;
 	istate->cache_changed = 0;
@@ -1894,6 +2553,19 @@ int discard_index(struct index_state *istate)
 	discard_split_index(istate);
 	free_untracked_cache(istate->untracked);
 	istate->untracked = NULL;
+	if (istate->fsmonitor_dirty) {
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = NULL;
+	}
+	istate->fsmonitor_last_update = 0;
+	istate->fsmonitor_has_run_once = 0;
+	istate->sparse_index = 0;
+
+	if (istate->ce_mem_pool) {
+		mem_pool_discard(istate->ce_mem_pool,
+				 should_validate_cache_entries());
+		istate->ce_mem_pool = NULL;
+	}
 	return 0;
 }
 
@@ -1945,11 +2617,16 @@ static int ce_write(git_SHA_CTX *context, int fd, void *data, unsigned int len)
 	return 0;
 }
 
-static int write_index_ext_header(git_SHA_CTX *context, int fd,
+static int write_index_ext_header(git_SHA_CTX *context,
+				  git_SHA_CTX *eoie_context, int fd,
 				  unsigned int ext, unsigned int sz)
 {
 	ext = htonl(ext);
 	sz = htonl(sz);
+	if (eoie_context) {
+		git_SHA1_Update(eoie_context, &ext, 4);
+		git_SHA1_Update(eoie_context, &sz, 4);
+	}
 	return ((ce_write(context, fd, &ext, 4) < 0) ||
 		(ce_write(context, fd, &sz, 4) < 0)) ? -1 : 0;
 }
@@ -2185,7 +2862,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 			  int strip_extensions)
 {
 	int newfd = tempfile->fd;
-	git_SHA_CTX c;
+	git_SHA_CTX c, eoie_c;
 	struct cache_header hdr;
 	int i, err, removed, extended, hdr_version;
 	struct cache_entry **cache = istate->cache;
@@ -2193,6 +2870,9 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	struct stat st;
 	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
 	int drop_cache_tree = 0;
+	int nr_threads, record_eoie = 0, ieot_entries = 0, nr = 0;
+	struct index_entry_offset_table *ieot = NULL;
+	off_t offset;
 
 	for (i = removed = extended = 0; i < entries; i++) {
 		if (cache[i]->ce_flags & CE_REMOVE)
@@ -2222,9 +2902,33 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	hdr.hdr_version = htonl(hdr_version);
 	hdr.hdr_entries = htonl(entries - removed);
 
+	/*
+	 * Let a reader with as many threads as we would use parse the
+	 * extensions on their own (EOIE), and the entries in blocks,
+	 * keeping one thread for the extensions (IEOT).
+	 */
+	nr_threads = index_threads(entries - removed);
+	if (!strip_extensions && nr_threads > 1) {
+		int ieot_blocks = nr_threads - 1;
+
+		record_eoie = 1;
+		if (ieot_blocks > entries - removed)
+			ieot_blocks = entries - removed;
+		if (ieot_blocks > 1) {
+			ieot = alloc_ieot(ieot_blocks);
+			ieot_entries = DIV_ROUND_UP(entries - removed, ieot_blocks);
+		}
+	}
+
 	git_SHA1_Init(&c);
+	git_SHA1_Init(&eoie_c);
 	if (ce_write(&c, newfd, &hdr, sizeof(hdr)) < 0)
-		return -1;
+		goto fail;
+
+	offset = lseek(newfd, 0, SEEK_CUR);
+	if (offset < 0)
+		goto fail;
+	offset += write_buffer_len;
 
 	previous_name = (hdr_version == 4) ? &previous_name_buf : NULL;
 	for (i = 0; i < entries; i++) {
@@ -2241,33 +2945,83 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 				allow = git_env_bool("GIT_ALLOW_NULL_SHA1", 0);
 			if (allow)
 				warning(msg, ce->name);
-			else
-				return error(msg, ce->name);
+			else {
+				error(msg, ce->name);
+				goto fail;
+			}
 
 			drop_cache_tree = 1;
 		}
+		if (ieot && nr == ieot_entries) {
+			ieot->entries[ieot->nr].offset = offset;
+			ieot->entries[ieot->nr].nr = nr;
+			ieot->nr++;
+			/*
+			 * Make the first entry of the next block strip the
+			 * whole previous name, so that it can be read
+			 * without it.
+			 */
+			if (previous_name)
+				previous_name->buf[0] = 0;
+			nr = 0;
+			offset = lseek(newfd, 0, SEEK_CUR);
+			if (offset < 0)
+				goto fail;
+			offset += write_buffer_len;
+		}
 		if (ce_write_entry(&c, newfd, ce, previous_name) < 0)
-			return -1;
+			goto fail;
+		nr++;
+	}
+	if (ieot && nr) {
+		ieot->entries[ieot->nr].offset = offset;
+		ieot->entries[ieot->nr].nr = nr;
+		ieot->nr++;
 	}
 	strbuf_release(&previous_name_buf);
 
+	offset = lseek(newfd, 0, SEEK_CUR);
+	if (offset < 0)
+		goto fail;
+	offset += write_buffer_len;
+
 	/* Write extension data here */
+	if (ieot) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_ieot_extension(&sb, ieot);
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_INDEXENTRYOFFSETTABLE,
+					     sb.len) < 0 ||
+			ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		free(ieot);
+		ieot = NULL;
+		if (err)
+			return -1;
+	}
 	if (!strip_extensions && istate->split_index) {
 		struct strbuf sb = STRBUF_INIT;
 
 		err = write_link_extension(&sb, istate) < 0 ||
-			write_index_ext_header(&c, newfd, CACHE_EXT_LINK,
-					       sb.len) < 0 ||
+			write_index_ext_header(&c, &eoie_c, newfd,
+					       CACHE_EXT_LINK, sb.len) < 0 ||
 			ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
 			return -1;
 	}
+	if (istate->sparse_index) {
+		if (write_index_ext_header(&c, &eoie_c, newfd,
+					   CACHE_EXT_SPARSE_DIRECTORIES, 0) < 0)
+			return -1;
+	}
 	if (!strip_extensions && !drop_cache_tree && istate->cache_tree) {
 		struct strbuf sb = STRBUF_INIT;
 
 		cache_tree_write(&sb, istate->cache_tree);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_TREE, sb.len) < 0
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_TREE, sb.len) < 0
 			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
@@ -2277,8 +3031,8 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		struct strbuf sb = STRBUF_INIT;
 
 		resolve_undo_write(&sb, istate->resolve_undo);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_RESOLVE_UNDO,
-					     sb.len) < 0
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_RESOLVE_UNDO, sb.len) < 0
 			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
@@ -2288,7 +3042,32 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		struct strbuf sb = STRBUF_INIT;
 
 		write_untracked_extension(&sb, istate->untracked);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_UNTRACKED,
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_UNTRACKED, sb.len) < 0 ||
+			ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	}
+	if (!strip_extensions && istate->fsmonitor_last_update &&
+	    istate->fsmonitor_dirty) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_fsmonitor_extension(&sb, istate);
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_FSMONITOR, sb.len) < 0 ||
+			ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	}
+	/* the EOIE extension must come last */
+	if (record_eoie && offset <= 0xffffffff) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_eoie_extension(&sb, &eoie_c, offset);
+		err = write_index_ext_header(&c, NULL, newfd,
+					     CACHE_EXT_ENDOFINDEXENTRIES,
 					     sb.len) < 0 ||
 			ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
@@ -2305,6 +3084,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	istate->timestamp.sec = (unsigned int)st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
 	return 0;
+
+fail:
+	free(ieot);
+	strbuf_release(&previous_name_buf);
+	return -1;
 }
 
 void set_alternate_index_output(const char *name)
@@ -2469,13 +3253,24 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		       unsigned flags)
 {
 	int new_shared_index, ret;
+	int was_full = !istate->sparse_index;
 	struct split_index *si = istate->split_index;
 
+	convert_to_sparse(istate);
+
+	/*
+	 * Number the entries before a split index replaces them with
+	 * those that it writes itself.
+	 */
+	if (istate->fsmonitor_last_update)
+		fill_fsmonitor_bitmap(istate);
+
 	if (!si || alternate_index_output ||
 	    (istate->cache_changed & ~EXTMASK)) {
 		if (si)
 			hashclr(si->base_sha1);
-		return do_write_locked_index(istate, lock, flags);
+		ret = do_write_locked_index(istate, lock, flags);
+		goto out;
 	}
 
 	if (getenv("GIT_TEST_SPLIT_INDEX")) {
@@ -2491,7 +3286,7 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	if (new_shared_index) {
 		ret = write_shared_index(istate, lock, flags);
 		if (ret)
-			return ret;
+			goto out;
 	}
 
 	ret = write_split_index(istate, lock, flags);
@@ -2500,6 +3295,13 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	if (!ret && !new_shared_index)
 		freshen_shared_index(sha1_to_hex(si->base_sha1), 1);
 
+out:
+	if (istate->fsmonitor_dirty) {
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = NULL;
+	}
+	if (was_full)
+		ensure_full_index(istate);
 	return ret;
 }
 
@@ -2519,14 +3321,13 @@ int read_index_unmerged(struct index_state *istate)
 	for (i = 0; i < istate->cache_nr; i++) {
 		struct cache_entry *ce = istate->cache[i];
 		struct cache_entry *new_ce;
-		int size, len;
+		int len;
 
 		if (!ce_stage(ce))
 			continue;
 		unmerged = 1;
 		len = ce_namelen(ce);
-		size = cache_entry_size(len);
-		new_ce = xcalloc(1, size);
+		new_ce = make_empty_cache_entry(istate, len);
 		memcpy(new_ce->name, ce->name, len);
 		new_ce->ce_flags = create_ce_flags(0) | CE_CONFLICTED;
 		new_ce->ce_namelen = len;
@@ -2553,7 +3354,7 @@ int index_name_is_other(const struct index_state *istate, const char *name,
 	int pos;
 	if (namelen && name[namelen - 1] == '/')
 		namelen--;
-	pos = index_name_pos(istate, name, namelen);
+	pos = index_name_pos_sparse(istate, name, namelen);
 	if (0 <= pos)
 		return 0;	/* exact match */
 	pos = -pos - 1;
@@ -2575,7 +3376,7 @@ void *read_blob_data_from_index(const struct index_state *istate,
 	void *data;
 
 	len = strlen(path);
-	pos = index_name_pos(istate, path, len);
+	pos = index_name_pos_sparse(istate, path, len);
 	if (pos < 0) {
 		/*
 		 * We might be in the middle of a merge, in which
@@ -1,6 +1,7 @@
 #ifndef REFS_H
 #define REFS_H
 
+struct argv_array;
 struct object_id;
 struct ref_store;
 struct strbuf;
@@ -138,6 +139,12 @@ int resolve_gitlink_ref(const char *submodule, const char *refname,
  */
 int refname_match(const char *abbrev_name, const char *full_name);
 
+/*
+ * Add to prefixes the full refnames that abbrev_name may stand for,
+ * according to the same rules.
+ */
+void expand_ref_prefix(struct argv_array *prefixes, const char *abbrev_name);
+
 int expand_ref(const char *str, int len, unsigned char *sha1, char **ref);
 int dwim_ref(const char *str, int len, unsigned char *sha1, char **ref);
 int dwim_log(const char *str, int len, unsigned char *sha1, char **ref);
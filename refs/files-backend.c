@@ -32,9 +32,32 @@ static int ref_resolves_to_object(const char *refname,
 	return 1;
 }
 
+/* How the references in a packed-refs file are known to be peeled */
+enum packed_refs_peeled {
+	PEELED_NONE,
+	PEELED_TAGS,
+	PEELED_FULLY
+};
+
 struct packed_ref_cache {
+	/*
+	 * The references, or NULL if the file is sorted and has not
+	 * been parsed as a whole yet (see get_packed_ref_dir()).
+	 */
 	struct ref_cache *cache;
 
+	/*
+	 * The contents of a sorted packed-refs file, which lookups and
+	 * iterations read directly while "cache" is NULL.  The records
+	 * start after the header line at "start" and end at "eof".
+	 * "buf" is mmapped unless "mmapped" is unset, in which case it
+	 * was read into memory.
+	 */
+	char *buf;
+	const char *start, *eof;
+	int mmapped;
+	enum packed_refs_peeled peeled;
+
 	/*
 	 * Count of references to the data structure in this instance,
 	 * including the pointer from files_ref_store::packed if any.
@@ -84,7 +107,12 @@ static void acquire_packed_ref_cache(struct packed_ref_cache *packed_refs)
 static int release_packed_ref_cache(struct packed_ref_cache *packed_refs)
 {
 	if (!--packed_refs->referrers) {
-		free_ref_cache(packed_refs->cache);
+		if (packed_refs->cache)
+			free_ref_cache(packed_refs->cache);
+		if (packed_refs->mmapped)
+			munmap(packed_refs->buf, packed_refs->eof - packed_refs->buf);
+		else
+			free(packed_refs->buf);
 		stat_validity_clear(&packed_refs->validity);
 		free(packed_refs);
 		return 1;
@@ -177,12 +205,15 @@ static struct files_ref_store *files_downcast(struct ref_store *ref_store,
 /* The length of a peeled reference line in packed-refs, including EOL: */
 #define PEELED_LINE_LENGTH 42
 
+/* The start of the packed-refs header line, followed by its traits: */
+#define PACKED_REFS_PREFIX "# pack-refs with:"
+
 /*
  * The packed-refs header line that we write out.  Perhaps other
  * traits will be added later.  The trailing space is required.
  */
 static const char PACKED_REFS_HEADER[] =
-	"# pack-refs with: peeled fully-peeled \n";
+	PACKED_REFS_PREFIX " peeled fully-peeled sorted \n";
 
 /*
  * Parse one line from a packed-refs file.  Write the SHA1 to sha1.
@@ -209,9 +240,8 @@ static const char *parse_ref_line(struct strbuf *line, struct object_id *oid)
 }
 
 /*
- * Read from `packed_refs_file` into a newly-allocated
- * `packed_ref_cache` and return it. The return value will already
- * have its reference count incremented.
+ * Parse the whole of the packed-refs file in "packed_refs->buf" into
+ * packed_refs->cache.
  *
  * A comment line of the form "# pack-refs with: " may contain zero or
  * more traits. We interpret the traits as follows:
@@ -236,43 +266,37 @@ static const char *parse_ref_line(struct strbuf *line, struct object_id *oid)
  *      trait should typically be written alongside "peeled" for
  *      compatibility with older clients, but we do not require it
  *      (i.e., "peeled" is a no-op if "fully-peeled" is set).
+ *
+ *   sorted:
+ *
+ *      The references are sorted by refname, and every line is well
+ *      formed, so that single references and ranges of them can be
+ *      found by binary search (see find_reference_location()).
  */
-static struct packed_ref_cache *read_packed_refs(const char *packed_refs_file)
+static void fill_packed_ref_cache(struct packed_ref_cache *packed_refs)
 {
-	FILE *f;
-	struct packed_ref_cache *packed_refs = xcalloc(1, sizeof(*packed_refs));
+	const char *pos = packed_refs->buf, *eof = packed_refs->eof;
 	struct ref_entry *last = NULL;
 	struct strbuf line = STRBUF_INIT;
-	enum { PEELED_NONE, PEELED_TAGS, PEELED_FULLY } peeled = PEELED_NONE;
+	enum packed_refs_peeled peeled = PEELED_NONE;
 	struct ref_dir *dir;
 
-	acquire_packed_ref_cache(packed_refs);
 	packed_refs->cache = create_ref_cache(NULL, NULL);
 	packed_refs->cache->root->flag &= ~REF_INCOMPLETE;
 
-	f = fopen(packed_refs_file, "r");
-	if (!f) {
-		if (errno == ENOENT) {
-			/*
-			 * This is OK; it just means that no
-			 * "packed-refs" file has been written yet,
-			 * which is equivalent to it being empty.
-			 */
-			return packed_refs;
-		} else {
-			die_errno("couldn't read %s", packed_refs_file);
-		}
-	}
-
-	stat_validity_update(&packed_refs->validity, fileno(f));
-
 	dir = get_ref_dir(packed_refs->cache->root);
-	while (strbuf_getwholeline(&line, f, '\n') != EOF) {
+	while (pos < eof) {
+		const char *eol = memchr(pos, '\n', eof - pos);
+		const char *next = eol ? eol + 1 : eof;
 		struct object_id oid;
 		const char *refname;
 		const char *traits;
 
-		if (skip_prefix(line.buf, "# pack-refs with:", &traits)) {
+		strbuf_reset(&line);
+		strbuf_add(&line, pos, next - pos);
+		pos = next;
+
+		if (skip_prefix(line.buf, PACKED_REFS_PREFIX, &traits)) {
 			if (strstr(traits, " fully-peeled "))
 				peeled = PEELED_FULLY;
 			else if (strstr(traits, " peeled "))
@@ -313,8 +337,233 @@ static struct packed_ref_cache *read_packed_refs(const char *packed_refs_file)
 		}
 	}
 
-	fclose(f);
 	strbuf_release(&line);
+}
+
+/*
+ * Return a pointer to the start of the record that contains the
+ * character at "p".  A record is a reference line together with its
+ * "^" peeled line, if any.
+ */
+static const char *find_start_of_record(const char *buf, const char *p)
+{
+	while (p > buf && (p[-1] != '\n' || p[0] == '^'))
+		p--;
+	return p;
+}
+
+/*
+ * Return a pointer to the start of the record following the one that
+ * contains the character at "p".
+ */
+static const char *find_end_of_record(const char *p, const char *end)
+{
+	while (++p < end && (p[-1] != '\n' || p[0] == '^'))
+		;
+	return p;
+}
+
+/*
+ * Compare the refname of the record at "rec" to "refname", the way
+ * strcmp() would.
+ */
+static int cmp_record_to_refname(const char *rec, const char *refname)
+{
+	const char *r1 = rec + GIT_SHA1_HEXSZ + 1;
+	const char *r2 = refname;
+
+	while (1) {
+		if (*r1 == '\n')
+			return *r2 ? -1 : 0;
+		if (!*r2)
+			return 1;
+		if (*r1 != *r2)
+			return (unsigned char)*r1 < (unsigned char)*r2 ? -1 : +1;
+		r1++;
+		r2++;
+	}
+}
+
+/*
+ * Return true if the records of a sorted packed-refs file can be
+ * searched without running off its end: the file must end with a
+ * newline, and its last record must be long enough to hold an object
+ * name, so that cmp_record_to_refname() always finds the end of a
+ * refname before the end of the buffer.
+ */
+static int packed_refs_buffer_safe(struct packed_ref_cache *packed_refs)
+{
+	const char *start = packed_refs->start, *eof = packed_refs->eof;
+	const char *last;
+
+	if (start == eof)
+		return 1;
+	if (eof[-1] != '\n')
+		return 0;
+	last = find_start_of_record(start, eof - 1);
+	return eof - last >= GIT_SHA1_HEXSZ + 2;
+}
+
+/*
+ * Find the record for "refname" in the sorted packed-refs buffer by
+ * binary search.  If there is none, return NULL if "mustexist" is set,
+ * and otherwise the place where it would be, which is where the
+ * references starting with "refname" begin.
+ */
+static const char *find_reference_location(struct packed_ref_cache *packed_refs,
+					   const char *refname, int mustexist)
+{
+	const char *lo = packed_refs->start;
+	const char *hi = packed_refs->eof;
+
+	while (lo < hi) {
+		const char *mid, *rec;
+		int cmp;
+
+		mid = lo + (hi - lo) / 2;
+		rec = find_start_of_record(lo, mid);
+		cmp = cmp_record_to_refname(rec, refname);
+		if (cmp < 0)
+			lo = find_end_of_record(mid, hi);
+		else if (cmp > 0)
+			hi = rec;
+		else
+			return rec;
+	}
+
+	return mustexist ? NULL : lo;
+}
+
+/*
+ * Parse the record at "rec" in the sorted packed-refs buffer into
+ * "refname", "oid", "peeled" and "flag", and return the start of the
+ * next record.  Only we write sorted files, so unlike
+ * fill_packed_ref_cache() we die on a line we do not understand.
+ */
+static const char *parse_packed_record(struct packed_ref_cache *packed_refs,
+				       const char *rec, struct strbuf *refname,
+				       struct object_id *oid,
+				       struct object_id *peeled,
+				       unsigned int *flag)
+{
+	const char *eof = packed_refs->eof;
+	const char *p, *eol;
+
+	eol = memchr(rec, '\n', eof - rec);
+	if (!eol || eol - rec < GIT_SHA1_HEXSZ + 2 ||
+	    parse_oid_hex(rec, oid, &p) || *p++ != ' ')
+		die("unexpected line in packed-refs: %.*s",
+		    (int)((eol ? eol : eof) - rec), rec);
+
+	strbuf_reset(refname);
+	strbuf_add(refname, p, eol - p);
+
+	*flag = REF_ISPACKED;
+	if (check_refname_format(refname->buf, REFNAME_ALLOW_ONELEVEL)) {
+		if (!refname_is_safe(refname->buf))
+			die("packed refname is dangerous: %s", refname->buf);
+		oidclr(oid);
+		*flag |= REF_BAD_NAME | REF_ISBROKEN;
+	}
+	if (packed_refs->peeled == PEELED_FULLY ||
+	    (packed_refs->peeled == PEELED_TAGS &&
+	     starts_with(refname->buf, "refs/tags/")))
+		*flag |= REF_KNOWS_PEELED;
+
+	oidclr(peeled);
+	p = eol + 1;
+	if (p < eof && *p == '^') {
+		if (eof - p < PEELED_LINE_LENGTH ||
+		    p[PEELED_LINE_LENGTH - 1] != '\n' ||
+		    get_oid_hex(p + 1, peeled))
+			die("unexpected line in packed-refs: %.*s",
+			    (int)(eof - p < PEELED_LINE_LENGTH ?
+				  eof - p : PEELED_LINE_LENGTH), p);
+		*flag |= REF_KNOWS_PEELED;
+		p += PEELED_LINE_LENGTH;
+	}
+	return p;
+}
+
+/*
+ * Read from `packed_refs_file` into a newly-allocated
+ * `packed_ref_cache` and return it. The return value will already
+ * have its reference count incremented.
+ *
+ * A file with the "sorted" trait is only mapped; its references are
+ * looked up and iterated over in place, and only parsed as a whole
+ * when they are about to be modified.  Any other file is parsed right
+ * away.
+ */
+static struct packed_ref_cache *read_packed_refs(const char *packed_refs_file)
+{
+	struct packed_ref_cache *packed_refs = xcalloc(1, sizeof(*packed_refs));
+	const char *traits;
+	struct stat st;
+	size_t size;
+	int fd, sorted = 0;
+
+	acquire_packed_ref_cache(packed_refs);
+
+	fd = open(packed_refs_file, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT) {
+			/*
+			 * This is OK; it just means that no
+			 * "packed-refs" file has been written yet,
+			 * which is equivalent to it being empty.
+			 */
+			fill_packed_ref_cache(packed_refs);
+			return packed_refs;
+		} else {
+			die_errno("couldn't read %s", packed_refs_file);
+		}
+	}
+
+	stat_validity_update(&packed_refs->validity, fd);
+
+	if (fstat(fd, &st) < 0)
+		die_errno("couldn't stat %s", packed_refs_file);
+	size = xsize_t(st.st_size);
+
+	if (!size) {
+		close(fd);
+		fill_packed_ref_cache(packed_refs);
+		return packed_refs;
+	}
+
+#ifdef MMAP_PREVENTS_DELETE
+	/* the file could not be replaced while we have it mapped */
+	packed_refs->buf = xmalloc(size);
+	if (read_in_full(fd, packed_refs->buf, size) != size)
+		die_errno("couldn't read %s", packed_refs_file);
+#else
+	packed_refs->buf = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	packed_refs->mmapped = 1;
+#endif
+	close(fd);
+	packed_refs->start = packed_refs->buf;
+	packed_refs->eof = packed_refs->buf + size;
+
+	if (size > strlen(PACKED_REFS_PREFIX) &&
+	    skip_prefix(packed_refs->buf, PACKED_REFS_PREFIX, &traits)) {
+		const char *eol = memchr(traits, '\n', packed_refs->eof - traits);
+
+		if (eol) {
+			char *tmp = xmemdupz(traits, eol - traits);
+
+			if (strstr(tmp, " fully-peeled "))
+				packed_refs->peeled = PEELED_FULLY;
+			else if (strstr(tmp, " peeled "))
+				packed_refs->peeled = PEELED_TAGS;
+			sorted = !!strstr(tmp, " sorted ");
+			free(tmp);
+			packed_refs->start = eol + 1;
+		}
+	}
+
+	if (!sorted || !packed_refs_buffer_safe(packed_refs))
+		fill_packed_ref_cache(packed_refs);
 
 	return packed_refs;
 }
@@ -394,6 +643,8 @@ static struct packed_ref_cache *get_packed_ref_cache(struct files_ref_store *ref
 
 static struct ref_dir *get_packed_ref_dir(struct packed_ref_cache *packed_ref_cache)
 {
+	if (!packed_ref_cache->cache)
+		fill_packed_ref_cache(packed_ref_cache);
 	return get_ref_dir(packed_ref_cache->cache->root);
 }
 
@@ -546,13 +797,44 @@ static struct ref_cache *get_loose_ref_cache(struct files_ref_store *refs)
 }
 
 /*
- * Return the ref_entry for the given refname from the packed
- * references.  If it does not exist, return NULL.
+ * Look up "refname" in the packed references.  If it is there, store
+ * its value in "oid", its flags in "flag" and, if REF_KNOWS_PEELED is
+ * among them, its peeled value (the null oid if it cannot be peeled)
+ * in "peeled", and return 0.  Otherwise return -1.  "peeled" and
+ * "flag" may be NULL.
  */
-static struct ref_entry *get_packed_ref(struct files_ref_store *refs,
-					const char *refname)
+static int find_packed_ref(struct files_ref_store *refs, const char *refname,
+			   struct object_id *oid, struct object_id *peeled,
+			   unsigned int *flag)
 {
-	return find_ref_entry(get_packed_refs(refs), refname);
+	struct packed_ref_cache *packed_refs = get_packed_ref_cache(refs);
+	struct object_id peeled_buf;
+	unsigned int flag_buf;
+
+	if (!peeled)
+		peeled = &peeled_buf;
+	if (!flag)
+		flag = &flag_buf;
+
+	if (packed_refs->cache) {
+		struct ref_entry *entry =
+			find_ref_entry(get_packed_ref_dir(packed_refs), refname);
+
+		if (!entry)
+			return -1;
+		oidcpy(oid, &entry->u.value.oid);
+		oidcpy(peeled, &entry->u.value.peeled);
+		*flag = entry->flag;
+	} else {
+		struct strbuf name = STRBUF_INIT;
+		const char *rec = find_reference_location(packed_refs, refname, 1);
+
+		if (!rec)
+			return -1;
+		parse_packed_record(packed_refs, rec, &name, oid, peeled, flag);
+		strbuf_release(&name);
+	}
+	return 0;
 }
 
 /*
@@ -562,15 +844,14 @@ static int resolve_packed_ref(struct files_ref_store *refs,
 			      const char *refname,
 			      unsigned char *sha1, unsigned int *flags)
 {
-	struct ref_entry *entry;
+	struct object_id oid;
 
 	/*
 	 * The loose reference file does not exist; check for a packed
 	 * reference.
 	 */
-	entry = get_packed_ref(refs, refname);
-	if (entry) {
-		hashcpy(sha1, entry->u.value.oid.hash);
+	if (!find_packed_ref(refs, refname, &oid, NULL, NULL)) {
+		hashcpy(sha1, oid.hash);
 		*flags |= REF_ISPACKED;
 		return 0;
 	}
@@ -983,19 +1264,22 @@ static int files_peel_ref(struct ref_store *ref_store,
 		return -1;
 
 	/*
-	 * If the reference is packed, read its ref_entry from the
-	 * cache in the hope that we already know its peeled value.
+	 * If the reference is packed, look it up in the packed refs
+	 * in the hope that we already know its peeled value.
 	 * We only try this optimization on packed references because
 	 * (a) forcing the filling of the loose reference cache could
 	 * be expensive and (b) loose references anyway usually do not
 	 * have REF_KNOWS_PEELED.
 	 */
 	if (flag & REF_ISPACKED) {
-		struct ref_entry *r = get_packed_ref(refs, refname);
-		if (r) {
-			if (peel_entry(r, 0))
+		struct object_id oid, peeled;
+		unsigned int packed_flag;
+
+		if (!find_packed_ref(refs, refname, &oid, &peeled, &packed_flag) &&
+		    (packed_flag & REF_KNOWS_PEELED)) {
+			if (is_null_oid(&peeled))
 				return -1;
-			hashcpy(sha1, r->u.value.peeled.hash);
+			hashcpy(sha1, peeled.hash);
 			return 0;
 		}
 	}
@@ -1003,6 +1287,101 @@ static int files_peel_ref(struct ref_store *ref_store,
 	return peel_object(base, sha1);
 }
 
+/*
+ * An iterator over the references of a sorted packed-refs file that
+ * reads them straight from the buffer.
+ */
+struct packed_ref_iterator {
+	struct ref_iterator base;
+
+	struct packed_ref_cache *packed_refs;
+	const char *pos;
+	char *prefix;
+
+	struct strbuf refname_buf;
+	struct object_id oid;
+	struct object_id peeled;
+};
+
+static int packed_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct packed_ref_iterator *iter =
+		(struct packed_ref_iterator *)ref_iterator;
+
+	if (iter->pos < iter->packed_refs->eof) {
+		iter->pos = parse_packed_record(iter->packed_refs, iter->pos,
+						&iter->refname_buf, &iter->oid,
+						&iter->peeled, &iter->base.flags);
+		/* the references under a prefix are all next to each other */
+		if (!iter->prefix || starts_with(iter->refname_buf.buf, iter->prefix)) {
+			iter->base.refname = iter->refname_buf.buf;
+			iter->base.oid = &iter->oid;
+			return ITER_OK;
+		}
+	}
+
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int packed_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				    struct object_id *peeled)
+{
+	struct packed_ref_iterator *iter =
+		(struct packed_ref_iterator *)ref_iterator;
+
+	if (iter->base.flags & REF_KNOWS_PEELED) {
+		if (is_null_oid(&iter->peeled))
+			return -1;
+		oidcpy(peeled, &iter->peeled);
+		return 0;
+	}
+	if (iter->base.flags & REF_ISBROKEN)
+		return -1;
+	return peel_object(iter->oid.hash, peeled->hash) ? -1 : 0;
+}
+
+static int packed_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct packed_ref_iterator *iter =
+		(struct packed_ref_iterator *)ref_iterator;
+
+	strbuf_release(&iter->refname_buf);
+	free(iter->prefix);
+	release_packed_ref_cache(iter->packed_refs);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable packed_ref_iterator_vtable = {
+	packed_ref_iterator_advance,
+	packed_ref_iterator_peel,
+	packed_ref_iterator_abort
+};
+
+static struct ref_iterator *packed_ref_iterator_begin(
+		struct packed_ref_cache *packed_refs, const char *prefix)
+{
+	struct packed_ref_iterator *iter = xcalloc(1, sizeof(*iter));
+	struct ref_iterator *ref_iterator = &iter->base;
+
+	base_ref_iterator_init(ref_iterator, &packed_ref_iterator_vtable);
+
+	iter->packed_refs = packed_refs;
+	acquire_packed_ref_cache(packed_refs);
+	strbuf_init(&iter->refname_buf, 0);
+
+	if (prefix && *prefix) {
+		iter->prefix = xstrdup(prefix);
+		iter->pos = find_reference_location(packed_refs, prefix, 0);
+	} else {
+		iter->pos = packed_refs->start;
+	}
+
+	return ref_iterator;
+}
+
 struct files_ref_iterator {
 	struct ref_iterator base;
 
@@ -1111,8 +1490,12 @@ static struct ref_iterator *files_ref_iterator_begin(
 
 	iter->packed_ref_cache = get_packed_ref_cache(refs);
 	acquire_packed_ref_cache(iter->packed_ref_cache);
-	packed_iter = cache_ref_iterator_begin(iter->packed_ref_cache->cache,
-					       prefix, 0);
+	if (iter->packed_ref_cache->cache)
+		packed_iter = cache_ref_iterator_begin(iter->packed_ref_cache->cache,
+						       prefix, 0);
+	else
+		packed_iter = packed_ref_iterator_begin(iter->packed_ref_cache,
+							prefix);
 
 	iter->iter0 = overlay_ref_iterator_begin(loose_iter, packed_iter);
 	iter->flags = flags;
@@ -1321,6 +1704,8 @@ static int lock_packed_refs(struct files_ref_store *refs, int flags)
 	packed_ref_cache = get_packed_ref_cache(refs);
 	/* Increment the reference count to prevent it from being freed: */
 	acquire_packed_ref_cache(packed_ref_cache);
+	/* We are about to modify the references, so parse them all: */
+	get_packed_ref_dir(packed_ref_cache);
 	return 0;
 }
 
@@ -1588,7 +1973,9 @@ static int repack_without_refs(struct files_ref_store *refs,
 
 	/* Look for a packed ref */
 	for_each_string_list_item(refname, refnames) {
-		if (get_packed_ref(refs, refname->string)) {
+		struct object_id oid;
+
+		if (!find_packed_ref(refs, refname->string, &oid, NULL, NULL)) {
 			needs_repacking = 1;
 			break;
 		}
@@ -2551,163 +2938,6 @@ static struct ref_iterator *files_reflog_iterator_begin(struct ref_store *ref_st
 	return ref_iterator;
 }
 
-/*
- * If update is a direct update of head_ref (the reference pointed to
- * by HEAD), then add an extra REF_LOG_ONLY update for HEAD.
- */
-static int split_head_update(struct ref_update *update,
-			     struct ref_transaction *transaction,
-			     const char *head_ref,
-			     struct string_list *affected_refnames,
-			     struct strbuf *err)
-{
-	struct string_list_item *item;
-	struct ref_update *new_update;
-
-	if ((update->flags & REF_LOG_ONLY) ||
-	    (update->flags & REF_ISPRUNING) ||
-	    (update->flags & REF_UPDATE_VIA_HEAD))
-		return 0;
-
-	if (strcmp(update->refname, head_ref))
-		return 0;
-
-	/*
-	 * First make sure that HEAD is not already in the
-	 * transaction. This insertion is O(N) in the transaction
-	 * size, but it happens at most once per transaction.
-	 */
-	item = string_list_insert(affected_refnames, "HEAD");
-	if (item->util) {
-		/* An entry already existed */
-		strbuf_addf(err,
-			    "multiple updates for 'HEAD' (including one "
-			    "via its referent '%s') are not allowed",
-			    update->refname);
-		return TRANSACTION_NAME_CONFLICT;
-	}
-
-	new_update = ref_transaction_add_update(
-			transaction, "HEAD",
-			update->flags | REF_LOG_ONLY | REF_NODEREF,
-			update->new_oid.hash, update->old_oid.hash,
-			update->msg);
-
-	item->util = new_update;
-
-	return 0;
-}
-
-/*
- * update is for a symref that points at referent and doesn't have
- * REF_NODEREF set. Split it into two updates:
- * - The original update, but with REF_LOG_ONLY and REF_NODEREF set
- * - A new, separate update for the referent reference
- * Note that the new update will itself be subject to splitting when
- * the iteration gets to it.
- */
-static int split_symref_update(struct files_ref_store *refs,
-			       struct ref_update *update,
-			       const char *referent,
-			       struct ref_transaction *transaction,
-			       struct string_list *affected_refnames,
-			       struct strbuf *err)
-{
-	struct string_list_item *item;
-	struct ref_update *new_update;
-	unsigned int new_flags;
-
-	/*
-	 * First make sure that referent is not already in the
-	 * transaction. This insertion is O(N) in the transaction
-	 * size, but it happens at most once per symref in a
-	 * transaction.
-	 */
-	item = string_list_insert(affected_refnames, referent);
-	if (item->util) {
-		/* An entry already existed */
-		strbuf_addf(err,
-			    "multiple updates for '%s' (including one "
-			    "via symref '%s') are not allowed",
-			    referent, update->refname);
-		return TRANSACTION_NAME_CONFLICT;
-	}
-
-	new_flags = update->flags;
-	if (!strcmp(update->refname, "HEAD")) {
-		/*
-		 * Record that the new update came via HEAD, so that
-		 * when we process it, split_head_update() doesn't try
-		 * to add another reflog update for HEAD. Note that
-		 * this bit will be propagated if the new_update
-		 * itself needs to be split.
-		 */
-		new_flags |= REF_UPDATE_VIA_HEAD;
-	}
-
-	new_update = ref_transaction_add_update(
-			transaction, referent, new_flags,
-			update->new_oid.hash, update->old_oid.hash,
-			update->msg);
-
-	new_update->parent_update = update;
-
-	/*
-	 * Change the symbolic ref update to log only. Also, it
-	 * doesn't need to check its old SHA-1 value, as that will be
-	 * done when new_update is processed.
-	 */
-	update->flags |= REF_LOG_ONLY | REF_NODEREF;
-	update->flags &= ~REF_HAVE_OLD;
-
-	item->util = new_update;
-
-	return 0;
-}
-
-/*
- * Return the refname under which update was originally requested.
- */
-static const char *original_update_refname(struct ref_update *update)
-{
-	while (update->parent_update)
-		update = update->parent_update;
-
-	return update->refname;
-}
-
-/*
- * Check whether the REF_HAVE_OLD and old_oid values stored in update
- * are consistent with oid, which is the reference's current value. If
- * everything is OK, return 0; otherwise, write an error message to
- * err and return -1.
- */
-static int check_old_oid(struct ref_update *update, struct object_id *oid,
-			 struct strbuf *err)
-{
-	if (!(update->flags & REF_HAVE_OLD) ||
-		   !oidcmp(oid, &update->old_oid))
-		return 0;
-
-	if (is_null_oid(&update->old_oid))
-		strbuf_addf(err, "cannot lock ref '%s': "
-			    "reference already exists",
-			    original_update_refname(update));
-	else if (is_null_oid(oid))
-		strbuf_addf(err, "cannot lock ref '%s': "
-			    "reference is missing but expected %s",
-			    original_update_refname(update),
-			    oid_to_hex(&update->old_oid));
-	else
-		strbuf_addf(err, "cannot lock ref '%s': "
-			    "is at %s but expected %s",
-			    original_update_refname(update),
-			    oid_to_hex(oid),
-			    oid_to_hex(&update->old_oid));
-
-	return -1;
-}
-
 /*
  * Prepare for carrying out update:
  * - Lock the reference referred to by update.
@@ -2789,8 +3019,8 @@ static int lock_ref_for_update(struct files_ref_store *refs,
 			 * of processing the split-off update, so we
 			 * don't have to do it here.
 			 */
-			ret = split_symref_update(refs, update,
-						  referent.buf, transaction,
+			ret = split_symref_update(update, referent.buf,
+						  transaction,
 						  affected_refnames, err);
 			if (ret)
 				return ret;
@@ -2977,6 +3207,71 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 	return ret;
 }
 
+/*
+ * A transaction that writes at least this many references stores them
+ * in the packed-refs file, with a single write, instead of renaming a
+ * loose reference file into place for each of them.
+ */
+#define PACKED_UPDATE_THRESHOLD 100
+
+/*
+ * Return true if the new value of update can be written to the
+ * packed-refs file. That is not the case for symbolic references and
+ * for references outside of "refs/" or private to a worktree, and
+ * neither if a loose reference exists that would shadow the value.
+ */
+static int can_pack_update(struct ref_update *update)
+{
+	struct ref_lock *lock = update->backend_data;
+
+	if (!(update->flags & REF_NEEDS_COMMIT) ||
+	    update->type & (REF_ISSYMREF | REF_ISBROKEN) ||
+	    !starts_with(update->refname, "refs/") ||
+	    ref_type(update->refname) != REF_TYPE_NORMAL)
+		return 0;
+	return (update->type & REF_ISPACKED) || is_null_oid(&lock->old_oid);
+}
+
+/*
+ * Write the updates of transaction that are marked REF_COMMIT_PACKED,
+ * and remove the references that it deletes, in a single rewrite of
+ * the packed-refs file. The loose lockfiles of the packed updates are
+ * left to be rolled back.
+ */
+static int write_packed_updates(struct files_ref_store *refs,
+				struct ref_transaction *transaction,
+				struct strbuf *err)
+{
+	struct ref_dir *packed;
+	size_t i;
+
+	if (lock_packed_refs(refs, 0)) {
+		unable_to_lock_message(files_packed_refs_path(refs), errno, err);
+		return -1;
+	}
+	packed = get_packed_refs(refs);
+
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+
+		if (update->flags & REF_COMMIT_PACKED) {
+			remove_entry_from_dir(packed, update->refname);
+			add_packed_ref(refs, update->refname,
+				       &update->new_oid);
+		} else if (update->flags & REF_DELETING &&
+			   !(update->flags & (REF_LOG_ONLY | REF_ISPRUNING))) {
+			remove_entry_from_dir(packed, update->refname);
+		}
+	}
+
+	if (commit_packed_refs(refs)) {
+		strbuf_addf(err, "unable to write packed-refs file: %s",
+			    strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
 static int files_transaction_finish(struct ref_store *ref_store,
 				    struct ref_transaction *transaction,
 				    struct strbuf *err)
@@ -2988,6 +3283,7 @@ static int files_transaction_finish(struct ref_store *ref_store,
 	struct string_list refs_to_delete = STRING_LIST_INIT_NODUP;
 	struct string_list_item *ref_to_delete;
 	struct strbuf sb = STRBUF_INIT;
+	size_t packed_nr = 0;
 
 	assert(err);
 
@@ -2996,6 +3292,15 @@ static int files_transaction_finish(struct ref_store *ref_store,
 		return 0;
 	}
 
+	for (i = 0; i < transaction->nr; i++)
+		if (can_pack_update(transaction->updates[i]))
+			packed_nr++;
+	if (packed_nr < PACKED_UPDATE_THRESHOLD)
+		packed_nr = 0;
+	for (i = 0; packed_nr && i < transaction->nr; i++)
+		if (can_pack_update(transaction->updates[i]))
+			transaction->updates[i]->flags |= REF_COMMIT_PACKED;
+
 	/* Perform updates first so live commits remain referenced */
 	for (i = 0; i < transaction->nr; i++) {
 		struct ref_update *update = transaction->updates[i];
@@ -3020,7 +3325,8 @@ static int files_transaction_finish(struct ref_store *ref_store,
 				goto cleanup;
 			}
 		}
-		if (update->flags & REF_NEEDS_COMMIT) {
+		if (update->flags & REF_NEEDS_COMMIT &&
+		    !(update->flags & REF_COMMIT_PACKED)) {
 			clear_loose_ref_cache(refs);
 			if (commit_ref(lock)) {
 				strbuf_addf(err, "couldn't set '%s'", lock->ref_name);
@@ -3031,6 +3337,11 @@ static int files_transaction_finish(struct ref_store *ref_store,
 			}
 		}
 	}
+	if (packed_nr && write_packed_updates(refs, transaction, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+
 	/* Perform deletes now that updates are safely completed */
 	for (i = 0; i < transaction->nr; i++) {
 		struct ref_update *update = transaction->updates[i];
@@ -3056,7 +3367,7 @@ static int files_transaction_finish(struct ref_store *ref_store,
 		}
 	}
 
-	if (repack_without_refs(refs, &refs_to_delete, err)) {
+	if (!packed_nr && repack_without_refs(refs, &refs_to_delete, err)) {
 		ret = TRANSACTION_GENERIC_ERROR;
 		goto cleanup;
 	}
@@ -3078,10 +3389,11 @@ static int files_transaction_finish(struct ref_store *ref_store,
 	for (i = 0; i < transaction->nr; i++) {
 		struct ref_update *update = transaction->updates[i];
 
-		if (update->flags & REF_DELETED_LOOSE) {
+		if (update->flags & (REF_DELETED_LOOSE | REF_COMMIT_PACKED)) {
 			/*
-			 * The loose reference was deleted. Delete any
-			 * empty parent directories. (Note that this
+			 * The loose reference was deleted, or was only
+			 * locked to write the packed-refs file. Delete
+			 * any empty parent directories. (Note that this
 			 * can only work because we have already
 			 * removed the lockfile.)
 			 */
@@ -3369,7 +3681,7 @@ static int files_init_db(struct ref_store *ref_store, struct strbuf *err)
 }
 
 struct ref_storage_be refs_be_files = {
-	NULL,
+	&refs_be_reftable,
 	"files",
 	files_ref_store_create,
 	files_init_db,
@@ -61,6 +61,12 @@
  */
 #define REF_DELETED_LOOSE 0x200
 
+/*
+ * Used as a flag in ref_update::flags when the new value is to be
+ * written to the packed-refs file instead of the loose reference.
+ */
+#define REF_COMMIT_PACKED 0x400
+
 /*
  * Return true iff refname is minimally safe. "Safe" here means that
  * deleting a loose reference by this name will not do any damage, for
@@ -191,6 +197,47 @@ struct ref_update *ref_transaction_add_update(
 		const unsigned char *old_sha1,
 		const char *msg);
 
+/*
+ * Helpers for the transaction_prepare() methods of backends.
+ *
+ * split_head_update(): If update is a direct update of head_ref (the
+ * reference pointed to by HEAD), then add an extra REF_LOG_ONLY update
+ * for HEAD.
+ *
+ * split_symref_update(): update is for a symref that points at
+ * referent and doesn't have REF_NODEREF set. Turn it into a
+ * REF_LOG_ONLY update of the symref and add a separate update for the
+ * referent to the transaction.
+ *
+ * Both return 0 on success, or TRANSACTION_NAME_CONFLICT (with a
+ * message in err) if the new update clashes with one in
+ * affected_refnames, which they keep up to date.
+ */
+int split_head_update(struct ref_update *update,
+		      struct ref_transaction *transaction,
+		      const char *head_ref,
+		      struct string_list *affected_refnames,
+		      struct strbuf *err);
+int split_symref_update(struct ref_update *update,
+			const char *referent,
+			struct ref_transaction *transaction,
+			struct string_list *affected_refnames,
+			struct strbuf *err);
+
+/*
+ * Return the refname under which update was originally requested.
+ */
+const char *original_update_refname(struct ref_update *update);
+
+/*
+ * Check whether the REF_HAVE_OLD and old_oid values stored in update
+ * are consistent with oid, which is the reference's current value. If
+ * everything is OK, return 0; otherwise, write an error message to
+ * err and return -1.
+ */
+int check_old_oid(struct ref_update *update, const struct object_id *oid,
+		  struct strbuf *err);
+
 /*
  * Transaction states.
  *
@@ -655,6 +702,7 @@ struct ref_storage_be {
 };
 
 extern struct ref_storage_be refs_be_files;
+extern struct ref_storage_be refs_be_reftable;
 
 /*
  * A representation of the reference store for the main repository or
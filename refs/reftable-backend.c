@@ -0,0 +1,1668 @@
+#include "../cache.h"
+#include "../refs.h"
+#include "refs-internal.h"
+#include "reftable.h"
+#include "../iterator.h"
+#include "../lockfile.h"
+#include "../object.h"
+#include "../dir.h"
+
+/*
+ * A reference store that keeps references and reflogs in stacks of
+ * reftables (see refs/reftable.h). The refs shared by all worktrees
+ * live in "$GIT_COMMON_DIR/reftable"; a linked worktree keeps its
+ * per-worktree refs (HEAD and refs/bisect/) in "$GIT_DIR/reftable".
+ *
+ * Pseudorefs like FETCH_HEAD and ORIG_HEAD are not part of the
+ * tables; refs.c reads and writes them as plain files in $GIT_DIR,
+ * and so does this backend when they are updated in a transaction.
+ */
+struct reftable_ref_store {
+	struct ref_store base;
+	unsigned int store_flags;
+
+	char *gitdir;
+	struct reftable_stack *main_stack;
+	/* NULL unless this is the store of a linked worktree */
+	struct reftable_stack *worktree_stack;
+};
+
+/*
+ * Per-update data of a transaction between prepare and finish.
+ */
+struct reftable_update {
+	/* The value of the reference before the transaction */
+	struct object_id old_oid;
+};
+
+static struct ref_store *reftable_ref_store_create(const char *gitdir,
+						   unsigned int flags)
+{
+	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct ref_store *ref_store = (struct ref_store *)refs;
+	struct strbuf sb = STRBUF_INIT;
+
+	base_ref_store_init(ref_store, &refs_be_reftable);
+	refs->store_flags = flags;
+	refs->gitdir = xstrdup(gitdir);
+
+	if (get_common_dir_noenv(&sb, gitdir)) {
+		char *dir = xstrfmt("%s/reftable", gitdir);
+
+		refs->worktree_stack = reftable_stack_new(dir);
+		free(dir);
+	}
+	strbuf_addstr(&sb, "/reftable");
+	refs->main_stack = reftable_stack_new(sb.buf);
+	strbuf_release(&sb);
+
+	return ref_store;
+}
+
+/*
+ * Downcast ref_store to reftable_ref_store. Die if ref_store is not a
+ * reftable_ref_store or if it doesn't have the capabilities listed in
+ * required_flags. The caller name is used in any necessary error
+ * messages.
+ */
+static struct reftable_ref_store *reftable_downcast(struct ref_store *ref_store,
+						    unsigned int required_flags,
+						    const char *caller)
+{
+	struct reftable_ref_store *refs;
+
+	if (ref_store->be != &refs_be_reftable)
+		die("BUG: ref_store is type \"%s\" not \"reftable\" in %s",
+		    ref_store->be->name, caller);
+
+	refs = (struct reftable_ref_store *)ref_store;
+
+	if ((refs->store_flags & required_flags) != required_flags)
+		die("BUG: operation %s requires abilities 0x%x, but only have 0x%x",
+		    caller, required_flags, refs->store_flags);
+
+	return refs;
+}
+
+static struct reftable_stack *stack_for(struct reftable_ref_store *refs,
+					const char *refname)
+{
+	if (refs->worktree_stack &&
+	    ref_type(refname) == REF_TYPE_PER_WORKTREE)
+		return refs->worktree_stack;
+	return refs->main_stack;
+}
+
+static int reftable_init_db(struct ref_store *ref_store, struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "init_db");
+	struct strbuf sb = STRBUF_INIT;
+
+	safe_create_dir(refs->main_stack->dir, 1);
+	strbuf_addf(&sb, "%s/tables.list", refs->main_stack->dir);
+	if (!file_exists(sb.buf)) {
+		write_file_buf(sb.buf, "", 0);
+		adjust_shared_perm(sb.buf);
+	}
+
+	/*
+	 * HEAD lives in the reftable, but other versions of git need
+	 * a HEAD file to recognize the directory as a repository.
+	 */
+	strbuf_reset(&sb);
+	strbuf_addf(&sb, "%s/HEAD", refs->gitdir);
+	if (!file_exists(sb.buf))
+		write_file(sb.buf, "ref: refs/heads/.invalid");
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+/* Read the pseudoref refname from $GIT_DIR, like read_raw_ref(). */
+static int read_pseudoref_file(struct reftable_ref_store *refs,
+			       const char *refname, unsigned char *sha1,
+			       struct strbuf *referent, unsigned int *type)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	const char *p;
+	int ret = 0;
+
+	strbuf_addf(&path, "%s/%s", refs->gitdir, refname);
+	if (strbuf_read_file(&buf, path.buf, 0) < 0) {
+		ret = -1;
+		goto out;
+	}
+	strbuf_rtrim(&buf);
+	if (skip_prefix(buf.buf, "ref:", &p)) {
+		while (isspace(*p))
+			p++;
+		strbuf_reset(referent);
+		strbuf_addstr(referent, p);
+		*type |= REF_ISSYMREF;
+	} else if (get_sha1_hex(buf.buf, sha1) ||
+		   (buf.buf[40] && !isspace(buf.buf[40]))) {
+		*type |= REF_ISBROKEN;
+		errno = EINVAL;
+		ret = -1;
+	}
+
+out:
+	strbuf_release(&path);
+	strbuf_release(&buf);
+	return ret;
+}
+
+/*
+ * Write the pseudoref refname to $GIT_DIR with the given contents, or
+ * delete it if contents is NULL.
+ */
+static int write_pseudoref_file(struct reftable_ref_store *refs,
+				const char *refname, const char *contents,
+				struct strbuf *err)
+{
+	static struct lock_file lock;
+	struct strbuf path = STRBUF_INIT;
+	size_t len;
+	int fd, ret = 0;
+
+	strbuf_addf(&path, "%s/%s", refs->gitdir, refname);
+	if (!contents) {
+		if (unlink(path.buf) && errno != ENOENT) {
+			strbuf_addf(err, "could not delete '%s': %s",
+				    path.buf, strerror(errno));
+			ret = -1;
+		}
+		goto out;
+	}
+
+	fd = hold_lock_file_for_update(&lock, path.buf, 0);
+	if (fd < 0) {
+		unable_to_lock_message(path.buf, errno, err);
+		ret = -1;
+		goto out;
+	}
+	len = strlen(contents);
+	if (write_in_full(fd, contents, len) != len ||
+	    commit_lock_file(&lock)) {
+		strbuf_addf(err, "could not write to '%s'", path.buf);
+		rollback_lock_file(&lock);
+		ret = -1;
+	}
+
+out:
+	strbuf_release(&path);
+	return ret;
+}
+
+static int reftable_read_raw_ref(struct ref_store *ref_store,
+				 const char *refname, unsigned char *sha1,
+				 struct strbuf *referent, unsigned int *type)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
+	struct reftable_stack *st = stack_for(refs, refname);
+	struct reftable_ref_record rec = REFTABLE_REF_RECORD_INIT;
+	int ret;
+
+	*type = 0;
+
+	if (ref_type(refname) == REF_TYPE_PSEUDOREF)
+		return read_pseudoref_file(refs, refname, sha1, referent, type);
+
+	if (reftable_stack_reload(st)) {
+		errno = EIO;
+		return -1;
+	}
+	ret = reftable_stack_read_ref(st, refname, &rec);
+	if (ret) {
+		reftable_ref_record_release(&rec);
+		errno = ret < 0 ? EIO : ENOENT;
+		return -1;
+	}
+
+	if (rec.value_type == REFTABLE_REF_SYMREF) {
+		*type |= REF_ISSYMREF;
+		strbuf_reset(referent);
+		strbuf_addbuf(referent, &rec.target);
+	} else {
+		hashcpy(sha1, rec.oid.hash);
+	}
+	reftable_ref_record_release(&rec);
+	return 0;
+}
+
+/*
+ * Resolve refname within the tables we already have loaded, without
+ * reloading them, so that an iterator sees a consistent state.
+ */
+static int resolve_loaded_ref(struct reftable_ref_store *refs,
+			      const char *refname, struct object_id *oid)
+{
+	struct reftable_ref_record rec = REFTABLE_REF_RECORD_INIT;
+	struct strbuf name = STRBUF_INIT;
+	int depth, ret = -1;
+
+	strbuf_addstr(&name, refname);
+	for (depth = 0; depth <= SYMREF_MAXDEPTH; depth++) {
+		if (reftable_stack_read_ref(stack_for(refs, name.buf),
+					    name.buf, &rec))
+			break;
+		if (rec.value_type != REFTABLE_REF_SYMREF) {
+			oidcpy(oid, &rec.oid);
+			ret = 0;
+			break;
+		}
+		strbuf_swap(&name, &rec.target);
+	}
+	reftable_ref_record_release(&rec);
+	strbuf_release(&name);
+	return ret;
+}
+
+enum iter_filter {
+	ITER_ALL_REFS,
+	ITER_SHARED_REFS,
+	ITER_PER_WORKTREE_REFS
+};
+
+struct reftable_ref_iterator {
+	struct ref_iterator base;
+
+	struct reftable_ref_store *refs;
+	struct reftable_merged_iter iter;
+	struct reftable_ref_record rec;
+	struct object_id oid;
+	struct object_id peeled;
+	int have_peeled;
+	char *prefix;
+	enum iter_filter filter;
+	unsigned int flags;
+};
+
+static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+	int ret;
+
+	while (!(ret = reftable_merged_iter_next_ref(&iter->iter, &iter->rec))) {
+		const char *refname = iter->rec.refname.buf;
+		int flags = 0;
+
+		if (!starts_with(refname, iter->prefix)) {
+			ret = 1;
+			break;
+		}
+		/* HEAD and pseudorefs are not part of the iteration */
+		if (!starts_with(refname, "refs/"))
+			continue;
+		if (iter->filter != ITER_ALL_REFS &&
+		    (ref_type(refname) == REF_TYPE_PER_WORKTREE) !=
+		    (iter->filter == ITER_PER_WORKTREE_REFS))
+			continue;
+
+		iter->have_peeled = 0;
+		if (iter->rec.value_type == REFTABLE_REF_SYMREF) {
+			flags |= REF_ISSYMREF;
+			if (resolve_loaded_ref(iter->refs, refname, &iter->oid)) {
+				oidclr(&iter->oid);
+				flags |= REF_ISBROKEN;
+			}
+		} else {
+			oidcpy(&iter->oid, &iter->rec.oid);
+			if (iter->rec.value_type == REFTABLE_REF_VAL2) {
+				oidcpy(&iter->peeled, &iter->rec.peeled);
+				iter->have_peeled = 1;
+			}
+		}
+
+		if (!(iter->flags & DO_FOR_EACH_INCLUDE_BROKEN)) {
+			if (flags & REF_ISBROKEN)
+				continue;
+			if (!has_sha1_file(iter->oid.hash)) {
+				error("%s does not point to a valid object!",
+				      refname);
+				continue;
+			}
+		}
+
+		iter->base.refname = refname;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE || ret < 0)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int reftable_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				      struct object_id *peeled)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	if (iter->have_peeled) {
+		oidcpy(peeled, &iter->peeled);
+		return 0;
+	}
+	return peel_object(iter->oid.hash, peeled->hash) == PEEL_PEELED ? 0 : -1;
+}
+
+static int reftable_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	reftable_merged_iter_release(&iter->iter);
+	reftable_ref_record_release(&iter->rec);
+	free(iter->prefix);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_ref_iterator_vtable = {
+	reftable_ref_iterator_advance,
+	reftable_ref_iterator_peel,
+	reftable_ref_iterator_abort
+};
+
+static struct ref_iterator *stack_ref_iterator_begin(
+		struct reftable_ref_store *refs, struct reftable_stack *st,
+		const char *prefix, enum iter_filter filter,
+		unsigned int flags)
+{
+	struct reftable_ref_iterator *iter;
+	struct ref_iterator *ref_iterator;
+
+	if (reftable_stack_reload(st))
+		return empty_ref_iterator_begin();
+
+	iter = xcalloc(1, sizeof(*iter));
+	ref_iterator = &iter->base;
+	base_ref_iterator_init(ref_iterator, &reftable_ref_iterator_vtable);
+
+	iter->refs = refs;
+	strbuf_init(&iter->rec.refname, 0);
+	strbuf_init(&iter->rec.target, 0);
+	iter->prefix = xstrdup(prefix);
+	iter->filter = filter;
+	iter->flags = flags;
+	reftable_stack_ref_iter(st, &iter->iter, prefix, 0);
+	return ref_iterator;
+}
+
+static struct ref_iterator *reftable_ref_iterator_begin(
+		struct ref_store *ref_store,
+		const char *prefix, unsigned int flags)
+{
+	struct reftable_ref_store *refs;
+	unsigned int required_flags = REF_STORE_READ;
+	struct ref_iterator *main_iter, *worktree_iter;
+
+	if (!(flags & DO_FOR_EACH_INCLUDE_BROKEN))
+		required_flags |= REF_STORE_ODB;
+	refs = reftable_downcast(ref_store, required_flags,
+				 "ref_iterator_begin");
+	if (!prefix)
+		prefix = "";
+
+	if (!refs->worktree_stack)
+		return stack_ref_iterator_begin(refs, refs->main_stack, prefix,
+				(flags & DO_FOR_EACH_PER_WORKTREE_ONLY) ?
+				ITER_PER_WORKTREE_REFS : ITER_ALL_REFS,
+				flags);
+
+	worktree_iter = stack_ref_iterator_begin(refs, refs->worktree_stack,
+						 prefix, ITER_PER_WORKTREE_REFS,
+						 flags);
+	if (flags & DO_FOR_EACH_PER_WORKTREE_ONLY)
+		return worktree_iter;
+	main_iter = stack_ref_iterator_begin(refs, refs->main_stack, prefix,
+					     ITER_SHARED_REFS, flags);
+	return overlay_ref_iterator_begin(worktree_iter, main_iter);
+}
+
+static int reftable_peel_ref(struct ref_store *ref_store,
+			     const char *refname, unsigned char *sha1)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ | REF_STORE_ODB,
+				  "peel_ref");
+	struct reftable_ref_record rec = REFTABLE_REF_RECORD_INIT;
+	unsigned char base[20];
+	int flag;
+
+	if (current_ref_iter && current_ref_iter->refname == refname) {
+		struct object_id peeled;
+
+		if (ref_iterator_peel(current_ref_iter, &peeled))
+			return -1;
+		hashcpy(sha1, peeled.hash);
+		return 0;
+	}
+
+	if (refs_read_ref_full(ref_store, refname,
+			       RESOLVE_REF_READING, base, &flag))
+		return -1;
+
+	/* a direct ref may have its peeled value recorded */
+	if (!(flag & REF_ISSYMREF) &&
+	    !reftable_stack_read_ref(stack_for(refs, refname), refname, &rec) &&
+	    rec.value_type == REFTABLE_REF_VAL2 &&
+	    !hashcmp(rec.oid.hash, base)) {
+		hashcpy(sha1, rec.peeled.hash);
+		reftable_ref_record_release(&rec);
+		return 0;
+	}
+	reftable_ref_record_release(&rec);
+
+	return peel_object(base, sha1);
+}
+
+/*
+ * Fill in the value of a ref record that points at oid, remembering
+ * the peeled value of annotated tags.
+ */
+static void set_ref_value(struct reftable_ref_record *rec,
+			  const struct object_id *oid)
+{
+	oidcpy(&rec->oid, oid);
+	if (peel_object(oid->hash, rec->peeled.hash) == PEEL_PEELED)
+		rec->value_type = REFTABLE_REF_VAL2;
+	else
+		rec->value_type = REFTABLE_REF_VAL1;
+}
+
+/*
+ * Return 1 if refname has a reflog in st, 0 if it does not, and -1 on
+ * error.
+ */
+static int stack_reflog_exists(struct reftable_stack *st, const char *refname)
+{
+	struct reftable_merged_iter it;
+	struct reftable_log_record log = REFTABLE_LOG_RECORD_INIT;
+	int ret;
+
+	reftable_stack_log_iter(st, &it, refname, 0);
+	ret = reftable_merged_iter_next_log(&it, &log);
+	if (!ret)
+		ret = !strcmp(log.refname.buf, refname);
+	else if (ret > 0)
+		ret = 0;
+	reftable_merged_iter_release(&it);
+	reftable_log_record_release(&log);
+	return ret;
+}
+
+/*
+ * Add tombstones for all reflog entries of refname in st to add,
+ * except for the ones whose update index is listed in keep.
+ */
+static int delete_log_records(struct reftable_stack *st,
+			      struct reftable_addition *add,
+			      const char *refname)
+{
+	struct reftable_merged_iter it;
+	struct reftable_log_record log = REFTABLE_LOG_RECORD_INIT;
+	int ret;
+
+	reftable_stack_log_iter(st, &it, refname, 0);
+	while (!(ret = reftable_merged_iter_next_log(&it, &log)) &&
+	       !strcmp(log.refname.buf, refname)) {
+		struct reftable_log_record *rec =
+			reftable_addition_log(add, refname);
+
+		rec->update_index = log.update_index;
+		rec->value_type = REFTABLE_LOG_DELETION;
+	}
+	reftable_merged_iter_release(&it);
+	reftable_log_record_release(&log);
+	return ret < 0 ? -1 : 0;
+}
+
+static void fill_log_record(struct reftable_log_record *rec,
+			    const struct object_id *old_oid,
+			    const struct object_id *new_oid,
+			    const char *msg)
+{
+	const char *committer = git_committer_info(0);
+	const char *email_end = strrchr(committer, '>');
+	char *end;
+
+	rec->value_type = REFTABLE_LOG_UPDATE;
+	oidcpy(&rec->old_oid, old_oid);
+	oidcpy(&rec->new_oid, new_oid);
+
+	if (!email_end)
+		die("BUG: committer ident '%s' has no email", committer);
+	strbuf_add(&rec->ident, committer, email_end + 1 - committer);
+	rec->time = parse_timestamp(email_end + 1, &end, 10);
+	rec->tz = strtol(end, NULL, 10);
+
+	if (msg && *msg) {
+		/* copy_reflog_msg() adds a leading TAB and trailing LF */
+		strbuf_grow(&rec->message, strlen(msg) + 2);
+		strbuf_setlen(&rec->message,
+			      copy_reflog_msg(rec->message.buf, msg));
+		strbuf_remove(&rec->message, 0, 1);
+		strbuf_setlen(&rec->message, rec->message.len - 1);
+	}
+}
+
+/*
+ * Add a reflog entry for refname to add, if refname has a reflog or
+ * should get one.
+ */
+static int add_log_record(struct reftable_stack *st,
+			  struct reftable_addition *add, const char *refname,
+			  const struct object_id *old_oid,
+			  const struct object_id *new_oid,
+			  const char *msg, unsigned int flags)
+{
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+
+	if (!(flags & REF_FORCE_CREATE_REFLOG) &&
+	    !should_autocreate_reflog(refname)) {
+		int exists = stack_reflog_exists(st, refname);
+
+		if (exists < 0)
+			return -1;
+		if (!exists)
+			return 0;
+	}
+
+	fill_log_record(reftable_addition_log(add, refname),
+			old_oid, new_oid, msg);
+	return 0;
+}
+
+static void lock_error(struct strbuf *err, const char *refname)
+{
+	char *reason = strbuf_detach(err, NULL);
+
+	strbuf_addf(err, "cannot lock ref '%s': %s", refname, reason);
+	free(reason);
+}
+
+/*
+ * Lock the stacks of refs for writing. On error, release any locks
+ * taken and write a message to err.
+ */
+static int lock_stacks(struct reftable_ref_store *refs, struct strbuf *err)
+{
+	if (reftable_stack_lock(refs->main_stack, err))
+		return -1;
+	if (refs->worktree_stack &&
+	    reftable_stack_lock(refs->worktree_stack, err)) {
+		reftable_stack_unlock(refs->main_stack);
+		return -1;
+	}
+	return 0;
+}
+
+static void unlock_stacks(struct reftable_ref_store *refs)
+{
+	reftable_stack_unlock(refs->main_stack);
+	if (refs->worktree_stack)
+		reftable_stack_unlock(refs->worktree_stack);
+}
+
+/*
+ * Prepare one update of a transaction with the stacks locked:
+ * - Read the current value of the reference.
+ * - Check that its old value (if specified) is correct, and in any
+ *   case record it for the reflog.
+ * - If it is a symref update without REF_NODEREF, split it up into a
+ *   REF_LOG_ONLY update of the symref and add a separate update for
+ *   the referent to transaction.
+ * - If it is an update of head_ref, add a corresponding REF_LOG_ONLY
+ *   update of HEAD.
+ * - Check that a new value can be written.
+ */
+static int prepare_update(struct reftable_ref_store *refs,
+			  struct ref_update *update,
+			  struct ref_transaction *transaction,
+			  const char *head_ref,
+			  struct string_list *affected_refnames,
+			  struct strbuf *err)
+{
+	struct reftable_update *data = xcalloc(1, sizeof(*data));
+	struct strbuf referent = STRBUF_INIT;
+	struct object_id oid;
+	int mustexist = (update->flags & REF_HAVE_OLD) &&
+		!is_null_oid(&update->old_oid);
+	int ret = 0;
+
+	update->backend_data = data;
+
+	if ((update->flags & REF_HAVE_NEW) && is_null_oid(&update->new_oid))
+		update->flags |= REF_DELETING;
+
+	if (head_ref) {
+		ret = split_head_update(update, transaction, head_ref,
+					affected_refnames, err);
+		if (ret)
+			goto out;
+	}
+
+	if (refs_read_raw_ref(&refs->base, update->refname, oid.hash,
+			      &referent, &update->type)) {
+		if (errno != ENOENT && !(update->flags & REF_DELETING)) {
+			strbuf_addf(err, "unable to resolve reference '%s'",
+				    update->refname);
+			lock_error(err, original_update_refname(update));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if (mustexist) {
+			strbuf_addf(err, "unable to resolve reference '%s'",
+				    update->refname);
+			lock_error(err, original_update_refname(update));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if (errno == ENOENT &&
+		    refs_verify_refname_available(&refs->base, update->refname,
+						  affected_refnames, NULL, err)) {
+			lock_error(err, original_update_refname(update));
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto out;
+		}
+		update->type = 0;
+		oidclr(&oid);
+	}
+
+	if (update->type & REF_ISSYMREF) {
+		if (update->flags & REF_NODEREF) {
+			/*
+			 * We won't be reading the referent as part of
+			 * the transaction, so we have to read it here
+			 * to record and possibly check old_sha1:
+			 */
+			if (refs_read_ref_full(&refs->base, referent.buf, 0,
+					       data->old_oid.hash, NULL)) {
+				if (update->flags & REF_HAVE_OLD) {
+					strbuf_addf(err, "cannot lock ref '%s': "
+						    "error reading reference",
+						    original_update_refname(update));
+					ret = TRANSACTION_GENERIC_ERROR;
+					goto out;
+				}
+			} else if (check_old_oid(update, &data->old_oid, err)) {
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto out;
+			}
+		} else {
+			ret = split_symref_update(update, referent.buf,
+						  transaction,
+						  affected_refnames, err);
+			goto out;
+		}
+	} else {
+		struct ref_update *parent_update;
+
+		oidcpy(&data->old_oid, &oid);
+		if (check_old_oid(update, &oid, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+
+		/*
+		 * If this update is happening indirectly because of a
+		 * symref update, record the old SHA-1 in the parent
+		 * update:
+		 */
+		for (parent_update = update->parent_update;
+		     parent_update;
+		     parent_update = parent_update->parent_update) {
+			struct reftable_update *parent_data =
+				parent_update->backend_data;
+			oidcpy(&parent_data->old_oid, &oid);
+		}
+	}
+
+	if (update->flags & REF_LOG_ONLY)
+		goto out;
+
+	if (update->flags & REF_DELETING) {
+		if (update->type & REF_ISSYMREF || !is_null_oid(&oid))
+			update->flags |= REF_NEEDS_COMMIT;
+	} else if (update->flags & REF_HAVE_NEW) {
+		struct object *o = parse_object(&update->new_oid);
+
+		if (!o) {
+			strbuf_addf(err,
+				    "cannot update ref '%s': "
+				    "trying to write ref '%s' with nonexistent object %s",
+				    update->refname, update->refname,
+				    oid_to_hex(&update->new_oid));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if (o->type != OBJ_COMMIT && is_branch(update->refname)) {
+			strbuf_addf(err,
+				    "cannot update ref '%s': "
+				    "trying to write non-commit object %s to branch '%s'",
+				    update->refname,
+				    oid_to_hex(&update->new_oid), update->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		/*
+		 * If the reference already has the desired value, we
+		 * don't need to write it.
+		 */
+		if (update->type & REF_ISSYMREF ||
+		    oidcmp(&oid, &update->new_oid))
+			update->flags |= REF_NEEDS_COMMIT;
+	}
+
+out:
+	strbuf_release(&referent);
+	return ret;
+}
+
+/*
+ * Release the per-update data and locks of transaction, and mark it
+ * closed.
+ */
+static void reftable_transaction_cleanup(struct reftable_ref_store *refs,
+					 struct ref_transaction *transaction)
+{
+	size_t i;
+
+	for (i = 0; i < transaction->nr; i++) {
+		free(transaction->updates[i]->backend_data);
+		transaction->updates[i]->backend_data = NULL;
+	}
+	unlock_stacks(refs);
+	transaction->state = REF_TRANSACTION_CLOSED;
+}
+
+static int reftable_transaction_prepare(struct ref_store *ref_store,
+					struct ref_transaction *transaction,
+					struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE,
+				  "ref_transaction_prepare");
+	struct string_list affected_refnames = STRING_LIST_INIT_NODUP;
+	char *head_ref = NULL;
+	int head_type;
+	struct object_id head_oid;
+	size_t i;
+	int ret = 0;
+
+	assert(err);
+
+	if (!transaction->nr) {
+		transaction->state = REF_TRANSACTION_PREPARED;
+		return 0;
+	}
+
+	/*
+	 * Fail if a refname appears more than once in the
+	 * transaction. (If we end up splitting up any updates using
+	 * split_symref_update() or split_head_update(), those
+	 * functions will check that the new updates don't have the
+	 * same refname as any existing ones.)
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct string_list_item *item =
+			string_list_append(&affected_refnames, update->refname);
+
+		item->util = update;
+	}
+	string_list_sort(&affected_refnames);
+	if (ref_update_reject_duplicates(&affected_refnames, err)) {
+		string_list_clear(&affected_refnames, 0);
+		transaction->state = REF_TRANSACTION_CLOSED;
+		return TRANSACTION_GENERIC_ERROR;
+	}
+
+	/*
+	 * All the updates of the transaction are written as one new
+	 * table per stack, so holding the locks of the stacks from
+	 * here to transaction_finish() makes the transaction atomic.
+	 */
+	if (lock_stacks(refs, err)) {
+		string_list_clear(&affected_refnames, 0);
+		transaction->state = REF_TRANSACTION_CLOSED;
+		return TRANSACTION_GENERIC_ERROR;
+	}
+
+	/*
+	 * If HEAD is a symbolic reference, then record the name of
+	 * the reference that it points to, so that a direct update of
+	 * that reference is logged in the reflog of HEAD, too (see
+	 * files_transaction_prepare()).
+	 */
+	head_ref = refs_resolve_refdup(ref_store, "HEAD",
+				       RESOLVE_REF_NO_RECURSE,
+				       head_oid.hash, &head_type);
+	if (head_ref && !(head_type & REF_ISSYMREF)) {
+		free(head_ref);
+		head_ref = NULL;
+	}
+
+	/* Note that prepare_update() might append more updates. */
+	for (i = 0; i < transaction->nr; i++) {
+		ret = prepare_update(refs, transaction->updates[i],
+				     transaction, head_ref,
+				     &affected_refnames, err);
+		if (ret)
+			break;
+	}
+
+	free(head_ref);
+	string_list_clear(&affected_refnames, 0);
+
+	if (ret)
+		reftable_transaction_cleanup(refs, transaction);
+	else
+		transaction->state = REF_TRANSACTION_PREPARED;
+	return ret;
+}
+
+static int reftable_transaction_finish(struct ref_store *ref_store,
+				       struct ref_transaction *transaction,
+				       struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, 0, "ref_transaction_finish");
+	struct reftable_addition main_add = REFTABLE_ADDITION_INIT;
+	struct reftable_addition worktree_add = REFTABLE_ADDITION_INIT;
+	size_t i;
+	int ret = 0;
+
+	assert(err);
+
+	if (!transaction->nr) {
+		transaction->state = REF_TRANSACTION_CLOSED;
+		return 0;
+	}
+
+	main_add.update_index =
+		reftable_stack_next_update_index(refs->main_stack);
+	if (refs->worktree_stack)
+		worktree_add.update_index =
+			reftable_stack_next_update_index(refs->worktree_stack);
+
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct reftable_update *data = update->backend_data;
+		struct reftable_stack *st = stack_for(refs, update->refname);
+		struct reftable_addition *add =
+			st == refs->main_stack ? &main_add : &worktree_add;
+
+		if ((update->flags & REF_NEEDS_COMMIT &&
+		     !(update->flags & REF_DELETING)) ||
+		    update->flags & REF_LOG_ONLY) {
+			if (add_log_record(st, add, update->refname,
+					   &data->old_oid, &update->new_oid,
+					   update->msg, update->flags)) {
+				strbuf_addf(err, "cannot update the ref '%s': "
+					    "unable to read its reflog",
+					    update->refname);
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto cleanup;
+			}
+		}
+
+		if (!(update->flags & REF_NEEDS_COMMIT))
+			continue;
+
+		if (ref_type(update->refname) == REF_TYPE_PSEUDOREF) {
+			char *contents = NULL;
+
+			if (!(update->flags & REF_DELETING))
+				contents = xstrfmt("%s\n",
+						   oid_to_hex(&update->new_oid));
+			ret = write_pseudoref_file(refs, update->refname,
+						   contents, err);
+			free(contents);
+			if (ret) {
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto cleanup;
+			}
+			continue;
+		}
+
+		if (update->flags & REF_DELETING) {
+			reftable_addition_ref(add, update->refname)->value_type =
+				REFTABLE_REF_DELETION;
+			/* the reflog goes with the reference */
+			if (delete_log_records(st, add, update->refname)) {
+				strbuf_addf(err, "cannot delete the reflog of '%s'",
+					    update->refname);
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto cleanup;
+			}
+		} else {
+			set_ref_value(reftable_addition_ref(add, update->refname),
+				      &update->new_oid);
+		}
+	}
+
+	reftable_sort_records(&main_add);
+	if (reftable_stack_add(refs->main_stack, &main_add, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+	if (refs->worktree_stack) {
+		reftable_sort_records(&worktree_add);
+		if (reftable_stack_add(refs->worktree_stack, &worktree_add, err))
+			ret = TRANSACTION_GENERIC_ERROR;
+	}
+
+cleanup:
+	reftable_transaction_cleanup(refs, transaction);
+	reftable_addition_release(&main_add);
+	reftable_addition_release(&worktree_add);
+	return ret;
+}
+
+static int reftable_transaction_abort(struct ref_store *ref_store,
+				      struct ref_transaction *transaction,
+				      struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, 0, "ref_transaction_abort");
+
+	reftable_transaction_cleanup(refs, transaction);
+	return 0;
+}
+
+static int reftable_initial_transaction_commit(struct ref_store *ref_store,
+					       struct ref_transaction *transaction,
+					       struct strbuf *err)
+{
+	int ret;
+
+	/*
+	 * A regular transaction already writes all of its updates as
+	 * a single table, which is all the files backend gains by
+	 * writing straight to packed-refs.
+	 */
+	ret = reftable_transaction_prepare(ref_store, transaction, err);
+	if (ret)
+		return ret;
+	return reftable_transaction_finish(ref_store, transaction, err);
+}
+
+static int reftable_pack_refs(struct ref_store *ref_store, unsigned int flags)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE | REF_STORE_ODB,
+				  "pack_refs");
+	struct strbuf err = STRBUF_INIT;
+	int ret = 0;
+
+	if (reftable_stack_compact_all(refs->main_stack, &err) ||
+	    (refs->worktree_stack &&
+	     reftable_stack_compact_all(refs->worktree_stack, &err)))
+		ret = error("%s", err.buf);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_create_symref(struct ref_store *ref_store,
+				  const char *refname, const char *target,
+				  const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_symref");
+	struct reftable_stack *st = stack_for(refs, refname);
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct reftable_ref_record *rec;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id old_oid, new_oid;
+	int ret = 0;
+
+	if (ref_type(refname) == REF_TYPE_PSEUDOREF) {
+		char *contents = xstrfmt("ref: %s\n", target);
+
+		if (write_pseudoref_file(refs, refname, contents, &err))
+			ret = error("%s", err.buf);
+		free(contents);
+		goto out;
+	}
+
+	if (reftable_stack_lock(st, &err)) {
+		ret = error("%s", err.buf);
+		goto out;
+	}
+
+	if (refs_read_ref_full(&refs->base, refname, RESOLVE_REF_READING,
+			       old_oid.hash, NULL)) {
+		oidclr(&old_oid);
+		if (errno == ENOENT &&
+		    refs_verify_refname_available(&refs->base, refname,
+						  NULL, NULL, &err)) {
+			reftable_stack_unlock(st);
+			ret = error("%s", err.buf);
+			goto out;
+		}
+	}
+
+	add.update_index = reftable_stack_next_update_index(st);
+	rec = reftable_addition_ref(&add, refname);
+	rec->value_type = REFTABLE_REF_SYMREF;
+	strbuf_addstr(&rec->target, target);
+
+	if (logmsg &&
+	    !refs_read_ref_full(&refs->base, target, RESOLVE_REF_READING,
+				new_oid.hash, NULL) &&
+	    add_log_record(st, &add, refname, &old_oid, &new_oid, logmsg, 0))
+		error("unable to read the reflog of '%s'", refname);
+
+	reftable_sort_records(&add);
+	if (reftable_stack_add(st, &add, &err))
+		ret = error("unable to write symref for %s: %s",
+			    refname, err.buf);
+
+out:
+	reftable_addition_release(&add);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_delete_refs(struct ref_store *ref_store, const char *msg,
+				struct string_list *refnames, unsigned int flags)
+{
+	struct ref_transaction *transaction;
+	struct strbuf err = STRBUF_INIT;
+	int i, ret = 0;
+
+	if (!refnames->nr)
+		return 0;
+
+	/*
+	 * Unlike with loose refs and packed-refs, deleting all the
+	 * references at once is also the cheapest way to do it.
+	 */
+	transaction = ref_store_transaction_begin(ref_store, &err);
+	if (!transaction)
+		goto fail;
+	for (i = 0; i < refnames->nr; i++) {
+		const char *refname = refnames->items[i].string;
+		unsigned int ref_flags = flags;
+
+		/* like refs_delete_ref(), delete pseudorefs themselves */
+		if (ref_type(refname) == REF_TYPE_PSEUDOREF)
+			ref_flags |= REF_NODEREF;
+		if (ref_transaction_delete(transaction, refname,
+					   NULL, ref_flags, msg, &err))
+			goto fail;
+	}
+	if (ref_transaction_commit(transaction, &err))
+		goto fail;
+	goto out;
+
+fail:
+	if (refnames->nr == 1)
+		ret = error(_("could not delete reference %s: %s"),
+			    refnames->items[0].string, err.buf);
+	else
+		ret = error(_("could not delete references: %s"), err.buf);
+out:
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_rename_ref(struct ref_store *ref_store,
+			       const char *oldrefname, const char *newrefname,
+			       const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "rename_ref");
+	struct reftable_stack *st = stack_for(refs, oldrefname);
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct reftable_merged_iter it;
+	struct reftable_log_record log = REFTABLE_LOG_RECORD_INIT;
+	struct string_list moved = STRING_LIST_INIT_NODUP;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id orig_oid, head_oid;
+	const char *head_ref;
+	int flag = 0, head_flag, i, ret;
+
+	if (st != stack_for(refs, newrefname))
+		return error("cannot rename %s to %s: they are stored "
+			     "in different worktrees", oldrefname, newrefname);
+
+	if (reftable_stack_lock(st, &err)) {
+		ret = error("%s", err.buf);
+		goto out;
+	}
+
+	if (!refs_resolve_ref_unsafe(&refs->base, oldrefname,
+				     RESOLVE_REF_READING | RESOLVE_REF_NO_RECURSE,
+				     orig_oid.hash, &flag)) {
+		ret = error("refname %s not found", oldrefname);
+		goto unlock;
+	}
+	if (flag & REF_ISSYMREF) {
+		ret = error("refname %s is a symbolic ref, renaming it is not supported",
+			    oldrefname);
+		goto unlock;
+	}
+	if (!refs_rename_ref_available(&refs->base, oldrefname, newrefname)) {
+		ret = 1;
+		goto unlock;
+	}
+
+	add.update_index = reftable_stack_next_update_index(st);
+	reftable_addition_ref(&add, oldrefname)->value_type =
+		REFTABLE_REF_DELETION;
+	set_ref_value(reftable_addition_ref(&add, newrefname), &orig_oid);
+
+	/* Move the reflog, replacing any that newrefname had */
+	reftable_stack_log_iter(st, &it, oldrefname, 0);
+	while (!(ret = reftable_merged_iter_next_log(&it, &log)) &&
+	       !strcmp(log.refname.buf, oldrefname)) {
+		struct reftable_log_record *rec;
+
+		rec = reftable_addition_log(&add, oldrefname);
+		rec->update_index = log.update_index;
+		rec->value_type = REFTABLE_LOG_DELETION;
+
+		rec = reftable_addition_log(&add, newrefname);
+		strbuf_swap(&rec->ident, &log.ident);
+		strbuf_swap(&rec->message, &log.message);
+		rec->update_index = log.update_index;
+		rec->value_type = log.value_type;
+		oidcpy(&rec->old_oid, &log.old_oid);
+		oidcpy(&rec->new_oid, &log.new_oid);
+		rec->time = log.time;
+		rec->tz = log.tz;
+		string_list_append(&moved, "")->util =
+			(void *)(uintptr_t)log.update_index;
+	}
+	reftable_merged_iter_release(&it);
+
+	reftable_stack_log_iter(st, &it, newrefname, 0);
+	while (ret >= 0 &&
+	       !(ret = reftable_merged_iter_next_log(&it, &log)) &&
+	       !strcmp(log.refname.buf, newrefname)) {
+		for (i = 0; i < moved.nr; i++)
+			if ((uintptr_t)moved.items[i].util == log.update_index)
+				break;
+		if (i < moved.nr)
+			continue;
+		reftable_addition_log(&add, newrefname)->update_index =
+			log.update_index;
+	}
+	reftable_merged_iter_release(&it);
+	if (ret < 0) {
+		ret = error("unable to read the reflog of %s", oldrefname);
+		goto unlock;
+	}
+
+	/*
+	 * Log the deletion of the old name in the reflog of HEAD if
+	 * it points there, and the creation of the new one, like a
+	 * delete_ref() followed by an update_ref() would.
+	 */
+	head_ref = refs_resolve_ref_unsafe(&refs->base, "HEAD",
+					   RESOLVE_REF_NO_RECURSE,
+					   head_oid.hash, &head_flag);
+	if (logmsg && head_ref && (head_flag & REF_ISSYMREF) &&
+	    !strcmp(head_ref, oldrefname) && stack_for(refs, "HEAD") == st &&
+	    add_log_record(st, &add, "HEAD", &orig_oid, &null_oid, logmsg, 0)) {
+		ret = error("unable to read the reflog of HEAD");
+		goto unlock;
+	}
+	if ((moved.nr || should_autocreate_reflog(newrefname)) &&
+	    add_log_record(st, &add, newrefname, &orig_oid, &orig_oid,
+			   logmsg, REF_FORCE_CREATE_REFLOG)) {
+		ret = error("unable to read the reflog of %s", newrefname);
+		goto unlock;
+	}
+
+	reftable_sort_records(&add);
+	ret = 0;
+	if (reftable_stack_add(st, &add, &err))
+		ret = error("unable to rename '%s' to '%s': %s",
+			    oldrefname, newrefname, err.buf);
+	goto out;
+
+unlock:
+	reftable_stack_unlock(st);
+out:
+	reftable_log_record_release(&log);
+	reftable_addition_release(&add);
+	string_list_clear(&moved, 0);
+	strbuf_release(&err);
+	return ret;
+}
+
+struct reftable_reflog_iterator {
+	struct ref_iterator base;
+
+	struct reftable_ref_store *refs;
+	struct reftable_merged_iter iter;
+	struct reftable_log_record log;
+	struct strbuf last_refname;
+	struct object_id oid;
+	enum iter_filter filter;
+};
+
+static int reftable_reflog_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+	int ret;
+
+	while (!(ret = reftable_merged_iter_next_log(&iter->iter, &iter->log))) {
+		const char *refname = iter->log.refname.buf;
+		int flags;
+
+		if (!strbuf_cmp(&iter->log.refname, &iter->last_refname))
+			continue;
+		strbuf_reset(&iter->last_refname);
+		strbuf_addbuf(&iter->last_refname, &iter->log.refname);
+
+		if (iter->filter != ITER_ALL_REFS &&
+		    (ref_type(refname) == REF_TYPE_PER_WORKTREE) !=
+		    (iter->filter == ITER_PER_WORKTREE_REFS))
+			continue;
+
+		if (refs_read_ref_full(&iter->refs->base, refname, 0,
+				       iter->oid.hash, &flags)) {
+			error("bad ref for %s", refname);
+			continue;
+		}
+
+		iter->base.refname = iter->last_refname.buf;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE || ret < 0)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int reftable_reflog_iterator_peel(struct ref_iterator *ref_iterator,
+					 struct object_id *peeled)
+{
+	die("BUG: ref_iterator_peel() called for reflog_iterator");
+}
+
+static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	reftable_merged_iter_release(&iter->iter);
+	reftable_log_record_release(&iter->log);
+	strbuf_release(&iter->last_refname);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_reflog_iterator_vtable = {
+	reftable_reflog_iterator_advance,
+	reftable_reflog_iterator_peel,
+	reftable_reflog_iterator_abort
+};
+
+static struct ref_iterator *stack_reflog_iterator_begin(
+		struct reftable_ref_store *refs, struct reftable_stack *st,
+		enum iter_filter filter)
+{
+	struct reftable_reflog_iterator *iter;
+	struct ref_iterator *ref_iterator;
+
+	if (reftable_stack_reload(st))
+		return empty_ref_iterator_begin();
+
+	iter = xcalloc(1, sizeof(*iter));
+	ref_iterator = &iter->base;
+	base_ref_iterator_init(ref_iterator, &reftable_reflog_iterator_vtable);
+
+	iter->refs = refs;
+	strbuf_init(&iter->log.refname, 0);
+	strbuf_init(&iter->log.ident, 0);
+	strbuf_init(&iter->log.message, 0);
+	strbuf_init(&iter->last_refname, 0);
+	iter->filter = filter;
+	reftable_stack_log_iter(st, &iter->iter, "", 0);
+	return ref_iterator;
+}
+
+static struct ref_iterator *reftable_reflog_iterator_begin(struct ref_store *ref_store)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "reflog_iterator_begin");
+
+	if (!refs->worktree_stack)
+		return stack_reflog_iterator_begin(refs, refs->main_stack,
+						   ITER_ALL_REFS);
+	return overlay_ref_iterator_begin(
+		stack_reflog_iterator_begin(refs, refs->worktree_stack,
+					    ITER_PER_WORKTREE_REFS),
+		stack_reflog_iterator_begin(refs, refs->main_stack,
+					    ITER_SHARED_REFS));
+}
+
+/*
+ * Collect the reflog entries of refname, newest first, skipping the
+ * marker that an empty reflog exists.
+ */
+static int read_reflog(struct reftable_ref_store *refs, const char *refname,
+		       struct reftable_log_record **entries, int *nr)
+{
+	struct reftable_stack *st = stack_for(refs, refname);
+	struct reftable_merged_iter it;
+	struct reftable_log_record log = REFTABLE_LOG_RECORD_INIT;
+	int alloc = 0, ret;
+
+	*entries = NULL;
+	*nr = 0;
+	if (reftable_stack_reload(st))
+		return -1;
+
+	reftable_stack_log_iter(st, &it, refname, 0);
+	while (!(ret = reftable_merged_iter_next_log(&it, &log)) &&
+	       !strcmp(log.refname.buf, refname)) {
+		if (reftable_log_record_is_marker(&log))
+			continue;
+		ALLOC_GROW(*entries, *nr + 1, alloc);
+		(*entries)[(*nr)++] = log;
+		strbuf_init(&log.refname, 0);
+		strbuf_init(&log.ident, 0);
+		strbuf_init(&log.message, 0);
+	}
+	reftable_merged_iter_release(&it);
+	reftable_log_record_release(&log);
+	return ret < 0 ? -1 : 0;
+}
+
+static void free_reflog(struct reftable_log_record *entries, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		reftable_log_record_release(&entries[i]);
+	free(entries);
+}
+
+static int show_log_record(struct reftable_log_record *log,
+			   each_reflog_ent_fn fn, void *cb_data)
+{
+	/* callers expect the message to be terminated by LF */
+	strbuf_addch(&log->message, '\n');
+	return fn(&log->old_oid, &log->new_oid, log->ident.buf,
+		  log->time, log->tz, log->message.buf, cb_data);
+}
+
+static int reftable_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+						const char *refname,
+						each_reflog_ent_fn fn,
+						void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent_reverse");
+	struct reftable_log_record *entries;
+	int i, nr, ret = 0;
+
+	if (read_reflog(refs, refname, &entries, &nr))
+		return -1;
+	for (i = 0; i < nr && !ret; i++)
+		ret = show_log_record(&entries[i], fn, cb_data);
+	free_reflog(entries, nr);
+	return ret;
+}
+
+static int reftable_for_each_reflog_ent(struct ref_store *ref_store,
+					const char *refname,
+					each_reflog_ent_fn fn, void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent");
+	struct reftable_log_record *entries;
+	int i, nr, ret = 0;
+
+	if (read_reflog(refs, refname, &entries, &nr))
+		return -1;
+	for (i = nr - 1; i >= 0 && !ret; i--)
+		ret = show_log_record(&entries[i], fn, cb_data);
+	free_reflog(entries, nr);
+	return ret;
+}
+
+static int reftable_reflog_exists(struct ref_store *ref_store,
+				  const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "reflog_exists");
+	struct reftable_stack *st = stack_for(refs, refname);
+
+	if (reftable_stack_reload(st))
+		return 0;
+	return stack_reflog_exists(st, refname) > 0;
+}
+
+static int reftable_create_reflog(struct ref_store *ref_store,
+				  const char *refname, int force_create,
+				  struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_reflog");
+	struct reftable_stack *st = stack_for(refs, refname);
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	int exists, ret;
+
+	if (!force_create && !should_autocreate_reflog(refname))
+		return 0;
+	if (reftable_stack_lock(st, err))
+		return -1;
+
+	exists = stack_reflog_exists(st, refname);
+	if (exists) {
+		reftable_stack_unlock(st);
+		if (exists < 0) {
+			strbuf_addf(err, "unable to read the reflog of '%s'",
+				    refname);
+			return -1;
+		}
+		return 0;
+	}
+
+	add.update_index = reftable_stack_next_update_index(st);
+	reftable_addition_log(&add, refname)->value_type = REFTABLE_LOG_UPDATE;
+	ret = reftable_stack_add(st, &add, err);
+	reftable_addition_release(&add);
+	return ret;
+}
+
+static int reftable_delete_reflog(struct ref_store *ref_store,
+				  const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "delete_reflog");
+	struct reftable_stack *st = stack_for(refs, refname);
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct strbuf err = STRBUF_INIT;
+	int ret = 0;
+
+	if (reftable_stack_lock(st, &err)) {
+		ret = error("%s", err.buf);
+		goto out;
+	}
+	add.update_index = reftable_stack_next_update_index(st);
+	if (delete_log_records(st, &add, refname)) {
+		reftable_stack_unlock(st);
+		ret = error("unable to read the reflog of '%s'", refname);
+		goto out;
+	}
+	reftable_sort_records(&add);
+	if (reftable_stack_add(st, &add, &err))
+		ret = error("%s", err.buf);
+
+out:
+	reftable_addition_release(&add);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_reflog_expire(struct ref_store *ref_store,
+				  const char *refname, const unsigned char *sha1,
+				  unsigned int flags,
+				  reflog_expiry_prepare_fn prepare_fn,
+				  reflog_expiry_should_prune_fn should_prune_fn,
+				  reflog_expiry_cleanup_fn cleanup_fn,
+				  void *policy_cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "reflog_expire");
+	struct reftable_stack *st = stack_for(refs, refname);
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct reftable_log_record *entries;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id oid, last_kept_oid;
+	unsigned int type;
+	struct strbuf referent = STRBUF_INIT;
+	int i, nr, kept = 0, status = 0;
+
+	/*
+	 * Holding the lock of the stack also keeps the reference
+	 * itself stable, which we might need to update if
+	 * --updateref was specified.
+	 */
+	if (reftable_stack_lock(st, &err)) {
+		status = error("cannot lock ref '%s': %s", refname, err.buf);
+		goto out;
+	}
+	if (refs_read_raw_ref(ref_store, refname, oid.hash, &referent, &type))
+		type = 0;
+	if (!stack_reflog_exists(st, refname)) {
+		reftable_stack_unlock(st);
+		goto out;
+	}
+	if (read_reflog(refs, refname, &entries, &nr)) {
+		reftable_stack_unlock(st);
+		status = error("unable to read the reflog of '%s'", refname);
+		goto out;
+	}
+
+	hashcpy(oid.hash, sha1);
+	oidclr(&last_kept_oid);
+	add.update_index = reftable_stack_next_update_index(st);
+
+	(*prepare_fn)(refname, &oid, policy_cb_data);
+	for (i = nr - 1; i >= 0; i--) {
+		struct reftable_log_record *e = &entries[i];
+		struct object_id *ooid = &e->old_oid;
+		struct reftable_log_record *rec;
+
+		strbuf_addch(&e->message, '\n');
+		if (flags & EXPIRE_REFLOGS_REWRITE)
+			ooid = &last_kept_oid;
+
+		if ((*should_prune_fn)(ooid, &e->new_oid, e->ident.buf,
+				       e->time, e->tz, e->message.buf,
+				       policy_cb_data)) {
+			if (flags & EXPIRE_REFLOGS_DRY_RUN)
+				printf("would prune %s", e->message.buf);
+			else if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("prune %s", e->message.buf);
+			rec = reftable_addition_log(&add, refname);
+			rec->update_index = e->update_index;
+			rec->value_type = REFTABLE_LOG_DELETION;
+			continue;
+		}
+
+		if (oidcmp(ooid, &e->old_oid)) {
+			/* overwrite the entry with the rewritten one */
+			rec = reftable_addition_log(&add, refname);
+			rec->update_index = e->update_index;
+			rec->value_type = REFTABLE_LOG_UPDATE;
+			oidcpy(&rec->old_oid, ooid);
+			oidcpy(&rec->new_oid, &e->new_oid);
+			strbuf_addbuf(&rec->ident, &e->ident);
+			rec->time = e->time;
+			rec->tz = e->tz;
+			strbuf_add(&rec->message, e->message.buf,
+				   e->message.len - 1);
+		}
+		oidcpy(&last_kept_oid, &e->new_oid);
+		kept++;
+		if (flags & EXPIRE_REFLOGS_VERBOSE)
+			printf("keep %s", e->message.buf);
+	}
+	(*cleanup_fn)(policy_cb_data);
+	free_reflog(entries, nr);
+
+	if (flags & EXPIRE_REFLOGS_DRY_RUN) {
+		reftable_stack_unlock(st);
+		goto out;
+	}
+
+	/* the reflog stays around even if all its entries are pruned */
+	if (!kept)
+		reftable_addition_log(&add, refname)->value_type =
+			REFTABLE_LOG_UPDATE;
+
+	/*
+	 * It doesn't make sense to adjust a reference pointed to by a
+	 * symbolic ref based on expiring entries in the symbolic
+	 * reference's reflog. Nor can we update a reference if there
+	 * are no remaining reflog entries.
+	 */
+	if ((flags & EXPIRE_REFLOGS_UPDATE_REF) &&
+	    !(type & REF_ISSYMREF) && !is_null_oid(&last_kept_oid))
+		set_ref_value(reftable_addition_ref(&add, refname),
+			      &last_kept_oid);
+
+	reftable_sort_records(&add);
+	if (reftable_stack_add(st, &add, &err))
+		status = error("unable to write reflog '%s' (%s)",
+			       refname, err.buf);
+
+out:
+	reftable_addition_release(&add);
+	strbuf_release(&referent);
+	strbuf_release(&err);
+	return status;
+}
+
+struct ref_storage_be refs_be_reftable = {
+	NULL,
+	"reftable",
+	reftable_ref_store_create,
+	reftable_init_db,
+	reftable_transaction_prepare,
+	reftable_transaction_finish,
+	reftable_transaction_abort,
+	reftable_initial_transaction_commit,
+
+	reftable_pack_refs,
+	reftable_peel_ref,
+	reftable_create_symref,
+	reftable_delete_refs,
+	reftable_rename_ref,
+
+	reftable_ref_iterator_begin,
+	reftable_read_raw_ref,
+
+	reftable_reflog_iterator_begin,
+	reftable_for_each_reflog_ent,
+	reftable_for_each_reflog_ent_reverse,
+	reftable_reflog_exists,
+	reftable_create_reflog,
+	reftable_delete_reflog,
+	reftable_reflog_expire
+};
@@ -0,0 +1,1525 @@
+#include "../cache.h"
+#include "../lockfile.h"
+#include "../varint.h"
+#include "reftable.h"
+
+#define REFTABLE_SIGNATURE "REFT"
+#define REFTABLE_VERSION 1
+#define REFTABLE_HEADER_SIZE 24
+#define REFTABLE_FOOTER_SIZE (REFTABLE_HEADER_SIZE + 3 * 8 + 4)
+
+#define BLOCK_TYPE_REF 'r'
+#define BLOCK_TYPE_LOG 'g'
+#define BLOCK_TYPE_INDEX 'i'
+#define BLOCK_HEADER_SIZE 4
+
+/* Every RESTART_INTERVAL-th record of a block stores its full key */
+#define RESTART_INTERVAL 16
+#define MAX_RESTARTS 0xffff
+#define MAX_BLOCK_LEN 0xffffff
+
+/* A log key is the refname, a NUL and the inverted update index */
+#define LOG_KEY_SUFFIX_LEN 9
+
+static void put_be16(unsigned char *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static uint32_t get_be24(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static void put_be24(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 16;
+	p[1] = v >> 8;
+	p[2] = v;
+}
+
+static void put_be64(unsigned char *p, uint64_t v)
+{
+	put_be32(p, v >> 32);
+	put_be32(p + 4, v & 0xffffffff);
+}
+
+/*
+ * Like decode_varint(), but refuse to read past end. Return 0 on
+ * success and -1 if the data is truncated or the value overflows.
+ */
+static int get_varint(const unsigned char **p, const unsigned char *end,
+		      uint64_t *value)
+{
+	const unsigned char *buf = *p;
+	unsigned char c;
+	uint64_t val;
+
+	if (buf >= end)
+		return -1;
+	c = *buf++;
+	val = c & 127;
+	while (c & 128) {
+		val += 1;
+		if (!val || (val >> 57) || buf >= end)
+			return -1;
+		c = *buf++;
+		val = (val << 7) + (c & 127);
+	}
+	*p = buf;
+	*value = val;
+	return 0;
+}
+
+static void strbuf_add_varint(struct strbuf *sb, uint64_t value)
+{
+	unsigned char buf[16];
+
+	strbuf_add(sb, buf, encode_varint(value, buf));
+}
+
+static int key_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+	int cmp = memcmp(a, b, alen < blen ? alen : blen);
+
+	if (cmp)
+		return cmp;
+	return alen < blen ? -1 : alen != blen;
+}
+
+static void log_key(struct strbuf *key, const char *refname,
+		    uint64_t update_index)
+{
+	unsigned char buf[8];
+
+	strbuf_reset(key);
+	strbuf_addstr(key, refname);
+	strbuf_addch(key, '\0');
+	put_be64(buf, ~update_index);
+	strbuf_add(key, buf, sizeof(buf));
+}
+
+void reftable_ref_record_release(struct reftable_ref_record *rec)
+{
+	strbuf_release(&rec->refname);
+	strbuf_release(&rec->target);
+}
+
+void reftable_log_record_release(struct reftable_log_record *rec)
+{
+	strbuf_release(&rec->refname);
+	strbuf_release(&rec->ident);
+	strbuf_release(&rec->message);
+}
+
+int reftable_log_record_is_marker(const struct reftable_log_record *rec)
+{
+	return rec->value_type == REFTABLE_LOG_UPDATE &&
+		is_null_oid(&rec->old_oid) && is_null_oid(&rec->new_oid);
+}
+
+/*
+ * Return the length of the value of a record of the given block and
+ * value type starting at p, or -1 if it is truncated.
+ */
+static ssize_t value_length(char block_type, unsigned int value_type,
+			    const unsigned char *p, const unsigned char *end)
+{
+	const unsigned char *start = p;
+	uint64_t len, dummy;
+
+	switch (block_type) {
+	case BLOCK_TYPE_INDEX:
+		if (get_varint(&p, end, &dummy))
+			return -1;
+		break;
+	case BLOCK_TYPE_REF:
+		if (get_varint(&p, end, &dummy))
+			return -1;
+		switch (value_type) {
+		case REFTABLE_REF_DELETION:
+			break;
+		case REFTABLE_REF_VAL1:
+			p += GIT_SHA1_RAWSZ;
+			break;
+		case REFTABLE_REF_VAL2:
+			p += 2 * GIT_SHA1_RAWSZ;
+			break;
+		case REFTABLE_REF_SYMREF:
+			if (get_varint(&p, end, &len) || len > end - p)
+				return -1;
+			p += len;
+			break;
+		default:
+			return -1;
+		}
+		break;
+	case BLOCK_TYPE_LOG:
+		if (value_type == REFTABLE_LOG_DELETION)
+			break;
+		if (value_type != REFTABLE_LOG_UPDATE ||
+		    end - p < 2 * GIT_SHA1_RAWSZ)
+			return -1;
+		p += 2 * GIT_SHA1_RAWSZ;
+		if (get_varint(&p, end, &len) || len > end - p)
+			return -1;
+		p += len;
+		if (get_varint(&p, end, &dummy) || end - p < 2)
+			return -1;
+		p += 2;
+		if (get_varint(&p, end, &len) || len > end - p)
+			return -1;
+		p += len;
+		break;
+	default:
+		return -1;
+	}
+	if (p > end)
+		return -1;
+	return p - start;
+}
+
+/*
+ * Writing tables
+ */
+
+struct index_entry {
+	struct strbuf last_key;
+	uint64_t offset;
+};
+
+struct table_writer {
+	int fd;
+	uint64_t offset;
+	uint32_t block_size;
+	uint64_t min_update_index;
+	uint64_t max_update_index;
+	int error;
+
+	char block_type;
+	struct strbuf block;
+	uint32_t *restarts;
+	int restarts_nr, restarts_alloc;
+	int entries;
+	struct strbuf last_key;
+	struct strbuf scratch;
+
+	/* the last key and offset of each block of the current section */
+	struct index_entry *index;
+	int index_nr, index_alloc;
+
+	uint64_t ref_index_offset;
+	uint64_t log_offset;
+	uint64_t log_index_offset;
+};
+
+static void writer_write(struct table_writer *w, const void *buf, size_t len)
+{
+	if (w->error)
+		return;
+	if (write_in_full(w->fd, buf, len) != len)
+		w->error = errno ? errno : EIO;
+	w->offset += len;
+}
+
+static void writer_header(struct table_writer *w, unsigned char *buf)
+{
+	memcpy(buf, REFTABLE_SIGNATURE, 4);
+	buf[4] = REFTABLE_VERSION;
+	put_be24(buf + 5, w->block_size);
+	put_be64(buf + 8, w->min_update_index);
+	put_be64(buf + 16, w->max_update_index);
+}
+
+static void block_start(struct table_writer *w, char type)
+{
+	strbuf_reset(&w->block);
+	strbuf_addch(&w->block, type);
+	strbuf_addchars(&w->block, 0, BLOCK_HEADER_SIZE - 1);
+	w->block_type = type;
+	w->restarts_nr = 0;
+	w->entries = 0;
+	strbuf_reset(&w->last_key);
+}
+
+static void block_flush(struct table_writer *w)
+{
+	unsigned char buf[3];
+	int i;
+
+	if (!w->entries)
+		return;
+	if (w->restarts_nr > MAX_RESTARTS)
+		die("BUG: too many restart points in reftable block");
+	for (i = 0; i < w->restarts_nr; i++) {
+		put_be24(buf, w->restarts[i]);
+		strbuf_add(&w->block, buf, 3);
+	}
+	put_be16(buf, w->restarts_nr);
+	strbuf_add(&w->block, buf, 2);
+	if (w->block.len > MAX_BLOCK_LEN)
+		die("BUG: reftable block too large");
+	put_be24((unsigned char *)w->block.buf + 1, w->block.len);
+
+	if (w->block_type != BLOCK_TYPE_INDEX) {
+		struct index_entry *e;
+
+		ALLOC_GROW(w->index, w->index_nr + 1, w->index_alloc);
+		e = &w->index[w->index_nr++];
+		strbuf_init(&e->last_key, 0);
+		strbuf_addbuf(&e->last_key, &w->last_key);
+		e->offset = w->offset;
+	}
+	writer_write(w, w->block.buf, w->block.len);
+	w->entries = 0;
+}
+
+static void encode_record(struct strbuf *out, size_t prefix,
+			  const char *key, size_t keylen,
+			  unsigned int value_type,
+			  const char *value, size_t value_len)
+{
+	strbuf_reset(out);
+	strbuf_add_varint(out, prefix);
+	strbuf_add_varint(out, ((uint64_t)(keylen - prefix) << 3) | value_type);
+	strbuf_add(out, key + prefix, keylen - prefix);
+	strbuf_add(out, value, value_len);
+}
+
+static void block_add(struct table_writer *w, const char *key, size_t keylen,
+		      unsigned int value_type,
+		      const char *value, size_t value_len)
+{
+	int restart = !(w->entries % RESTART_INTERVAL);
+	size_t prefix = 0;
+
+	if (w->entries &&
+	    key_cmp(w->last_key.buf, w->last_key.len, key, keylen) >= 0)
+		die("BUG: reftable records added out of order");
+
+	if (!restart)
+		while (prefix < keylen && prefix < w->last_key.len &&
+		       key[prefix] == w->last_key.buf[prefix])
+			prefix++;
+	encode_record(&w->scratch, prefix, key, keylen, value_type,
+		      value, value_len);
+
+	if (w->entries && w->block_type != BLOCK_TYPE_INDEX &&
+	    w->block.len + w->scratch.len + 3 * (w->restarts_nr + 1) + 2 >
+	    w->block_size) {
+		block_flush(w);
+		block_start(w, w->block_type);
+		restart = 1;
+		encode_record(&w->scratch, 0, key, keylen, value_type,
+			      value, value_len);
+	}
+
+	if (restart) {
+		ALLOC_GROW(w->restarts, w->restarts_nr + 1, w->restarts_alloc);
+		w->restarts[w->restarts_nr++] = w->block.len;
+	}
+	strbuf_addbuf(&w->block, &w->scratch);
+	strbuf_reset(&w->last_key);
+	strbuf_add(&w->last_key, key, keylen);
+	w->entries++;
+}
+
+/*
+ * Flush the last block of the current section and, if the section
+ * has more than one block, write an index block for it. Return the
+ * offset of the index block, or 0 if there is none.
+ */
+static uint64_t section_finish(struct table_writer *w)
+{
+	uint64_t index_offset = 0;
+	int i;
+
+	block_flush(w);
+	if (w->index_nr > 1) {
+		struct strbuf value = STRBUF_INIT;
+
+		index_offset = w->offset;
+		block_start(w, BLOCK_TYPE_INDEX);
+		for (i = 0; i < w->index_nr; i++) {
+			strbuf_reset(&value);
+			strbuf_add_varint(&value, w->index[i].offset);
+			block_add(w, w->index[i].last_key.buf,
+				  w->index[i].last_key.len, 0,
+				  value.buf, value.len);
+		}
+		block_flush(w);
+		strbuf_release(&value);
+	}
+	for (i = 0; i < w->index_nr; i++)
+		strbuf_release(&w->index[i].last_key);
+	w->index_nr = 0;
+	w->block_type = 0;
+	return index_offset;
+}
+
+static void writer_init(struct table_writer *w, int fd,
+			uint64_t min_update_index, uint64_t max_update_index)
+{
+	unsigned char header[REFTABLE_HEADER_SIZE];
+
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	w->block_size = REFTABLE_BLOCK_SIZE;
+	w->min_update_index = min_update_index;
+	w->max_update_index = max_update_index;
+	strbuf_init(&w->block, w->block_size);
+	strbuf_init(&w->last_key, 0);
+	strbuf_init(&w->scratch, 0);
+
+	writer_header(w, header);
+	writer_write(w, header, sizeof(header));
+	block_start(w, BLOCK_TYPE_REF);
+}
+
+static void writer_add_ref(struct table_writer *w,
+			   const struct reftable_ref_record *rec)
+{
+	struct strbuf value = STRBUF_INIT;
+
+	if (w->block_type != BLOCK_TYPE_REF)
+		die("BUG: ref record added after log records");
+	if (rec->update_index < w->min_update_index)
+		die("BUG: ref record update index out of range");
+
+	strbuf_add_varint(&value, rec->update_index - w->min_update_index);
+	switch (rec->value_type) {
+	case REFTABLE_REF_DELETION:
+		break;
+	case REFTABLE_REF_VAL2:
+		strbuf_add(&value, rec->oid.hash, GIT_SHA1_RAWSZ);
+		strbuf_add(&value, rec->peeled.hash, GIT_SHA1_RAWSZ);
+		break;
+	case REFTABLE_REF_VAL1:
+		strbuf_add(&value, rec->oid.hash, GIT_SHA1_RAWSZ);
+		break;
+	case REFTABLE_REF_SYMREF:
+		strbuf_add_varint(&value, rec->target.len);
+		strbuf_addbuf(&value, &rec->target);
+		break;
+	default:
+		die("BUG: unknown ref record type %u", rec->value_type);
+	}
+	block_add(w, rec->refname.buf, rec->refname.len, rec->value_type,
+		  value.buf, value.len);
+	strbuf_release(&value);
+}
+
+static void writer_add_log(struct table_writer *w,
+			   const struct reftable_log_record *rec)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct strbuf value = STRBUF_INIT;
+	unsigned char tz[2];
+
+	if (w->block_type == BLOCK_TYPE_REF) {
+		w->ref_index_offset = section_finish(w);
+		w->log_offset = w->offset;
+		block_start(w, BLOCK_TYPE_LOG);
+	}
+
+	log_key(&key, rec->refname.buf, rec->update_index);
+	if (rec->value_type == REFTABLE_LOG_UPDATE) {
+		strbuf_add(&value, rec->old_oid.hash, GIT_SHA1_RAWSZ);
+		strbuf_add(&value, rec->new_oid.hash, GIT_SHA1_RAWSZ);
+		strbuf_add_varint(&value, rec->ident.len);
+		strbuf_addbuf(&value, &rec->ident);
+		strbuf_add_varint(&value, rec->time);
+		put_be16(tz, (int16_t)rec->tz);
+		strbuf_add(&value, tz, 2);
+		strbuf_add_varint(&value, rec->message.len);
+		strbuf_addbuf(&value, &rec->message);
+	}
+	block_add(w, key.buf, key.len, rec->value_type, value.buf, value.len);
+	strbuf_release(&key);
+	strbuf_release(&value);
+}
+
+static int writer_finish(struct table_writer *w)
+{
+	unsigned char footer[REFTABLE_FOOTER_SIZE];
+	unsigned char *p = footer;
+
+	if (w->block_type == BLOCK_TYPE_REF)
+		w->ref_index_offset = section_finish(w);
+	else if (w->block_type == BLOCK_TYPE_LOG)
+		w->log_index_offset = section_finish(w);
+
+	writer_header(w, p);
+	p += REFTABLE_HEADER_SIZE;
+	put_be64(p, w->ref_index_offset);
+	put_be64(p + 8, w->log_offset);
+	put_be64(p + 16, w->log_index_offset);
+	p += 24;
+	put_be32(p, crc32(0, footer, p - footer));
+	writer_write(w, footer, sizeof(footer));
+
+	strbuf_release(&w->block);
+	strbuf_release(&w->last_key);
+	strbuf_release(&w->scratch);
+	free(w->restarts);
+	free(w->index);
+
+	if (w->error) {
+		errno = w->error;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Reading tables
+ */
+
+static int table_corrupt(struct reftable_table *t, const char *what)
+{
+	error("reftable '%s' is corrupt: %s", t->name, what);
+	errno = EINVAL;
+	return -1;
+}
+
+static int table_parse(struct reftable_table *t)
+{
+	const unsigned char *footer;
+	uint64_t footer_start;
+
+	if (t->size < REFTABLE_HEADER_SIZE + REFTABLE_FOOTER_SIZE)
+		return table_corrupt(t, "file too short");
+	footer_start = t->size - REFTABLE_FOOTER_SIZE;
+	footer = t->data + footer_start;
+
+	if (memcmp(t->data, REFTABLE_SIGNATURE, 4))
+		return table_corrupt(t, "bad signature");
+	if (t->data[4] != REFTABLE_VERSION)
+		return table_corrupt(t, "unsupported version");
+	if (memcmp(t->data, footer, REFTABLE_HEADER_SIZE))
+		return table_corrupt(t, "footer does not match header");
+	if (get_be32(footer + REFTABLE_FOOTER_SIZE - 4) !=
+	    crc32(0, footer, REFTABLE_FOOTER_SIZE - 4))
+		return table_corrupt(t, "bad footer checksum");
+
+	t->block_size = get_be24(t->data + 5);
+	t->min_update_index = get_be64(t->data + 8);
+	t->max_update_index = get_be64(t->data + 16);
+	footer += REFTABLE_HEADER_SIZE;
+	t->ref_index_offset = get_be64(footer);
+	t->log_offset = get_be64(footer + 8);
+	t->log_index_offset = get_be64(footer + 16);
+
+	if (t->ref_index_offset > footer_start ||
+	    t->log_offset > footer_start ||
+	    t->log_index_offset > footer_start ||
+	    (t->log_offset && t->log_offset < REFTABLE_HEADER_SIZE) ||
+	    (t->ref_index_offset && t->ref_index_offset < REFTABLE_HEADER_SIZE) ||
+	    (t->log_index_offset && t->log_index_offset < t->log_offset))
+		return table_corrupt(t, "bad section offsets");
+
+	if (t->ref_index_offset)
+		t->ref_end = t->ref_index_offset;
+	else if (t->log_offset)
+		t->ref_end = t->log_offset;
+	else
+		t->ref_end = footer_start;
+
+	if (!t->log_offset)
+		t->log_offset = t->log_end = footer_start;
+	else if (t->log_index_offset)
+		t->log_end = t->log_index_offset;
+	else
+		t->log_end = footer_start;
+	return 0;
+}
+
+struct reftable_table *reftable_table_open(const char *path, const char *name)
+{
+	struct reftable_table *t;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0) {
+		int save_errno = errno;
+
+		close(fd);
+		errno = save_errno;
+		return NULL;
+	}
+
+	t = xcalloc(1, sizeof(*t));
+	t->refcount = 1;
+	t->name = xstrdup(name);
+	t->size = xsize_t(st.st_size);
+#ifdef MMAP_PREVENTS_DELETE
+	/* the table could not be removed by compaction while mapped */
+	t->data = xmalloc(t->size ? t->size : 1);
+	if (read_in_full(fd, (void *)t->data, t->size) != t->size)
+		die_errno("couldn't read %s", path);
+#else
+	if (t->size) {
+		t->data = xmmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		t->mmapped = 1;
+	}
+#endif
+	close(fd);
+
+	if (table_parse(t)) {
+		reftable_table_close(t);
+		errno = EINVAL;
+		return NULL;
+	}
+	return t;
+}
+
+void reftable_table_close(struct reftable_table *t)
+{
+	if (!t || --t->refcount)
+		return;
+	if (t->mmapped)
+		munmap((void *)t->data, t->size);
+	else
+		free((void *)t->data);
+	free(t->name);
+	free(t);
+}
+
+/*
+ * Position it at the start of the block at offset off. Return 0 on
+ * success, 1 if off is the end of the section, and -1 if the block is
+ * corrupt.
+ */
+static int table_iter_load_block(struct reftable_table_iter *it, uint64_t off)
+{
+	const unsigned char *block;
+	size_t len, restarts;
+
+	it->block_off = off;
+	it->block_len = 0;
+	it->records_end = it->pos = 0;
+	strbuf_reset(&it->key);
+	if (off >= it->section_end) {
+		it->eof = 1;
+		return 1;
+	}
+
+	block = it->table->data + off;
+	if (it->section_end - off < BLOCK_HEADER_SIZE + 2 ||
+	    block[0] != it->block_type)
+		goto corrupt;
+	len = get_be24(block + 1);
+	if (len > it->section_end - off || len < BLOCK_HEADER_SIZE + 2)
+		goto corrupt;
+	restarts = get_be16(block + len - 2);
+	if (len < BLOCK_HEADER_SIZE + 2 + 3 * restarts)
+		goto corrupt;
+
+	it->block_len = len;
+	it->records_end = len - 2 - 3 * restarts;
+	it->pos = BLOCK_HEADER_SIZE;
+	return 0;
+
+corrupt:
+	it->eof = 1;
+	return table_corrupt((struct reftable_table *)it->table, "bad block");
+}
+
+/*
+ * Decode the record at it->pos, moving to the next block first if the
+ * current one is exhausted. Return 0 on success, 1 at the end of the
+ * section, and -1 on error.
+ */
+static int table_iter_next(struct reftable_table_iter *it)
+{
+	const unsigned char *p, *end;
+	uint64_t prefix, suffix;
+	ssize_t value_len;
+
+	if (it->eof)
+		return 1;
+	while (it->pos >= it->records_end) {
+		int ret = table_iter_load_block(it, it->block_off + it->block_len);
+		if (ret)
+			return ret;
+	}
+
+	p = it->table->data + it->block_off + it->pos;
+	end = it->table->data + it->block_off + it->records_end;
+	if (get_varint(&p, end, &prefix) || get_varint(&p, end, &suffix) ||
+	    prefix > it->key.len || (suffix >> 3) > end - p)
+		goto corrupt;
+	strbuf_setlen(&it->key, prefix);
+	strbuf_add(&it->key, p, suffix >> 3);
+	p += suffix >> 3;
+	it->value_type = suffix & 7;
+
+	value_len = value_length(it->block_type, it->value_type, p, end);
+	if (value_len < 0)
+		goto corrupt;
+	it->value = p;
+	it->value_end = p + value_len;
+	it->pos = it->value_end - (it->table->data + it->block_off);
+	return 0;
+
+corrupt:
+	it->eof = 1;
+	return table_corrupt((struct reftable_table *)it->table, "bad record");
+}
+
+/*
+ * Within the current block, find the last restart point whose key is
+ * not greater than key and continue from there. Return 0 if the
+ * iterator now points at the first record not smaller than key, 1 if
+ * there is no such record, and -1 on error.
+ */
+static int table_iter_seek_block(struct reftable_table_iter *it,
+				 const char *key, size_t keylen)
+{
+	const unsigned char *block = it->table->data + it->block_off;
+	const unsigned char *restarts = block + it->records_end;
+	size_t nr = (it->block_len - 2 - it->records_end) / 3;
+	size_t lo = 0, hi = nr, best = 0;
+	int ret;
+
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+
+		it->pos = get_be24(restarts + 3 * mi);
+		strbuf_reset(&it->key);
+		if (it->pos >= it->records_end)
+			return table_corrupt((struct reftable_table *)it->table,
+					     "bad restart point");
+		ret = table_iter_next(it);
+		if (ret)
+			return ret;
+		if (key_cmp(it->key.buf, it->key.len, key, keylen) <= 0) {
+			best = mi;
+			lo = mi + 1;
+		} else {
+			hi = mi;
+		}
+	}
+
+	it->pos = nr ? get_be24(restarts + 3 * best) : it->records_end;
+	strbuf_reset(&it->key);
+	while (!(ret = table_iter_next(it)))
+		if (key_cmp(it->key.buf, it->key.len, key, keylen) >= 0)
+			return 0;
+	return ret;
+}
+
+static void table_iter_init(struct reftable_table_iter *it,
+			    const struct reftable_table *t, char block_type)
+{
+	it->table = t;
+	it->block_type = block_type;
+	it->block_off = it->block_len = it->records_end = it->pos = 0;
+	it->eof = 0;
+	strbuf_reset(&it->key);
+	switch (block_type) {
+	case BLOCK_TYPE_REF:
+		it->section_end = t->ref_end;
+		break;
+	case BLOCK_TYPE_LOG:
+		it->section_end = t->log_end;
+		break;
+	default:
+		die("BUG: cannot iterate over reftable block type '%c'",
+		    block_type);
+	}
+}
+
+/*
+ * Position it at the first record of its section that is not smaller
+ * than key, using the section index if there is one. Return 0 if there
+ * is such a record, 1 if there is none, and -1 on error.
+ */
+static int table_iter_seek(struct reftable_table_iter *it,
+			   const char *key, size_t keylen)
+{
+	const struct reftable_table *t = it->table;
+	uint64_t start, index_offset;
+	int ret;
+
+	if (it->block_type == BLOCK_TYPE_REF) {
+		start = REFTABLE_HEADER_SIZE;
+		index_offset = t->ref_index_offset;
+	} else {
+		start = t->log_offset;
+		index_offset = t->log_index_offset;
+	}
+
+	if (index_offset) {
+		struct reftable_table_iter idx = { NULL };
+		const unsigned char *p;
+		uint64_t off;
+
+		strbuf_init(&idx.key, 0);
+		idx.table = t;
+		idx.block_type = BLOCK_TYPE_INDEX;
+		idx.section_end = t->size - REFTABLE_FOOTER_SIZE;
+		ret = table_iter_load_block(&idx, index_offset);
+		if (!ret) {
+			/* the index is a single block */
+			idx.section_end = index_offset + idx.block_len;
+			ret = table_iter_seek_block(&idx, key, keylen);
+		}
+		if (ret) {
+			strbuf_release(&idx.key);
+			it->eof = 1;
+			return ret;
+		}
+		p = idx.value;
+		ret = get_varint(&p, idx.value_end, &off);
+		strbuf_release(&idx.key);
+		if (ret || off < start || off >= it->section_end) {
+			it->eof = 1;
+			return table_corrupt((struct reftable_table *)t,
+					     "bad index record");
+		}
+		start = off;
+	}
+
+	ret = table_iter_load_block(it, start);
+	if (ret)
+		return ret;
+	return table_iter_seek_block(it, key, keylen);
+}
+
+static void decode_ref(const struct reftable_table_iter *it,
+		       struct reftable_ref_record *rec)
+{
+	const unsigned char *p = it->value;
+	uint64_t delta, len;
+
+	strbuf_reset(&rec->refname);
+	strbuf_addbuf(&rec->refname, &it->key);
+	/* value_length() has already checked the bounds */
+	get_varint(&p, it->value_end, &delta);
+	rec->update_index = it->table->min_update_index + delta;
+	rec->value_type = it->value_type;
+	strbuf_reset(&rec->target);
+	switch (it->value_type) {
+	case REFTABLE_REF_VAL2:
+		hashcpy(rec->peeled.hash, p + GIT_SHA1_RAWSZ);
+		/* fallthrough */
+	case REFTABLE_REF_VAL1:
+		hashcpy(rec->oid.hash, p);
+		break;
+	case REFTABLE_REF_SYMREF:
+		get_varint(&p, it->value_end, &len);
+		strbuf_add(&rec->target, p, len);
+		break;
+	}
+}
+
+static int decode_log(const struct reftable_table_iter *it,
+		      struct reftable_log_record *rec)
+{
+	const unsigned char *p = it->value;
+	uint64_t len, time;
+
+	if (it->key.len < LOG_KEY_SUFFIX_LEN ||
+	    it->key.buf[it->key.len - LOG_KEY_SUFFIX_LEN])
+		return table_corrupt((struct reftable_table *)it->table,
+				     "bad log key");
+	strbuf_reset(&rec->refname);
+	strbuf_add(&rec->refname, it->key.buf, it->key.len - LOG_KEY_SUFFIX_LEN);
+	rec->update_index = ~get_be64(it->key.buf + it->key.len - 8);
+	rec->value_type = it->value_type;
+	strbuf_reset(&rec->ident);
+	strbuf_reset(&rec->message);
+	if (it->value_type != REFTABLE_LOG_UPDATE)
+		return 0;
+
+	/* value_length() has already checked the bounds */
+	hashcpy(rec->old_oid.hash, p);
+	hashcpy(rec->new_oid.hash, p + GIT_SHA1_RAWSZ);
+	p += 2 * GIT_SHA1_RAWSZ;
+	get_varint(&p, it->value_end, &len);
+	strbuf_add(&rec->ident, p, len);
+	p += len;
+	get_varint(&p, it->value_end, &time);
+	rec->time = time;
+	rec->tz = (int16_t)get_be16(p);
+	p += 2;
+	get_varint(&p, it->value_end, &len);
+	strbuf_add(&rec->message, p, len);
+	return 0;
+}
+
+/*
+ * Merged iteration
+ */
+
+static void merged_iter_init(struct reftable_merged_iter *it,
+			     struct reftable_table **tables, int nr,
+			     char block_type, const char *key, size_t keylen,
+			     int include_deletions)
+{
+	int i;
+
+	it->nr = nr;
+	it->current = -1;
+	it->include_deletions = include_deletions;
+	strbuf_init(&it->last_key, 0);
+	it->subs = xcalloc(nr ? nr : 1, sizeof(*it->subs));
+	for (i = 0; i < nr; i++) {
+		struct reftable_table_iter *sub = &it->subs[i];
+
+		strbuf_init(&sub->key, 0);
+		tables[i]->refcount++;
+		table_iter_init(sub, tables[i], block_type);
+		if (table_iter_seek(sub, key, keylen))
+			sub->eof = 1;
+	}
+}
+
+void reftable_merged_iter_release(struct reftable_merged_iter *it)
+{
+	int i;
+
+	for (i = 0; i < it->nr; i++) {
+		strbuf_release(&it->subs[i].key);
+		reftable_table_close((struct reftable_table *)it->subs[i].table);
+	}
+	free(it->subs);
+	it->subs = NULL;
+	it->nr = 0;
+	strbuf_release(&it->last_key);
+}
+
+/*
+ * Move to the next key and point it->current at the newest table that
+ * has a record for it. The subiterators always point at the record they
+ * will contribute next.
+ */
+static int merged_iter_next(struct reftable_merged_iter *it)
+{
+	int i;
+
+	while (1) {
+		struct reftable_table_iter *winner = NULL;
+
+		if (it->current >= 0) {
+			for (i = 0; i < it->nr; i++) {
+				struct reftable_table_iter *sub = &it->subs[i];
+
+				if (!sub->eof &&
+				    !key_cmp(sub->key.buf, sub->key.len,
+					     it->last_key.buf, it->last_key.len) &&
+				    table_iter_next(sub) < 0)
+					return -1;
+			}
+		}
+
+		for (i = 0; i < it->nr; i++) {
+			struct reftable_table_iter *sub = &it->subs[i];
+
+			if (sub->eof)
+				continue;
+			if (!winner ||
+			    key_cmp(sub->key.buf, sub->key.len,
+				    winner->key.buf, winner->key.len) <= 0) {
+				winner = sub;
+				it->current = i;
+			}
+		}
+		if (!winner) {
+			it->current = -1;
+			return 1;
+		}
+		strbuf_reset(&it->last_key);
+		strbuf_addbuf(&it->last_key, &winner->key);
+
+		/* log and ref deletions share the value type 0 */
+		if (winner->value_type != REFTABLE_REF_DELETION ||
+		    it->include_deletions)
+			return 0;
+	}
+}
+
+int reftable_merged_iter_next_ref(struct reftable_merged_iter *it,
+				  struct reftable_ref_record *rec)
+{
+	int ret = merged_iter_next(it);
+
+	if (!ret)
+		decode_ref(&it->subs[it->current], rec);
+	return ret;
+}
+
+int reftable_merged_iter_next_log(struct reftable_merged_iter *it,
+				  struct reftable_log_record *rec)
+{
+	int ret = merged_iter_next(it);
+
+	if (!ret)
+		ret = decode_log(&it->subs[it->current], rec);
+	return ret;
+}
+
+/*
+ * Stacks
+ */
+
+struct reftable_stack *reftable_stack_new(const char *dir)
+{
+	struct reftable_stack *st = xcalloc(1, sizeof(*st));
+
+	st->dir = xstrdup(dir);
+	st->list_file = xstrfmt("%s/tables.list", dir);
+	strbuf_init(&st->list, 0);
+	string_list_init(&st->obsolete, 1);
+	return st;
+}
+
+void reftable_stack_free(struct reftable_stack *st)
+{
+	int i;
+
+	if (!st)
+		return;
+	for (i = 0; i < st->nr; i++)
+		reftable_table_close(st->tables[i]);
+	free(st->tables);
+	strbuf_release(&st->list);
+	string_list_clear(&st->obsolete, 0);
+	free(st->list_file);
+	free(st->dir);
+	/* st->lock must not be freed; it may be registered for cleanup */
+	free(st);
+}
+
+static struct reftable_table *find_table(struct reftable_table **tables,
+					 int nr, const char *name)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (tables[i] && !strcmp(tables[i]->name, name))
+			return tables[i];
+	return NULL;
+}
+
+/*
+ * Open the tables named in list, reusing the ones we already have
+ * open. Return 0 on success, 1 if a table has vanished (presumably
+ * because a concurrent compaction removed it), and -1 on error.
+ */
+static int stack_load(struct reftable_stack *st, const struct strbuf *list)
+{
+	struct reftable_table **tables = NULL;
+	int nr = 0, alloc = 0, i, ret = 0;
+	struct strbuf path = STRBUF_INIT;
+	const char *p = list->buf, *eol;
+
+	for (; *p; p = eol + 1) {
+		struct reftable_table *t;
+		char *name;
+
+		eol = strchrnul(p, '\n');
+		name = xmemdupz(p, eol - p);
+		t = find_table(st->tables, st->nr, name);
+		if (t) {
+			/* take it over from the old stack */
+			for (i = 0; i < st->nr; i++)
+				if (st->tables[i] == t)
+					st->tables[i] = NULL;
+		} else {
+			strbuf_reset(&path);
+			strbuf_addf(&path, "%s/%s", st->dir, name);
+			t = reftable_table_open(path.buf, name);
+			if (!t) {
+				if (errno == ENOENT) {
+					ret = 1;
+				} else {
+					if (errno != EINVAL)
+						error_errno("unable to open reftable '%s'",
+							    path.buf);
+					ret = -1;
+				}
+				free(name);
+				break;
+			}
+		}
+		free(name);
+		ALLOC_GROW(tables, nr + 1, alloc);
+		tables[nr++] = t;
+		if (!*eol)
+			break;
+	}
+	strbuf_release(&path);
+
+	if (ret) {
+		/*
+		 * Some tables of the old view may have been taken
+		 * over already; drop everything so that the caller
+		 * starts over from scratch.
+		 */
+		for (i = 0; i < nr; i++)
+			reftable_table_close(tables[i]);
+		free(tables);
+		for (i = 0; i < st->nr; i++)
+			reftable_table_close(st->tables[i]);
+		free(st->tables);
+		st->tables = NULL;
+		st->nr = st->alloc = 0;
+		strbuf_reset(&st->list);
+		return ret;
+	}
+
+	for (i = 0; i < st->nr; i++)
+		reftable_table_close(st->tables[i]);
+	free(st->tables);
+	st->tables = tables;
+	st->nr = nr;
+	st->alloc = alloc;
+	strbuf_reset(&st->list);
+	strbuf_addbuf(&st->list, list);
+	return 0;
+}
+
+int reftable_stack_reload(struct reftable_stack *st)
+{
+	struct strbuf list = STRBUF_INIT;
+	int tries, ret = 0;
+
+	for (tries = 0; tries < 5; tries++) {
+		strbuf_reset(&list);
+		if (strbuf_read_file(&list, st->list_file, 0) < 0 &&
+		    errno != ENOENT) {
+			ret = error_errno("unable to read '%s'", st->list_file);
+			break;
+		}
+		if (st->list.len == list.len && !strbuf_cmp(&st->list, &list) &&
+		    (st->nr || !list.len))
+			break;
+		ret = stack_load(st, &list);
+		if (ret <= 0)
+			break;
+	}
+	if (ret > 0)
+		ret = error("unable to load a consistent view of '%s'",
+			    st->list_file);
+	strbuf_release(&list);
+	return ret;
+}
+
+int reftable_stack_lock(struct reftable_stack *st, struct strbuf *err)
+{
+	if (!st->lock)
+		st->lock = xcalloc(1, sizeof(*st->lock));
+	if (safe_create_leading_directories_const(st->list_file)) {
+		strbuf_addf(err, "unable to create directory for '%s'",
+			    st->list_file);
+		return -1;
+	}
+	if (hold_lock_file_for_update(st->lock, st->list_file, 0) < 0) {
+		unable_to_lock_message(st->list_file, errno, err);
+		return -1;
+	}
+	if (reftable_stack_reload(st)) {
+		rollback_lock_file(st->lock);
+		strbuf_addf(err, "unable to read '%s'", st->list_file);
+		return -1;
+	}
+	return 0;
+}
+
+void reftable_stack_unlock(struct reftable_stack *st)
+{
+	if (st->lock)
+		rollback_lock_file(st->lock);
+}
+
+uint64_t reftable_stack_next_update_index(struct reftable_stack *st)
+{
+	return st->nr ? st->tables[st->nr - 1]->max_update_index + 1 : 1;
+}
+
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct reftable_ref_record *rec)
+{
+	struct reftable_table_iter it = { NULL };
+	size_t len = strlen(refname);
+	int i, ret = 1;
+
+	strbuf_init(&it.key, 0);
+	for (i = st->nr - 1; i >= 0; i--) {
+		table_iter_init(&it, st->tables[i], BLOCK_TYPE_REF);
+		ret = table_iter_seek(&it, refname, len);
+		if (ret < 0)
+			break;
+		if (!ret && !key_cmp(it.key.buf, it.key.len, refname, len)) {
+			decode_ref(&it, rec);
+			ret = rec->value_type == REFTABLE_REF_DELETION;
+			break;
+		}
+		ret = 1;
+	}
+	strbuf_release(&it.key);
+	return ret;
+}
+
+void reftable_stack_ref_iter(struct reftable_stack *st,
+			     struct reftable_merged_iter *it,
+			     const char *prefix, int include_deletions)
+{
+	merged_iter_init(it, st->tables, st->nr, BLOCK_TYPE_REF,
+			 prefix, strlen(prefix), include_deletions);
+}
+
+void reftable_stack_log_iter(struct reftable_stack *st,
+			     struct reftable_merged_iter *it,
+			     const char *refname, int include_deletions)
+{
+	/* the first possible key for refname, or all keys if it is empty */
+	merged_iter_init(it, st->tables, st->nr, BLOCK_TYPE_LOG, refname,
+			 *refname ? strlen(refname) + 1 : 0, include_deletions);
+}
+
+struct reftable_ref_record *reftable_addition_ref(struct reftable_addition *add,
+						  const char *refname)
+{
+	struct reftable_ref_record *rec;
+
+	ALLOC_GROW(add->refs, add->refs_nr + 1, add->refs_alloc);
+	rec = &add->refs[add->refs_nr++];
+	memset(rec, 0, sizeof(*rec));
+	strbuf_init(&rec->refname, 0);
+	strbuf_init(&rec->target, 0);
+	strbuf_addstr(&rec->refname, refname);
+	rec->update_index = add->update_index;
+	return rec;
+}
+
+struct reftable_log_record *reftable_addition_log(struct reftable_addition *add,
+						  const char *refname)
+{
+	struct reftable_log_record *rec;
+
+	ALLOC_GROW(add->logs, add->logs_nr + 1, add->logs_alloc);
+	rec = &add->logs[add->logs_nr++];
+	memset(rec, 0, sizeof(*rec));
+	strbuf_init(&rec->refname, 0);
+	strbuf_init(&rec->ident, 0);
+	strbuf_init(&rec->message, 0);
+	strbuf_addstr(&rec->refname, refname);
+	rec->update_index = add->update_index;
+	return rec;
+}
+
+static int ref_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_ref_record *a = va, *b = vb;
+
+	return strcmp(a->refname.buf, b->refname.buf);
+}
+
+static int log_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_log_record *a = va, *b = vb;
+	int cmp = strcmp(a->refname.buf, b->refname.buf);
+
+	if (cmp)
+		return cmp;
+	/* newest first */
+	return a->update_index < b->update_index ? 1 :
+		a->update_index != b->update_index ? -1 : 0;
+}
+
+void reftable_sort_records(struct reftable_addition *add)
+{
+	QSORT(add->refs, add->refs_nr, ref_record_cmp);
+	QSORT(add->logs, add->logs_nr, log_record_cmp);
+}
+
+void reftable_addition_release(struct reftable_addition *add)
+{
+	int i;
+
+	for (i = 0; i < add->refs_nr; i++)
+		reftable_ref_record_release(&add->refs[i]);
+	for (i = 0; i < add->logs_nr; i++)
+		reftable_log_record_release(&add->logs[i]);
+	free(add->refs);
+	free(add->logs);
+	add->refs = NULL;
+	add->logs = NULL;
+	add->refs_nr = add->refs_alloc = add->logs_nr = add->logs_alloc = 0;
+}
+
+/*
+ * Create a new table file for the update indices min..max, filling it
+ * with the help of write_fn. Return the name of the new table, or NULL
+ * on error.
+ */
+static char *write_table(struct reftable_stack *st,
+			 uint64_t min_update_index, uint64_t max_update_index,
+			 int (*write_fn)(struct table_writer *w, void *cb_data),
+			 void *cb_data, struct strbuf *err)
+{
+	static struct lock_file table_lock;
+	struct table_writer w;
+	struct strbuf path = STRBUF_INIT;
+	char *name;
+	int fd;
+
+	name = xstrfmt("0x%012"PRIx64"-0x%012"PRIx64".ref",
+		       min_update_index, max_update_index);
+	strbuf_addf(&path, "%s/%s", st->dir, name);
+	fd = hold_lock_file_for_update(&table_lock, path.buf, 0);
+	if (fd < 0) {
+		unable_to_lock_message(path.buf, errno, err);
+		goto fail;
+	}
+
+	writer_init(&w, fd, min_update_index, max_update_index);
+	if (write_fn(&w, cb_data) | writer_finish(&w)) {
+		strbuf_addf(err, "unable to write '%s': %s",
+			    path.buf, strerror(errno));
+		rollback_lock_file(&table_lock);
+		goto fail;
+	}
+	if (commit_lock_file(&table_lock)) {
+		strbuf_addf(err, "unable to write '%s': %s",
+			    path.buf, strerror(errno));
+		goto fail;
+	}
+	adjust_shared_perm(path.buf);
+	strbuf_release(&path);
+	return name;
+
+fail:
+	strbuf_release(&path);
+	free(name);
+	return NULL;
+}
+
+static int write_addition(struct table_writer *w, void *cb_data)
+{
+	struct reftable_addition *add = cb_data;
+	int i;
+
+	for (i = 0; i < add->refs_nr; i++)
+		writer_add_ref(w, &add->refs[i]);
+	for (i = 0; i < add->logs_nr; i++)
+		writer_add_log(w, &add->logs[i]);
+	return 0;
+}
+
+struct compaction {
+	struct reftable_table **tables;
+	int nr;
+	/* tombstones can be dropped when nothing lies underneath */
+	int keep_deletions;
+};
+
+static int write_compacted(struct table_writer *w, void *cb_data)
+{
+	struct compaction *c = cb_data;
+	struct reftable_merged_iter it;
+	struct reftable_ref_record ref = REFTABLE_REF_RECORD_INIT;
+	struct reftable_log_record log = REFTABLE_LOG_RECORD_INIT;
+	int ret;
+
+	merged_iter_init(&it, c->tables, c->nr, BLOCK_TYPE_REF, "", 0,
+			 c->keep_deletions);
+	while (!(ret = reftable_merged_iter_next_ref(&it, &ref)))
+		writer_add_ref(w, &ref);
+	reftable_merged_iter_release(&it);
+
+	if (ret > 0) {
+		merged_iter_init(&it, c->tables, c->nr, BLOCK_TYPE_LOG, "", 0,
+				 c->keep_deletions);
+		while (!(ret = reftable_merged_iter_next_log(&it, &log)))
+			writer_add_log(w, &log);
+		reftable_merged_iter_release(&it);
+	}
+
+	reftable_ref_record_release(&ref);
+	reftable_log_record_release(&log);
+	if (ret < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Merge tables first..last of the stack into a single table, and
+ * replace them by it in st->tables. The caller has to hold the lock
+ * and to write out the new list.
+ */
+static int compact_range(struct reftable_stack *st, int first, int last,
+			 struct strbuf *err)
+{
+	struct compaction c;
+	struct reftable_table *t;
+	struct strbuf path = STRBUF_INIT;
+	char *name;
+	int i;
+
+	c.tables = st->tables + first;
+	c.nr = last - first + 1;
+	c.keep_deletions = first > 0;
+	name = write_table(st, st->tables[first]->min_update_index,
+			   st->tables[last]->max_update_index,
+			   write_compacted, &c, err);
+	if (!name)
+		return -1;
+
+	strbuf_addf(&path, "%s/%s", st->dir, name);
+	t = reftable_table_open(path.buf, name);
+	if (!t) {
+		strbuf_addf(err, "unable to open '%s'", path.buf);
+		unlink(path.buf);
+		strbuf_release(&path);
+		free(name);
+		return -1;
+	}
+	strbuf_release(&path);
+	free(name);
+
+	/*
+	 * The merged tables stay open, but are no longer part of the
+	 * stack; their files are removed once the new list is in place.
+	 */
+	for (i = first; i <= last; i++)
+		string_list_append(&st->obsolete, st->tables[i]->name);
+	for (i = first; i <= last; i++)
+		reftable_table_close(st->tables[i]);
+	st->tables[first] = t;
+	memmove(st->tables + first + 1, st->tables + last + 1,
+		(st->nr - last - 1) * sizeof(*st->tables));
+	st->nr -= last - first;
+	return 0;
+}
+
+/*
+ * Find the longest run of tables at the top of the stack whose sizes
+ * do not decrease geometrically, and merge them, so that the number
+ * of tables stays logarithmic in the number of updates.
+ */
+static int auto_compact(struct reftable_stack *st, struct strbuf *err)
+{
+	uint64_t total;
+	int first;
+
+	if (st->nr < 2)
+		return 0;
+	first = st->nr - 1;
+	total = st->tables[first]->size;
+	while (first > 0 && st->tables[first - 1]->size <= 2 * total) {
+		first--;
+		total += st->tables[first]->size;
+	}
+	if (first == st->nr - 1)
+		return 0;
+	return compact_range(st, first, st->nr - 1, err);
+}
+
+/*
+ * Write the current set of tables as the new "tables.list", which
+ * releases the lock, and remove the tables that were compacted away.
+ */
+static int commit_list(struct reftable_stack *st, struct strbuf *err)
+{
+	struct strbuf list = STRBUF_INIT;
+	struct string_list_item *item;
+	int fd = get_lock_file_fd(st->lock), i;
+
+	for (i = 0; i < st->nr; i++)
+		strbuf_addf(&list, "%s\n", st->tables[i]->name);
+	if (write_in_full(fd, list.buf, list.len) != list.len ||
+	    commit_lock_file(st->lock)) {
+		strbuf_addf(err, "unable to write '%s': %s",
+			    st->list_file, strerror(errno));
+		rollback_lock_file(st->lock);
+		strbuf_release(&list);
+		string_list_clear(&st->obsolete, 0);
+		/* our view no longer matches the disk */
+		strbuf_reset(&st->list);
+		return -1;
+	}
+	adjust_shared_perm(st->list_file);
+	strbuf_swap(&st->list, &list);
+	strbuf_release(&list);
+
+	for_each_string_list_item(item, &st->obsolete) {
+		struct strbuf path = STRBUF_INIT;
+
+		strbuf_addf(&path, "%s/%s", st->dir, item->string);
+		unlink_or_warn(path.buf);
+		strbuf_release(&path);
+	}
+	string_list_clear(&st->obsolete, 0);
+	return 0;
+}
+
+int reftable_stack_add(struct reftable_stack *st,
+		       struct reftable_addition *add, struct strbuf *err)
+{
+	struct reftable_table *t;
+	struct strbuf path = STRBUF_INIT;
+	char *name;
+
+	if (!add->refs_nr && !add->logs_nr) {
+		reftable_stack_unlock(st);
+		return 0;
+	}
+
+	name = write_table(st, add->update_index, add->update_index,
+			   write_addition, add, err);
+	if (!name) {
+		reftable_stack_unlock(st);
+		return -1;
+	}
+	strbuf_addf(&path, "%s/%s", st->dir, name);
+	t = reftable_table_open(path.buf, name);
+	if (!t) {
+		strbuf_addf(err, "unable to open '%s'", path.buf);
+		unlink(path.buf);
+		strbuf_release(&path);
+		free(name);
+		reftable_stack_unlock(st);
+		return -1;
+	}
+	strbuf_release(&path);
+	free(name);
+	ALLOC_GROW(st->tables, st->nr + 1, st->alloc);
+	st->tables[st->nr++] = t;
+
+	/*
+	 * A failed compaction is not fatal; the new table is complete
+	 * on its own.
+	 */
+	if (auto_compact(st, err)) {
+		warning("%s", err->buf);
+		strbuf_reset(err);
+		string_list_clear(&st->obsolete, 0);
+	}
+	return commit_list(st, err);
+}
+
+int reftable_stack_compact_all(struct reftable_stack *st, struct strbuf *err)
+{
+	if (reftable_stack_lock(st, err))
+		return -1;
+	if (st->nr < 2) {
+		reftable_stack_unlock(st);
+		return 0;
+	}
+	if (compact_range(st, 0, st->nr - 1, err)) {
+		reftable_stack_unlock(st);
+		string_list_clear(&st->obsolete, 0);
+		return -1;
+	}
+	return commit_list(st, err);
+}
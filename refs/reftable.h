@@ -0,0 +1,231 @@
+#ifndef REFS_REFTABLE_H
+#define REFS_REFTABLE_H
+
+/*
+ * Reading and writing of reftables: immutable, block-based sorted
+ * tables of references and reflog entries, kept in a stack of
+ * incremental tables that is compacted as it grows. See
+ * Documentation/technical/reftable-format.txt for the file format.
+ *
+ * This module only knows about tables and records; the glue that
+ * implements a ref_storage_be on top of it lives in
+ * refs/reftable-backend.c.
+ */
+
+#include "../string-list.h"
+
+struct lock_file;
+
+#define REFTABLE_BLOCK_SIZE 4096
+
+/* Ref record value types */
+#define REFTABLE_REF_DELETION 0
+#define REFTABLE_REF_VAL1     1 /* object name */
+#define REFTABLE_REF_VAL2     2 /* object name and peeled value */
+#define REFTABLE_REF_SYMREF   3 /* symbolic ref */
+
+/* Log record value types */
+#define REFTABLE_LOG_DELETION 0
+#define REFTABLE_LOG_UPDATE   1
+
+struct reftable_ref_record {
+	struct strbuf refname;
+	uint64_t update_index;
+	unsigned int value_type;
+	struct object_id oid;
+	struct object_id peeled;
+	struct strbuf target;
+};
+
+#define REFTABLE_REF_RECORD_INIT { STRBUF_INIT, 0, 0, { { 0 } }, { { 0 } }, STRBUF_INIT }
+
+/*
+ * A reflog entry. A log record whose old and new values are both the
+ * null object name marks a reflog that exists but may have no
+ * entries; iterators that show entries to the user skip it.
+ */
+struct reftable_log_record {
+	struct strbuf refname;
+	uint64_t update_index;
+	unsigned int value_type;
+	struct object_id old_oid;
+	struct object_id new_oid;
+	struct strbuf ident; /* "Name <email>" */
+	timestamp_t time;
+	int tz;
+	struct strbuf message; /* normalized, without trailing LF */
+};
+
+#define REFTABLE_LOG_RECORD_INIT { STRBUF_INIT, 0, 0, { { 0 } }, { { 0 } }, \
+				   STRBUF_INIT, 0, 0, STRBUF_INIT }
+
+void reftable_ref_record_release(struct reftable_ref_record *rec);
+void reftable_log_record_release(struct reftable_log_record *rec);
+
+/* Return true iff rec only marks the existence of its reflog. */
+int reftable_log_record_is_marker(const struct reftable_log_record *rec);
+
+/*
+ * A single table file, mapped into memory. Tables are reference
+ * counted, so that iterators keep working when a reload of the stack
+ * drops tables from it.
+ */
+struct reftable_table {
+	int refcount;
+	char *name;
+	const unsigned char *data;
+	size_t size;
+	int mmapped;
+
+	uint32_t block_size;
+	uint64_t min_update_index;
+	uint64_t max_update_index;
+
+	uint64_t ref_end;
+	uint64_t ref_index_offset;
+	uint64_t log_offset;
+	uint64_t log_end;
+	uint64_t log_index_offset;
+};
+
+/*
+ * Open the table at path. On error, return NULL with errno set if the
+ * file could not be opened, or with errno set to EINVAL (and an error
+ * message printed) if it is corrupt.
+ */
+struct reftable_table *reftable_table_open(const char *path, const char *name);
+
+/* Drop a reference to table, and free it with the last one. */
+void reftable_table_close(struct reftable_table *table);
+
+/*
+ * A cursor over either the ref or the log records of one table.
+ */
+struct reftable_table_iter {
+	const struct reftable_table *table;
+	char block_type;
+	uint64_t section_end;
+
+	uint64_t block_off;
+	size_t block_len;
+	size_t records_end;
+	size_t pos;
+
+	struct strbuf key;
+	unsigned int value_type;
+	const unsigned char *value;
+	const unsigned char *value_end;
+	int eof;
+};
+
+/*
+ * A merged view over the ref or log records of a set of tables, in
+ * which a record from a later table shadows the record with the same
+ * key in all earlier ones.
+ */
+struct reftable_merged_iter {
+	struct reftable_table_iter *subs;
+	int nr;
+	int current;
+	int include_deletions;
+	struct strbuf last_key;
+};
+
+/*
+ * A stack of tables, as listed (oldest first) in the "tables.list"
+ * file of a reftable directory.
+ */
+struct reftable_stack {
+	char *dir;
+	char *list_file;
+	struct strbuf list;
+	struct reftable_table **tables;
+	int nr, alloc;
+	struct lock_file *lock;
+	/* tables to remove once the new list is committed */
+	struct string_list obsolete;
+};
+
+struct reftable_stack *reftable_stack_new(const char *dir);
+void reftable_stack_free(struct reftable_stack *st);
+
+/*
+ * Make sure that our view of the stack matches what is on disk.
+ * Return 0 on success, or -1 (having printed an error) on failure.
+ */
+int reftable_stack_reload(struct reftable_stack *st);
+
+/*
+ * Lock "tables.list" and reload the stack. The lock is held until
+ * reftable_stack_unlock() or a successful reftable_stack_add().
+ */
+int reftable_stack_lock(struct reftable_stack *st, struct strbuf *err);
+void reftable_stack_unlock(struct reftable_stack *st);
+
+/* The update index that the next table added to the stack will use. */
+uint64_t reftable_stack_next_update_index(struct reftable_stack *st);
+
+/*
+ * Look up refname in the (already reloaded) stack. Return 0 and fill
+ * rec if it exists, 1 if it does not, and -1 on error.
+ */
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct reftable_ref_record *rec);
+
+/*
+ * Start iterating over the ref or log records of the stack, starting
+ * at the first one whose refname is not smaller than prefix. Tombstones
+ * are only returned if include_deletions is set.
+ */
+void reftable_stack_ref_iter(struct reftable_stack *st,
+			     struct reftable_merged_iter *it,
+			     const char *prefix, int include_deletions);
+void reftable_stack_log_iter(struct reftable_stack *st,
+			     struct reftable_merged_iter *it,
+			     const char *refname, int include_deletions);
+
+/*
+ * Advance to the next record and decode it into rec. Return 0 on
+ * success, 1 at the end of the iteration, and -1 on error.
+ */
+int reftable_merged_iter_next_ref(struct reftable_merged_iter *it,
+				  struct reftable_ref_record *rec);
+int reftable_merged_iter_next_log(struct reftable_merged_iter *it,
+				  struct reftable_log_record *rec);
+void reftable_merged_iter_release(struct reftable_merged_iter *it);
+
+/*
+ * Records to be written as a new table; ref records must be sorted by
+ * refname and log records by refname and decreasing update_index.
+ * Use reftable_sort_records() to sort them.
+ */
+struct reftable_addition {
+	uint64_t update_index;
+	struct reftable_ref_record *refs;
+	int refs_nr, refs_alloc;
+	struct reftable_log_record *logs;
+	int logs_nr, logs_alloc;
+};
+
+#define REFTABLE_ADDITION_INIT { 0, NULL, 0, 0, NULL, 0, 0 }
+
+struct reftable_ref_record *reftable_addition_ref(struct reftable_addition *add,
+						  const char *refname);
+struct reftable_log_record *reftable_addition_log(struct reftable_addition *add,
+						  const char *refname);
+void reftable_sort_records(struct reftable_addition *add);
+void reftable_addition_release(struct reftable_addition *add);
+
+/*
+ * Write the records in add as a new table on top of the locked stack,
+ * compacting the top of the stack if its tables no longer shrink
+ * geometrically from bottom to top, then commit "tables.list". The
+ * lock is released in any case.
+ */
+int reftable_stack_add(struct reftable_stack *st,
+		       struct reftable_addition *add, struct strbuf *err);
+
+/* Merge all the tables of the stack into one. */
+int reftable_stack_compact_all(struct reftable_stack *st, struct strbuf *err);
+
+#endif /* REFS_REFTABLE_H */
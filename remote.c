@@ -629,6 +629,25 @@ void free_refspec(int nr_refspec, struct refspec *refspec)
 	free(refspec);
 }
 
+void refspec_ref_prefixes(const struct refspec *refspec, int nr,
+			  struct argv_array *prefixes)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		const struct refspec *item = &refspec[i];
+		const char *src = item->src[0] ? item->src : "HEAD";
+		const char *glob;
+
+		if (item->exact_sha1)
+			continue;
+		if (item->pattern && (glob = strchr(src, '*')))
+			argv_array_pushf(prefixes, "%.*s", (int)(glob - src), src);
+		else
+			expand_ref_prefix(prefixes, src);
+	}
+}
+
 static int valid_remote_nick(const char *name)
 {
 	if (!name[0] || is_dot_or_dotdot(name))
@@ -173,6 +173,14 @@ extern struct refspec *parse_push_refspec(int nr_refspec, const char **refspec);
 
 void free_refspec(int nr_refspec, struct refspec *refspec);
 
+/*
+ * Add to prefixes the prefixes of the remote refnames that the fetch
+ * refspecs can match, for the server to limit its ref advertisement.
+ */
+struct argv_array;
+void refspec_ref_prefixes(const struct refspec *refspec, int nr,
+			  struct argv_array *prefixes);
+
 extern int query_refspecs(struct refspec *specs, int nr, struct refspec *query);
 char *apply_refspecs(struct refspec *refspecs, int nr_refspec,
 		     const char *name);
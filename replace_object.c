@@ -90,6 +90,14 @@ static void prepare_replace_object(void)
 		check_replace_refs = 0;
 }
 
+int replace_objects_present(void)
+{
+	if (!check_replace_refs)
+		return 0;
+	prepare_replace_object();
+	return replace_object_nr > 0;
+}
+
 /* We allow "recursive" replacement. Only within reason, though */
 #define MAXREPLACEDEPTH 5
 
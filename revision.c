@@ -19,6 +19,9 @@
 #include "dir.h"
 #include "cache-tree.h"
 #include "bisect.h"
+#include "commit-graph.h"
+#include "bloom.h"
+#include "prio-queue.h"
 
 volatile show_early_output_fn_t show_early_output;
 
@@ -424,8 +427,71 @@ static void file_change(struct diff_options *options,
 	DIFF_OPT_SET(options, HAS_CHANGES);
 }
 
+static void prepare_to_use_bloom_filter(struct rev_info *revs)
+{
+	const struct bloom_filter_settings *settings;
+	struct pathspec *ps = &revs->prune_data;
+	int i;
+
+	/*
+	 * The filters only know about literal paths, and --follow changes
+	 * the pathspec as it goes.
+	 */
+	if (revs->bloom_keys_nr || !ps->nr || ps->has_wildcard ||
+	    (ps->magic & ~PATHSPEC_LITERAL) ||
+	    DIFF_OPT_TST(&revs->diffopt, FOLLOW_RENAMES))
+		return;
+
+	settings = commit_graph_bloom_settings();
+	if (!settings)
+		return;
+
+	for (i = 0; i < ps->nr; i++) {
+		int len = ps->items[i].len;
+
+		while (len && ps->items[i].match[len - 1] == '/')
+			len--;
+		if (!len)
+			return;
+	}
+
+	ALLOC_ARRAY(revs->bloom_keys, ps->nr);
+	for (i = 0; i < ps->nr; i++) {
+		const char *path = ps->items[i].match;
+		int len = ps->items[i].len;
+
+		while (path[len - 1] == '/')
+			len--;
+		fill_bloom_key(path, len, &revs->bloom_keys[i], settings);
+	}
+	revs->bloom_keys_nr = ps->nr;
+	revs->bloom_filter_settings = settings;
+}
+
+/*
+ * Return 0 if the changed-path Bloom filter of "commit" shows that none
+ * of the paths we are limited to differ from its first parent, and 1
+ * otherwise.
+ */
+static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
+						 struct commit *commit)
+{
+	struct bloom_filter filter;
+	int i;
+
+	if (!load_bloom_filter_from_graph(commit, &filter))
+		return 1;
+
+	for (i = 0; i < revs->bloom_keys_nr; i++)
+		if (bloom_filter_contains(&filter, &revs->bloom_keys[i],
+					  revs->bloom_filter_settings))
+			return 1;
+	return 0;
+}
+
 static int rev_compare_tree(struct rev_info *revs,
-			    struct commit *parent, struct commit *commit)
+			    struct commit *parent, struct commit *commit,
+			    int nth_parent)
 {
 	struct tree *t1 = parent->tree;
 	struct tree *t2 = commit->tree;
@@ -453,6 +519,10 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
+	if (!nth_parent && revs->bloom_keys_nr &&
+	    !check_maybe_different_in_bloom_filter(revs, commit))
+		return REV_TREE_SAME;
+
 	tree_difference = REV_TREE_SAME;
 	DIFF_OPT_CLR(&revs->pruning, HAS_CHANGES);
 	if (diff_tree_oid(&t1->object.oid, &t2->object.oid, "",
@@ -655,7 +725,7 @@ static void try_to_simplify_commit(struct rev_info *revs, struct commit *commit)
 			die("cannot simplify commit %s (because of %s)",
 			    oid_to_hex(&commit->object.oid),
 			    oid_to_hex(&p->object.oid));
-		switch (rev_compare_tree(revs, p, commit)) {
+		switch (rev_compare_tree(revs, p, commit, nth_parent)) {
 		case REV_TREE_SAME:
 			if (!revs->simplify_history || !relevant_commit(p)) {
 				/* Even if a merge with an uninteresting
@@ -770,7 +840,8 @@ static int add_parents_to_list(struct rev_info *revs, struct commit *commit,
 			if (p->object.flags & SEEN)
 				continue;
 			p->object.flags |= SEEN;
-			commit_list_insert_by_date_cached(p, list, cached_base, cache_ptr);
+			if (list)
+				commit_list_insert_by_date_cached(p, list, cached_base, cache_ptr);
 		}
 		return 0;
 	}
@@ -797,7 +868,8 @@ static int add_parents_to_list(struct rev_info *revs, struct commit *commit,
 		p->object.flags |= left_flag;
 		if (!(p->object.flags & SEEN)) {
 			p->object.flags |= SEEN;
-			commit_list_insert_by_date_cached(p, list, cached_base, cache_ptr);
+			if (list)
+				commit_list_insert_by_date_cached(p, list, cached_base, cache_ptr);
 		}
 		if (revs->first_parent_only)
 			break;
@@ -2342,7 +2414,16 @@ int setup_revisions(int argc, const char **argv, struct rev_info *revs, struct s
 	    DIFF_OPT_TST(&revs->diffopt, FOLLOW_RENAMES))
 		revs->diff = 1;
 
-	if (revs->topo_order)
+	/*
+	 * Without generation numbers, we cannot tell when all the
+	 * children of a commit have been shown, short of walking the
+	 * whole history up front.  With --first-parent, the order must
+	 * still respect the other parents of the commits shown, which
+	 * the incremental walk never looks at.
+	 */
+	if (revs->topo_order &&
+	    (revs->reflog_info || revs->first_parent_only ||
+	     !generation_numbers_enabled()))
 		revs->limited = 1;
 
 	if (revs->prune_data.nr) {
@@ -2768,6 +2849,255 @@ void reset_revision_walk(void)
 	clear_object_flags(SEEN | ADDED | SHOWN);
 }
 
+/*
+ * Incremental --topo-order walk.
+ *
+ * Instead of walking the whole history in limit_list() and sorting it,
+ * we use generation numbers to learn just enough of the graph to know
+ * that a commit has no children left to show.  Three walks run
+ * "lazily", each in decreasing generation number order:
+ *
+ *  - the explore walk visits commits the way get_revision_1() would
+ *    have, so that UNINTERESTING and TREESAME are known (and parents
+ *    simplified) before a commit is counted;
+ *
+ *  - the indegree walk counts, for every commit it reaches, the
+ *    children that point at it;
+ *
+ *  - the topo queue holds the commits whose children have all been
+ *    shown, and is what get_revision_1() pops from.
+ *
+ * A commit's children all have a higher generation number, so once
+ * the indegree walk has passed generation "g", the indegree of every
+ * commit at generation "g" or above is final.  Commits outside the
+ * commit-graph have GENERATION_NUMBER_INFINITY and are simply all
+ * walked first.
+ */
+#define TOPO_WALK_EXPLORED (1u<<0)
+#define TOPO_WALK_INDEGREE (1u<<1)
+
+define_commit_slab(topo_walk_state_slab, unsigned char);
+define_commit_slab(indegree_slab, int);
+define_commit_slab(author_date_slab, timestamp_t);
+
+struct topo_walk_info {
+	uint32_t min_generation;
+	struct prio_queue explore_queue;
+	struct prio_queue indegree_queue;
+	struct prio_queue topo_queue;
+	struct topo_walk_state_slab state;
+	struct indegree_slab indegree;
+	struct author_date_slab author_date;
+};
+
+static void test_state_and_insert(struct topo_walk_info *info,
+				  struct prio_queue *q, struct commit *c,
+				  unsigned char bit)
+{
+	unsigned char *state = topo_walk_state_slab_at(&info->state, c);
+
+	if (*state & bit)
+		return;
+	*state |= bit;
+	prio_queue_put(q, c);
+}
+
+static void explore_walk_step(struct rev_info *revs)
+{
+	struct topo_walk_info *info = revs->topo_walk_info;
+	struct commit_list *p;
+	struct commit *c = prio_queue_get(&info->explore_queue);
+
+	if (!c)
+		return;
+	if (parse_commit_gently(c, 1) < 0)
+		return;
+
+	if (revs->max_age != -1 && (c->date < revs->max_age))
+		c->object.flags |= UNINTERESTING;
+
+	if (add_parents_to_list(revs, c, NULL, NULL) < 0)
+		return;
+
+	if (c->object.flags & UNINTERESTING)
+		mark_parents_uninteresting(c);
+
+	for (p = c->parents; p; p = p->next)
+		test_state_and_insert(info, &info->explore_queue, p->item,
+				      TOPO_WALK_EXPLORED);
+}
+
+static void explore_to_depth(struct rev_info *revs, uint32_t gen_cutoff)
+{
+	struct topo_walk_info *info = revs->topo_walk_info;
+	struct commit *c;
+
+	while ((c = prio_queue_peek(&info->explore_queue)) &&
+	       c->generation >= gen_cutoff)
+		explore_walk_step(revs);
+}
+
+static void indegree_walk_step(struct rev_info *revs)
+{
+	struct topo_walk_info *info = revs->topo_walk_info;
+	struct commit_list *p;
+	struct commit *c = prio_queue_get(&info->indegree_queue);
+
+	if (!c)
+		return;
+	if (parse_commit_gently(c, 1) < 0)
+		return;
+
+	/* the parents of "c" are only final once it has been explored */
+	explore_to_depth(revs, c->generation);
+
+	for (p = c->parents; p; p = p->next) {
+		struct commit *parent = p->item;
+		int *pi = indegree_slab_at(&info->indegree, parent);
+
+		if (*pi)
+			(*pi)++;
+		else
+			*pi = 2;
+
+		test_state_and_insert(info, &info->indegree_queue, parent,
+				      TOPO_WALK_INDEGREE);
+
+		if (revs->first_parent_only)
+			return;
+	}
+}
+
+static void compute_indegrees_to_depth(struct rev_info *revs,
+				       uint32_t gen_cutoff)
+{
+	struct topo_walk_info *info = revs->topo_walk_info;
+	struct commit *c;
+
+	while ((c = prio_queue_peek(&info->indegree_queue)) &&
+	       c->generation >= gen_cutoff)
+		indegree_walk_step(revs);
+}
+
+static void init_topo_walk(struct rev_info *revs)
+{
+	struct topo_walk_info *info;
+	struct commit_list *list;
+
+	info = xcalloc(1, sizeof(*info));
+	revs->topo_walk_info = info;
+
+	init_topo_walk_state_slab(&info->state);
+	init_indegree_slab(&info->indegree);
+
+	switch (revs->sort_order) {
+	default: /* REV_SORT_IN_GRAPH_ORDER */
+		info->topo_queue.compare = NULL;
+		break;
+	case REV_SORT_BY_COMMIT_DATE:
+		info->topo_queue.compare = compare_commits_by_commit_date;
+		break;
+	case REV_SORT_BY_AUTHOR_DATE:
+		init_author_date_slab(&info->author_date);
+		info->topo_queue.compare = compare_commits_by_author_date;
+		info->topo_queue.cb_data = &info->author_date;
+		break;
+	}
+
+	info->explore_queue.compare = compare_commits_by_gen_then_commit_date;
+	info->indegree_queue.compare = compare_commits_by_gen_then_commit_date;
+
+	info->min_generation = GENERATION_NUMBER_INFINITY;
+	for (list = revs->commits; list; list = list->next) {
+		struct commit *c = list->item;
+
+		if (parse_commit_gently(c, 1))
+			continue;
+
+		test_state_and_insert(info, &info->explore_queue, c,
+				      TOPO_WALK_EXPLORED);
+		test_state_and_insert(info, &info->indegree_queue, c,
+				      TOPO_WALK_INDEGREE);
+
+		if (c->generation < info->min_generation)
+			info->min_generation = c->generation;
+
+		*(indegree_slab_at(&info->indegree, c)) = 1;
+
+		if (revs->sort_order == REV_SORT_BY_AUTHOR_DATE)
+			record_author_date(&info->author_date, c);
+	}
+	compute_indegrees_to_depth(revs, info->min_generation);
+
+	for (list = revs->commits; list; list = list->next) {
+		struct commit *c = list->item;
+
+		if (*(indegree_slab_at(&info->indegree, c)) == 1)
+			prio_queue_put(&info->topo_queue, c);
+	}
+
+	/*
+	 * This is unfortunate; the initial tips need to be shown
+	 * in the order given from the revision traversal machinery.
+	 */
+	if (revs->sort_order == REV_SORT_IN_GRAPH_ORDER)
+		prio_queue_reverse(&info->topo_queue);
+}
+
+static struct commit *next_topo_commit(struct rev_info *revs)
+{
+	struct commit *c;
+	struct topo_walk_info *info = revs->topo_walk_info;
+
+	/* pop next off of topo_queue */
+	c = prio_queue_get(&info->topo_queue);
+
+	if (c)
+		*(indegree_slab_at(&info->indegree, c)) = 0;
+
+	return c;
+}
+
+static void expand_topo_walk(struct rev_info *revs, struct commit *commit)
+{
+	struct commit_list *p;
+	struct topo_walk_info *info = revs->topo_walk_info;
+
+	if (add_parents_to_list(revs, commit, NULL, NULL) < 0) {
+		if (!revs->ignore_missing_links)
+			die("Failed to traverse parents of commit %s",
+			    oid_to_hex(&commit->object.oid));
+	}
+
+	for (p = commit->parents; p; p = p->next) {
+		struct commit *parent = p->item;
+		int *pi;
+
+		if (parent->object.flags & UNINTERESTING)
+			continue;
+
+		if (parse_commit_gently(parent, 1) < 0)
+			continue;
+
+		if (parent->generation < info->min_generation) {
+			info->min_generation = parent->generation;
+			compute_indegrees_to_depth(revs, info->min_generation);
+		}
+
+		pi = indegree_slab_at(&info->indegree, parent);
+
+		(*pi)--;
+		if (*pi == 1) {
+			if (revs->sort_order == REV_SORT_BY_AUTHOR_DATE)
+				record_author_date(&info->author_date, parent);
+			prio_queue_put(&info->topo_queue, parent);
+		}
+
+		if (revs->first_parent_only)
+			return;
+	}
+}
+
 int prepare_revision_walk(struct rev_info *revs)
 {
 	int i;
@@ -2796,15 +3126,20 @@ int prepare_revision_walk(struct rev_info *revs)
 	    (revs->limited && limiting_can_increase_treesame(revs)))
 		revs->treesame.name = "treesame";
 
+	if (revs->prune)
+		prepare_to_use_bloom_filter(revs);
+
 	if (revs->no_walk != REVISION_WALK_NO_WALK_UNSORTED)
 		commit_list_sort_by_date(&revs->commits);
 	if (revs->no_walk)
 		return 0;
-	if (revs->limited)
+	if (revs->limited) {
 		if (limit_list(revs) < 0)
 			return -1;
-	if (revs->topo_order)
-		sort_in_topological_order(&revs->commits, revs->sort_order);
+		if (revs->topo_order)
+			sort_in_topological_order(&revs->commits, revs->sort_order);
+	} else if (revs->topo_order)
+		init_topo_walk(revs);
 	if (revs->line_level_traverse)
 		line_log_filter(revs);
 	if (revs->simplify_merges)
@@ -2821,7 +3156,9 @@ static enum rewrite_result rewrite_one(struct rev_info *revs, struct commit **pp
 	for (;;) {
 		struct commit *p = *pp;
 		if (!revs->limited)
-			if (add_parents_to_list(revs, p, &revs->commits, &cache) < 0)
+			if (add_parents_to_list(revs, p,
+						revs->topo_walk_info ? NULL : &revs->commits,
+						&cache) < 0)
 				return rewrite_one_error;
 		if (p->object.flags & UNINTERESTING)
 			return rewrite_one_ok;
@@ -3114,11 +3451,16 @@ static void track_linear(struct rev_info *revs, struct commit *commit)
 
 static struct commit *get_revision_1(struct rev_info *revs)
 {
-	if (!revs->commits)
-		return NULL;
+	while (1) {
+		struct commit *commit;
 
-	do {
-		struct commit *commit = pop_commit(&revs->commits);
+		if (revs->topo_walk_info)
+			commit = next_topo_commit(revs);
+		else
+			commit = pop_commit(&revs->commits);
+
+		if (!commit)
+			return NULL;
 
 		if (revs->reflog_info) {
 			save_parents(revs, commit);
@@ -3135,7 +3477,9 @@ static struct commit *get_revision_1(struct rev_info *revs)
 			if (revs->max_age != -1 &&
 			    (commit->date < revs->max_age))
 				continue;
-			if (add_parents_to_list(revs, commit, &revs->commits, NULL) < 0) {
+			if (revs->topo_walk_info)
+				expand_topo_walk(revs, commit);
+			else if (add_parents_to_list(revs, commit, &revs->commits, NULL) < 0) {
 				if (!revs->ignore_missing_links)
 					die("Failed to traverse parents of commit %s",
 						oid_to_hex(&commit->object.oid));
@@ -3153,8 +3497,7 @@ static struct commit *get_revision_1(struct rev_info *revs)
 				track_linear(revs, commit);
 			return commit;
 		}
-	} while (revs->commits);
-	return NULL;
+	}
 }
 
 /*
@@ -29,6 +29,7 @@ struct rev_info;
 struct log_info;
 struct string_list;
 struct saved_parents;
+struct topo_walk_info;
 
 struct rev_cmdline_info {
 	unsigned int nr;
@@ -192,6 +193,14 @@ struct rev_info {
 	struct diff_options diffopt;
 	struct diff_options pruning;
 
+	/* changed-path Bloom filter keys of prune_data, see bloom.h */
+	struct bloom_key *bloom_keys;
+	int bloom_keys_nr;
+	const struct bloom_filter_settings *bloom_filter_settings;
+
+	/* incremental walk for topo_order without limit_list() */
+	struct topo_walk_info *topo_walk_info;
+
 	struct reflog_walk_info *reflog_info;
 	struct decoration children;
 	struct decoration merge_simplification;
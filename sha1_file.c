@@ -27,6 +27,8 @@
 #include "list.h"
 #include "mergesort.h"
 #include "quote.h"
+#include "midx.h"
+#include "parallel-hash.h"
 
 #define SZ_FMT PRIuMAX
 static inline uintmax_t sz_fmt(size_t s) { return s; }
@@ -1084,6 +1086,11 @@ void close_pack_index(struct packed_git *p)
 		munmap((void *)p->index_data, p->index_size);
 		p->index_data = NULL;
 	}
+	if (p->revindex_map) {
+		munmap((void *)p->revindex_map, p->revindex_size);
+		p->revindex_map = NULL;
+		p->revindex_data = NULL;
+	}
 }
 
 static unsigned int get_max_fd_limit(void)
@@ -1482,9 +1489,13 @@ static void prepare_packed_git_one(char *objdir, int local)
 		if (!report_garbage)
 			continue;
 
+		if (!strcmp(de->d_name, "multi-pack-index"))
+			continue;
+
 		if (ends_with(de->d_name, ".idx") ||
 		    ends_with(de->d_name, ".pack") ||
 		    ends_with(de->d_name, ".bitmap") ||
+		    ends_with(de->d_name, ".rev") ||
 		    ends_with(de->d_name, ".keep"))
 			string_list_append(&garbage, path.buf);
 		else
@@ -1583,9 +1594,12 @@ void prepare_packed_git(void)
 	if (prepare_packed_git_run_once)
 		return;
 	prepare_packed_git_one(get_object_directory(), 1);
+	prepare_multi_pack_index_one(get_object_directory());
 	prepare_alt_odb();
-	for (alt = alt_odb_list; alt; alt = alt->next)
+	for (alt = alt_odb_list; alt; alt = alt->next) {
 		prepare_packed_git_one(alt->path, 0);
+		prepare_multi_pack_index_one(alt->path);
+	}
 	rearrange_packed_git();
 	prepare_packed_git_mru();
 	prepare_packed_git_run_once = 1;
@@ -2112,18 +2126,18 @@ static const unsigned char *get_delta_base_sha1(struct packed_git *p,
 		unsigned char *base = use_pack(p, w_curs, curpos, NULL);
 		return base;
 	} else if (type == OBJ_OFS_DELTA) {
-		struct revindex_entry *revidx;
+		int pos;
 		off_t base_offset = get_delta_base(p, w_curs, &curpos,
 						   type, delta_obj_offset);
 
 		if (!base_offset)
 			return NULL;
 
-		revidx = find_pack_revindex(p, base_offset);
-		if (!revidx)
+		pos = find_revindex_position(p, base_offset);
+		if (pos < 0)
 			return NULL;
 
-		return nth_packed_object_sha1(p, revidx->nr);
+		return nth_packed_object_sha1(p, pack_pos_to_index(p, pos));
 	} else
 		return NULL;
 }
@@ -2156,13 +2170,12 @@ int unpack_object_header(struct packed_git *p,
 
 static int retry_bad_packed_offset(struct packed_git *p, off_t obj_offset)
 {
-	int type;
-	struct revindex_entry *revidx;
+	int type, pos;
 	const unsigned char *sha1;
-	revidx = find_pack_revindex(p, obj_offset);
-	if (!revidx)
+	pos = find_revindex_position(p, obj_offset);
+	if (pos < 0)
 		return OBJ_BAD;
-	sha1 = nth_packed_object_sha1(p, revidx->nr);
+	sha1 = nth_packed_object_sha1(p, pack_pos_to_index(p, pos));
 	mark_bad_packed_object(p, sha1);
 	type = sha1_object_info(sha1, NULL);
 	if (type <= OBJ_NONE)
@@ -2273,8 +2286,8 @@ int packed_object_info(struct packed_git *p, off_t obj_offset,
 	}
 
 	if (oi->disk_sizep) {
-		struct revindex_entry *revidx = find_pack_revindex(p, obj_offset);
-		*oi->disk_sizep = revidx[1].offset - obj_offset;
+		int pos = find_revindex_position(p, obj_offset);
+		*oi->disk_sizep = pack_pos_to_offset(p, pos + 1) - obj_offset;
 	}
 
 	if (oi->typep) {
@@ -2528,11 +2541,12 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 		}
 
 		if (do_check_packed_object_crc && p->index_version > 1) {
-			struct revindex_entry *revidx = find_pack_revindex(p, obj_offset);
-			off_t len = revidx[1].offset - obj_offset;
-			if (check_pack_crc(p, &w_curs, obj_offset, len, revidx->nr)) {
+			int pos = find_revindex_position(p, obj_offset);
+			off_t len = pack_pos_to_offset(p, pos + 1) - obj_offset;
+			uint32_t nr = pack_pos_to_index(p, pos);
+			if (check_pack_crc(p, &w_curs, obj_offset, len, nr)) {
 				const unsigned char *sha1 =
-					nth_packed_object_sha1(p, revidx->nr);
+					nth_packed_object_sha1(p, nr);
 				error("bad packed object CRC for %s",
 				      sha1_to_hex(sha1));
 				mark_bad_packed_object(p, sha1);
@@ -2617,11 +2631,12 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 			 * This is costly but should happen only in the presence
 			 * of a corrupted pack, and is better than failing outright.
 			 */
-			struct revindex_entry *revidx;
+			int pos;
 			const unsigned char *base_sha1;
-			revidx = find_pack_revindex(p, obj_offset);
-			if (revidx) {
-				base_sha1 = nth_packed_object_sha1(p, revidx->nr);
+			pos = find_revindex_position(p, obj_offset);
+			if (pos >= 0) {
+				base_sha1 = nth_packed_object_sha1(p,
+						pack_pos_to_index(p, pos));
 				error("failed to read delta base object %s"
 				      " at offset %"PRIuMAX" from %s",
 				      sha1_to_hex(base_sha1), (uintmax_t)obj_offset,
@@ -2829,18 +2844,25 @@ int is_pack_valid(struct packed_git *p)
 	return !open_packed_git(p);
 }
 
+static int is_bad_packed_object(struct packed_git *p,
+				const unsigned char *sha1)
+{
+	unsigned i;
+
+	for (i = 0; i < p->num_bad_objects; i++)
+		if (!hashcmp(sha1, p->bad_object_sha1 + 20 * i))
+			return 1;
+	return 0;
+}
+
 static int fill_pack_entry(const unsigned char *sha1,
 			   struct pack_entry *e,
 			   struct packed_git *p)
 {
 	off_t offset;
 
-	if (p->num_bad_objects) {
-		unsigned i;
-		for (i = 0; i < p->num_bad_objects; i++)
-			if (!hashcmp(sha1, p->bad_object_sha1 + 20 * i))
-				return 0;
-	}
+	if (is_bad_packed_object(p, sha1))
+		return 0;
 
 	offset = find_pack_entry_one(sha1, p);
 	if (!offset)
@@ -2861,6 +2883,31 @@ static int fill_pack_entry(const unsigned char *sha1,
 	return 1;
 }
 
+/*
+ * Look up sha1 in a multi-pack-index. Returns 1 and fills e if found,
+ * 0 if the midx does not know the object, and -1 if it does but the
+ * entry cannot be used (bad object, pack gone, corrupt midx).
+ */
+static int fill_midx_entry(const unsigned char *sha1,
+			   struct pack_entry *e,
+			   struct multi_pack_index *m)
+{
+	struct packed_git *p;
+	off_t offset;
+	int ret;
+
+	ret = find_midx_entry(m, sha1, &p, &offset);
+	if (ret <= 0)
+		return ret;
+
+	if (is_bad_packed_object(p, sha1) || !is_pack_valid(p))
+		return -1;
+	e->offset = offset;
+	e->p = p;
+	hashcpy(e->sha1, sha1);
+	return 1;
+}
+
 /*
  * Iff a pack file contains the object named by sha1, return true and
  * store its location to e.
@@ -2868,13 +2915,32 @@ static int fill_pack_entry(const unsigned char *sha1,
 static int find_pack_entry(const unsigned char *sha1, struct pack_entry *e)
 {
 	struct mru_entry *p;
+	struct multi_pack_index *m;
+	int skip_midx_packs = 1;
 
 	prepare_packed_git();
 	if (!packed_git)
 		return 0;
 
+	/*
+	 * Packs covered by a multi-pack-index need not be searched one
+	 * by one, unless the midx pointed us to an entry we could not use
+	 * and another copy of the object may live in one of them.
+	 */
+	for (m = multi_pack_index; m; m = m->next) {
+		int ret = fill_midx_entry(sha1, e, m);
+		if (ret > 0)
+			return 1;
+		if (ret < 0)
+			skip_midx_packs = 0;
+	}
+
 	for (p = packed_git_mru->head; p; p = p->next) {
-		if (fill_pack_entry(sha1, e, p->item)) {
+		struct packed_git *pack = p->item;
+
+		if (skip_midx_packs && pack->multi_pack_index)
+			continue;
+		if (fill_pack_entry(sha1, e, pack)) {
 			mru_mark(packed_git_mru, p);
 			return 1;
 		}
@@ -3329,15 +3395,20 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 	git_zstream stream;
 	git_SHA_CTX c;
 	unsigned char parano_sha1[20];
-	static struct strbuf tmp_file = STRBUF_INIT;
-	const char *filename = sha1_file_name(sha1);
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct strbuf filename = STRBUF_INIT;
+
+	/* not sha1_file_name(): its buffer is shared by all threads */
+	strbuf_addf(&filename, "%s/", get_object_directory());
+	fill_sha1_path(&filename, sha1);
 
-	fd = create_tmpfile(&tmp_file, filename);
+	fd = create_tmpfile(&tmp_file, filename.buf);
 	if (fd < 0) {
 		if (errno == EACCES)
-			return error("insufficient permission for adding an object to repository database %s", get_object_directory());
+			ret = error("insufficient permission for adding an object to repository database %s", get_object_directory());
 		else
-			return error_errno("unable to create temporary file");
+			ret = error_errno("unable to create temporary file");
+		goto out;
 	}
 
 	/* Set it up */
@@ -3385,7 +3456,11 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 			warning_errno("failed utime() on %s", tmp_file.buf);
 	}
 
-	return finalize_object_file(tmp_file.buf, filename);
+	ret = finalize_object_file(tmp_file.buf, filename.buf);
+out:
+	strbuf_release(&tmp_file);
+	strbuf_release(&filename);
+	return ret;
 }
 
 static int freshen_loose_object(const unsigned char *sha1)
@@ -3406,6 +3481,21 @@ static int freshen_packed_object(const unsigned char *sha1)
 	return 1;
 }
 
+int freshen_object(const unsigned char *sha1)
+{
+	return freshen_packed_object(sha1) || freshen_loose_object(sha1);
+}
+
+int write_loose_sha1_file(const unsigned char *sha1, const char *type,
+			  const void *buf, unsigned long len)
+{
+	char hdr[32];
+	int hdrlen;
+
+	hdrlen = xsnprintf(hdr, sizeof(hdr), "%s %lu", type, len) + 1;
+	return write_loose_object(sha1, hdr, hdrlen, buf, len, 0);
+}
+
 int write_sha1_file(const void *buf, unsigned long len, const char *type, unsigned char *sha1)
 {
 	char hdr[32];
@@ -3415,7 +3505,7 @@ int write_sha1_file(const void *buf, unsigned long len, const char *type, unsign
 	 * it out into .git/objects/??/?{38} file.
 	 */
 	write_sha1_file_prepare(buf, len, type, sha1, hdr, &hdrlen);
-	if (freshen_packed_object(sha1) || freshen_loose_object(sha1))
+	if (freshen_object(sha1))
 		return 0;
 	return write_loose_object(sha1, hdr, hdrlen, buf, len, 0);
 }
@@ -3433,7 +3523,7 @@ int hash_sha1_file_literally(const void *buf, unsigned long len, const char *typ
 
 	if (!(flags & HASH_WRITE_OBJECT))
 		goto cleanup;
-	if (freshen_packed_object(sha1) || freshen_loose_object(sha1))
+	if (freshen_object(sha1))
 		goto cleanup;
 	status = write_loose_object(sha1, header, hdrlen, buf, len, 0);
 
@@ -3562,7 +3652,7 @@ static int index_mem(unsigned char *sha1, void *buf, size_t size,
 	}
 
 	if (write_object)
-		ret = write_sha1_file(buf, size, typename(type), sha1);
+		ret = write_sha1_file_bulk_checkin(buf, size, type, sha1);
 	else
 		ret = hash_sha1_file(buf, size, typename(type), sha1);
 	if (re_allocated)
@@ -3584,8 +3674,8 @@ static int index_stream_convert_blob(unsigned char *sha1, int fd,
 				 write_object ? safe_crlf : SAFE_CRLF_FALSE);
 
 	if (write_object)
-		ret = write_sha1_file(sbuf.buf, sbuf.len, typename(OBJ_BLOB),
-				      sha1);
+		ret = write_sha1_file_bulk_checkin(sbuf.buf, sbuf.len,
+						   OBJ_BLOB, sha1);
 	else
 		ret = hash_sha1_file(sbuf.buf, sbuf.len, typename(OBJ_BLOB),
 				     sha1);
@@ -3685,6 +3775,8 @@ int index_path(unsigned char *sha1, const char *path, struct stat *st, unsigned
 
 	switch (st->st_mode & S_IFMT) {
 	case S_IFREG:
+		if (parallel_hash_result(path, path, st, flags, sha1))
+			break;
 		fd = open(path, O_RDONLY);
 		if (fd < 0)
 			return error_errno("open(\"%s\")", path);
@@ -3697,7 +3789,7 @@ int index_path(unsigned char *sha1, const char *path, struct stat *st, unsigned
 			return error_errno("readlink(\"%s\")", path);
 		if (!(flags & HASH_WRITE_OBJECT))
 			hash_sha1_file(sb.buf, sb.len, blob_type, sha1);
-		else if (write_sha1_file(sb.buf, sb.len, blob_type, sha1))
+		else if (write_sha1_file_bulk_checkin(sb.buf, sb.len, OBJ_BLOB, sha1))
 			return error("%s: failed to insert into database",
 				     path);
 		strbuf_release(&sb);
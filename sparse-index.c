@@ -0,0 +1,360 @@
+#include "cache.h"
+#include "cache-tree.h"
+#include "dir.h"
+#include "pathspec.h"
+#include "sparse-index.h"
+#include "tree.h"
+#include "wildmatch.h"
+
+static int load_sparse_patterns(struct exclude_list *el)
+{
+	char *sparse = git_pathdup("info/sparse-checkout");
+	int ret;
+
+	memset(el, 0, sizeof(*el));
+	ret = add_excludes_from_file_to_list(sparse, "", 0, el, NULL);
+	free(sparse);
+	return ret;
+}
+
+/*
+ * Could the pattern, anchored at the top of the work tree, match
+ * something below the directory whose "depth" components are in
+ * "path"?
+ */
+static int pattern_reaches_below(const struct exclude *x,
+				 const char *path, int pathlen, int depth)
+{
+	const char *pat = x->pattern, *pat_end = x->pattern + x->patternlen;
+	const char *p = path, *end = path + pathlen;
+	struct strbuf pat_comp = STRBUF_INIT, comp = STRBUF_INIT;
+	int d, ret = 1;
+
+	if (pat < pat_end && *pat == '/')
+		pat++;
+	/* "**" may stand for any number of directories */
+	for (d = 0; pat + d + 1 < pat_end; d++)
+		if (pat[d] == '*' && pat[d + 1] == '*')
+			return 1;
+
+	for (d = 0; d < depth; d++) {
+		const char *pat_slash = memchr(pat, '/', pat_end - pat);
+		const char *slash = memchr(p, '/', end - p);
+
+		/* the pattern stops at or above the directory */
+		if (!pat_slash) {
+			ret = 0;
+			break;
+		}
+		if (!slash)
+			slash = end;
+		strbuf_reset(&pat_comp);
+		strbuf_add(&pat_comp, pat, pat_slash - pat);
+		strbuf_reset(&comp);
+		strbuf_add(&comp, p, slash - p);
+		if (wildmatch(pat_comp.buf, comp.buf,
+			      ignore_case ? WM_CASEFOLD : 0, NULL)) {
+			ret = 0;
+			break;
+		}
+		pat = pat_slash + 1;
+		p = slash + 1;
+	}
+	strbuf_release(&pat_comp);
+	strbuf_release(&comp);
+	return ret;
+}
+
+int sparse_dir_outside_patterns(struct exclude_list *el,
+				const char *path, int pathlen)
+{
+	int i, depth = 0, included = 0;
+
+	/*
+	 * As in clear_ce_flags_dir(), the last pattern that matches the
+	 * directory or one of its leading directories decides about the
+	 * paths inside it that no pattern matches themselves.
+	 */
+	for (i = 1; i <= pathlen; i++) {
+		const char *basename;
+		int dtype = DT_DIR, ret;
+
+		if (i < pathlen && path[i] != '/')
+			continue;
+		basename = path + i;
+		while (basename > path && basename[-1] != '/')
+			basename--;
+		ret = is_excluded_from_list(path, i, basename, &dtype, el,
+					    &the_index);
+		if (ret >= 0)
+			included = ret;
+		depth++;
+	}
+	if (included)
+		return 0;
+
+	for (i = 0; i < el->nr; i++) {
+		const struct exclude *x = el->excludes[i];
+
+		if (x->flags & EXC_FLAG_NEGATIVE)
+			continue;
+		/* a pattern without a slash matches at any depth */
+		if (x->flags & EXC_FLAG_NODIR)
+			return 0;
+		if (pattern_reaches_below(x, path, pathlen, depth))
+			return 0;
+	}
+	return 1;
+}
+
+static struct cache_entry *make_sparse_dir_entry(struct index_state *istate,
+						 const char *path, int len,
+						 const struct cache_tree *it)
+{
+	struct cache_entry *ce = make_empty_cache_entry(istate, len);
+
+	memcpy(ce->name, path, len);
+	ce->ce_namelen = len;
+	ce->ce_mode = S_IFDIR;
+	ce->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+	oidcpy(&ce->oid, &it->oid);
+	return ce;
+}
+
+static int can_collapse(const struct cache_entry *ce)
+{
+	return !ce_stage(ce) && !S_ISGITLINK(ce->ce_mode) &&
+		(ce->ce_flags & CE_SKIP_WORKTREE) &&
+		!(ce->ce_flags & (CE_VALID | CE_INTENT_TO_ADD));
+}
+
+/*
+ * Collapse the entries [start, end) of the directory "path" (with a
+ * trailing slash, or empty at the top), whose tree is "it", moving the
+ * remaining entries down to istate->cache[nr]. Returns the number of
+ * entries that are left.
+ */
+static int collapse_dir(struct index_state *istate, struct exclude_list *el,
+			struct strbuf *path, struct cache_tree *it,
+			int start, int end, int nr)
+{
+	int i, nr_start = nr;
+	size_t baselen = path->len;
+
+	/* already collapsed */
+	if (end - start == 1 && S_ISSPARSEDIR(istate->cache[start]->ce_mode) &&
+	    ce_namelen(istate->cache[start]) == path->len) {
+		istate->cache[nr] = istate->cache[start];
+		return 1;
+	}
+
+	if (path->len &&
+	    sparse_dir_outside_patterns(el, path->buf, path->len - 1)) {
+		for (i = start; i < end; i++)
+			if (!can_collapse(istate->cache[i]))
+				break;
+		if (i == end) {
+			struct cache_entry *ce;
+
+			ce = make_sparse_dir_entry(istate, path->buf,
+						   path->len, it);
+			for (i = start; i < end; i++)
+				discard_cache_entry(istate->cache[i]);
+			istate->cache[nr] = ce;
+			cache_tree_free_subtrees(it);
+			it->entry_count = 1;
+			return 1;
+		}
+	}
+
+	i = start;
+	while (i < end) {
+		struct cache_entry *ce = istate->cache[i];
+		const char *slash = strchr(ce->name + baselen, '/');
+		struct cache_tree *sub;
+		int pos, span;
+
+		pos = slash ? cache_tree_subtree_pos(it, ce->name + baselen,
+						     slash - ce->name - baselen)
+			    : -1;
+		if (pos < 0) {
+			istate->cache[nr++] = ce;
+			i++;
+			continue;
+		}
+		sub = it->down[pos]->cache_tree;
+		span = sub->entry_count;
+		strbuf_add(path, ce->name + baselen, slash - ce->name - baselen + 1);
+		nr += collapse_dir(istate, el, path, sub, i, i + span, nr);
+		strbuf_setlen(path, baselen);
+		i += span;
+	}
+	it->entry_count = nr - nr_start;
+	return nr - nr_start;
+}
+
+void convert_to_sparse(struct index_state *istate)
+{
+	struct exclude_list el;
+	struct strbuf path = STRBUF_INIT;
+	int i;
+
+	if (!core_apply_sparse_checkout || istate->split_index ||
+	    !git_config_get_sparse_index()) {
+		ensure_full_index(istate);
+		return;
+	}
+	if (!istate->cache_nr)
+		return;
+
+	for (i = 0; i < istate->cache_nr; i++)
+		if (ce_stage(istate->cache[i]) ||
+		    (istate->cache[i]->ce_flags & CE_REMOVE))
+			return;
+
+	/* the sparse directory entries name the trees of the cache-tree */
+	if (!istate->cache_tree)
+		istate->cache_tree = cache_tree();
+	if (cache_tree_update(istate, WRITE_TREE_SILENT | WRITE_TREE_MISSING_OK))
+		return;
+	/* intent-to-add entries leave their trees, up to the root, invalid */
+	if (istate->cache_tree->entry_count < 0)
+		return;
+
+	if (load_sparse_patterns(&el) < 0)
+		return;
+	istate->cache_nr = collapse_dir(istate, &el, &path, istate->cache_tree,
+					0, istate->cache_nr, 0);
+	clear_exclude_list(&el);
+	strbuf_release(&path);
+
+	istate->sparse_index = 0;
+	for (i = 0; i < istate->cache_nr; i++)
+		if (S_ISSPARSEDIR(istate->cache[i]->ce_mode)) {
+			istate->sparse_index = 1;
+			break;
+		}
+	free_name_hash(istate);
+}
+
+static int add_path_to_index(const unsigned char *sha1, struct strbuf *base,
+			     const char *path, unsigned int mode, int stage,
+			     void *context)
+{
+	struct index_state *istate = context;
+	struct cache_entry *ce;
+	int len = base->len + strlen(path);
+
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+
+	ce = make_empty_cache_entry(istate, len);
+	memcpy(ce->name, base->buf, base->len);
+	memcpy(ce->name + base->len, path, len - base->len);
+	ce->ce_namelen = len;
+	ce->ce_mode = create_ce_mode(mode);
+	ce->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+	hashcpy(ce->oid.hash, sha1);
+
+	/* trees list their entries in the order of the index */
+	ALLOC_GROW(istate->cache, istate->cache_nr + 1, istate->cache_alloc);
+	istate->cache[istate->cache_nr++] = ce;
+	return 0;
+}
+
+void ensure_full_index(struct index_state *istate)
+{
+	struct cache_entry **old_cache;
+	unsigned int i, old_nr;
+	struct pathspec ps;
+	uint64_t start;
+
+	if (!istate->sparse_index)
+		return;
+
+	start = getnanotime();
+	old_cache = istate->cache;
+	old_nr = istate->cache_nr;
+	istate->cache = NULL;
+	istate->cache_nr = istate->cache_alloc = 0;
+	ALLOC_GROW(istate->cache, old_nr, istate->cache_alloc);
+	memset(&ps, 0, sizeof(ps));
+
+	for (i = 0; i < old_nr; i++) {
+		struct cache_entry *ce = old_cache[i];
+		struct tree *tree;
+		unsigned int nr = istate->cache_nr;
+
+		if (!S_ISSPARSEDIR(ce->ce_mode)) {
+			ALLOC_GROW(istate->cache, istate->cache_nr + 1,
+				   istate->cache_alloc);
+			istate->cache[istate->cache_nr++] = ce;
+			continue;
+		}
+
+		tree = lookup_tree(&ce->oid);
+		if (!tree || read_tree_recursive(tree, ce->name, ce_namelen(ce),
+						 0, &ps, add_path_to_index,
+						 istate))
+			die("unable to expand sparse directory '%s' (tree %s)",
+			    ce->name, oid_to_hex(&ce->oid));
+		if (istate->cache_tree)
+			cache_tree_expand_sparse_dir(istate->cache_tree, ce->name,
+						     istate->cache_nr - nr);
+		discard_cache_entry(ce);
+	}
+	free(old_cache);
+
+	istate->sparse_index = 0;
+	free_name_hash(istate);
+	trace_performance_since(start, "expand sparse index (%u entries)",
+				istate->cache_nr);
+}
+
+/*
+ * Is there a sparse directory entry that is a leading directory of the
+ * first "len" bytes of "name", or, if "prefix_only" is set, one that
+ * starts with them?
+ */
+static int sparse_dir_overlaps(struct index_state *istate,
+			       const char *name, int len, int prefix_only)
+{
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+		int cmplen = ce_namelen(ce);
+
+		if (!S_ISSPARSEDIR(ce->ce_mode))
+			continue;
+		if (len < cmplen) {
+			if (!prefix_only)
+				continue;
+			cmplen = len;
+		}
+		if (!memcmp(ce->name, name, cmplen))
+			return 1;
+	}
+	return 0;
+}
+
+int pathspec_needs_full_index(struct index_state *istate,
+			      const struct pathspec *pathspec,
+			      const char *seen)
+{
+	int i;
+
+	if (!istate->sparse_index)
+		return 0;
+	for (i = 0; i < pathspec->nr; i++) {
+		const struct pathspec_item *item = &pathspec->items[i];
+
+		if (seen && seen[i])
+			continue;
+		if (sparse_dir_overlaps(istate, item->match,
+					item->nowildcard_len,
+					item->nowildcard_len < item->len))
+			return 1;
+	}
+	return 0;
+}
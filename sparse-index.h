@@ -0,0 +1,42 @@
+#ifndef SPARSE_INDEX_H
+#define SPARSE_INDEX_H
+
+struct index_state;
+struct exclude_list;
+struct pathspec;
+
+/*
+ * With index.sparse and a sparse checkout, replace the entries of each
+ * directory that is entirely outside of the sparse checkout by a single
+ * sparse directory entry naming its tree. A sparse index is expanded
+ * again if it cannot be kept sparse, e.g. because index.sparse has been
+ * turned off.
+ */
+void convert_to_sparse(struct index_state *istate);
+
+/*
+ * Replace the sparse directory entries of the index by the entries of
+ * their trees, all marked skip-worktree. Does nothing if the index is
+ * not sparse.
+ */
+void ensure_full_index(struct index_state *istate);
+
+/*
+ * Tell whether no path inside the directory "path" (without a trailing
+ * slash) can be included by the sparse checkout patterns in "el". This
+ * errs on the side of "no": a pattern that might match below the
+ * directory keeps it from being collapsed.
+ */
+int sparse_dir_outside_patterns(struct exclude_list *el,
+				const char *path, int pathlen);
+
+/*
+ * Tell whether an item of the pathspec that is not marked in "seen"
+ * may name a path hidden in one of the sparse directory entries of
+ * the index, so that the index must be expanded to find it.
+ */
+int pathspec_needs_full_index(struct index_state *istate,
+			      const struct pathspec *pathspec,
+			      const char *seen);
+
+#endif
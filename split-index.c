@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "split-index.h"
 #include "ewah/ewok.h"
+#include "mem-pool.h"
 
 struct split_index *init_split_index(struct index_state *istate)
 {
@@ -67,6 +68,28 @@ static void mark_base_index_entries(struct index_state *base)
 		base->cache[i]->index = i + 1;
 }
 
+/*
+ * Entries that were added to istate while it was split are allocated
+ * from the pool of the base index, and entries of istate may have been
+ * moved to the base when it was written out. Hand the pool of the base
+ * over to istate before throwing the base away, without looking at its
+ * entries.
+ */
+static void discard_base_index(struct index_state *istate,
+			       struct split_index *si)
+{
+	struct index_state *base = si->base;
+
+	if (base->ce_mem_pool) {
+		mem_pool_init(&istate->ce_mem_pool, 0);
+		mem_pool_combine(istate->ce_mem_pool, base->ce_mem_pool);
+	}
+	base->cache_nr = 0;
+	discard_index(base);
+	free(base);
+	si->base = NULL;
+}
+
 void move_cache_to_base_index(struct index_state *istate)
 {
 	struct split_index *si = istate->split_index;
@@ -80,10 +103,8 @@ void move_cache_to_base_index(struct index_state *istate)
 	assert(si->refcount <= 1);
 
 	unshare_split_index(istate, 0);
-	if (si->base) {
-		discard_index(si->base);
-		free(si->base);
-	}
+	if (si->base)
+		discard_base_index(istate, si);
 	si->base = xcalloc(1, sizeof(*si->base));
 	si->base->version = istate->version;
 	/* zero timestamp disables racy test in ce_write_index() */
@@ -94,6 +115,10 @@ void move_cache_to_base_index(struct index_state *istate)
 	mark_base_index_entries(si->base);
 	for (i = 0; i < si->base->cache_nr; i++)
 		si->base->cache[i]->ce_flags &= ~CE_UPDATE_IN_BASE;
+
+	/* the entries now belong to the base index, and so does their pool */
+	si->base->ce_mem_pool = istate->ce_mem_pool;
+	istate->ce_mem_pool = NULL;
 }
 
 static void mark_entry_for_delete(size_t pos, void *data)
@@ -130,7 +155,7 @@ static void replace_entry(size_t pos, void *data)
 	src->ce_flags |= CE_UPDATE_IN_BASE;
 	src->ce_namelen = dst->ce_namelen;
 	copy_cache_entry(dst, src);
-	free(src);
+	discard_cache_entry(src);
 	si->nr_replacements++;
 }
 
@@ -232,7 +257,7 @@ void prepare_to_write_split_index(struct index_state *istate)
 			base->ce_flags = base_flags;
 			if (ret)
 				ce->ce_flags |= CE_UPDATE_IN_BASE;
-			free(base);
+			discard_cache_entry(base);
 			si->base->cache[ce->index - 1] = ce;
 		}
 		for (i = 0; i < si->base->cache_nr; i++) {
@@ -301,7 +326,7 @@ void unshare_split_index(struct index_state *istate, int discard)
 
 		if (!discard) {
 			int len = ce_namelen(ce);
-			new = xcalloc(1, cache_entry_size(len));
+			new = make_empty_cache_entry(istate, len);
 			copy_cache_entry(new, ce);
 			memcpy(new->name, ce->name, len);
 			new->index = 0;
@@ -321,10 +346,8 @@ void discard_split_index(struct index_state *istate)
 	si->refcount--;
 	if (si->refcount)
 		return;
-	if (si->base) {
-		discard_index(si->base);
-		free(si->base);
-	}
+	if (si->base)
+		discard_base_index(istate, si);
 	free(si);
 }
 
@@ -337,7 +360,7 @@ void save_or_free_index_entry(struct index_state *istate, struct cache_entry *ce
 	    ce == istate->split_index->base->cache[ce->index - 1])
 		ce->ce_flags |= CE_REMOVE;
 	else
-		free(ce);
+		discard_cache_entry(ce);
 }
 
 void replace_index_entry_in_base(struct index_state *istate,
@@ -350,7 +373,7 @@ void replace_index_entry_in_base(struct index_state *istate,
 	    old->index <= istate->split_index->base->cache_nr) {
 		new->index = old->index;
 		if (old != istate->split_index->base->cache[new->index - 1])
-			free(istate->split_index->base->cache[new->index - 1]);
+			discard_cache_entry(istate->split_index->base->cache[new->index - 1]);
 		istate->split_index->base->cache[new->index - 1] = new;
 	}
 }
@@ -0,0 +1,85 @@
+#include "cache.h"
+#include "commit.h"
+#include "bloom.h"
+
+static struct bloom_filter_settings settings = DEFAULT_BLOOM_FILTER_SETTINGS;
+
+static void print_bloom_filter(struct bloom_filter *filter)
+{
+	size_t i;
+
+	printf("Filter_Length:%d\n", (int)filter->len);
+	printf("Filter_Data:");
+	for (i = 0; i < filter->len; i++)
+		printf("%02x|", filter->data[i]);
+	printf("\n");
+}
+
+static const char *usage_msg =
+	"test-bloom get_murmur3 <string>\n"
+	"test-bloom generate_filter <path>...\n"
+	"test-bloom get_filter_for_commit <commit>\n"
+	"test-bloom maybe_changed <commit> <path>";
+
+int cmd_main(int argc, const char **argv)
+{
+	if (argc < 2)
+		usage(usage_msg);
+
+	if (!strcmp(argv[1], "get_murmur3")) {
+		if (argc != 3)
+			usage(usage_msg);
+		printf("Murmur3 Hash with seed=0:0x%08x\n",
+		       murmur3_seeded(0, argv[2], strlen(argv[2])));
+	} else if (!strcmp(argv[1], "generate_filter")) {
+		struct bloom_filter filter;
+		int i;
+
+		if (argc < 3)
+			usage(usage_msg);
+		filter.len = ((argc - 2) * settings.bits_per_entry +
+			      BITS_PER_WORD - 1) / BITS_PER_WORD;
+		filter.data = xcalloc(filter.len, 1);
+		for (i = 2; i < argc; i++) {
+			struct bloom_key key;
+			fill_bloom_key(argv[i], strlen(argv[i]), &key, &settings);
+			add_key_to_filter(&key, &filter, &settings);
+			clear_bloom_key(&key);
+		}
+		print_bloom_filter(&filter);
+		free(filter.data);
+	} else if (!strcmp(argv[1], "get_filter_for_commit")) {
+		struct object_id oid;
+		struct commit *c;
+		struct bloom_filter filter;
+
+		if (argc != 3)
+			usage(usage_msg);
+		setup_git_directory();
+		if (get_oid(argv[2], &oid))
+			die("cannot parse commit '%s'", argv[2]);
+		c = lookup_commit_reference(&oid);
+		if (!c)
+			die("'%s' is not a commit", argv[2]);
+		compute_bloom_filter(c, &filter, &settings);
+		print_bloom_filter(&filter);
+		free(filter.data);
+	} else if (!strcmp(argv[1], "maybe_changed")) {
+		struct object_id oid;
+		struct commit *c;
+
+		if (argc != 4)
+			usage(usage_msg);
+		setup_git_directory();
+		git_config(git_default_config, NULL);
+		if (get_oid(argv[2], &oid))
+			die("cannot parse commit '%s'", argv[2]);
+		c = lookup_commit_reference(&oid);
+		if (!c)
+			die("'%s' is not a commit", argv[2]);
+		printf("%d\n", bloom_filter_maybe_changed(c, argv[3]));
+	} else
+		usage(usage_msg);
+
+	return 0;
+}
@@ -0,0 +1,26 @@
+#include "cache.h"
+#include "ewah/ewok.h"
+
+int cmd_main(int ac, const char **av)
+{
+	struct index_state *istate = &the_index;
+	struct bitmap *dirty;
+	int i;
+
+	setup_git_directory();
+	if (do_read_index(istate, get_index_file(), 0) < 0)
+		die("unable to read index file");
+	if (!istate->fsmonitor_last_update) {
+		printf("no fsmonitor\n");
+		return 0;
+	}
+	printf("fsmonitor last update %"PRIuMAX"\n",
+	       (uintmax_t)istate->fsmonitor_last_update);
+
+	dirty = ewah_to_bitmap(istate->fsmonitor_dirty);
+	for (i = 0; i < istate->cache_nr; i++)
+		printf("%c %s\n", bitmap_get(dirty, i) ? '-' : '+',
+		       istate->cache[i]->name);
+	bitmap_free(dirty);
+	return 0;
+}
@@ -0,0 +1,19 @@
+#include "cache.h"
+
+int cmd_main(int ac, const char **av)
+{
+	struct index_state *istate = &the_index;
+	int i;
+
+	setup_git_directory();
+	if (do_read_index(istate, get_index_file(), 0) < 0)
+		die("unable to read index file");
+	printf("%s index\n", istate->sparse_index ? "sparse" : "full");
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		printf("%06o %s %s\n", ce->ce_mode, oid_to_hex(&ce->oid),
+		       ce->name);
+	}
+	return 0;
+}
@@ -14,6 +14,30 @@ test_perf 'rev-list --all --objects' '
 	git rev-list --all --objects >/dev/null
 '
 
+test_expect_success 'write commit-graph' '
+	git commit-graph write --reachable
+'
+
+test_perf 'rev-list --all with commit-graph' '
+	git -c core.commitGraph=true rev-list --all >/dev/null
+'
+
+test_perf 'log --graph --all with commit-graph' '
+	git -c core.commitGraph=true log --graph --all --format=%H >/dev/null
+'
+
+test_perf 'log --graph --all' '
+	git log --graph --all --format=%H >/dev/null
+'
+
+test_perf 'log --graph --all -10 with commit-graph' '
+	git -c core.commitGraph=true log --graph --all --format=%H -10 >/dev/null
+'
+
+test_perf 'log --graph --all -10' '
+	git log --graph --all --format=%H -10 >/dev/null
+'
+
 test_expect_success 'create new unreferenced commit' '
 	commit=$(git commit-tree HEAD^{tree} -p HEAD) &&
 	test_export commit
@@ -11,4 +11,18 @@ test_perf "read_cache/discard_cache $count times" "
 	test-read-cache $count
 "
 
+# Rewrite the index so that it records the offsets that threaded
+# reading needs, then read it with an increasing number of threads.
+test_expect_success 'write index with an entry offset table' '
+	rm -f .git/index &&
+	GIT_TEST_INDEX_THREADS=8 git reset -q
+'
+
+for threads in 1 2 4 8
+do
+	test_perf "read_cache/discard_cache $count times (index.threads=$threads)" "
+		GIT_TEST_INDEX_THREADS=$threads test-read-cache $count
+	"
+done
+
 test_done
@@ -46,4 +46,19 @@ test_perf "read-tree status br_ballast ($nr_files)" '
 	git status
 '
 
+test_expect_success "write the cache-tree" '
+	git write-tree
+'
+
+test_perf "status -uno, index matching HEAD" '
+	git status -uno
+'
+
+for threads in 1 2 8
+do
+	test_perf "status -uall, $threads untracked threads" "
+		git -c core.untrackedThreads=$threads status -uall
+	"
+done
+
 test_done
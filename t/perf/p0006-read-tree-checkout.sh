@@ -64,4 +64,15 @@ test_perf "switch between aliases ($nr_files)" '
 	git checkout -q br_ballast
 '
 
+# The switches above only write out the files that differ; these
+# write them all, sequentially and then with parallel checkout.
+for workers in 1 2 8
+do
+	test_perf "checkout of all files with $workers workers ($nr_files)" "
+		git ls-files -z | xargs -0 rm -f &&
+		git -c checkout.workers=$workers \\
+		    -c checkout.thresholdForParallelism=0 checkout -f -q HEAD
+	"
+done
+
 test_done
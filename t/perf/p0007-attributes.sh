@@ -0,0 +1,33 @@
+#!/bin/sh
+
+test_description='performance of looking up attributes for many paths
+
+The generated .gitattributes mixes the kinds of patterns that are
+looked up differently: literal basenames, "*.ext" patterns, and
+patterns with a leading directory.
+'
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup long .gitattributes' '
+	for i in $(test_seq 1 2000)
+	do
+		echo "*.ext$i text" &&
+		echo "name-$i -diff" &&
+		echo "/generated/dir-$i/* binary" || return 1
+	done >.git/info/attributes &&
+	git ls-files >paths
+'
+
+test_perf 'check-attr --all for every path' '
+	git check-attr --stdin --all <paths >/dev/null
+'
+
+test_perf 'archive' '
+	git archive HEAD >/dev/null
+'
+
+test_done
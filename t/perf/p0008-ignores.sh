@@ -0,0 +1,38 @@
+#!/bin/sh
+
+test_description='performance of matching paths against a long .gitignore
+
+The generated .gitignore mixes the kinds of patterns that are looked up
+differently: literal basenames, literal paths, paths with a literal
+leading directory, and basename globs.
+'
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup long .gitignore' '
+	for i in $(test_seq 1 5000)
+	do
+		echo "generated-$i" &&
+		echo "/out/gen-$i/build" &&
+		echo "/out/gen-$i/*.tmp" || return 1
+	done >.git/info/exclude &&
+	echo "*.generated" >>.git/info/exclude &&
+	mkdir -p untracked &&
+	for i in $(test_seq 1 1000)
+	do
+		>untracked/file-$i || return 1
+	done
+'
+
+test_perf 'status --ignored' '
+	git status --ignored
+'
+
+test_perf 'ls-files -o' '
+	git ls-files -o
+'
+
+test_done
@@ -0,0 +1,77 @@
+#!/bin/sh
+
+test_description='performance of the files and reftable ref backends
+
+Create the same large set of references in a repository of each ref
+format, then compare iterating over them, looking up single refs, and
+updating and deleting refs one transaction at a time.
+'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+# Number of refs to create, and number of single-ref updates to time.
+NR_REFS=${NR_REFS:-50000}
+NR_UPDATES=${NR_UPDATES:-200}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	for format in files reftable
+	do
+		GIT_DEFAULT_REF_FORMAT=$format git clone -q . $format || return 1
+	done &&
+	commit=$(git rev-parse HEAD) &&
+	test_seq $NR_REFS |
+	sed "s,.*,create refs/tags/tag-& $commit," >create &&
+	test_seq $NR_UPDATES |
+	sed "s,.*,refs/heads/branch-&," >updates &&
+	test_seq $NR_UPDATES |
+	sed "s,.*,refs/tags/tag-&," >deletes &&
+	test_seq $NR_UPDATES |
+	sed "s,.*,create refs/tags/tag-& $commit," >recreate &&
+	for format in files reftable
+	do
+		git -C $format update-ref --stdin <create &&
+		git -C $format pack-refs --all || return 1
+	done
+'
+
+for format in files reftable
+do
+	test_perf "for-each-ref ($format)" "
+		git -C $format for-each-ref >/dev/null
+	"
+
+	test_perf "for-each-ref prefix ($format)" "
+		git -C $format for-each-ref refs/heads/ >/dev/null
+	"
+
+	test_perf "rev-parse single ref ($format)" "
+		for i in \$(test_seq 50)
+		do
+			git -C $format rev-parse --verify -q refs/tags/tag-$((NR_REFS / 2)) \
+				>/dev/null || return 1
+		done
+	"
+
+	test_perf "update-ref one at a time ($format)" "
+		while read ref
+		do
+			git -C $format update-ref \$ref HEAD || return 1
+		done <updates &&
+		git -C $format for-each-ref --format='delete %(refname)' \
+			refs/heads/branch-* >delete &&
+		git -C $format update-ref --stdin <delete
+	"
+
+	test_perf "delete packed refs one at a time ($format)" "
+		while read ref
+		do
+			git -C $format update-ref -d \$ref || return 1
+		done <deletes &&
+		git -C $format update-ref --stdin <recreate &&
+		git -C $format pack-refs --all
+	"
+done
+
+test_done
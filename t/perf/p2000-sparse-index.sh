@@ -0,0 +1,40 @@
+#!/bin/sh
+
+test_description="Tests performance of commands with a sparse index"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'setup sparse checkouts with full and sparse index' '
+	dir=$(git ls-tree -d --name-only HEAD | head -n 1) &&
+	test -n "$dir" &&
+	cat >sparse-checkout <<-EOF &&
+	/*
+	!/*/
+	/$dir/
+	EOF
+	for repo in full-index sparse-index
+	do
+		git clone -q -s --no-checkout . $repo &&
+		git -C $repo config core.sparseCheckout true &&
+		cp sparse-checkout $repo/.git/info/sparse-checkout &&
+		git -C $repo read-tree -mu HEAD || return 1
+	done &&
+	git -C sparse-index config index.sparse true &&
+	git -C sparse-index read-tree -mu HEAD
+'
+
+test_perf_on_all () {
+	for repo in full-index sparse-index
+	do
+		test_perf "$* ($repo)" "git -C $repo $*"
+	done
+}
+
+test_perf_on_all status
+test_perf_on_all add -A
+test_perf_on_all commit -q --allow-empty -m empty
+test_perf_on_all checkout -q -f HEAD
+
+test_done
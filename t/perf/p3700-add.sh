@@ -0,0 +1,46 @@
+#!/bin/sh
+
+test_description='performance of adding many changed files'
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup' '
+	cp .git/index index.orig &&
+	git ls-files -s | grep "^100" | cut -f2 >paths &&
+	while read path
+	do
+		echo >>"$path" || return 1
+	done <paths
+'
+
+for threads in 1 2 8
+do
+	test_perf "add -u, $threads threads" "
+		cp index.orig .git/index &&
+		git -c core.hashThreads=$threads add -u
+	"
+
+	test_perf "hash-object --stdin-paths, $threads threads" "
+		git -c core.hashThreads=$threads hash-object --stdin-paths <paths >/dev/null
+	"
+done
+
+for bulk in false true
+do
+	test_perf "add 1000 new files with fsync, core.bulkCheckin=$bulk" "
+		run=\$((\$(cat run 2>/dev/null || echo 0) + 1)) &&
+		echo \$run >run &&
+		mkdir new-\$run &&
+		for i in \$(test_seq 1 1000)
+		do
+			echo \$run \$i >new-\$run/\$i || return 1
+		done &&
+		git -c core.fsyncObjectFiles=true -c core.bulkCheckin=$bulk \
+			add new-\$run
+	"
+done
+
+test_done
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description='Tests looking up objects by their position in a pack'
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'repack' '
+	git repack -ad &&
+	PACK=$(ls .git/objects/pack/*.pack | head -n1) &&
+	test -f "$PACK" &&
+	git rev-parse HEAD:$(git ls-tree --name-only HEAD | head -n1) >object &&
+	export PACK
+'
+
+test_perf 'disk size of one object, in-memory reverse index' '
+	git cat-file --batch-check="%(objectsize:disk)" <object
+'
+
+test_expect_success 'write the reverse index' '
+	git index-pack --rev-index $PACK
+'
+
+test_perf 'disk size of one object, on-disk reverse index' '
+	git cat-file --batch-check="%(objectsize:disk)" <object
+'
+
+test_done
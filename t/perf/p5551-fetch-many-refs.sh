@@ -0,0 +1,33 @@
+#!/bin/sh
+
+test_description='performance of fetching many new refs
+
+Fetch a large number of tags into an empty repository, storing each ref
+in its own transaction, or all of them in one transaction with
+fetch.batchRefUpdates.
+'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+NR_REFS=${NR_REFS:-5000}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	test_seq $NR_REFS |
+	sed "s,.*,create refs/tags/tag-& HEAD," |
+	git update-ref --stdin &&
+	git pack-refs --all
+'
+
+for batch in false true
+do
+	test_perf "fetch $NR_REFS tags (batchRefUpdates=$batch)" "
+		rm -rf dst &&
+		git init -q --bare dst &&
+		git -C dst -c fetch.batchRefUpdates=$batch \
+			fetch -q .. 'refs/tags/*:refs/tags/*'
+	"
+done
+
+test_done
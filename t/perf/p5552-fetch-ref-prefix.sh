@@ -0,0 +1,53 @@
+#!/bin/sh
+
+test_description='performance of fetching one branch from a server with many refs
+
+The server has a large number of refs outside of refs/heads and
+refs/tags, like the refs/pull/* refs of a hosting site. Fetch a single
+branch over the file:// and ext:: transports, with and without telling
+the server which refs we want with fetch.refPrefixes, and report the
+size of the ref advertisement in each case.
+'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+NR_REFS=${NR_REFS:-50000}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	test_seq $NR_REFS |
+	sed "s,.*,create refs/pull/&/head HEAD," |
+	git update-ref --stdin &&
+	git pack-refs --all &&
+	git init -q --bare dst &&
+	git -C dst config protocol.ext.allow always
+'
+
+for transport in file ext
+do
+	case $transport in
+	file)
+		url="file://$(pwd)" ;;
+	ext)
+		url="ext::git %s .." ;;
+	esac
+
+	for prefixes in false true
+	do
+		test_expect_success "advertised bytes ($transport, refPrefixes=$prefixes)" "
+			GIT_TRACE_PACKET=\"\$(pwd)/trace\" git -C dst \
+				-c fetch.refPrefixes=$prefixes \
+				fetch -q --no-tags '$url' master &&
+			say \"\$(grep 'fetch< ' trace | wc -c) bytes\" &&
+			rm trace
+		"
+
+		test_perf "fetch one branch ($transport, refPrefixes=$prefixes)" "
+			git -C dst -c fetch.refPrefixes=$prefixes \
+				fetch -q --no-tags '$url' master
+		"
+	done
+done
+
+test_done
@@ -0,0 +1,136 @@
+#!/bin/sh
+
+test_description='performance of reachability queries with a commit-graph
+
+Build a deep synthetic history: a single mainline with a tag on every
+100th commit, and topic branches forking off it, most of which are
+merged back a little later.  Then compare merge-base, tag --contains
+and branch --merged with and without the generation numbers stored in
+the commit-graph file.
+'
+. ./perf-lib.sh
+
+# make a history of $1 mainline commits on master; every 500th commit
+# starts a topic branch of 5 commits, merged back 250 commits later
+create_history () {
+	perl -le '
+		my ($n) = @ARGV;
+		my %topic;
+		for my $i (1..$n) {
+			my $date = 1000000000 + 60 * $i;
+			if (exists $topic{$i}) {
+				print "commit refs/heads/master";
+				print "mark :$i";
+				print "committer nobody <nobody\@example.com> $date +0000";
+				print "data 6";
+				print "merge";
+				print "merge :$topic{$i}";
+			} else {
+				print "commit refs/heads/master";
+				print "mark :$i";
+				print "committer nobody <nobody\@example.com> $date +0000";
+				print "data 4";
+				print "foo";
+				print "M 100644 inline file";
+				print "data <<EOF";
+				print "$i";
+				print "EOF";
+			}
+			if ($i % 100 == 0) {
+				print "reset refs/tags/v$i";
+				print "from :$i";
+			}
+			if ($i % 500 == 0) {
+				my $from = $i;
+				for my $j (1..5) {
+					my $mark = 1000000 + 10 * $i + $j;
+					print "commit refs/heads/topic/$i";
+					print "mark :$mark";
+					print "committer nobody <nobody\@example.com> $date +0000";
+					print "data 4";
+					print "bar";
+					print "from :$from";
+					print "M 100644 inline topic-$i";
+					print "data <<EOF";
+					print "$j";
+					print "EOF";
+					$from = $mark;
+				}
+				$topic{$i + 250} = $from;
+			}
+		}
+	' "$@" |
+	git fast-import --date-format=raw
+}
+
+test_expect_success 'create history' '
+	git init repo &&
+	(
+		cd repo &&
+		create_history 20000 &&
+		git repack -adq &&
+		old=$(git rev-parse master~15000) &&
+		side=$(echo side | git commit-tree -p $old master~15000^{tree}) &&
+		git branch side $side
+	)
+'
+
+test_perf 'merge-base (no commit-graph)' '
+	git -C repo merge-base --all master topic/1000 >/dev/null
+'
+
+test_perf 'merge-base --is-ancestor, negative (no commit-graph)' '
+	test_must_fail git -C repo merge-base --is-ancestor master topic/19500
+'
+
+test_perf 'tag --contains (no commit-graph)' '
+	git -C repo tag --contains master~10000 >/dev/null
+'
+
+test_perf 'tag --contains, negative (no commit-graph)' '
+	git -C repo tag --contains side >/dev/null
+'
+
+test_perf 'branch --contains (no commit-graph)' '
+	git -C repo branch --contains master~10000 >/dev/null
+'
+
+test_perf 'branch --merged (no commit-graph)' '
+	git -C repo branch --merged master~1000 >/dev/null
+'
+
+test_expect_success 'write commit-graph' '
+	git -C repo commit-graph write --reachable
+'
+
+test_perf 'merge-base (commit-graph)' '
+	git -C repo -c core.commitGraph=true \
+		merge-base --all master topic/1000 >/dev/null
+'
+
+test_perf 'merge-base --is-ancestor, negative (commit-graph)' '
+	test_must_fail git -C repo -c core.commitGraph=true \
+		merge-base --is-ancestor master topic/19500
+'
+
+test_perf 'tag --contains (commit-graph)' '
+	git -C repo -c core.commitGraph=true \
+		tag --contains master~10000 >/dev/null
+'
+
+test_perf 'tag --contains, negative (commit-graph)' '
+	git -C repo -c core.commitGraph=true \
+		tag --contains side >/dev/null
+'
+
+test_perf 'branch --contains (commit-graph)' '
+	git -C repo -c core.commitGraph=true \
+		branch --contains master~10000 >/dev/null
+'
+
+test_perf 'branch --merged (commit-graph)' '
+	git -C repo -c core.commitGraph=true \
+		branch --merged master~1000 >/dev/null
+'
+
+test_done
@@ -32,4 +32,11 @@ test_perf 'ls-files -o' '
 	git ls-files -o
 '
 
+for threads in 1 2 8
+do
+	test_perf "clean many untracked sub dirs, $threads threads" "
+		git -c core.untrackedThreads=$threads clean -n -q -f -f -d
+	"
+done
+
 test_done
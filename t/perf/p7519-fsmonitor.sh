@@ -0,0 +1,39 @@
+#!/bin/sh
+
+test_description='performance of git status with a file system monitor hook
+
+The hook used here reports nothing, as a real file system monitor
+would for a work tree that has not changed since the last command; it
+shows how much of the cost of "git status" is the lstat(2) of tracked
+files and the readdir(3) of directories that the hook lets us skip.
+'
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup' '
+	write_script .git/fsmonitor-empty <<-\EOF &&
+	exit 0
+	EOF
+	git config core.untrackedCache true &&
+	git status
+'
+
+test_perf 'status (untracked cache)' '
+	git status
+'
+
+# Adding the extension marks every entry dirty; let one status record
+# which of them are clean before timing.
+test_expect_success 'enable fsmonitor' '
+	git config core.fsmonitor .git/fsmonitor-empty &&
+	git status
+'
+
+test_perf 'status (untracked cache, fsmonitor)' '
+	git status
+'
+
+test_done
@@ -269,6 +269,52 @@ EOF
 	test_line_count = 0 err
 '
 
+test_expect_success 'each kind of pattern, many paths at once' '
+	mkdir -p kinds/sub/deep &&
+	echo "[attr]mytest test=macro" >.gitattributes &&
+	cat >kinds/.gitattributes <<-\EOF &&
+	*.c test=c
+	Makefile test=make
+	*.gz test=gz
+	*.tar.gz test=tgz
+	doc/*.c test=doc-c
+	/top.c test=top
+	x*.h test=glob
+	sub/Makefile mytest
+	EOF
+	echo "*.c test=deep" >kinds/sub/deep/.gitattributes &&
+	cat >expect <<-\EOF &&
+	kinds/a.c: test: c
+	kinds/doc/a.c: test: doc-c
+	kinds/x/doc/a.c: test: c
+	kinds/top.c: test: top
+	kinds/x/top.c: test: c
+	kinds/sub/deep/a.c: test: deep
+	kinds/sub/a.c: test: c
+	kinds/sub/deep/more/a.c: test: deep
+	kinds/Makefile: test: make
+	kinds/sub/Makefile: test: macro
+	kinds/x/sub/Makefile: test: make
+	kinds/a.gz: test: gz
+	kinds/a.tar.gz: test: tgz
+	kinds/x1.h: test: glob
+	kinds/d/x1.h: test: glob
+	kinds/y.h: test: unspecified
+	kinds/c: test: unspecified
+	EOF
+	sed -e "s/:.*//" <expect | git check-attr --stdin test >actual &&
+	test_cmp expect actual &&
+	cat >expect <<-\EOF &&
+	kinds/A.C: test: c
+	kinds/DOC/a.c: test: doc-c
+	kinds/MAKEFILE: test: make
+	kinds/A.TAR.GZ: test: tgz
+	EOF
+	sed -e "s/:.*//" <expect |
+	git -c core.ignorecase=true check-attr --stdin test >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'using --git-dir and --work-tree' '
 	mkdir unreal real &&
 	git init real &&
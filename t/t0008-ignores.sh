@@ -841,4 +841,65 @@ test_expect_success 'info/exclude trumps core.excludesfile' '
 	test_cmp expect actual
 '
 
+############################################################################
+#
+# test long exclude lists, which are matched through an index
+
+test_expect_success 'setup long exclude list' '
+	mkdir -p long/build long/x &&
+	>long/x/build &&
+	for i in $(test_seq 1 20)
+	do
+		echo "unused-$i" || return 1
+	done >long/.gitignore &&
+	cat >>long/.gitignore <<-\EOF
+	*.o
+	!keep.o
+	build/
+	/top-only
+	doc/api-*.html
+	!doc/api-keep.html
+	Makefile
+	sub/Makefile
+	!sub/deep/Makefile
+	**/gen
+	EOF
+'
+
+test_expect_success 'last match wins in long exclude list' '
+	cat >expect <<-\EOF &&
+	long/.gitignore:21:*.o	long/a.o
+	long/.gitignore:22:!keep.o	long/keep.o
+	long/.gitignore:22:!keep.o	long/x/keep.o
+	long/.gitignore:23:build/	long/build
+	::	long/x/build
+	long/.gitignore:24:/top-only	long/top-only
+	::	long/x/top-only
+	long/.gitignore:25:doc/api-*.html	long/doc/api-foo.html
+	long/.gitignore:26:!doc/api-keep.html	long/doc/api-keep.html
+	::	long/x/doc/api-foo.html
+	long/.gitignore:27:Makefile	long/Makefile
+	long/.gitignore:28:sub/Makefile	long/sub/Makefile
+	long/.gitignore:29:!sub/deep/Makefile	long/sub/deep/Makefile
+	long/.gitignore:27:Makefile	long/x/sub/Makefile
+	long/.gitignore:30:**/gen	long/a/b/gen
+	long/.gitignore:7:unused-7	long/x/unused-7
+	::	long/x/UNUSED-7
+	EOF
+	sed -e "s/.*	//" expect >paths &&
+	git check-ignore -v -n --stdin <paths >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'long exclude list with core.ignorecase' '
+	cat >expect <<-\EOF &&
+	long/.gitignore:7:unused-7	long/x/UNUSED-7
+	long/.gitignore:28:sub/Makefile	long/SUB/makefile
+	long/.gitignore:25:doc/api-*.html	long/DOC/api-foo.html
+	EOF
+	sed -e "s/.*	//" expect >paths &&
+	git -c core.ignorecase=true check-ignore -v -n --stdin <paths >actual &&
+	test_cmp expect actual
+'
+
 test_done
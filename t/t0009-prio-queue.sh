@@ -47,4 +47,17 @@ test_expect_success 'notice empty queue' '
 	test_cmp expect actual
 '
 
+cat >expect <<'EOF'
+NULL
+1
+1
+2
+2
+NULL
+EOF
+test_expect_success 'peek does not remove' '
+	test-prio-queue peek 2 1 peek get peek get get >actual &&
+	test_cmp expect actual
+'
+
 test_done
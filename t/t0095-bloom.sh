@@ -0,0 +1,102 @@
+#!/bin/sh
+
+test_description='changed-path Bloom filters'
+. ./test-lib.sh
+
+test_expect_success 'compute unseeded murmur3 hash for empty string' '
+	cat >expect <<-\EOF &&
+	Murmur3 Hash with seed=0:0x00000000
+	EOF
+	test-bloom get_murmur3 "" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'compute unseeded murmur3 hash for test string 1' '
+	cat >expect <<-\EOF &&
+	Murmur3 Hash with seed=0:0x627b0c2c
+	EOF
+	test-bloom get_murmur3 "Hello world!" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'compute unseeded murmur3 hash for test string 2' '
+	cat >expect <<-\EOF &&
+	Murmur3 Hash with seed=0:0x2e4ff723
+	EOF
+	test-bloom get_murmur3 "The quick brown fox jumps over the lazy dog" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'compute bloom key for empty string' '
+	cat >expect <<-\EOF &&
+	Filter_Length:2
+	Filter_Data:11|11|
+	EOF
+	test-bloom generate_filter "" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'create a filter with several paths' '
+	cat >expect <<-\EOF &&
+	Filter_Length:4
+	Filter_Data:55|67|f4|8e|
+	EOF
+	test-bloom generate_filter file.c dir dir/file.c >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'setup history' '
+	mkdir -p dir/sub &&
+	echo one >dir/sub/file &&
+	echo one >top &&
+	git add dir top &&
+	git commit -m one &&
+	echo two >top &&
+	git commit -a -m two &&
+	echo three >dir/sub/file &&
+	git commit -a -m three &&
+	git commit --allow-empty -m empty
+'
+
+test_expect_success 'filter of a root commit covers all of its paths' '
+	test-bloom generate_filter top dir dir/sub dir/sub/file >expect &&
+	test-bloom get_filter_for_commit HEAD~3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'filter covers changed paths and their directories' '
+	test-bloom generate_filter dir dir/sub dir/sub/file >expect &&
+	test-bloom get_filter_for_commit HEAD~1 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'filter of an empty commit is empty but present' '
+	cat >expect <<-\EOF &&
+	Filter_Length:1
+	Filter_Data:00|
+	EOF
+	test-bloom get_filter_for_commit HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'filters are read from the commit-graph' '
+	git config core.commitGraph true &&
+	git commit-graph write --reachable --changed-paths &&
+	echo 1 >expect &&
+	test-bloom maybe_changed HEAD~1 dir/sub/file >actual &&
+	test_cmp expect actual &&
+	echo 0 >expect &&
+	test-bloom maybe_changed HEAD~2 dir/sub/file >actual &&
+	test_cmp expect actual &&
+	test-bloom maybe_changed HEAD top >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'filters are not used without core.commitGraph' '
+	git config core.commitGraph false &&
+	echo 1 >expect &&
+	test-bloom maybe_changed HEAD~2 dir/sub/file >actual &&
+	test_cmp expect actual
+'
+
+test_done
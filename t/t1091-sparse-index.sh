@@ -0,0 +1,153 @@
+#!/bin/sh
+
+test_description='sparse index
+
+With index.sparse, the directories that are outside of the sparse
+checkout are kept in the index as a single entry for their tree.
+Compare the commands run in such a repository with the same commands
+run in a sparse checkout with a full index.'
+
+. ./test-lib.sh
+
+# a split index is never sparse
+sane_unset GIT_TEST_SPLIT_INDEX
+
+test_expect_success 'setup' '
+	mkdir -p deep/deeper folder1/sub folder2 &&
+	for f in a deep/a deep/deeper/a folder1/a folder1/sub/a folder2/a
+	do
+		echo "$f" >$f || return 1
+	done &&
+	git add . &&
+	git commit -m initial &&
+
+	git checkout -b inside &&
+	echo changed >>deep/a &&
+	git commit -a -m inside &&
+
+	git checkout -b outside master &&
+	echo changed >>folder1/a &&
+	echo new >folder2/b &&
+	git add folder2/b &&
+	git commit -a -m outside &&
+	git checkout master &&
+
+	cat >sparse-checkout <<-\EOF &&
+	/*
+	!/*/
+	/deep/
+	EOF
+	for repo in full-index sparse-index
+	do
+		git clone -q . $repo &&
+		git -C $repo config core.sparseCheckout true &&
+		cp sparse-checkout $repo/.git/info/sparse-checkout &&
+		git -C $repo read-tree -mu HEAD || return 1
+	done &&
+	git -C sparse-index config index.sparse true &&
+	git -C sparse-index read-tree -mu HEAD
+'
+
+test_all_match () {
+	(cd full-index && "$@" >../full-actual 2>../full-err) &&
+	(cd sparse-index && "$@" >../sparse-actual 2>../sparse-err) &&
+	test_cmp full-actual sparse-actual &&
+	test_cmp full-err sparse-err
+}
+
+test_expect_success 'directories outside of the sparse checkout are collapsed' '
+	(cd sparse-index && test-dump-sparse-index) >actual &&
+	grep "^sparse index" actual &&
+	grep "^040000 $(git rev-parse HEAD:folder1) folder1/\$" actual &&
+	grep "^040000 $(git rev-parse HEAD:folder2) folder2/\$" actual &&
+	grep " deep/deeper/a\$" actual &&
+	! grep " folder1/a\$" actual &&
+	(cd full-index && test-dump-sparse-index) >actual &&
+	grep "^full index" actual
+'
+
+test_expect_success 'commands that need a full index expand it' '
+	test_all_match git ls-files -s -t &&
+	test_all_match git diff-index --cached HEAD -- folder1 &&
+	test_all_match git write-tree
+'
+
+test_expect_success 'status, add and commit inside the sparse checkout' '
+	test_all_match git status --porcelain=v2 &&
+	for repo in full-index sparse-index
+	do
+		echo more >>$repo/deep/deeper/a &&
+		echo new >$repo/deep/new || return 1
+	done &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git add deep &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git commit -q -m more &&
+	test_all_match git rev-parse HEAD^{tree} &&
+	(cd sparse-index && test-dump-sparse-index) >actual &&
+	grep "^sparse index" actual
+'
+
+test_expect_success 'add of a path hidden in a sparse directory' '
+	test_all_match git add --refresh folder1/a &&
+	test_all_match git ls-files -t folder1
+'
+
+test_expect_success 'checkout keeps the index sparse' '
+	test_all_match git checkout -q inside &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git checkout -q outside &&
+	test_all_match git ls-files -s -t &&
+	test_all_match git status --porcelain=v2 &&
+	test_path_is_missing sparse-index/folder1 &&
+	(cd sparse-index && test-dump-sparse-index) >actual &&
+	grep "^sparse index" actual &&
+	grep "^040000 $(git rev-parse outside:folder2) folder2/\$" actual &&
+	test_all_match git checkout -q master
+'
+
+test_expect_success 'sparse-aware commands do not expand the index' '
+	(
+		GIT_TRACE_PERFORMANCE="$(pwd)/trace" &&
+		export GIT_TRACE_PERFORMANCE &&
+		test_all_match git status --porcelain=v2 &&
+		echo more >>full-index/deep/a &&
+		echo more >>sparse-index/deep/a &&
+		test_all_match git add deep/a &&
+		test_all_match git commit -q -m "no expansion" &&
+		test_all_match git checkout -q inside &&
+		test_all_match git checkout -q master
+	) &&
+	grep "git command:.*checkout" trace &&
+	! grep "expand sparse index" trace
+'
+
+test_expect_success 'checkout of paths inside a sparse directory' '
+	test_all_match git checkout outside -- folder2 &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git ls-files -s -t &&
+	test_all_match git reset -q HEAD -- folder2 &&
+	rm -r full-index/folder2 sparse-index/folder2 &&
+	test_all_match git status --porcelain=v2
+'
+
+test_expect_success 'index.sparse=false expands the index when it is written' '
+	(cd sparse-index && test-dump-sparse-index) >actual &&
+	grep "^sparse index" actual &&
+	git -C sparse-index config index.sparse false &&
+	git -C sparse-index read-tree -mu HEAD &&
+	(cd sparse-index && test-dump-sparse-index) >actual &&
+	grep "^full index" actual &&
+	git -C sparse-index config index.sparse true &&
+	git -C sparse-index read-tree -mu HEAD
+'
+
+test_expect_success 'a split index is never sparse' '
+	test_when_finished "git -C sparse-index update-index --no-split-index" &&
+	git -C sparse-index update-index --split-index &&
+	(cd sparse-index && test-dump-sparse-index) >actual &&
+	grep "^full index" actual &&
+	test_all_match git status --porcelain=v2
+'
+
+test_done
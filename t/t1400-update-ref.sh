@@ -1277,6 +1277,34 @@ test_expect_success ULIMIT_FILE_DESCRIPTORS 'large transaction deleting branches
 )
 '
 
+test_expect_success 'large transaction stores refs in packed-refs' '
+	git update-ref refs/heads/packed-victim HEAD &&
+	git pack-refs --all &&
+	git update-ref refs/heads/loose-one HEAD &&
+	other=$(git commit-tree -m other HEAD^{tree}) &&
+	for i in $(test_seq 150)
+	do
+		echo "create refs/heads/many/$i HEAD" || return 1
+	done >large_input &&
+	echo "delete refs/heads/packed-victim" >>large_input &&
+	echo "update refs/heads/loose-one $other" >>large_input &&
+	git update-ref --stdin <large_input &&
+	test_path_is_missing .git/refs/heads/many &&
+	grep "refs/heads/many/150$" .git/packed-refs &&
+	git rev-parse --verify -q refs/heads/many/150 &&
+	test_must_fail git rev-parse --verify -q refs/heads/packed-victim &&
+	! grep packed-victim .git/packed-refs &&
+	test_path_is_file .git/refs/heads/loose-one &&
+	echo $other >expect &&
+	git rev-parse refs/heads/loose-one >actual &&
+	test_cmp expect actual &&
+	sed "s/^create \([^ ]*\).*/delete \1/" large_input |
+	grep "^delete refs/heads/many/" >delete_input &&
+	git update-ref --stdin <delete_input &&
+	! grep refs/heads/many/ .git/packed-refs &&
+	git update-ref -d refs/heads/loose-one
+'
+
 test_expect_success 'handle per-worktree refs in refs/bisect' '
 	git commit --allow-empty -m "initial commit" &&
 	git worktree add -b branch worktree &&
@@ -0,0 +1,259 @@
+#!/bin/sh
+
+test_description='reftable reference backend'
+
+. ./test-lib.sh
+
+RUN="test-ref-store main"
+
+table_count () {
+	wc -l <"${1:-.git}/reftable/tables.list"
+}
+
+test_expect_success 'init --ref-format=reftable' '
+	git init --ref-format=reftable repo &&
+	test "$(git -C repo config core.repositoryformatversion)" = 1 &&
+	test "$(git -C repo config extensions.refStorage)" = reftable &&
+	test_path_is_file repo/.git/reftable/tables.list &&
+	test_path_is_missing repo/.git/refs/heads/master &&
+	echo refs/heads/master >expect &&
+	git -C repo symbolic-ref HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unknown ref format is rejected' '
+	test_must_fail git init --ref-format=bogus bogus &&
+	test_path_is_missing bogus/.git/config &&
+	git init bogus2 &&
+	git -C bogus2 config core.repositoryformatversion 1 &&
+	git -C bogus2 config extensions.refStorage bogus &&
+	test_must_fail git -C bogus2 rev-parse HEAD 2>err &&
+	test_i18ngrep "unknown ref storage format" err
+'
+
+test_expect_success 'reinit keeps the ref format' '
+	git init repo &&
+	test "$(git -C repo config extensions.refStorage)" = reftable &&
+	test_must_fail git init --ref-format=files repo
+'
+
+test_expect_success 'GIT_DEFAULT_REF_FORMAT is honored by init and clone' '
+	GIT_DEFAULT_REF_FORMAT=reftable git init env &&
+	test "$(git -C env config extensions.refStorage)" = reftable &&
+	git init --ref-format=files env-files &&
+	test_path_is_dir env-files/.git/refs/heads &&
+	test_path_is_missing env-files/.git/reftable
+'
+
+test_expect_success 'setup' '
+	cd repo &&
+	test_commit one &&
+	test_commit two &&
+	git tag -a -m annotated annotated one
+'
+
+test_expect_success 'refs are read back' '
+	git rev-parse two >expect &&
+	git rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	cat >expect <<-EOF &&
+	$(git rev-parse two) refs/heads/master
+	$(git rev-parse annotated) refs/tags/annotated
+	$(git rev-parse one) refs/tags/annotated^{}
+	$(git rev-parse one) refs/tags/one
+	$(git rev-parse two) refs/tags/two
+	EOF
+	git show-ref -d >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'peeled values survive compaction' '
+	git pack-refs --all &&
+	test "$(table_count)" = 1 &&
+	git rev-parse one >expect &&
+	$RUN peel-ref refs/tags/annotated >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'update-ref with old value' '
+	test_must_fail git update-ref refs/heads/master HEAD HEAD~1 &&
+	git update-ref refs/heads/master HEAD~1 HEAD &&
+	git rev-parse one >expect &&
+	git rev-parse master >actual &&
+	test_cmp expect actual &&
+	git update-ref refs/heads/master two
+'
+
+test_expect_success 'transactions are atomic' '
+	before=$(table_count) &&
+	cat >stdin <<-EOF &&
+	create refs/heads/new $(git rev-parse one)
+	update refs/heads/master $(git rev-parse one) $(git rev-parse one)
+	EOF
+	test_must_fail git update-ref --stdin <stdin &&
+	test_must_fail git rev-parse --verify -q refs/heads/new &&
+	test "$(table_count)" = "$before"
+'
+
+test_expect_success 'deleting refs' '
+	git branch to-delete &&
+	git tag to-delete-tag &&
+	git update-ref -d refs/heads/to-delete &&
+	test_must_fail git rev-parse --verify -q refs/heads/to-delete &&
+	test_must_fail git reflog exists refs/heads/to-delete &&
+	$RUN delete-refs 0 msg refs/tags/to-delete-tag &&
+	test_must_fail git rev-parse --verify -q refs/tags/to-delete-tag
+'
+
+test_expect_success 'symbolic refs' '
+	git symbolic-ref refs/heads/sym refs/heads/master &&
+	echo refs/heads/master >expect &&
+	git symbolic-ref refs/heads/sym >actual &&
+	test_cmp expect actual &&
+	git for-each-ref --format="%(refname):%(symref)" refs/heads/ >actual &&
+	cat >expect <<-\EOF &&
+	refs/heads/master:
+	refs/heads/sym:refs/heads/master
+	EOF
+	test_cmp expect actual &&
+	git update-ref --no-deref -d refs/heads/sym &&
+	git rev-parse --verify refs/heads/master &&
+	test_must_fail git symbolic-ref refs/heads/sym
+'
+
+test_expect_success 'dangling symrefs are not shown' '
+	git symbolic-ref refs/heads/dangling refs/heads/nowhere &&
+	git for-each-ref refs/heads/ >actual &&
+	! grep dangling actual &&
+	git update-ref --no-deref -d refs/heads/dangling
+'
+
+test_expect_success 'D/F conflicts are detected' '
+	git branch df &&
+	test_must_fail git branch df/sub &&
+	test_must_fail git update-ref refs/heads/master/sub HEAD &&
+	git branch -d df &&
+	git branch df/sub &&
+	test_must_fail git branch df &&
+	git branch -d df/sub
+'
+
+test_expect_success 'reflogs' '
+	git reflog show master >actual &&
+	test_line_count = 4 actual &&
+	git branch -m master renamed &&
+	git reflog show renamed >actual &&
+	test_line_count = 5 actual &&
+	head -n 1 actual | grep "renamed refs/heads/master to refs/heads/renamed" &&
+	test_must_fail git reflog exists refs/heads/master &&
+	git symbolic-ref HEAD >actual &&
+	echo refs/heads/renamed >expect &&
+	test_cmp expect actual &&
+	git branch -m renamed master
+'
+
+test_expect_success 'reflog entries' '
+	$RUN for-each-reflog-ent refs/heads/master >actual &&
+	head -n 1 actual | grep "commit (initial): one" &&
+	$RUN for-each-reflog-ent-reverse refs/heads/master >actual &&
+	head -n 1 actual | grep "renamed refs/heads/renamed to refs/heads/master" &&
+	$RUN for-each-reflog | cut -c 42- | sort >actual &&
+	cat >expect <<-\EOF &&
+	HEAD 0x1
+	refs/heads/master 0x0
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'reflog expire' '
+	git reflog expire --expire=all refs/heads/master &&
+	git reflog exists refs/heads/master &&
+	git reflog show refs/heads/master >actual &&
+	test_must_be_empty actual &&
+	git rev-parse --verify master
+'
+
+test_expect_success 'create and delete reflogs' '
+	git update-ref refs/tags/unlogged HEAD &&
+	test_must_fail git reflog exists refs/tags/unlogged &&
+	git update-ref --create-reflog refs/tags/logged HEAD &&
+	git reflog exists refs/tags/logged &&
+	$RUN delete-reflog refs/tags/logged &&
+	test_must_fail git reflog exists refs/tags/logged &&
+	$RUN create-reflog refs/tags/logged 1 &&
+	git reflog exists refs/tags/logged
+'
+
+test_expect_success 'stack is compacted automatically' '
+	for i in $(test_seq 100)
+	do
+		echo "create refs/heads/branch-$i HEAD" |
+		git update-ref --stdin || return 1
+	done &&
+	test "$(table_count)" -le 7 &&
+	git for-each-ref refs/heads/branch-* >actual &&
+	test_line_count = 100 actual &&
+	git pack-refs &&
+	test "$(table_count)" = 1 &&
+	ls .git/reftable >actual &&
+	test_line_count = 2 actual
+'
+
+test_expect_success 'many refs in one table' '
+	for i in $(test_seq 2000)
+	do
+		echo "create refs/tags/many-$i HEAD" || return 1
+	done >stdin &&
+	git update-ref --stdin <stdin &&
+	git for-each-ref refs/tags/many-* >actual &&
+	test_line_count = 2000 actual &&
+	git rev-parse --verify refs/tags/many-1234 &&
+	test_must_fail git rev-parse --verify -q refs/tags/many-2001
+'
+
+test_expect_success 'locked stack' '
+	>.git/reftable/tables.list.lock &&
+	test_must_fail git update-ref refs/heads/locked HEAD &&
+	rm .git/reftable/tables.list.lock &&
+	git update-ref refs/heads/locked HEAD
+'
+
+test_expect_success 'pseudorefs' '
+	git update-ref ORIG_HEAD HEAD~1 &&
+	git rev-parse HEAD~1 >expect &&
+	git rev-parse ORIG_HEAD >actual &&
+	test_cmp expect actual &&
+	echo "update ORIG_HEAD HEAD" | git update-ref --stdin &&
+	git rev-parse HEAD >expect &&
+	git rev-parse ORIG_HEAD >actual &&
+	test_cmp expect actual &&
+	git update-ref -d ORIG_HEAD &&
+	test_must_fail git rev-parse --verify -q ORIG_HEAD
+'
+
+test_expect_success 'worktrees have their own HEAD' '
+	git worktree add ../wt -b wt-branch one &&
+	echo refs/heads/wt-branch >expect &&
+	git -C ../wt symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/master >expect &&
+	git symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	(
+		cd ../wt &&
+		test_commit three
+	) &&
+	git rev-parse wt-branch >expect &&
+	git -C ../wt rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	test-ref-store worktree:wt resolve-ref HEAD 0 >actual &&
+	grep "refs/heads/wt-branch" actual
+'
+
+test_expect_success 'gc keeps the stack small' '
+	git gc &&
+	git fsck &&
+	test "$(table_count)" -le 7
+'
+
+test_done
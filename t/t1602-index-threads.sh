@@ -0,0 +1,127 @@
+#!/bin/sh
+
+test_description='reading the index with multiple threads'
+
+. ./test-lib.sh
+
+# The tests below choose when to use threads, and look for extensions
+# that a split index would only write to the shared index
+sane_unset GIT_TEST_INDEX_THREADS
+sane_unset GIT_TEST_SPLIT_INDEX
+
+# Does the index have an extension with the given signature?
+index_has_ext () {
+	perl -e '
+		local $/;
+		my $index = <STDIN>;
+		exit(index($index, $ARGV[0]) < 0);
+	' "$1" <.git/index
+}
+
+# Check that the index reads the same with and without threads;
+# index.threads is set to false in the repository, which is overridden
+# by GIT_TEST_INDEX_THREADS.
+check_threaded_read () {
+	git ls-files --stage --debug >expect &&
+	GIT_TEST_INDEX_THREADS=4 git ls-files --stage --debug >actual &&
+	test_cmp expect actual &&
+	test-dump-cache-tree >expect &&
+	GIT_TEST_INDEX_THREADS=4 test-dump-cache-tree >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	for dir in one two three
+	do
+		mkdir $dir &&
+		for i in $(test_seq 20)
+		do
+			echo "$dir $i" >$dir/file-$i || return 1
+		done
+	done &&
+	git add . &&
+	git commit -m initial &&
+	git config index.threads false &&
+	cat >.git/info/exclude <<-\EOF
+	expect
+	actual
+	err
+	EOF
+'
+
+test_expect_success 'index.threads=false writes no offset table' '
+	git update-index --index-version 4 &&
+	git update-index --index-version 2 &&
+	! index_has_ext EOIE &&
+	! index_has_ext IEOT &&
+	check_threaded_read
+'
+
+for version in 2 3 4
+do
+	test_expect_success "threaded read of index version $version" '
+		rm -f .git/index &&
+		GIT_INDEX_VERSION=$version GIT_TEST_INDEX_THREADS=4 git reset &&
+		if test $version = 3
+		then
+			: >intent &&
+			GIT_TEST_INDEX_THREADS=4 git add -N intent
+		fi &&
+		test "$(test-index-version <.git/index)" = $version &&
+		index_has_ext EOIE &&
+		index_has_ext IEOT &&
+		check_threaded_read &&
+		git rm --cached -q --ignore-unmatch intent &&
+		rm -f intent
+	'
+done
+
+test_expect_success 'two threads only split off the extensions' '
+	GIT_TEST_INDEX_THREADS=2 git update-index --index-version 4 &&
+	GIT_TEST_INDEX_THREADS=2 git update-index --index-version 2 &&
+	index_has_ext EOIE &&
+	! index_has_ext IEOT &&
+	check_threaded_read
+'
+
+test_expect_success 'index written with threads is read by a serial reader' '
+	rm -f .git/index &&
+	GIT_INDEX_VERSION=4 GIT_TEST_INDEX_THREADS=3 git reset &&
+	index_has_ext IEOT &&
+	git status --porcelain >actual 2>err &&
+	test_must_be_empty actual &&
+	test_must_be_empty err
+'
+
+test_expect_success 'resolve-undo and conflicts survive a threaded read' '
+	git reset --hard &&
+	git checkout -b side &&
+	echo side >one/file-1 &&
+	git commit -a -m side &&
+	git checkout master &&
+	echo master >one/file-1 &&
+	git commit -a -m master &&
+	test_must_fail git merge side &&
+	GIT_TEST_INDEX_THREADS=4 git update-index --index-version 4 &&
+	check_threaded_read &&
+	echo resolved >one/file-1 &&
+	GIT_TEST_INDEX_THREADS=4 git add one/file-1 &&
+	index_has_ext REUC &&
+	check_threaded_read &&
+	GIT_TEST_INDEX_THREADS=4 git checkout -m one/file-1 &&
+	GIT_TEST_INDEX_THREADS=4 git ls-files -u >actual &&
+	test_line_count = 3 actual
+'
+
+test_expect_success 'split index with threads' '
+	git reset --hard &&
+	GIT_TEST_INDEX_THREADS=4 git update-index --split-index &&
+	echo changed >two/file-2 &&
+	GIT_TEST_INDEX_THREADS=4 git add two/file-2 &&
+	check_threaded_read &&
+	GIT_TEST_INDEX_THREADS=4 git status --porcelain >actual &&
+	echo "M  two/file-2" >expect &&
+	test_cmp expect actual
+'
+
+test_done
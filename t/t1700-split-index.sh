@@ -7,6 +7,9 @@ test_description='split index mode tests'
 # We need total control of index splitting here
 sane_unset GIT_TEST_SPLIT_INDEX
 
+# The hashes of the index files below depend on its extensions
+sane_unset GIT_TEST_INDEX_THREADS
+
 test_expect_success 'enable split index' '
 	git config splitIndex.maxPercentChange 100 &&
 	git update-index --split-index &&
@@ -370,4 +373,25 @@ test_expect_success 'check splitIndex.sharedIndexExpire set to "never" and "now"
 	test $(ls .git/sharedindex.* | wc -l) -le 2
 '
 
+test_expect_success 'entries of a split index come from the pools of the index' '
+	(
+		GIT_TEST_VALIDATE_INDEX_CACHE_ENTRIES=1 &&
+		export GIT_TEST_VALIDATE_INDEX_CACHE_ENTRIES &&
+		git update-index --split-index &&
+		git add . &&
+		git commit -q -m "pooled entries" &&
+		echo changed >one &&
+		git commit -q -a -m "pooled entries, changed" &&
+		git read-tree -m HEAD^ HEAD &&
+		git reset --hard &&
+		git checkout HEAD^ -- one &&
+		git reset --hard HEAD^ &&
+		git config core.splitIndex false &&
+		git update-index --no-split-index &&
+		git checkout -q -b pooled HEAD@{1} &&
+		git status &&
+		git diff --exit-code HEAD
+	)
+'
+
 test_done
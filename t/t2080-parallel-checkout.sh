@@ -0,0 +1,148 @@
+#!/bin/sh
+
+test_description='parallel checkout
+
+Check that writing the files out with checkout workers gives the same
+working tree and index as writing them out sequentially.
+'
+
+. ./test-lib.sh
+
+# Run a checkout-like command in the "sequential" repository, then
+# with two workers and no threshold in the "parallel" one, and check
+# that both give the same working tree.
+test_checkout_matches () {
+	(
+		cd sequential &&
+		git -c checkout.workers=1 "$@"
+	) &&
+	(
+		cd parallel &&
+		GIT_TRACE="$TRASH_DIRECTORY/trace" \
+		git -c checkout.workers=2 \
+		    -c checkout.thresholdForParallelism=0 "$@"
+	) &&
+	grep "checkout--worker" trace >/dev/null &&
+	rm -f trace &&
+	for repo in sequential parallel
+	do
+		(
+			cd $repo &&
+			git diff-files --quiet &&
+			find . -path ./.git -prune -o -type f -print |
+			sort | xargs cat >../$repo.content
+		) || return 1
+	done &&
+	test_cmp sequential.content parallel.content
+}
+
+test_expect_success 'setup' '
+	for i in 1 2 3 4 5 6 7 8
+	do
+		mkdir -p dir$i/sub &&
+		echo "file $i" >dir$i/file &&
+		printf "one\ntwo\n" >dir$i/sub/text &&
+		echo "\$Id\$" >dir$i/sub/ident || return 1
+	done &&
+	echo "#!/bin/sh" >exec &&
+	chmod +x exec &&
+	cat >.gitattributes <<-\EOF &&
+	*/sub/text eol=crlf
+	*/sub/ident ident
+	EOF
+	git add . &&
+	git commit -m initial &&
+	git checkout -b other &&
+	for i in 1 3 5 7
+	do
+		echo "changed $i" >dir$i/file &&
+		printf "three\nfour\n" >dir$i/sub/text || return 1
+	done &&
+	git rm -r dir8 &&
+	git commit -a -m other &&
+	git checkout master &&
+	git clone -b master . sequential &&
+	git clone -b master . parallel
+'
+
+test_expect_success 'switching branches' '
+	test_checkout_matches checkout other &&
+	test_checkout_matches checkout master
+'
+
+test_expect_success 'checking out paths' '
+	rm -r sequential/dir2 parallel/dir2 &&
+	test_checkout_matches checkout -- dir2 &&
+	test_checkout_matches checkout other -- dir3
+'
+
+test_expect_success 'conversions are applied by the workers' '
+	printf "one\r\ntwo\r\n" >expect &&
+	test_cmp expect parallel/dir2/sub/text &&
+	(
+		cd parallel &&
+		printf "\$Id: %s \$\n" $(git rev-parse HEAD:dir2/sub/ident)
+	) >expect &&
+	test_cmp expect parallel/dir2/sub/ident
+'
+
+test_expect_success POSIXPERM 'executable bit is kept' '
+	test -x parallel/exec
+'
+
+test_expect_success 'few entries are written without workers' '
+	(
+		cd parallel &&
+		rm dir1/file &&
+		GIT_TRACE="$TRASH_DIRECTORY/trace" \
+		git -c checkout.workers=2 checkout -- dir1/file &&
+		test_path_is_file dir1/file
+	) &&
+	! grep "checkout--worker" trace
+'
+
+test_expect_success 'entries with a filter driver are written sequentially' '
+	write_script rot13.sh <<-\EOF &&
+	tr "a-z" "n-za-m"
+	EOF
+	(
+		cd parallel &&
+		git config filter.rot13.smudge "\"$TRASH_DIRECTORY/rot13.sh\"" &&
+		echo "dir4/file filter=rot13" >.git/info/attributes &&
+		rm -r dir4 dir5 &&
+		git -c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+			checkout -- dir4 dir5 &&
+		echo "svyr 4" >expect &&
+		test_cmp expect dir4/file &&
+		echo "file 5" >expect &&
+		test_cmp expect dir5/file
+	)
+'
+
+test_expect_success 'clone with workers' '
+	git -c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+		clone -b other . cloned &&
+	(
+		cd cloned &&
+		git diff-files --quiet &&
+		test_path_is_missing dir8
+	)
+'
+
+test_expect_success CASE_INSENSITIVE_FS 'colliding paths are written sequentially' '
+	git init colliding &&
+	(
+		cd colliding &&
+		echo lower >file &&
+		git add file &&
+		blob=$(echo upper | git hash-object -w --stdin) &&
+		git update-index --add --cacheinfo 100644,$blob,FILE &&
+		git commit -m collide &&
+		rm -f file FILE &&
+		git -c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+			checkout -f HEAD 2>err &&
+		test_must_be_empty err
+	)
+'
+
+test_done
@@ -211,4 +211,55 @@ test_expect_success 'retry acquiring packed-refs.lock' '
 	git -c core.packedrefstimeout=3000 pack-refs --all --prune
 '
 
+test_expect_success 'packed-refs is written sorted' '
+	git pack-refs --all --prune &&
+	head -n 1 .git/packed-refs >header &&
+	grep " sorted " header
+'
+
+test_expect_success 'look up and list refs in a sorted packed-refs' '
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		echo "create refs/heads/many/$i HEAD" &&
+		echo "create refs/heads/many-$i HEAD" &&
+		echo "create refs/tags/many/$i HEAD" || return 1
+	done | git update-ref --stdin &&
+	git tag -a -m annotated many-annotated &&
+	git pack-refs --all --prune &&
+	for i in 1 10 2 3 4 5 6 7 8 9
+	do
+		echo refs/heads/many/$i || return 1
+	done >expect &&
+	git for-each-ref --format="%(refname)" refs/heads/many/ >actual &&
+	test_cmp expect actual &&
+	git rev-parse --verify refs/heads/many/7 &&
+	git rev-parse --verify many-10 &&
+	test_must_fail git rev-parse --verify refs/heads/many/11 &&
+	test_must_fail git rev-parse --verify refs/heads/many &&
+	echo "$(git rev-parse HEAD) refs/tags/many-annotated^{}" >expect &&
+	git show-ref -d many-annotated | grep "\^{}" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'packed-refs without the sorted trait may be unsorted' '
+	git init unsorted &&
+	(
+		cd unsorted &&
+		test_commit one &&
+		oid=$(git rev-parse HEAD) &&
+		git pack-refs --all --prune &&
+		{
+			echo "# pack-refs with: peeled fully-peeled " &&
+			echo "$oid refs/tags/zzz" &&
+			echo "$oid refs/heads/master" &&
+			echo "$oid refs/heads/aaa"
+		} >.git/packed-refs &&
+		git rev-parse --verify refs/heads/aaa &&
+		git rev-parse --verify refs/tags/zzz &&
+		printf "refs/heads/aaa\nrefs/heads/master\nrefs/tags/zzz\n" >expect &&
+		git for-each-ref --format="%(refname)" >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -403,4 +403,35 @@ test_expect_success 'all statuses changed in folder if . is given' '
 	test $(git ls-files --stage | grep ^100755 | wc -l) -eq 0
 '
 
+test_expect_success 'core.bulkCheckin writes the new objects to one pack' '
+	git init bulk &&
+	(
+		cd bulk &&
+		for i in $(test_seq 1 30)
+		do
+			echo $i >file$i || return 1
+		done &&
+		echo 1 >same-as-file1 &&
+		git -c core.bulkCheckin=true add . &&
+		git count-objects -v >../counts &&
+		grep "^count: 0" ../counts &&
+		grep "^in-pack: 30" ../counts &&
+		grep "^packs: 1" ../counts &&
+		git fsck &&
+		echo changed >file1 &&
+		echo new >new &&
+		GIT_TEST_HASH_THREADS=4 git -c core.bulkCheckin=true add -A &&
+		echo changed again >file1 &&
+		echo file1 | git -c core.bulkCheckin=true update-index --stdin &&
+		git count-objects -v >../counts &&
+		grep "^count: 0" ../counts &&
+		grep "^in-pack: 33" ../counts &&
+		grep "^packs: 3" ../counts &&
+		echo changed again >expect &&
+		git cat-file blob :file1 >actual &&
+		test_cmp expect actual &&
+		git fsck
+	)
+'
+
 test_done
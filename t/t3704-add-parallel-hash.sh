@@ -0,0 +1,109 @@
+#!/bin/sh
+
+test_description='hash the files to add with several threads
+
+Check that adding files with several threads records the same blobs
+as adding them with a single one, including the files that the threads
+have to leave to the main thread.
+'
+
+. ./test-lib.sh
+
+sane_unset GIT_TEST_HASH_THREADS
+
+# Run a command in a fresh copy of "template" with one thread, then in
+# another with four, and check that both leave the same index and give
+# the same output.
+test_threads_match () {
+	rm -rf serial threaded &&
+	cp -R template serial &&
+	cp -R template threaded &&
+	(
+		cd serial &&
+		GIT_TEST_HASH_THREADS=1 "$@" >../serial.out &&
+		git ls-files -s >../serial.index
+	) &&
+	(
+		cd threaded &&
+		GIT_TRACE_PERFORMANCE="$TRASH_DIRECTORY/trace" \
+		GIT_TEST_HASH_THREADS=4 "$@" >../threaded.out &&
+		git ls-files -s >../threaded.index &&
+		git fsck --no-dangling
+	) &&
+	grep "with 4 threads" trace >/dev/null &&
+	rm -f trace &&
+	test_cmp serial.out threaded.out &&
+	test_cmp serial.index threaded.index
+}
+
+test_expect_success 'setup' '
+	git init template &&
+	(
+		cd template &&
+		cat >.gitattributes <<-\EOF &&
+		*.crlf text eol=crlf
+		*.id ident
+		*.rot filter=rot13
+		EOF
+		git config filter.rot13.clean "tr a-zA-Z n-za-mN-ZA-M" &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p dir$i &&
+			echo tracked $i >dir$i/tracked &&
+			echo "\$Id: $i\$" >dir$i/file.id &&
+			printf "line\r\n" >dir$i/file.crlf &&
+			echo secret $i >dir$i/file.rot || return 1
+		done &&
+		git add . &&
+		git commit -m initial &&
+		for i in $(test_seq 1 20)
+		do
+			echo changed $i >>dir$i/tracked &&
+			echo new $i >dir$i/new || return 1
+		done &&
+		echo more >>dir1/file.rot &&
+		ln -s tracked dir2/link &&
+		mkdir -p dir3/empty
+	)
+'
+
+test_expect_success 'add' '
+	test_threads_match git add -A &&
+	test_threads_match git add -u &&
+	test_threads_match git add dir1 dir2/new dir3
+'
+
+test_expect_success 'add leaves files with a filter driver alone' '
+	git -C threaded show :dir1/file.rot >actual &&
+	test_write_lines "frperg 1" "zber" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'commit -a' '
+	test_threads_match git commit -q -a -m changes
+'
+
+test_expect_success 'update-index --stdin' '
+	test_threads_match sh -c "git ls-files -o >../paths &&
+		git update-index --add --stdin <../paths" &&
+	test_threads_match sh -c "git ls-files -m -z >../paths &&
+		git update-index -z --stdin <../paths"
+'
+
+test_expect_success 'hash-object' '
+	test_threads_match sh -c "git ls-files >../paths &&
+		git hash-object -w --stdin-paths <../paths" &&
+	test_threads_match sh -c "git ls-files >../paths &&
+		git hash-object --stdin-paths --no-filters <../paths" &&
+	test_threads_match sh -c "git hash-object dir*/tracked" &&
+	test_threads_match sh -c "git hash-object --path=x.crlf dir*/tracked"
+'
+
+test_expect_success 'single thread when configured' '
+	test_seq 1 20 >>threaded/dir5/new &&
+	GIT_TRACE_PERFORMANCE="$TRASH_DIRECTORY/trace" \
+	git -C threaded -c core.hashThreads=1 add -A &&
+	! grep "hashed [0-9]* files" trace
+'
+
+test_done
@@ -0,0 +1,134 @@
+#!/bin/sh
+
+test_description='git log for a path with changed-path Bloom filters'
+. ./test-lib.sh
+
+test_expect_success 'setup test - repo, commits, commit-graph, log outputs' '
+	mkdir A A/B A/B/C &&
+	test_commit c1 A/file1 &&
+	test_commit c2 A/B/file2 &&
+	test_commit c3 A/B/C/file3 &&
+	test_commit c4 A/file1 &&
+	test_commit c5 A/B/file2 &&
+	test_commit c6 A/B/C/file3 &&
+	test_commit c7 A/file1 &&
+	test_commit c8 A/B/file2 &&
+	test_commit c9 A/B/C/file3 &&
+	git checkout -b side HEAD~4 &&
+	test_commit side1 A/file4 &&
+	test_commit side2 A/B/file6 &&
+	git checkout master &&
+	git merge -m merge side &&
+	test_commit c10 file_to_be_deleted &&
+	git rm file_to_be_deleted &&
+	git commit -m "delete file" &&
+	test_commit c11 A/file_or_dir &&
+	git rm A/file_or_dir &&
+	mkdir A/file_or_dir &&
+	test_commit c12 A/file_or_dir/file5 &&
+	git mv A/file1 A/renamed &&
+	git commit -m rename &&
+	git commit-graph write --reachable --changed-paths
+'
+
+graph_read_expect () {
+	cat >expect <<-EOF &&
+	header: 43475048 1 1 $1
+	num_commits: $2
+	chunks: oid_fanout oid_lookup commit_metadata $3
+	EOF
+	test-read-commit-graph .git/objects >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'commit-graph write wrote Bloom filters' '
+	graph_read_expect 5 $(git rev-list --all | wc -l) "bloom_indexes bloom_data"
+'
+
+test_bloom_filters_match () {
+	log_args=$1
+	git -c core.commitGraph=false log $log_args >log_wo_bloom &&
+	git -c core.commitGraph=true log $log_args >log_w_bloom &&
+	test_cmp log_wo_bloom log_w_bloom
+}
+
+for path in A A/ A/file1 A/B A/B/C A/B/C/file3 A/file4 A/file_or_dir \
+	    A/file_or_dir/file5 A/renamed file_to_be_deleted no/such/path
+do
+	for option in "" \
+		      "--full-history" \
+		      "--full-history --simplify-merges" \
+		      "--simplify-merges" \
+		      "--first-parent" \
+		      "--topo-order" \
+		      "--parents" \
+		      "--raw" \
+		      "--all" \
+		      "--reverse"
+	do
+		test_expect_success "git log $option -- $path" '
+			test_bloom_filters_match "--format=%H%x20%P $option -- $path"
+		'
+	done
+done
+
+test_expect_success 'git log with several paths' '
+	test_bloom_filters_match "--format=%H -- A/file4 A/B/C/file3" &&
+	test_bloom_filters_match "--format=%H -- A/B/C A/renamed no/such/path"
+'
+
+test_expect_success 'git log with wildcards and magic' '
+	test_bloom_filters_match "--format=%H -- A/*file*" &&
+	test_bloom_filters_match "--format=%H -- :(icase)a/file1" &&
+	test_bloom_filters_match "--format=%H -- :(exclude)A/B"
+'
+
+test_expect_success 'git log --follow' '
+	test_bloom_filters_match "--format=%H --follow -- A/renamed"
+'
+
+test_expect_success 'git log from a subdirectory' '
+	(
+		cd A/B &&
+		test_bloom_filters_match "--format=%H -- file2" &&
+		test_bloom_filters_match "--format=%H -- C"
+	)
+'
+
+test_expect_success 'git blame' '
+	git -c core.commitGraph=false blame A/B/file2 >blame_wo_bloom &&
+	git -c core.commitGraph=true blame A/B/file2 >blame_w_bloom &&
+	test_cmp blame_wo_bloom blame_w_bloom &&
+	git -c core.commitGraph=false blame A/renamed >blame_wo_bloom &&
+	git -c core.commitGraph=true blame A/renamed >blame_w_bloom &&
+	test_cmp blame_wo_bloom blame_w_bloom
+'
+
+test_expect_success 'Bloom filters are kept when appending' '
+	test_commit c13 A/B/C/file3 &&
+	git rev-parse HEAD | git commit-graph write --stdin-commits --append &&
+	graph_read_expect 5 $(git rev-list --all | wc -l) "bloom_indexes bloom_data" &&
+	test_bloom_filters_match "--format=%H -- A/B/C/file3"
+'
+
+test_expect_success 'commits outside the commit-graph are diffed' '
+	test_commit c14 A/B/C/file3 &&
+	test_bloom_filters_match "--format=%H -- A/B/C/file3"
+'
+
+test_expect_success 'Bloom filters are skipped for commits changing many paths' '
+	mkdir many &&
+	for i in $(test_seq 1 600)
+	do
+		echo $i >many/$i || return 1
+	done &&
+	git add many &&
+	git commit -m many &&
+	echo changed >A/file4 &&
+	git commit -a -m "after many" &&
+	git commit-graph write --reachable --changed-paths &&
+	test_bloom_filters_match "--format=%H -- A/file4" &&
+	test_bloom_filters_match "--format=%H -- many/10"
+'
+
+test_done
@@ -331,4 +331,33 @@ test_expect_success 'pack reuse respects --incremental' '
 	git show-index <empty.idx >actual &&
 	test_cmp expect actual
 '
+
+test_expect_success 'full repack writes a lookup table when asked to' '
+	git -c pack.writeBitmapLookupTable=true repack -adb &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	# the options: full DAG, hash cache and lookup table
+	echo " 00 15" >expect &&
+	od -An -tx1 -j6 -N2 $bitmap >actual &&
+	test_cmp expect actual &&
+	git rev-list --test-bitmap HEAD
+'
+
+test_expect_success 'bitmaps read through the lookup table give the same results' '
+	for args in "--count --all" "--count HEAD~2" "--count other ^master" \
+		    "--objects --all" "--objects other ^HEAD~3"
+	do
+		git rev-list --use-bitmap-index $args | sort >actual &&
+		GIT_TEST_READ_BITMAP_LOOKUP_TABLE=0 \
+			git rev-list --use-bitmap-index $args | sort >expect &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'full repack reuses bitmaps read through the lookup table' '
+	test_commit after-lookup-table &&
+	git -c pack.writeBitmapLookupTable=true repack -adb &&
+	git rev-list --test-bitmap HEAD~1 &&
+	git rev-list --test-bitmap HEAD
+'
+
 test_done
@@ -0,0 +1,212 @@
+#!/bin/sh
+
+test_description='commit graph'
+. ./test-lib.sh
+
+objdir=.git/objects
+
+graph_read_expect () {
+	OPTIONAL=""
+	NUM_CHUNKS=3
+	if test -n "$2"
+	then
+		OPTIONAL=" $2"
+		NUM_CHUNKS=$((3 + $(echo "$2" | wc -w)))
+	fi
+	cat >expect <<-EOF &&
+	header: 43475048 1 1 $NUM_CHUNKS
+	num_commits: $1
+	chunks: oid_fanout oid_lookup commit_metadata$OPTIONAL
+	EOF
+	test-read-commit-graph $objdir >actual &&
+	test_cmp expect actual
+}
+
+graph_git_two_modes () {
+	git -c core.commitGraph=true $1 >output &&
+	git -c core.commitGraph=false $1 >expect &&
+	test_cmp expect output
+}
+
+graph_git_behavior () {
+	MSG=$1
+	BRANCH=$2
+	COMPARE=$3
+	test_expect_success "check normal git operations: $MSG" '
+		graph_git_two_modes "log --oneline $BRANCH" &&
+		graph_git_two_modes "log --topo-order $BRANCH" &&
+		graph_git_two_modes "log --graph --date-order --all" &&
+		graph_git_two_modes "log --graph $COMPARE..$BRANCH" &&
+		graph_git_two_modes "rev-list --parents --all" &&
+		graph_git_two_modes "branch -vv" &&
+		graph_git_two_modes "merge-base -a $BRANCH $COMPARE" &&
+		graph_git_two_modes "merge-base --independent $BRANCH $COMPARE" &&
+		graph_git_two_modes "tag --contains $COMPARE" &&
+		graph_git_two_modes "tag --no-contains $BRANCH" &&
+		graph_git_two_modes "branch --contains $COMPARE" &&
+		graph_git_two_modes "branch --merged $BRANCH"
+	'
+}
+
+test_expect_success 'write graph with no commits' '
+	git commit-graph write &&
+	graph_read_expect 0
+'
+
+test_expect_success 'create commits and repack' '
+	for i in 1 2 3
+	do
+		test_commit $i &&
+		git branch commits/$i || return 1
+	done &&
+	git repack
+'
+
+test_expect_success 'write graph' '
+	git commit-graph write &&
+	graph_read_expect 3
+'
+
+graph_git_behavior 'graph exists' commits/3 commits/1
+
+test_expect_success 'add more commits, including merges' '
+	git reset --hard commits/1 &&
+	for i in 4 5
+	do
+		test_commit $i &&
+		git branch commits/$i || return 1
+	done &&
+	git reset --hard commits/2 &&
+	git merge commits/4 &&
+	git branch merge/1 &&
+	git reset --hard commits/4 &&
+	git merge commits/3 &&
+	git branch merge/2 &&
+	git reset --hard commits/1 &&
+	test_commit 6 &&
+	git branch commits/6 &&
+	git reset --hard commits/3 &&
+	git merge commits/5 commits/6 &&
+	git branch merge/3
+'
+
+graph_git_behavior 'new commits are not in the graph' merge/3 commits/1
+
+test_expect_success 'write graph with merges' '
+	git commit-graph write &&
+	graph_read_expect 9 extra_edges
+'
+
+graph_git_behavior 'merges are in the graph' merge/1 merge/2
+graph_git_behavior 'octopus merge is in the graph' merge/3 merge/1
+
+test_expect_success 'write graph from stdin commits' '
+	git rev-parse commits/5 |
+	git commit-graph write --stdin-commits &&
+	graph_read_expect 3
+'
+
+graph_git_behavior 'commits outside a partial graph' merge/3 commits/5
+
+test_expect_success 'append to the graph' '
+	git rev-parse merge/1 tags/3 |
+	git commit-graph write --stdin-commits --append &&
+	graph_read_expect 6
+'
+
+graph_git_behavior 'appended graph' merge/3 merge/2
+
+test_expect_success 'dates and generations are kept' '
+	git commit-graph write --reachable &&
+	git -c core.commitGraph=true log --format="%H %ct %P" --all >output &&
+	git log --format="%H %ct %P" --all >expect &&
+	test_cmp expect output
+'
+
+test_expect_success 'reachability queries prune by generation' '
+	git -c core.commitGraph=true merge-base --is-ancestor commits/1 merge/3 &&
+	test_must_fail git -c core.commitGraph=true \
+		merge-base --is-ancestor merge/3 commits/1 &&
+	test_must_fail git -c core.commitGraph=true \
+		merge-base --is-ancestor commits/6 merge/2 &&
+	git -c core.commitGraph=true tag --contains commits/6 >output &&
+	echo 6 >expect &&
+	test_cmp expect output &&
+	graph_git_two_modes "tag --contains merge/1~2" &&
+	graph_git_two_modes "branch --contains merge/2~2"
+'
+
+test_expect_success 'grafts disable the graph' '
+	test_when_finished rm -f .git/info/grafts &&
+	echo "$(git rev-parse commits/3)" >.git/info/grafts &&
+	git -c core.commitGraph=true rev-list merge/3 >output &&
+	git rev-list merge/3 >expect &&
+	test_cmp expect output &&
+	git -c core.commitGraph=true rev-list --count commits/3 >count &&
+	echo 1 >expect &&
+	test_cmp expect count
+'
+
+test_expect_success 'replace refs disable the graph' '
+	test_when_finished git replace -d commits/3 &&
+	git replace commits/3 commits/1 &&
+	git -c core.commitGraph=true rev-list merge/3 >output &&
+	git rev-list merge/3 >expect &&
+	test_cmp expect output
+'
+
+test_expect_success 'no graph is written for a shallow clone' '
+	git clone --no-local --depth=1 . shallow &&
+	git -C shallow commit-graph write &&
+	test_path_is_missing shallow/.git/objects/info/commit-graph
+'
+
+test_expect_success 'gc writes the graph when asked' '
+	rm -f $objdir/info/commit-graph &&
+	git gc &&
+	test_path_is_missing $objdir/info/commit-graph &&
+	git -c gc.writeCommitGraph=true gc &&
+	graph_read_expect 9 extra_edges
+'
+
+test_expect_success 'fetch adds to the graph when asked' '
+	git clone . fetched &&
+	git -C fetched config fetch.writeCommitGraph true &&
+	git -C fetched commit-graph write &&
+	test_commit new &&
+	(
+		cd fetched &&
+		objdir=.git/objects &&
+		graph_read_expect 9 extra_edges &&
+		git fetch &&
+		graph_read_expect 10 extra_edges &&
+		git -c core.commitGraph=true log --graph --all >output &&
+		git log --graph --all >expect &&
+		test_cmp expect output
+	)
+'
+
+test_expect_success 'corrupt graph is ignored' '
+	test_when_finished rm -f $objdir/info/commit-graph &&
+	git commit-graph write &&
+	printf "XXXX" | dd of=$objdir/info/commit-graph \
+		bs=1 conv=notrunc 2>/dev/null &&
+	git -c core.commitGraph=true rev-list merge/3 >output 2>err &&
+	git rev-list merge/3 >expect &&
+	test_cmp expect output &&
+	test_i18ngrep "commit-graph signature" err
+'
+
+test_expect_success 'graph of an alternate is used' '
+	git commit-graph write &&
+	git clone --shared . alt-user &&
+	(
+		cd alt-user &&
+		test_commit alt &&
+		git -c core.commitGraph=true log --graph --all >output &&
+		git log --graph --all >expect &&
+		test_cmp expect output
+	)
+'
+
+test_done
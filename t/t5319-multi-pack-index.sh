@@ -0,0 +1,127 @@
+#!/bin/sh
+
+test_description='multi-pack-index'
+. ./test-lib.sh
+
+objdir=.git/objects
+
+midx_read_expect () {
+	NUM_PACKS=$1
+	NUM_OBJECTS=$2
+	{
+		cat <<-EOF &&
+		header: 4d494458 1 1 4
+		chunks: pack-names oid-fanout oid-lookup object-offsets
+		num_packs: $NUM_PACKS
+		num_objects: $NUM_OBJECTS
+		packs:
+		EOF
+		ls $objdir/pack | sed -n "/\.idx$/p"
+	} >expect &&
+	test-read-midx $objdir >actual &&
+	test_cmp expect actual
+}
+
+all_objects () {
+	git cat-file --batch-all-objects --batch-check="%(objectname) %(objecttype) %(objectsize)"
+}
+
+test_expect_success 'write midx with no packs' '
+	test_when_finished rm -f $objdir/pack/multi-pack-index &&
+	git multi-pack-index write &&
+	midx_read_expect 0 0
+'
+
+test_expect_success 'create objects in several packs' '
+	for i in 1 2 3 4 5
+	do
+		test_commit $i &&
+		git repack -d || return 1
+	done &&
+	test_path_is_missing $objdir/00 &&
+	ls $objdir/pack/*.pack >packs &&
+	test_line_count = 5 packs
+'
+
+test_expect_success 'write midx with five packs' '
+	git multi-pack-index write &&
+	all_objects >objects &&
+	midx_read_expect 5 $(wc -l <objects)
+'
+
+test_expect_success 'objects are found through the midx' '
+	all_objects >expect &&
+	cut -d" " -f1 expect >names &&
+	git -c core.multiPackIndex=true cat-file \
+		--batch-check="%(objectname) %(objecttype) %(objectsize)" \
+		<names >actual &&
+	test_cmp expect actual &&
+	git -c core.multiPackIndex=true rev-list --objects --all >actual &&
+	git rev-list --objects --all >expect &&
+	test_cmp expect actual &&
+	git -c core.multiPackIndex=true fsck
+'
+
+test_expect_success 'duplicate objects are listed once' '
+	git rev-list --objects --all | cut -d" " -f1 |
+	git pack-objects $objdir/pack/pack &&
+	git multi-pack-index write &&
+	all_objects >objects &&
+	midx_read_expect 6 $(wc -l <objects)
+'
+
+test_expect_success 'packs added after the midx are searched' '
+	test_commit 6 &&
+	git repack -d &&
+	git -c core.multiPackIndex=true cat-file -e 6:6.t &&
+	git -c core.multiPackIndex=true rev-list --objects --all >actual &&
+	git rev-list --objects --all >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'midx naming a missing pack is ignored' '
+	git repack -a -d &&
+	test_path_is_file $objdir/pack/multi-pack-index &&
+	git -c core.multiPackIndex=true rev-list --objects --all >actual &&
+	git rev-list --objects --all >expect &&
+	test_cmp expect actual &&
+	git -c core.multiPackIndex=true count-objects -v >count &&
+	grep "^garbage: 0" count
+'
+
+test_expect_success 'repack rewrites the midx' '
+	test_commit 7 &&
+	git -c core.multiPackIndex=true repack -d &&
+	all_objects >objects &&
+	midx_read_expect 2 $(wc -l <objects)
+'
+
+test_expect_success 'gc keeps the midx' '
+	git -c core.multiPackIndex=true gc &&
+	all_objects >objects &&
+	midx_read_expect 1 $(wc -l <objects) &&
+	git -c core.multiPackIndex=true fsck
+'
+
+test_expect_success 'corrupt midx is ignored' '
+	test_when_finished rm -f $objdir/pack/multi-pack-index &&
+	printf "XXXX" | dd of=$objdir/pack/multi-pack-index \
+		bs=1 conv=notrunc 2>/dev/null &&
+	git -c core.multiPackIndex=true cat-file -e HEAD:7.t 2>err &&
+	test_i18ngrep "multi-pack-index signature" err
+'
+
+test_expect_success 'write midx for an alternate' '
+	git clone --shared . alt-user &&
+	git multi-pack-index --object-dir=$objdir write &&
+	(
+		cd alt-user &&
+		test_commit alt &&
+		git repack -d &&
+		git -c core.multiPackIndex=true rev-list --objects --all >actual &&
+		git rev-list --objects --all >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_done
@@ -0,0 +1,116 @@
+#!/bin/sh
+
+test_description='on-disk reverse index'
+
+. ./test-lib.sh
+
+sane_unset GIT_TEST_WRITE_REV_INDEX
+
+packdir=.git/objects/pack
+
+# Describe every object in the packs by its size on disk, which needs
+# the reverse index to know where each object ends.
+disk_sizes () {
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objectsize:disk)" "$@"
+}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	for i in $(test_seq 1 20)
+	do
+		test_seq $i 100 >file &&
+		git add file &&
+		git commit -q -m $i || return 1
+	done &&
+	git repack -ad &&
+	pack=$(ls $packdir/pack-*.pack) &&
+	rev=${pack%.pack}.rev &&
+	test_path_is_missing $rev &&
+	disk_sizes >expect
+'
+
+test_expect_success 'index-pack --rev-index writes a reverse index' '
+	git index-pack --rev-index $pack &&
+	test_path_is_file $rev &&
+	(
+		GIT_TEST_REV_INDEX_DIE_IN_MEMORY=1 &&
+		export GIT_TEST_REV_INDEX_DIE_IN_MEMORY &&
+		disk_sizes >actual
+	) &&
+	test_cmp expect actual
+'
+
+test_expect_success 'index-pack --verify checks the reverse index' '
+	git index-pack --rev-index --verify $pack &&
+	cp $rev rev.good &&
+	chmod +w $rev &&
+	printf "\0\0\0\0" | dd of=$rev bs=1 seek=12 conv=notrunc &&
+	test_must_fail git index-pack --rev-index --verify $pack &&
+	mv rev.good $rev
+'
+
+test_expect_success 'index-pack --no-rev-index overrides the configuration' '
+	rm -f $rev &&
+	git -c pack.writeReverseIndex=true index-pack --no-rev-index $pack &&
+	test_path_is_missing $rev &&
+	git -c pack.writeReverseIndex=true index-pack $pack &&
+	test_path_is_file $rev
+'
+
+test_expect_success 'a reverse index for another pack is not used' '
+	git -c pack.writeReverseIndex=true pack-objects --all other </dev/null >name &&
+	mv $rev rev.good &&
+	cp other-$(cat name).rev $rev &&
+	disk_sizes >actual 2>err &&
+	test_i18ngrep "does not match its pack" err &&
+	test_cmp expect actual &&
+	mv rev.good $rev
+'
+
+test_expect_success 'a truncated reverse index is not used' '
+	cp $rev rev.good &&
+	chmod +w $rev &&
+	test_copy_bytes 20 <rev.good >$rev &&
+	disk_sizes >actual 2>err &&
+	test_i18ngrep "wrong size" err &&
+	test_cmp expect actual &&
+	mv rev.good $rev
+'
+
+test_expect_success 'repack writes and removes reverse indexes' '
+	test_commit more &&
+	git -c pack.writeReverseIndex=true repack -d &&
+	test_path_is_file $rev &&
+	ls $packdir/*.rev >revs &&
+	test_line_count = 2 revs &&
+	git -c pack.writeReverseIndex=true repack -ad &&
+	test_path_is_missing $rev &&
+	ls $packdir/*.pack >packs &&
+	ls $packdir/*.rev >revs &&
+	test_line_count = 1 packs &&
+	test_line_count = 1 revs &&
+	git count-objects -v >count &&
+	grep "^garbage: 0" count
+'
+
+test_expect_success 'reverse index is used for bitmaps and pack reuse' '
+	git -c pack.writeReverseIndex=true repack -adb &&
+	git rev-list --objects --all | cut -d" " -f1 | sort >objects &&
+	GIT_TEST_REV_INDEX_DIE_IN_MEMORY=1 \
+		git rev-list --objects --all --use-bitmap-index >actual.raw &&
+	cut -d" " -f1 actual.raw | sort >actual &&
+	test_cmp objects actual &&
+	GIT_TEST_REV_INDEX_DIE_IN_MEMORY=1 \
+		git pack-objects --stdout --all </dev/null >all.pack &&
+	git index-pack --stdin <all.pack
+'
+
+test_expect_success 'GIT_TEST_WRITE_REV_INDEX writes reverse indexes' '
+	test_commit last &&
+	GIT_TEST_WRITE_REV_INDEX=1 git repack -ad &&
+	ls $packdir/*.rev >revs &&
+	test_line_count = 1 revs
+'
+
+test_done
@@ -718,4 +718,42 @@ test_expect_success C_LOCALE_OUTPUT 'fetch compact output' '
 	test_cmp expect actual
 '
 
+test_expect_success 'fetch.batchRefUpdates gives the same result and output' '
+	git init batch-src &&
+	(
+		cd batch-src &&
+		test_commit base &&
+		for i in $(test_seq 150)
+		do
+			echo "create refs/tags/batch-$i HEAD" || return 1
+		done >input &&
+		git update-ref --stdin <input
+	) &&
+	git init --bare batch-one &&
+	git init --bare batch-all &&
+	git -C batch-one fetch ../batch-src "refs/*:refs/*" 2>expect &&
+	git -C batch-all -c fetch.batchRefUpdates=true \
+		fetch ../batch-src "refs/*:refs/*" 2>actual &&
+	test_cmp expect actual &&
+	git -C batch-one for-each-ref >expect &&
+	git -C batch-all for-each-ref >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing batch-all/refs/tags/batch-1 &&
+	grep refs/tags/batch-1$ batch-all/packed-refs
+'
+
+test_expect_success 'fetch.batchRefUpdates reports failed refs one by one' '
+	git -C batch-src branch good &&
+	git -C batch-src branch conflict &&
+	git clone --bare batch-src batch-df &&
+	git -C batch-df update-ref refs/remotes/origin/conflict/sub HEAD &&
+	test_must_fail git -C batch-df -c fetch.batchRefUpdates=true \
+		fetch ../batch-src "refs/heads/*:refs/remotes/origin/*" 2>err &&
+	grep "unable to update local ref" err >failed &&
+	test_line_count = 1 failed &&
+	grep "origin/conflict" failed &&
+	git -C batch-df rev-parse --verify refs/remotes/origin/good &&
+	git -C batch-df rev-parse --verify refs/remotes/origin/master
+'
+
 test_done
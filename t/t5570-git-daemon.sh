@@ -65,6 +65,15 @@ test_expect_success 'remote detects correct HEAD' '
 	)
 '
 
+test_expect_success 'fetch sends ref prefixes to the daemon' '
+	(cd clone &&
+	 GIT_TRACE_PACKET="$(pwd)/trace" git fetch --no-tags origin other &&
+	 git rev-parse --verify FETCH_HEAD &&
+	 grep "fetch< .* refs/heads/other" trace &&
+	 ! grep "fetch< .* refs/heads/master" trace
+	)
+'
+
 test_expect_success 'prepare pack objects' '
 	cp -R "$GIT_DAEMON_DOCUMENT_ROOT_PATH"/repo.git "$GIT_DAEMON_DOCUMENT_ROOT_PATH"/repo_pack.git &&
 	(cd "$GIT_DAEMON_DOCUMENT_ROOT_PATH"/repo_pack.git &&
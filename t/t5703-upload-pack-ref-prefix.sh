@@ -0,0 +1,115 @@
+#!/bin/sh
+
+test_description='upload-pack only advertises the refs the client asks for'
+
+. ./test-lib.sh
+
+advertised () {
+	sed -n "s/^.*fetch< [0-9a-f]\{40\} \([^ \\]*\).*$/\1/p" "$1"
+}
+
+test_expect_success 'setup' '
+	git init server &&
+	(
+		cd server &&
+		test_commit one &&
+		test_commit two &&
+		git tag -a -m annotated annotated one &&
+		git branch other one &&
+		git update-ref refs/pull/1/head two &&
+		git commit --allow-empty -m unrelated &&
+		git update-ref refs/pull/2/head HEAD &&
+		git reset --hard two
+	) &&
+	git init client &&
+	git -C client remote add origin "file://$(pwd)/server"
+'
+
+test_expect_success 'default refspec advertises branches and tags' '
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client fetch origin &&
+	advertised trace >actual &&
+	cat >expect <<-\EOF &&
+	refs/heads/master
+	refs/heads/other
+	refs/tags/annotated
+	refs/tags/annotated^{}
+	refs/tags/one
+	refs/tags/two
+	EOF
+	test_cmp expect actual &&
+	git -C client rev-parse --verify refs/remotes/origin/other &&
+	git -C client rev-parse --verify refs/tags/annotated
+'
+
+test_expect_success 'command-line refspec limits the advertisement' '
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client fetch --no-tags origin other &&
+	advertised trace >actual &&
+	echo refs/heads/other >expect &&
+	test_cmp expect actual &&
+	git -C server rev-parse other >expect &&
+	git -C client rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'remote without refspecs asks for HEAD' '
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -C client fetch --no-tags "file://$(pwd)/server" &&
+	advertised trace >actual &&
+	echo HEAD >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'no matching refs still advertises capabilities' '
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -C client fetch --no-tags origin "refs/none/*:refs/none/*" &&
+	grep "fetch< 0\{40\} capabilities^{}" trace &&
+	test_must_fail git -C client rev-parse --verify -q refs/none/1
+'
+
+test_expect_success 'fetch.refPrefixes=false advertises all refs' '
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -C client -c fetch.refPrefixes=false fetch --no-tags origin other &&
+	advertised trace >actual &&
+	grep refs/pull/1/head actual
+'
+
+test_expect_success 'fetching an object by name advertises all refs' '
+	want=$(git -C server rev-parse refs/pull/1/head) &&
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -C client fetch origin $want:refs/heads/copy &&
+	grep refs/pull/1/head trace &&
+	echo $want >expect &&
+	git -C client rev-parse refs/heads/copy >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unadvertised ref tips can be fetched when allowed' '
+	want=$(git -C server rev-parse refs/pull/2/head) &&
+	url="ext::env GIT_PROTOCOL=ref-prefix=refs/heads/master git %s ../server" &&
+	test_must_fail git -C client -c protocol.ext.allow=always \
+		fetch --no-tags "$url" $want &&
+	test_config -C server uploadpack.allowTipSHA1InWant true &&
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client \
+		-c protocol.ext.allow=always fetch --no-tags "$url" $want &&
+	! grep refs/pull/2/head trace &&
+	git -C client cat-file -e $want
+'
+
+test_expect_success 'ext:: remote helper passes ref prefixes' '
+	rm -f trace &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client \
+		-c protocol.ext.allow=always \
+		fetch --no-tags "ext::git %s ../server" other &&
+	advertised trace >actual &&
+	echo refs/heads/other >expect &&
+	test_cmp expect actual
+'
+
+test_done
@@ -441,6 +441,19 @@ l0
 root
 EOF
 
+test_expect_success 'incremental topo-order with a commit-graph' '
+	git commit-graph write --reachable &&
+	for args in "--topo-order l5" "--topo-order a4 l3" "--topo-order --parents a3 b3 c3" \
+		    "--date-order a4 l3" "--author-date-order a4 l3" \
+		    "--topo-order --first-parent a4 l3" "--topo-order --max-count=4 a4 l3" \
+		    "--topo-order --all"
+	do
+		git -c core.commitGraph=false rev-list $args >expect &&
+		git -c core.commitGraph=true rev-list $args >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
 #
 #
 
@@ -0,0 +1,91 @@
+#!/bin/sh
+
+test_description='look for untracked files with several threads
+
+Check that reading the working tree with several threads finds the same
+untracked and ignored files as reading it with a single one.
+'
+
+. ./test-lib.sh
+
+sane_unset GIT_TEST_UNTRACKED_THREADS
+
+# Run a command with one thread, then with four, and check that both
+# give the same output.
+test_threads_match () {
+	(
+		cd repo &&
+		GIT_TEST_UNTRACKED_THREADS=1 "$@" >../serial &&
+		GIT_TRACE_PERFORMANCE="$TRASH_DIRECTORY/trace" \
+		GIT_TEST_UNTRACKED_THREADS=4 "$@" >../threaded
+	) &&
+	grep "with 4 threads" trace >/dev/null &&
+	rm -f trace &&
+	test_cmp serial threaded
+}
+
+test_expect_success 'setup' '
+	git init repo &&
+	(
+		cd repo &&
+		for i in 1 2 3 4 5 6 7 8
+		do
+			mkdir -p dir$i/sub dir$i/new/deep &&
+			echo tracked >dir$i/tracked &&
+			echo untracked >dir$i/untracked &&
+			echo untracked >dir$i/sub/untracked &&
+			echo untracked >dir$i/new/deep/untracked &&
+			echo ignored >dir$i/sub/file.ign || return 1
+		done &&
+		mkdir -p ignored-dir &&
+		echo ignored >ignored-dir/file &&
+		echo untracked >top-untracked &&
+		cat >.gitignore <<-\EOF &&
+		*.ign
+		/ignored-dir/
+		EOF
+		echo "!file.ign" >dir3/sub/.gitignore &&
+		echo "untracked" >dir5/.gitignore &&
+		git add dir*/tracked .gitignore &&
+		git commit -m initial
+	)
+'
+
+test_expect_success 'status' '
+	test_threads_match git status --porcelain &&
+	test_threads_match git status --porcelain -uall &&
+	test_threads_match git status --porcelain --ignored &&
+	test_threads_match git status --porcelain -uall --ignored
+'
+
+test_expect_success 'per-directory exclude files are honored' '
+	git -C repo status --porcelain -uall >actual &&
+	! grep "dir5/.*untracked" actual &&
+	grep "dir3/sub/file.ign" actual
+'
+
+test_expect_success 'ls-files and clean' '
+	test_threads_match git ls-files -o &&
+	test_threads_match git ls-files -o --directory &&
+	test_threads_match git ls-files -o -i --exclude-standard &&
+	test_threads_match git clean -n -d &&
+	test_threads_match git clean -n -d -x
+'
+
+test_expect_success 'untracked cache' '
+	git -C repo config core.untrackedCache true &&
+	test_threads_match git status --porcelain -uall &&
+	echo more >repo/dir2/new/deep/more &&
+	test_threads_match git status --porcelain -uall &&
+	GIT_DISABLE_UNTRACKED_CACHE=1 git -C repo status --porcelain -uall >expect &&
+	GIT_TEST_UNTRACKED_THREADS=4 git -C repo status --porcelain -uall >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'single thread when configured' '
+	GIT_TRACE_PERFORMANCE="$TRASH_DIRECTORY/trace" \
+	git -C repo -c core.untrackedThreads=1 status --porcelain >/dev/null &&
+	! grep "with [0-9]* threads" trace
+'
+
+test_done
@@ -0,0 +1,110 @@
+#!/bin/sh
+
+test_description='status shortcuts and phases
+
+Check that status skips comparing the index with HEAD when the
+cache-tree says they match, and that looking for untracked files while
+the index is compared gives the same output as looking for them
+afterwards.
+'
+
+. ./test-lib.sh
+
+sane_unset GIT_TEST_UNTRACKED_THREADS
+
+status_trace () {
+	rm -f trace &&
+	GIT_TRACE_PERFORMANCE="$TRASH_DIRECTORY/trace" "$@"
+}
+
+test_expect_success 'setup' '
+	git init repo &&
+	(
+		cd repo &&
+		for i in 1 2 3 4
+		do
+			mkdir -p dir$i/sub &&
+			echo tracked $i >dir$i/tracked &&
+			echo tracked $i >dir$i/sub/tracked &&
+			echo untracked $i >dir$i/sub/untracked || return 1
+		done &&
+		echo "*.ign" >.gitignore &&
+		echo ignored >dir1/file.ign &&
+		git add dir*/tracked dir*/sub/tracked .gitignore &&
+		git commit -m initial
+	)
+'
+
+test_expect_success 'index matching HEAD is not diffed' '
+	status_trace git -C repo status --porcelain >actual &&
+	grep "index matches HEAD" trace &&
+	! grep "changes to be committed" trace &&
+	cat >expect <<-\EOF &&
+	?? dir1/sub/untracked
+	?? dir2/sub/untracked
+	?? dir3/sub/untracked
+	?? dir4/sub/untracked
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'staged changes are still shown' '
+	echo changed >repo/dir2/sub/tracked &&
+	git -C repo add dir2/sub/tracked &&
+	git -C repo write-tree &&
+	status_trace git -C repo status --porcelain -uno >actual &&
+	! grep "index matches HEAD" trace &&
+	grep "changes to be committed" trace &&
+	echo "M  dir2/sub/tracked" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'intent-to-add entries are still diffed' '
+	git -C repo commit -q -m changed &&
+	echo new >repo/new &&
+	git -C repo add -N new &&
+	git -C repo write-tree &&
+	status_trace git -C repo status --porcelain -uno >actual &&
+	! grep "index matches HEAD" trace &&
+	echo " A new" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'amend compares with the parent' '
+	git -C repo rm -q --cached new &&
+	git -C repo write-tree &&
+	status_trace git -C repo commit --dry-run --amend -uno >actual &&
+	! grep "index matches" trace &&
+	grep "modified: *dir2/sub/tracked" actual
+'
+
+test_expect_success 'untracked files are looked for alongside the diffs' '
+	echo changed >repo/dir3/tracked &&
+	GIT_TEST_UNTRACKED_THREADS=1 \
+		git -C repo status --porcelain --ignored -uall >expect &&
+	status_trace git -C repo status --porcelain --ignored -uall >actual &&
+	grep "untracked files in a thread" trace &&
+	test_cmp expect actual &&
+	git -C repo status >expect &&
+	GIT_TEST_UNTRACKED_THREADS=4 git -C repo status >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'single thread when configured' '
+	status_trace git -C repo -c core.untrackedThreads=1 status >/dev/null &&
+	grep "status: untracked files" trace &&
+	! grep "in a thread" trace
+'
+
+test_expect_success 'not alongside the diffs with a submodule' '
+	git init repo/sub &&
+	test_commit -C repo/sub one &&
+	git -C repo add sub &&
+	status_trace git -C repo status --porcelain >actual &&
+	grep "^A  sub" actual &&
+	# the status of the submodule itself is traced first
+	grep "status: collect" trace | tail -n 1 >collect &&
+	! grep "in a thread" collect
+'
+
+test_done
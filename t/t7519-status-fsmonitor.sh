@@ -0,0 +1,175 @@
+#!/bin/sh
+
+test_description='git status with a file system monitor hook'
+
+. ./test-lib.sh
+
+# test-dump-fsmonitor only looks at the entries of .git/index itself
+sane_unset GIT_TEST_SPLIT_INDEX
+
+# The hook reports the paths listed in .git/fsmonitor-log, which the
+# tests append to with "changed" when they touch the work tree. Paths
+# that are changed without being logged must be trusted to be clean.
+changed () {
+	for path
+	do
+		echo "$path" >>.git/fsmonitor-log || return 1
+	done
+}
+
+test_expect_success 'setup' '
+	mkdir dir1 dir2 &&
+	echo 1 >tracked &&
+	echo 1 >dir1/tracked &&
+	echo 1 >dir2/tracked &&
+	git add . &&
+	test_tick &&
+	git commit -m initial &&
+	cat >.gitignore <<-\EOF &&
+	.gitignore
+	expect*
+	actual*
+	EOF
+	write_script .git/fsmonitor-hook <<-\EOF &&
+	if test "$1" != 1
+	then
+		echo >&2 "unsupported fsmonitor hook version $1"
+		exit 1
+	fi
+	echo "$2" >>.git/fsmonitor-queries
+	test -f .git/fsmonitor-log || exit 0
+	tr "\n" "\0" <.git/fsmonitor-log
+	EOF
+	write_script .git/fsmonitor-all <<-\EOF &&
+	printf /
+	EOF
+	write_script .git/fsmonitor-fail <<-\EOF &&
+	exit 1
+	EOF
+	git config core.fsmonitor .git/fsmonitor-hook
+'
+
+test_expect_success 'status adds the fsmonitor extension' '
+	test-dump-fsmonitor >actual &&
+	echo "no fsmonitor" >expect &&
+	test_cmp expect actual &&
+	git status &&
+	test-dump-fsmonitor >actual &&
+	grep "^fsmonitor last update" actual &&
+	cat >expect <<-\EOF &&
+	+ dir1/tracked
+	+ dir2/tracked
+	+ tracked
+	EOF
+	grep -v "^fsmonitor" actual >actual.entries &&
+	test_cmp expect actual.entries
+'
+
+test_expect_success 'hook is asked for changes since the last update' '
+	git status &&
+	token=$(test-dump-fsmonitor | sed -n "s/^fsmonitor last update //p") &&
+	git status &&
+	test "$(tail -n 1 .git/fsmonitor-queries)" = "$token"
+'
+
+test_expect_success 'changes that the hook does not report are not seen' '
+	echo 2 >tracked &&
+	git status --porcelain >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'changes that the hook reports are seen' '
+	changed tracked &&
+	git status --porcelain >actual &&
+	echo " M tracked" >expect &&
+	test_cmp expect actual &&
+	test-dump-fsmonitor >actual &&
+	grep "^- tracked" actual &&
+	grep "^+ dir1/tracked" actual
+'
+
+test_expect_success 'update-index --really-refresh does not trust the hook' '
+	echo 2 >dir1/tracked &&
+	test_must_fail git update-index --really-refresh >actual &&
+	grep "^dir1/tracked" actual
+'
+
+test_expect_success 'a hook answering "/" makes git check all paths' '
+	git -c core.fsmonitor=.git/fsmonitor-all status --porcelain >actual &&
+	cat >expect <<-\EOF &&
+	 M dir1/tracked
+	 M tracked
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'a failing hook makes git check all paths' '
+	echo 2 >dir2/tracked &&
+	git -c core.fsmonitor=.git/fsmonitor-fail status --porcelain >actual &&
+	cat >expect <<-\EOF &&
+	 M dir1/tracked
+	 M dir2/tracked
+	 M tracked
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'reset to a clean state' '
+	git reset --hard &&
+	rm -f .git/fsmonitor-log &&
+	git status --porcelain >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'split index keeps the entries apart' '
+	git update-index --split-index &&
+	test_when_finished "git update-index --no-split-index" &&
+	echo 3 >dir1/tracked &&
+	changed dir1/tracked &&
+	git add dir1/tracked &&
+	echo 3 >dir2/tracked &&
+	git status --porcelain >actual &&
+	echo "M  dir1/tracked" >expect &&
+	test_cmp expect actual &&
+	changed dir2/tracked &&
+	git status --porcelain >actual &&
+	cat >expect <<-\EOF &&
+	M  dir1/tracked
+	 M dir2/tracked
+	EOF
+	test_cmp expect actual &&
+	git reset --hard &&
+	rm -f .git/fsmonitor-log
+'
+
+test_lazy_prereq UNTRACKED_CACHE '
+	{ git update-index --test-untracked-cache; ret=$?; } &&
+	test $ret -ne 1
+'
+
+test_expect_success UNTRACKED_CACHE 'untracked cache only revisits reported directories' '
+	test_config core.untrackedCache true &&
+	git status --porcelain &&
+	git status --porcelain >actual &&
+	test_must_be_empty actual &&
+	: >dir1/new &&
+	git status --porcelain >actual &&
+	test_must_be_empty actual &&
+	changed dir1/new &&
+	git status --porcelain >actual &&
+	echo "?? dir1/new" >expect &&
+	test_cmp expect actual &&
+	rm dir1/new &&
+	rm -f .git/fsmonitor-log &&
+	changed dir1/new
+'
+
+test_expect_success 'unsetting core.fsmonitor removes the extension' '
+	git config --unset core.fsmonitor &&
+	git status &&
+	test-dump-fsmonitor >actual &&
+	echo "no fsmonitor" >expect &&
+	test_cmp expect actual
+'
+
+test_done
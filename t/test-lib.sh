@@ -121,6 +121,12 @@ export EDITOR
 GIT_TRACE_BARE=1
 export GIT_TRACE_BARE
 
+if test -n "${GIT_TEST_DEFAULT_REF_FORMAT:+isset}"
+then
+	GIT_DEFAULT_REF_FORMAT="$GIT_TEST_DEFAULT_REF_FORMAT"
+	export GIT_DEFAULT_REF_FORMAT
+fi
+
 if test -n "${TEST_GIT_INDEX_VERSION:+isset}"
 then
 	GIT_INDEX_VERSION="$TEST_GIT_INDEX_VERSION"
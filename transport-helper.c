@@ -11,6 +11,7 @@
 #include "sigchain.h"
 #include "argv-array.h"
 #include "refs.h"
+#include "connect.h"
 
 static int debug;
 
@@ -127,6 +128,15 @@ static struct child_process *get_helper(struct transport *transport)
 	if (have_git_dir())
 		argv_array_pushf(&helper->env_array, "%s=%s",
 				 GIT_DIR_ENVIRONMENT, get_git_dir());
+	/*
+	 * A helper that connects to upload-pack, like remote-ext,
+	 * passes its environment on to it.
+	 */
+	append_ref_prefix_params(&buf, ':', transport->ref_prefixes);
+	if (buf.len)
+		argv_array_pushf(&helper->env_array, "%s=%s",
+				 GIT_PROTOCOL_ENVIRONMENT, buf.buf);
+	strbuf_reset(&buf);
 
 	code = start_command(helper);
 	if (code < 0 && errno == ENOENT)
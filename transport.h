@@ -59,6 +59,13 @@ struct transport {
 	 */
 	const struct string_list *push_options;
 
+	/*
+	 * When fetching, the server may be asked to advertise only the
+	 * refs that start with one of these prefixes. It is free to
+	 * advertise more. Must be set before the connection is made.
+	 */
+	const struct argv_array *ref_prefixes;
+
 	/**
 	 * Returns 0 if successful, positive if the option is not
 	 * recognized or is inapplicable, and negative if the option
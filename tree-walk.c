@@ -554,6 +554,14 @@ int get_tree_entry(const unsigned char *tree_sha1, const char *name, unsigned ch
 	return retval;
 }
 
+int get_tree_entry_from_desc(const struct tree_desc *desc, const char *name,
+			     unsigned char *sha1, unsigned *mode)
+{
+	struct tree_desc t = *desc;
+
+	return find_tree_entry(&t, name, sha1, mode);
+}
+
 /*
  * This is Linux's built-in max for the number of symlinks to follow.
  * That limit, of course, does not affect git, but it's a reasonable
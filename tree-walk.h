@@ -80,6 +80,8 @@ struct traverse_info {
 };
 
 int get_tree_entry(const unsigned char *, const char *, unsigned char *, unsigned *);
+/* Like get_tree_entry(), but looks into a tree that is already read */
+int get_tree_entry_from_desc(const struct tree_desc *, const char *, unsigned char *, unsigned *);
 extern char *make_traverse_path(char *path, const struct traverse_info *info, const struct name_entry *n);
 extern void setup_traverse_info(struct traverse_info *info, const char *base);
 
@@ -5,10 +5,13 @@
 #include "tree-walk.h"
 #include "cache-tree.h"
 #include "unpack-trees.h"
+#include "parallel-checkout.h"
 #include "progress.h"
 #include "refs.h"
 #include "attr.h"
+#include "pathspec.h"
 #include "split-index.h"
+#include "sparse-index.h"
 #include "dir.h"
 #include "submodule.h"
 #include "submodule-config.h"
@@ -188,20 +191,11 @@ static int do_add_entry(struct unpack_trees_options *o, struct cache_entry *ce,
 			       ADD_CACHE_OK_TO_ADD | ADD_CACHE_OK_TO_REPLACE);
 }
 
-static struct cache_entry *dup_entry(const struct cache_entry *ce)
-{
-	unsigned int size = ce_size(ce);
-	struct cache_entry *new = xmalloc(size);
-
-	memcpy(new, ce, size);
-	return new;
-}
-
 static void add_entry(struct unpack_trees_options *o,
 		      const struct cache_entry *ce,
 		      unsigned int set, unsigned int clear)
 {
-	do_add_entry(o, dup_entry(ce), set, clear);
+	do_add_entry(o, dup_cache_entry(ce, &o->result), set, clear);
 }
 
 /*
@@ -353,7 +347,7 @@ static int check_updates(struct unpack_trees_options *o)
 	struct progress *progress = NULL;
 	struct index_state *index = &o->result;
 	struct checkout state = CHECKOUT_INIT;
-	int i;
+	int i, pc_workers, pc_threshold;
 
 	state.force = 1;
 	state.quiet = 1;
@@ -379,6 +373,12 @@ static int check_updates(struct unpack_trees_options *o)
 	if (should_update_submodules() && o->update && !o->dry_run)
 		reload_gitmodules_file(index, &state);
 
+	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+	if (!o->update || o->dry_run)
+		pc_workers = 1;
+	if (pc_workers > 1)
+		init_parallel_checkout();
+
 	for (i = 0; i < index->cache_nr; i++) {
 		struct cache_entry *ce = index->cache[i];
 
@@ -393,6 +393,8 @@ static int check_updates(struct unpack_trees_options *o)
 			}
 		}
 	}
+	if (pc_workers > 1)
+		errs |= run_parallel_checkout(&state, pc_workers, pc_threshold);
 	stop_progress(&progress);
 	if (o->update)
 		git_attr_set_direction(GIT_ATTR_CHECKIN, NULL);
@@ -749,6 +751,11 @@ static int compare_entry(const struct cache_entry *ce, const struct traverse_inf
 	if (cmp)
 		return cmp;
 
+	/* A sparse directory entry matches the tree that it stands for */
+	if (S_ISSPARSEDIR(ce->ce_mode) && S_ISDIR(n->mode) &&
+	    ce_namelen(ce) == traverse_path_len(info, n) + 1)
+		return 0;
+
 	/*
 	 * Even if the beginning compared identically, the ce should
 	 * compare as bigger than a directory leading up to it!
@@ -770,10 +777,22 @@ static int ce_in_traverse_path(const struct cache_entry *ce,
 	return (info->pathlen < ce_namelen(ce));
 }
 
-static struct cache_entry *create_ce_entry(const struct traverse_info *info, const struct name_entry *n, int stage)
+/*
+ * Entries that are only looked at by the merge functions are transient;
+ * the others are added to the result as they are, and are allocated
+ * from its pool.
+ */
+static struct cache_entry *create_ce_entry(const struct traverse_info *info,
+	const struct name_entry *n,
+	int stage,
+	struct index_state *istate,
+	int is_transient)
 {
 	int len = traverse_path_len(info, n);
-	struct cache_entry *ce = xcalloc(1, cache_entry_size(len));
+	struct cache_entry *ce =
+		is_transient ?
+		make_empty_transient_cache_entry(len) :
+		make_empty_cache_entry(istate, len);
 
 	ce->ce_mode = create_ce_mode(n->mode);
 	ce->ce_flags = create_ce_flags(stage);
@@ -819,7 +838,8 @@ static int unpack_nondirectories(int n, unsigned long mask,
 			stage = 3;
 		else
 			stage = 2;
-		src[i + o->merge] = create_ce_entry(info, names + i, stage);
+		src[i + o->merge] = create_ce_entry(info, names + i, stage,
+						    &o->result, o->merge);
 	}
 
 	if (o->merge) {
@@ -828,7 +848,7 @@ static int unpack_nondirectories(int n, unsigned long mask,
 		for (i = 0; i < n; i++) {
 			struct cache_entry *ce = src[i + o->merge];
 			if (ce != o->df_conflict_entry)
-				free(ce);
+				discard_cache_entry(ce);
 		}
 		return rc;
 	}
@@ -932,8 +952,18 @@ static struct cache_entry *find_cache_entry(struct traverse_info *info,
 
 	if (0 <= pos)
 		return o->src_index->cache[pos];
-	else
-		return NULL;
+	/*
+	 * The only entry "in" a directory of a sparse index may be the
+	 * sparse directory entry for it, which is matched with the tree.
+	 */
+	if (pos < -1) {
+		struct cache_entry *ce = o->src_index->cache[-2 - pos];
+
+		if (S_ISSPARSEDIR(ce->ce_mode) &&
+		    ce_namelen(ce) == traverse_path_len(info, p) + 1)
+			return ce;
+	}
+	return NULL;
 }
 
 static void debug_path(struct traverse_info *info)
@@ -1019,6 +1049,16 @@ static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, str
 		}
 	}
 
+	/*
+	 * The trees agree with a sparse directory entry (see
+	 * prepare_sparse_index()); keep it without looking inside.
+	 */
+	if (src[0] && S_ISSPARSEDIR(src[0]->ce_mode)) {
+		add_entry(o, src[0], 0, 0);
+		mark_ce_used(src[0], o);
+		return mask;
+	}
+
 	if (unpack_nondirectories(n, mask, dirmask, src, names, info) < 0)
 		return -1;
 
@@ -1139,6 +1179,12 @@ static int clear_ce_flags_1(struct cache_entry **cache, int nr,
 			continue;
 		}
 
+		/* sparse directories stay out of the work tree */
+		if (S_ISSPARSEDIR(ce->ce_mode)) {
+			cache++;
+			continue;
+		}
+
 		if (prefix->len && strncmp(ce->name, prefix->buf, prefix->len))
 			break;
 
@@ -1236,6 +1282,49 @@ static void mark_new_skip_worktree(struct exclude_list *el,
 static int verify_absent(const struct cache_entry *,
 			 enum unpack_trees_error_types,
 			 struct unpack_trees_options *);
+
+/*
+ * A sparse directory entry of the source index can only be carried
+ * over to the result if all trees have the same tree at its path, and
+ * if it stays outside of the sparse checkout. Otherwise, expand the
+ * source index before looking at it.
+ */
+static void prepare_sparse_index(struct unpack_trees_options *o,
+				 int n, struct tree_desc *t)
+{
+	struct index_state *istate = o->src_index;
+	int i, j;
+
+	if (!istate->sparse_index || !o->merge)
+		return;
+	if (!n || o->prefix || (o->pathspec && o->pathspec->nr))
+		goto expand;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (!S_ISSPARSEDIR(ce->ce_mode))
+			continue;
+		if (!o->skip_sparse_checkout &&
+		    !sparse_dir_outside_patterns(o->el, ce->name,
+						 ce_namelen(ce) - 1))
+			goto expand;
+		for (j = 0; j < n; j++) {
+			unsigned char sha1[20];
+			unsigned mode;
+
+			if (get_tree_entry_from_desc(t + j, ce->name, sha1, &mode) ||
+			    !S_ISDIR(mode) || hashcmp(sha1, ce->oid.hash))
+				goto expand;
+		}
+	}
+	o->result.sparse_index = 1;
+	return;
+
+expand:
+	ensure_full_index(istate);
+}
+
 /*
  * N-way merge "len" trees.  Returns 0 on success, -1 on failure to manipulate the
  * resulting index, -2 on failure to reflect the changes to the work tree.
@@ -1273,6 +1362,7 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		o->result.split_index->refcount++;
 	hashcpy(o->result.sha1, o->src_index->sha1);
 	o->merge_size = len;
+	prepare_sparse_index(o, len, t);
 	mark_all_ce_unused(o->src_index);
 
 	/*
@@ -1282,7 +1372,7 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		mark_new_skip_worktree(o->el, o->src_index, 0, CE_NEW_SKIP_WORKTREE);
 
 	if (!dfc)
-		dfc = xcalloc(1, cache_entry_size(0));
+		dfc = make_empty_transient_cache_entry(0);
 	o->df_conflict_entry = dfc;
 
 	if (len) {
@@ -1749,7 +1839,7 @@ static int merged_entry(const struct cache_entry *ce,
 			struct unpack_trees_options *o)
 {
 	int update = CE_UPDATE;
-	struct cache_entry *merge = dup_entry(ce);
+	struct cache_entry *merge = dup_cache_entry(ce, &o->result);
 
 	if (!old) {
 		/*
@@ -1769,7 +1859,7 @@ static int merged_entry(const struct cache_entry *ce,
 
 		if (verify_absent(merge,
 				  ERROR_WOULD_LOSE_UNTRACKED_OVERWRITTEN, o)) {
-			free(merge);
+			discard_cache_entry(merge);
 			return -1;
 		}
 		invalidate_ce_path(merge, o);
@@ -1795,7 +1885,7 @@ static int merged_entry(const struct cache_entry *ce,
 			update = 0;
 		} else {
 			if (verify_uptodate(old, o)) {
-				free(merge);
+				discard_cache_entry(merge);
 				return -1;
 			}
 			/* Migrate old flags over */
@@ -62,6 +62,8 @@ static int use_sideband;
 static int advertise_refs;
 static int stateless_rpc;
 static const char *pack_objects_hook;
+/* Prefixes of the refs that the client wants to be advertised, if any */
+static struct string_list ref_prefixes = STRING_LIST_INIT_DUP;
 
 static void reset_timeout(void)
 {
@@ -729,6 +731,8 @@ static void deepen_by_rev_list(int ac, const char **av,
 	packet_flush(1);
 }
 
+static void mark_our_refs(void);
+
 static void receive_needs(void)
 {
 	struct object_array shallows = OBJECT_ARRAY_INIT;
@@ -844,9 +848,14 @@ static void receive_needs(void)
 	 * in the stateless RPC mode, however, their choice may
 	 * have been based on the set of older refs advertised
 	 * by another process that handled the initial request.
+	 * When the client limited our advertisement to some ref
+	 * prefixes, the tips of the other refs count, too.
 	 */
-	if (has_non_tip)
+	if (has_non_tip) {
+		if (ref_prefixes.nr)
+			mark_our_refs();
 		check_non_tip();
+	}
 
 	if (!use_sideband && daemon_mode)
 		no_progress = 1;
@@ -923,24 +932,21 @@ static void format_symref_info(struct strbuf *buf, struct string_list *symref)
 		strbuf_addf(buf, " symref=%s:%s", item->string, (char *)item->util);
 }
 
-static int send_ref(const char *refname, const struct object_id *oid,
-		    int flag, void *cb_data)
+static int sent_capabilities;
+
+static void write_ref_line(const struct object_id *oid, const char *refname,
+			   struct string_list *symref)
 {
 	static const char *capabilities = "multi_ack thin-pack side-band"
 		" side-band-64k ofs-delta shallow deepen-since deepen-not"
 		" deepen-relative no-progress include-tag multi_ack_detailed";
-	const char *refname_nons = strip_namespace(refname);
-	struct object_id peeled;
-
-	if (mark_our_ref(refname_nons, refname, oid))
-		return 0;
 
-	if (capabilities) {
+	if (!sent_capabilities) {
 		struct strbuf symref_info = STRBUF_INIT;
 
-		format_symref_info(&symref_info, cb_data);
+		format_symref_info(&symref_info, symref);
 		packet_write_fmt(1, "%s %s%c%s%s%s%s%s agent=%s\n",
-			     oid_to_hex(oid), refname_nons,
+			     oid_to_hex(oid), refname,
 			     0, capabilities,
 			     (allow_unadvertised_object_request & ALLOW_TIP_SHA1) ?
 				     " allow-tip-sha1-in-want" : "",
@@ -951,9 +957,21 @@ static int send_ref(const char *refname, const struct object_id *oid,
 			     git_user_agent_sanitized());
 		strbuf_release(&symref_info);
 	} else {
-		packet_write_fmt(1, "%s %s\n", oid_to_hex(oid), refname_nons);
+		packet_write_fmt(1, "%s %s\n", oid_to_hex(oid), refname);
 	}
-	capabilities = NULL;
+	sent_capabilities = 1;
+}
+
+static int send_ref(const char *refname, const struct object_id *oid,
+		    int flag, void *cb_data)
+{
+	const char *refname_nons = strip_namespace(refname);
+	struct object_id peeled;
+
+	if (mark_our_ref(refname_nons, refname, oid))
+		return 0;
+
+	write_ref_line(oid, refname_nons, cb_data);
 	if (!peel_ref(refname, peeled.hash))
 		packet_write_fmt(1, "%s %s^{}\n", oid_to_hex(&peeled), refname_nons);
 	return 0;
@@ -976,6 +994,57 @@ static int find_symref(const char *refname, const struct object_id *oid,
 	return 0;
 }
 
+static void mark_our_refs(void)
+{
+	head_ref_namespaced(check_ref, NULL);
+	for_each_namespaced_ref(check_ref, NULL);
+}
+
+/*
+ * Send the refs that start with one of ref_prefixes. Each prefix is
+ * turned into the part of the ref namespace to iterate over; the parts
+ * contained in another one are skipped, so that each ref is sent once
+ * and in sorted order.
+ */
+static void send_refs_with_prefixes(struct string_list *symref)
+{
+	struct string_list parts = STRING_LIST_INIT_NODUP;
+	struct string_list_item *item;
+	struct strbuf buf = STRBUF_INIT;
+	const char *last = NULL;
+	int send_head = 0;
+
+	for_each_string_list_item(item, &ref_prefixes) {
+		const char *prefix = item->string;
+
+		if (starts_with("HEAD", prefix))
+			send_head = 1;
+		if (starts_with(prefix, "refs/"))
+			string_list_append(&parts, prefix);
+		else if (starts_with("refs/", prefix))
+			string_list_append(&parts, "refs/");
+	}
+	string_list_sort(&parts);
+
+	if (send_head)
+		head_ref_namespaced(send_ref, symref);
+	for_each_string_list_item(item, &parts) {
+		if (last && starts_with(item->string, last))
+			continue;
+		last = item->string;
+		strbuf_reset(&buf);
+		strbuf_addf(&buf, "%s%s", get_git_namespace(), item->string);
+		for_each_fullref_in(buf.buf, send_ref, symref, 0);
+	}
+
+	/* The client needs our capabilities even if no ref matched */
+	if (!sent_capabilities)
+		write_ref_line(&null_oid, "capabilities^{}", symref);
+
+	strbuf_release(&buf);
+	string_list_clear(&parts, 0);
+}
+
 static void upload_pack(void)
 {
 	struct string_list symref = STRING_LIST_INIT_DUP;
@@ -984,13 +1053,16 @@ static void upload_pack(void)
 
 	if (advertise_refs || !stateless_rpc) {
 		reset_timeout();
-		head_ref_namespaced(send_ref, &symref);
-		for_each_namespaced_ref(send_ref, &symref);
+		if (ref_prefixes.nr) {
+			send_refs_with_prefixes(&symref);
+		} else {
+			head_ref_namespaced(send_ref, &symref);
+			for_each_namespaced_ref(send_ref, &symref);
+		}
 		advertise_shallow_grafts(1);
 		packet_flush(1);
 	} else {
-		head_ref_namespaced(check_ref, NULL);
-		for_each_namespaced_ref(check_ref, NULL);
+		mark_our_refs();
 	}
 	string_list_clear(&symref, 1);
 	if (advertise_refs)
@@ -1003,6 +1075,28 @@ static void upload_pack(void)
 	}
 }
 
+/*
+ * Read the extra parameters that the client passed along with its
+ * request, in $GIT_PROTOCOL. Unknown ones are ignored.
+ */
+static void parse_protocol_params(void)
+{
+	const char *params = getenv(GIT_PROTOCOL_ENVIRONMENT);
+	struct string_list list = STRING_LIST_INIT_DUP;
+	struct string_list_item *item;
+
+	if (!params)
+		return;
+	string_list_split(&list, params, ':', -1);
+	for_each_string_list_item(item, &list) {
+		const char *prefix;
+
+		if (skip_prefix(item->string, "ref-prefix=", &prefix))
+			string_list_append(&ref_prefixes, prefix);
+	}
+	string_list_clear(&list, 0);
+}
+
 static int upload_pack_config(const char *var, const char *value, void *unused)
 {
 	if (!strcmp("uploadpack.allowtipsha1inwant", var)) {
@@ -1066,6 +1160,7 @@ int cmd_main(int argc, const char **argv)
 		die("'%s' does not appear to be a git repository", dir);
 
 	git_config(upload_pack_config, NULL);
+	parse_protocol_params();
 	upload_pack();
 	return 0;
 }
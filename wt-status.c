@@ -17,6 +17,9 @@
 #include "utf8.h"
 #include "worktree.h"
 #include "lockfile.h"
+#include "sparse-index.h"
+#include "cache-tree.h"
+#include "thread-utils.h"
 
 static const char cut_line[] =
 "------------------------ >8 ------------------------\n";
@@ -556,6 +559,7 @@ static void wt_status_collect_updated_cb(struct diff_queue_struct *q,
 static void wt_status_collect_changes_worktree(struct wt_status *s)
 {
 	struct rev_info rev;
+	uint64_t start = getnanotime();
 
 	init_revisions(&rev, NULL);
 	setup_revisions(0, NULL, &rev, NULL);
@@ -572,12 +576,39 @@ static void wt_status_collect_changes_worktree(struct wt_status *s)
 	rev.diffopt.format_callback_data = s;
 	copy_pathspec(&rev.prune_data, &s->pathspec);
 	run_diff_files(&rev, 0);
+	trace_performance_since(start, "status: changes not staged");
+}
+
+/*
+ * Does the index record the same tree as the commit that the changes
+ * to be committed are shown against? Then there are none, and diffing
+ * the two can be skipped. Unmerged and intent-to-add entries leave
+ * the root of the cache-tree invalid, so they are still diffed.
+ */
+static int index_matches_reference(struct wt_status *s)
+{
+	struct object_id oid;
+	struct tree *tree;
+
+	if (!the_index.cache_tree || the_index.cache_tree->entry_count < 0)
+		return 0;
+	if (get_sha1_treeish(s->reference, oid.hash))
+		return 0;
+	tree = parse_tree_indirect(&oid);
+	return tree && !oidcmp(&tree->object.oid, &the_index.cache_tree->oid);
 }
 
 static void wt_status_collect_changes_index(struct wt_status *s)
 {
 	struct rev_info rev;
 	struct setup_revision_opt opt;
+	uint64_t start = getnanotime();
+
+	if (index_matches_reference(s)) {
+		trace_performance_since(start, "status: index matches %s",
+					s->reference);
+		return;
+	}
 
 	init_revisions(&rev, NULL);
 	memset(&opt, 0, sizeof(opt));
@@ -608,12 +639,15 @@ static void wt_status_collect_changes_index(struct wt_status *s)
 	rev.diffopt.break_opt = 0;
 	copy_pathspec(&rev.prune_data, &s->pathspec);
 	run_diff_index(&rev, 1);
+	trace_performance_since(start, "status: changes to be committed");
 }
 
 static void wt_status_collect_changes_initial(struct wt_status *s)
 {
 	int i;
 
+	/* without a commit to compare with, every path is listed */
+	ensure_full_index(&the_index);
 	for (i = 0; i < active_nr; i++) {
 		struct string_list_item *it;
 		struct wt_status_change_data *d;
@@ -689,17 +723,72 @@ static void wt_status_collect_untracked(struct wt_status *s)
 
 	if (advice_status_u_option)
 		s->untracked_in_ms = (getnanotime() - t_begin) / 1000000;
+	trace_performance_since(t_begin, "status: untracked files");
 }
 
+#ifndef NO_PTHREADS
+static pthread_t untracked_thread;
+
+static void *collect_untracked_thread(void *data)
+{
+	wt_status_collect_untracked(data);
+	return NULL;
+}
+
+/*
+ * Look for untracked files in a thread of its own, while the main
+ * thread diffs the index, if the two cannot get in each other's way.
+ * Only the walk reads the index's .gitignore files of skip-worktree
+ * entries from the object database, and only comparing submodules
+ * resolves refs of other repositories as the walk does; when the
+ * index has neither kind of entry, what the two share is read-only.
+ */
+static int start_collecting_untracked(struct wt_status *s)
+{
+	int i;
+
+	if (!s->show_untracked_files || the_index.sparse_index ||
+	    git_config_get_untracked_threads() == 1)
+		return 0;
+	for (i = 0; i < active_nr; i++) {
+		const struct cache_entry *ce = active_cache[i];
+		if (S_ISGITLINK(ce->ce_mode) || ce_skip_worktree(ce))
+			return 0;
+	}
+
+	lazy_init_name_hash(&the_index);
+	return !pthread_create(&untracked_thread, NULL,
+			       collect_untracked_thread, s);
+}
+
+static void finish_collecting_untracked(void)
+{
+	if (pthread_join(untracked_thread, NULL))
+		die("unable to join untracked files thread");
+}
+#else
+#define start_collecting_untracked(s) 0
+#define finish_collecting_untracked()
+#endif
+
 void wt_status_collect(struct wt_status *s)
 {
+	uint64_t start = getnanotime();
+	int concurrent = start_collecting_untracked(s);
+
 	wt_status_collect_changes_worktree(s);
 
 	if (s->is_initial)
 		wt_status_collect_changes_initial(s);
 	else
 		wt_status_collect_changes_index(s);
-	wt_status_collect_untracked(s);
+
+	if (concurrent)
+		finish_collecting_untracked();
+	else
+		wt_status_collect_untracked(s);
+	trace_performance_since(start, "status: collect%s",
+				concurrent ? " (untracked files in a thread)" : "");
 }
 
 static void wt_longstatus_print_unmerged(struct wt_status *s)